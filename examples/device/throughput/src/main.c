@@ -0,0 +1,263 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bsp/board.h"
+#include "tusb.h"
+#include "usb_descriptors.h"
+
+//--------------------------------------------------------------------+
+// MACRO CONSTANT TYPEDEF PROTYPES
+//--------------------------------------------------------------------+
+
+/* Blink pattern
+ * - 250 ms  : device not mounted
+ * - 1000 ms : device mounted
+ * - 2500 ms : device is suspended
+ */
+enum  {
+  BLINK_NOT_MOUNTED = 250,
+  BLINK_MOUNTED     = 1000,
+  BLINK_SUSPENDED   = 2500,
+};
+
+static uint32_t blink_interval_ms = BLINK_NOT_MOUNTED;
+
+static throughput_stats_t stats;
+static throughput_stats_t stats_last; // at start of stats_task() window, cleared along with stats
+
+// Next byte of counting pattern sent by source and expected by sink
+static uint8_t source_pattern;
+static uint8_t sink_pattern;
+
+// One transfer worth of data moved by application at a time
+static uint8_t buf[CFG_TUD_VENDOR_EPSIZE];
+
+//------------- prototypes -------------//
+void led_blinking_task(void);
+void source_task(void);
+void sink_task(void);
+void loopback_task(void);
+void stats_task(void);
+
+/*------------- MAIN -------------*/
+int main(void)
+{
+  board_init();
+
+  tusb_init();
+
+  while (1)
+  {
+    tud_task(); // tinyusb device task
+    source_task();
+    sink_task();
+    loopback_task();
+    stats_task();
+    led_blinking_task();
+  }
+
+  return 0;
+}
+
+static void stats_reset(void)
+{
+  memset(&stats, 0, sizeof(stats));
+  memset(&stats_last, 0, sizeof(stats_last));
+  source_pattern = sink_pattern = 0;
+}
+
+//--------------------------------------------------------------------+
+// Device callbacks
+//--------------------------------------------------------------------+
+
+// Invoked when device is mounted
+void tud_mount_cb(void)
+{
+  stats_reset();
+  blink_interval_ms = BLINK_MOUNTED;
+}
+
+// Invoked when device is unmounted
+void tud_umount_cb(void)
+{
+  blink_interval_ms = BLINK_NOT_MOUNTED;
+}
+
+// Invoked when usb bus is suspended
+// remote_wakeup_en : if host allow us  to perform remote wakeup
+// Within 7ms, device must draw an average of current less than 2.5 mA from bus
+void tud_suspend_cb(bool remote_wakeup_en)
+{
+  (void) remote_wakeup_en;
+  blink_interval_ms = BLINK_SUSPENDED;
+}
+
+// Invoked when usb bus is resumed
+void tud_resume_cb(void)
+{
+  blink_interval_ms = BLINK_MOUNTED;
+}
+
+//--------------------------------------------------------------------+
+// Vendor control requests
+//--------------------------------------------------------------------+
+
+// Invoked when received VENDOR control request
+bool tud_vendor_control_request_cb(uint8_t rhport, tusb_control_request_t const * request)
+{
+  switch (request->bRequest)
+  {
+    case VENDOR_REQUEST_RESET:
+      stats_reset();
+      return tud_control_status(rhport, request);
+
+    case VENDOR_REQUEST_STATS:
+      return tud_control_xfer(rhport, request, &stats, sizeof(stats));
+
+    default:
+      // stall unknown request
+      return false;
+  }
+}
+
+// Invoked when DATA Stage of VENDOR's request is complete
+bool tud_vendor_control_complete_cb(uint8_t rhport, tusb_control_request_t const * request)
+{
+  (void) rhport;
+  (void) request;
+
+  // nothing to do
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Source, sink & loopback
+//--------------------------------------------------------------------+
+
+// Keep IN endpoint busy with counting pattern
+void source_task(void)
+{
+  if ( !tud_vendor_n_mounted(ITF_NUM_SOURCE) ) return;
+
+  uint32_t count = tud_vendor_n_write_available(ITF_NUM_SOURCE);
+  if ( count > sizeof(buf) ) count = sizeof(buf);
+  if ( count == 0 ) return;
+
+  for(uint32_t i=0; i<count; i++) buf[i] = source_pattern++;
+
+  // counted in tud_vendor_tx_cb() once sent, not when queued in fifo
+  tud_vendor_n_write(ITF_NUM_SOURCE, buf, count);
+}
+
+// Invoked when IN transfer is complete
+void tud_vendor_tx_cb(uint8_t itf, uint32_t sent_bytes)
+{
+  if ( itf == ITF_NUM_SOURCE ) stats.source_bytes += sent_bytes;
+}
+
+// Check counting pattern, resynchronize on the first mismatched byte
+void sink_task(void)
+{
+  uint32_t const count = tud_vendor_n_read(ITF_NUM_SINK, buf, sizeof(buf));
+
+  for(uint32_t i=0; i<count; i++)
+  {
+    if ( buf[i] != sink_pattern ) stats.sink_errors++;
+    sink_pattern = (uint8_t) (buf[i] + 1);
+  }
+
+  stats.sink_bytes += count;
+}
+
+// Echo only what fits in IN fifo, rest waits in OUT fifo
+void loopback_task(void)
+{
+  uint32_t count = tud_vendor_n_write_available(ITF_NUM_LOOPBACK);
+  if ( count > sizeof(buf) ) count = sizeof(buf);
+
+  count = tud_vendor_n_read(ITF_NUM_LOOPBACK, buf, count);
+  if ( count == 0 ) return;
+
+  tud_vendor_n_write(ITF_NUM_LOOPBACK, buf, count);
+  stats.loopback_bytes += count;
+}
+
+static unsigned long kb_per_sec(uint32_t bytes, uint32_t ms)
+{
+  return (unsigned long) (((uint64_t) bytes * 1000) / ms / 1024);
+}
+
+// Print rates about once per second while data is moving, over the actual elapsed time
+void stats_task(void)
+{
+  static bool started = false;
+  static uint32_t start_ms;
+
+  uint32_t const now = board_millis();
+
+  if ( !started )
+  {
+    started    = true;
+    start_ms   = now;
+    stats_last = stats;
+    return;
+  }
+
+  uint32_t const elapsed = now - start_ms;
+  if ( elapsed < 1000 ) return;
+  start_ms = now;
+
+  uint32_t const source   = stats.source_bytes   - stats_last.source_bytes;
+  uint32_t const sink     = stats.sink_bytes     - stats_last.sink_bytes;
+  uint32_t const loopback = stats.loopback_bytes - stats_last.loopback_bytes;
+  stats_last = stats;
+
+  if ( source || sink || loopback )
+  {
+    printf("source %lu KB/s, sink %lu KB/s (%lu errors), loopback %lu KB/s\r\n",
+           kb_per_sec(source, elapsed), kb_per_sec(sink, elapsed), (unsigned long) stats.sink_errors,
+           kb_per_sec(loopback, elapsed));
+  }
+}
+
+//--------------------------------------------------------------------+
+// BLINKING TASK
+//--------------------------------------------------------------------+
+void led_blinking_task(void)
+{
+  static uint32_t start_ms = 0;
+  static bool led_state = false;
+
+  // Blink every interval ms
+  if ( board_millis() - start_ms < blink_interval_ms) return; // not enough time
+  start_ms += blink_interval_ms;
+
+  board_led_write(led_state);
+  led_state = 1 - led_state; // toggle
+}
@@ -0,0 +1,52 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef USB_DESCRIPTORS_H_
+#define USB_DESCRIPTORS_H_
+
+// Vendor interfaces, in this order for host tool tools/throughput.py
+enum
+{
+  ITF_NUM_SOURCE = 0, // device sends counting pattern on IN endpoint
+  ITF_NUM_SINK,       // device checks counting pattern received on OUT endpoint
+  ITF_NUM_LOOPBACK,   // device echoes OUT endpoint data to IN endpoint
+  ITF_NUM_TOTAL
+};
+
+enum
+{
+  VENDOR_REQUEST_RESET = 1, // clear counters and restart sink pattern
+  VENDOR_REQUEST_STATS = 2  // get throughput_stats_t
+};
+
+// Counters since mount or last reset request, little endian
+typedef struct
+{
+  uint32_t source_bytes;   // sent on the bus, excluding data still in tx fifo
+  uint32_t sink_bytes;
+  uint32_t sink_errors;    // bytes not matching counting pattern
+  uint32_t loopback_bytes;
+} throughput_stats_t;
+
+#endif /* USB_DESCRIPTORS_H_ */
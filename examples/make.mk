@@ -5,6 +5,8 @@
 # Compiler
 ifeq ($(BOARD), fomu)
 CROSS_COMPILE = riscv-none-embed-
+else ifeq ($(BOARD), sim)
+CROSS_COMPILE =
 else
 CROSS_COMPILE = arm-none-eabi-
 endif
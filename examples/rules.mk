@@ -3,19 +3,27 @@
 #
 
 # libc
+ifeq ($(BOARD), sim)
+LIBS += -lm -lpthread
+else
 LIBS += -lgcc -lm -lnosys
 
 ifneq ($(BOARD), spresense)
 LIBS += -lc
 endif
+endif
 
 # TinyUSB Stack source
 SRC_C += \
 	src/tusb.c \
 	src/common/tusb_fifo.c \
+	src/common/tusb_msgq.c \
 	src/device/usbd.c \
 	src/device/usbd_control.c \
 	src/class/msc/msc_device.c \
+	src/class/msc/msc_cache.c \
+	src/class/msc/uas_device.c \
+	src/class/audio/audio_device.c \
 	src/class/cdc/cdc_device.c \
 	src/class/dfu/dfu_rt_device.c \
 	src/class/hid/hid_device.c \
@@ -29,7 +37,11 @@ INC += $(TOP)/src
 
 #
 CFLAGS += $(addprefix -I,$(INC))
+ifeq ($(BOARD), sim)
+LDFLAGS += $(CFLAGS) -Wl,-Map=$@.map -Wl,-cref -Wl,-gc-sections
+else
 LDFLAGS += $(CFLAGS) -fshort-enums -Wl,-T,$(TOP)/$(LD_FILE) -Wl,-Map=$@.map -Wl,-cref -Wl,-gc-sections -specs=nosys.specs -specs=nano.specs
+endif
 ASFLAGS += $(CFLAGS)
 
 # Assembly files can be name with upper case .S, convert it to .s 
@@ -49,7 +61,11 @@ endif
 
 # Set all as default goal
 .DEFAULT_GOAL := all
+ifeq ($(BOARD), sim)
+all: $(BUILD)/$(BOARD)-firmware.elf size
+else
 all: $(BUILD)/$(BOARD)-firmware.bin $(BUILD)/$(BOARD)-firmware.hex size
+endif
 
 uf2: $(BUILD)/$(BOARD)-firmware.uf2
 
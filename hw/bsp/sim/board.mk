@@ -0,0 +1,21 @@
+# Linux process with simulated device controller and virtual host, see src/portable/sim/dcd_sim.h
+# e.g: SIM_SCRIPT=script.txt _build/build-sim/sim-firmware.elf
+#  or: SIM_USBIP_PORT=3240 _build/build-sim/sim-firmware.elf, then usbip attach -r 127.0.0.1 -b 1-1
+
+CFLAGS += \
+  -DCFG_TUSB_MCU=OPT_MCU_SIM \
+  -D_GNU_SOURCE
+
+# host libc & pthread in place of newlib
+CFLAGS += -Wno-error=missing-format-attribute
+
+SRC_C += \
+  src/portable/sim/sim_host.c \
+  src/portable/sim/usbip_server.c
+
+# loopback host controller, only built when host stack is enabled
+SRC_C += src/portable/sim/hcd_sim.c
+
+# For TinyUSB port source
+VENDOR = .
+CHIP_FAMILY = sim
@@ -0,0 +1,104 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bsp/board.h"
+#include "portable/sim/dcd_sim.h"
+
+//--------------------------------------------------------------------+
+// Board porting API
+// Virtual host runs script from SIM_SCRIPT environment variable, or only enumerates.
+// With SIM_USBIP_PORT set, device is exported to a USB/IP client on that port instead.
+//--------------------------------------------------------------------+
+
+static bool _led_state;
+
+#if CFG_TUSB_OS == OPT_OS_NONE
+static uint64_t _start_ms; // board_millis() counts from board_init()
+
+static uint64_t monotonic_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec*1000 + (uint64_t) ts.tv_nsec/1000000;
+}
+#endif
+
+void board_init(void)
+{
+  setvbuf(stdout, NULL, _IONBF, 0);
+
+#if CFG_TUSB_OS == OPT_OS_NONE
+  _start_ms = monotonic_ms();
+#endif
+
+  // examples without device stack have nothing to connect
+#if TUSB_OPT_DEVICE_ENABLED
+  char const* usbip_port = getenv("SIM_USBIP_PORT");
+
+  if ( usbip_port )
+  {
+    if ( !sim_usbip_start((uint16_t) atoi(usbip_port)) ) exit(1);
+  }
+  else
+  {
+    sim_host_start(getenv("SIM_SCRIPT"));
+  }
+#endif
+}
+
+void board_led_write(bool state)
+{
+  _led_state = state;
+}
+
+uint32_t board_button_read(void)
+{
+  return 0;
+}
+
+int board_uart_read(uint8_t* buf, int len)
+{
+  (void) buf; (void) len;
+  return 0;
+}
+
+int board_uart_write(void const * buf, int len)
+{
+  return (int) write(STDOUT_FILENO, buf, (size_t) len);
+}
+
+#if CFG_TUSB_OS == OPT_OS_NONE
+uint32_t board_millis(void)
+{
+  return (uint32_t) (monotonic_ms() - _start_ms);
+}
+#endif
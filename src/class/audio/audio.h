@@ -26,7 +26,7 @@
 
 /** \ingroup group_class
  *  \defgroup ClassDriver_Audio Audio
- *            Currently only MIDI subclass is supported
+ *            Currently MIDI and Audio 2.0 streaming subclasses are supported
  *  @{ */
 
 #ifndef _TUSB_AUDIO_H__
@@ -41,6 +41,7 @@
 /// Audio Interface Subclass Codes
 typedef enum
 {
+  AUDIO_SUBCLASS_UNDEFINED = 0x00, ///< Undefined, used by Audio 2.0 Interface Association
   AUDIO_SUBCLASS_CONTROL = 0x01  , ///< Audio Control
   AUDIO_SUBCLASS_STREAMING       , ///< Audio Streaming
   AUDIO_SUBCLASS_MIDI_STREAMING  , ///< MIDI Streaming
@@ -89,6 +90,139 @@ typedef enum
   AUDIO_CS_INTERFACE_SAMPLE_RATE_CONVERTER = 0x0D,
 } audio_cs_interface_subtype_t;
 
+/// Audio Class-Specific AS Interface Descriptor Subtypes
+typedef enum
+{
+  AUDIO_CS_AS_INTERFACE_GENERAL     = 0x01,
+  AUDIO_CS_AS_INTERFACE_FORMAT_TYPE = 0x02,
+} audio_cs_as_interface_subtype_t;
+
+/// Audio Class-Specific Endpoint Descriptor Subtypes
+typedef enum
+{
+  AUDIO_CS_ENDPOINT_GENERAL = 0x01,
+} audio_cs_endpoint_subtype_t;
+
+/// Audio 2.0 Class-Specific Request Codes
+typedef enum
+{
+  AUDIO_CS_REQ_CUR   = 0x01,
+  AUDIO_CS_REQ_RANGE = 0x02,
+  AUDIO_CS_REQ_MEM   = 0x03,
+} audio_cs_req_t;
+
+/// Audio 2.0 Clock Source Control Selectors
+typedef enum
+{
+  AUDIO_CS_CTRL_SAM_FREQ  = 0x01,
+  AUDIO_CS_CTRL_CLK_VALID = 0x02,
+} audio_clock_src_control_selector_t;
+
+/// Audio 2.0 Feature Unit Control Selectors
+typedef enum
+{
+  AUDIO_FU_CTRL_MUTE   = 0x01,
+  AUDIO_FU_CTRL_VOLUME = 0x02,
+} audio_feature_unit_control_selector_t;
+
+/// Audio Terminal Types
+typedef enum
+{
+  AUDIO_TERM_TYPE_USB_STREAMING   = 0x0101,
+  AUDIO_TERM_TYPE_IN_MICROPHONE   = 0x0201,
+  AUDIO_TERM_TYPE_OUT_SPEAKER     = 0x0301,
+  AUDIO_TERM_TYPE_OUT_HEADPHONES  = 0x0302,
+} audio_terminal_type_t;
+
+/// Audio Format Type Codes
+typedef enum
+{
+  AUDIO_FORMAT_TYPE_I = 0x01,
+} audio_format_type_t;
+
+/// Audio 2.0 Type I Formats (bmFormats)
+typedef enum
+{
+  AUDIO_DATA_FORMAT_TYPE_I_PCM = TU_BIT(0),
+} audio_data_format_type_I_t;
+
+/// Audio 2.0 Clock Source Attributes & Controls
+typedef enum
+{
+  AUDIO_CLOCK_SOURCE_ATT_INT_PRO_CLK = 0x03, ///< Internal programmable clock
+  AUDIO_CLOCK_SOURCE_CTRL_FREQ_RW    = 0x03, ///< Frequency control is host programmable
+  AUDIO_CLOCK_SOURCE_CTRL_VALID_RO   = 0x04, ///< Validity control is read only
+} audio_clock_source_t;
+
+/// Audio 2.0 Feature Unit Controls, 2 bits per control
+typedef enum
+{
+  AUDIO_FU_CTRL_MUTE_RW   = 0x03,
+  AUDIO_FU_CTRL_VOLUME_RW = 0x0C,
+} audio_feature_unit_ctrl_t;
+
+/// Audio 2.0 Class-Specific AS Isochronous Data Endpoint Descriptor
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t bLength;
+  uint8_t bDescriptorType;
+  uint8_t bDescriptorSubType;
+  uint8_t bmAttributes;
+  uint8_t bmControls;
+  uint8_t bLockDelayUnits;
+  uint16_t wLockDelay;
+} audio_desc_cs_iso_data_ep_t;
+
+/// Audio 2.0 Class-Specific AS Interface Descriptor
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint8_t  bDescriptorSubType;
+  uint8_t  bTerminalLink;
+  uint8_t  bmControls;
+  uint8_t  bFormatType;
+  uint32_t bmFormats;
+  uint8_t  bNrChannels;
+  uint32_t bmChannelConfig;
+  uint8_t  iChannelNames;
+} audio_desc_cs_as_interface_t;
+
+/// Audio 2.0 Type I Format Type Descriptor
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t bLength;
+  uint8_t bDescriptorType;
+  uint8_t bDescriptorSubType;
+  uint8_t bFormatType;
+  uint8_t bSubslotSize;
+  uint8_t bBitResolution;
+} audio_desc_type_I_format_t;
+
+/// Audio 2.0 Clock Source Descriptor
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t bLength;
+  uint8_t bDescriptorType;
+  uint8_t bDescriptorSubType;
+  uint8_t bClockID;
+  uint8_t bmAttributes;
+  uint8_t bmControls;
+  uint8_t bAssocTerminal;
+  uint8_t iClockSource;
+} audio_desc_clock_source_t;
+
+/// Audio 2.0 Feature Unit Descriptor, bmaControls is per channel with master channel 0 first
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t bLength;
+  uint8_t bDescriptorType;
+  uint8_t bDescriptorSubType;
+  uint8_t bUnitID;
+  uint8_t bSourceID;
+  uint32_t bmaControls[1];
+} audio_desc_feature_unit_t;
+
 /** @} */
 
 #ifdef __cplusplus
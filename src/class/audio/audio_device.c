@@ -0,0 +1,631 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "tusb_option.h"
+
+#if (TUSB_OPT_DEVICE_ENABLED && CFG_TUD_AUDIO)
+
+//--------------------------------------------------------------------+
+// INCLUDE
+//--------------------------------------------------------------------+
+#include "audio_device.h"
+#include "device/usbd_pvt.h"
+
+//--------------------------------------------------------------------+
+// MACRO CONSTANT TYPEDEF
+//--------------------------------------------------------------------+
+
+static uint32_t const _audiod_rates[] = { CFG_TUD_AUDIO_SAMPLE_RATES };
+
+enum
+{
+  AUDIOD_RATE_COUNT = TU_ARRAY_SIZE(_audiod_rates),
+  AUDIOD_FU_MAX     = 2,  // one feature unit per stream direction
+
+  FRAMES_PER_SEC    = 1000, // full speed frame
+  FB_SHIFT          = 10    // feedback moves 1/64 sample per frame for each sample of fifo level error
+};
+
+typedef struct
+{
+  uint8_t unit_id;  // 0 if not used
+  bool    mute  [CFG_TUD_AUDIO_MAX_CHANNEL+1];
+  int16_t volume[CFG_TUD_AUDIO_MAX_CHANNEL+1];
+}audiod_feature_unit_t;
+
+typedef struct
+{
+  uint8_t  itf_num;
+  uint8_t  alt;           // 0 is idle (zero bandwidth) setting
+  uint8_t  ep_data;
+  uint8_t  ep_fb;         // explicit feedback endpoint of speaker stream
+  uint8_t  fb_size;       // 3 bytes (10.14) or 4 bytes (16.16)
+  uint16_t ep_size;
+  uint8_t  frame_size;    // bytes per sample frame (all channels)
+}audiod_stream_t;
+
+typedef struct
+{
+  uint8_t itf_ac;
+  uint8_t clock_id;
+
+  audiod_stream_t rx;     // speaker
+  audiod_stream_t tx;     // microphone
+
+  audiod_feature_unit_t fu[AUDIOD_FU_MAX];
+
+  uint32_t sample_rate;
+  uint32_t tx_remainder;  // fraction of sample (in 1/FRAMES_PER_SEC) carried to next microphone packet
+  uint32_t feedback;      // 16.16 samples per frame
+  bool     feedback_app;  // feedback is supplied by application
+
+  // data stage of control request
+  CFG_TUSB_MEM_ALIGN uint8_t ctrl_buf[2 + 12*AUDIOD_RATE_COUNT];
+
+  /*------------- From this point, data is not cleared by bus reset -------------*/
+  // FIFO
+  tu_fifo_t rx_ff;
+  tu_fifo_t tx_ff;
+  uint8_t rx_ff_buf[CFG_TUD_AUDIO_RX_BUFSIZE];
+  uint8_t tx_ff_buf[CFG_TUD_AUDIO_TX_BUFSIZE];
+
+#if CFG_FIFO_MUTEX
+  // rx fifo is overwritable: producer moves read index on overflow, needs both mutexes
+  osal_mutex_def_t rx_ff_mutex_wr;
+  osal_mutex_def_t rx_ff_mutex_rd;
+  osal_mutex_def_t tx_ff_mutex;
+#endif
+
+  // Endpoint Transfer buffer
+  CFG_TUSB_MEM_ALIGN uint8_t epout_buf[CFG_TUD_AUDIO_EPSIZE];
+  CFG_TUSB_MEM_ALIGN uint8_t epin_buf[CFG_TUD_AUDIO_EPSIZE];
+  CFG_TUSB_MEM_ALIGN uint8_t fb_buf[4];
+}audiod_interface_t;
+
+#define ITF_MEM_RESET_SIZE   offsetof(audiod_interface_t, rx_ff)
+
+//--------------------------------------------------------------------+
+// INTERNAL OBJECT & FUNCTION DECLARATION
+//--------------------------------------------------------------------+
+CFG_TUSB_MEM_SECTION static audiod_interface_t _audiod_itf;
+
+static audiod_feature_unit_t* find_feature_unit(uint8_t unit_id)
+{
+  if ( unit_id == 0 ) return NULL;
+
+  for(uint8_t i=0; i<AUDIOD_FU_MAX; i++)
+  {
+    if ( _audiod_itf.fu[i].unit_id == unit_id ) return &_audiod_itf.fu[i];
+  }
+
+  return NULL;
+}
+
+// Nominal samples per frame in 16.16
+static inline uint32_t nominal_feedback(void)
+{
+  return (uint32_t) ((((uint64_t) _audiod_itf.sample_rate) << 16) / FRAMES_PER_SEC);
+}
+
+// Ask host for slightly more or less samples so that rx fifo stays half full
+static uint32_t fifo_feedback(audiod_interface_t* p_audio)
+{
+  int32_t const half  = CFG_TUD_AUDIO_RX_BUFSIZE / 2;
+  int32_t       error = ((int32_t) tu_fifo_count(&p_audio->rx_ff) - half) / p_audio->rx.frame_size;
+
+  // at most one sample per frame away from nominal
+  int32_t const limit = 1 << (16 - FB_SHIFT);
+  if ( error >  limit ) error =  limit;
+  if ( error < -limit ) error = -limit;
+
+  return (uint32_t) ((int32_t) nominal_feedback() - error*(1 << FB_SHIFT));
+}
+
+static bool feedback_xfer(uint8_t rhport, audiod_interface_t* p_audio)
+{
+  // full speed format is 10.14 in 3 bytes
+  uint32_t const value = (p_audio->rx.fb_size == 3) ? (p_audio->feedback >> 2) : p_audio->feedback;
+
+  p_audio->fb_buf[0] = (uint8_t) (value      );
+  p_audio->fb_buf[1] = (uint8_t) (value >>  8);
+  p_audio->fb_buf[2] = (uint8_t) (value >> 16);
+  p_audio->fb_buf[3] = (uint8_t) (value >> 24);
+
+  return usbd_edpt_xfer(rhport, p_audio->rx.ep_fb, p_audio->fb_buf, p_audio->rx.fb_size);
+}
+
+// Send one frame worth of microphone samples, fractional rate (e.g 44.1 kHz) is spread over frames.
+// On underrun whatever is available is sent, host treats short packet as fewer samples.
+static bool tx_packet_xfer(uint8_t rhport, audiod_interface_t* p_audio)
+{
+  audiod_stream_t const* stream = &p_audio->tx;
+
+  uint32_t const samples = p_audio->sample_rate + p_audio->tx_remainder;
+  p_audio->tx_remainder  = samples % FRAMES_PER_SEC;
+
+  uint16_t count = (uint16_t) tu_min32((samples / FRAMES_PER_SEC) * stream->frame_size, stream->ep_size);
+  count = tu_min16(count, tu_fifo_count(&p_audio->tx_ff));
+  count = (uint16_t) (count - (count % stream->frame_size));
+
+  tu_fifo_read_n(&p_audio->tx_ff, p_audio->epin_buf, count);
+
+  return usbd_edpt_xfer(rhport, stream->ep_data, p_audio->epin_buf, count);
+}
+
+//--------------------------------------------------------------------+
+// APPLICATION API
+//--------------------------------------------------------------------+
+bool tud_audio_rx_streaming(void)
+{
+  return _audiod_itf.rx.alt != 0;
+}
+
+bool tud_audio_tx_streaming(void)
+{
+  return _audiod_itf.tx.alt != 0;
+}
+
+uint32_t tud_audio_sample_rate(void)
+{
+  return _audiod_itf.sample_rate;
+}
+
+uint16_t tud_audio_available(void)
+{
+  return tu_fifo_count(&_audiod_itf.rx_ff);
+}
+
+uint16_t tud_audio_read(void* buffer, uint16_t bufsize)
+{
+  return tu_fifo_read_n(&_audiod_itf.rx_ff, buffer, bufsize);
+}
+
+void tud_audio_read_flush(void)
+{
+  tu_fifo_clear(&_audiod_itf.rx_ff);
+}
+
+uint16_t tud_audio_write(void const* buffer, uint16_t bufsize)
+{
+  return tu_fifo_write_n(&_audiod_itf.tx_ff, buffer, bufsize);
+}
+
+uint16_t tud_audio_write_available(void)
+{
+  return tu_fifo_remaining(&_audiod_itf.tx_ff);
+}
+
+bool tud_audio_get_mute(uint8_t unit_id, uint8_t channel)
+{
+  audiod_feature_unit_t const* fu = find_feature_unit(unit_id);
+  TU_VERIFY(fu && channel <= CFG_TUD_AUDIO_MAX_CHANNEL);
+
+  return fu->mute[channel];
+}
+
+int16_t tud_audio_get_volume(uint8_t unit_id, uint8_t channel)
+{
+  audiod_feature_unit_t const* fu = find_feature_unit(unit_id);
+  TU_VERIFY(fu && channel <= CFG_TUD_AUDIO_MAX_CHANNEL, 0);
+
+  return fu->volume[channel];
+}
+
+void tud_audio_set_feedback(uint32_t feedback)
+{
+  _audiod_itf.feedback_app = (feedback != 0);
+  if ( feedback ) _audiod_itf.feedback = feedback;
+}
+
+//--------------------------------------------------------------------+
+// USBD Driver API
+//--------------------------------------------------------------------+
+void audiod_init(void)
+{
+  audiod_interface_t* p_audio = &_audiod_itf;
+
+  tu_memclr(p_audio, sizeof(audiod_interface_t));
+
+  // config fifo
+  tu_fifo_config(&p_audio->rx_ff, p_audio->rx_ff_buf, CFG_TUD_AUDIO_RX_BUFSIZE, 1, true);
+  tu_fifo_config(&p_audio->tx_ff, p_audio->tx_ff_buf, CFG_TUD_AUDIO_TX_BUFSIZE, 1, false);
+
+#if CFG_FIFO_MUTEX
+  tu_fifo_config_mutex(&p_audio->rx_ff, osal_mutex_create(&p_audio->rx_ff_mutex_wr), osal_mutex_create(&p_audio->rx_ff_mutex_rd));
+  tu_fifo_config_mutex(&p_audio->tx_ff, osal_mutex_create(&p_audio->tx_ff_mutex), NULL);
+#endif
+
+  audiod_reset(0);
+}
+
+void audiod_reset(uint8_t rhport)
+{
+  (void) rhport;
+
+  audiod_interface_t* p_audio = &_audiod_itf;
+
+  tu_memclr(p_audio, ITF_MEM_RESET_SIZE);
+  tu_fifo_clear(&p_audio->rx_ff);
+  tu_fifo_clear(&p_audio->tx_ff);
+
+  p_audio->sample_rate = _audiod_rates[0];
+}
+
+bool audiod_open(uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint16_t *p_length)
+{
+  (void) rhport;
+
+  TU_VERIFY(AUDIO_PROTOCOL_V2 == itf_desc->bInterfaceProtocol);
+
+  audiod_interface_t* p_audio = &_audiod_itf;
+  uint8_t const * p_desc = tu_desc_next(itf_desc);
+  (*p_length) = sizeof(tusb_desc_interface_t);
+
+  if ( AUDIO_SUBCLASS_CONTROL == itf_desc->bInterfaceSubClass )
+  {
+    // Only one audio function is supported
+    TU_ASSERT(p_audio->clock_id == 0);
+    p_audio->itf_ac = itf_desc->bInterfaceNumber;
+
+    // Find clock source and feature units among class-specific descriptors
+    uint8_t fu_count = 0;
+    while ( TUSB_DESC_CS_INTERFACE == tu_desc_type(p_desc) )
+    {
+      switch ( p_desc[2] )
+      {
+        case AUDIO_CS_INTERFACE_CLOCK_SOURCE:
+          p_audio->clock_id = ((audio_desc_clock_source_t const*) p_desc)->bClockID;
+        break;
+
+        case AUDIO_CS_INTERFACE_FEATURE_UNIT:
+          TU_ASSERT(fu_count < AUDIOD_FU_MAX);
+          p_audio->fu[fu_count++].unit_id = ((audio_desc_feature_unit_t const*) p_desc)->bUnitID;
+        break;
+
+        default: break;
+      }
+
+      (*p_length) = (uint16_t) ((*p_length) + tu_desc_len(p_desc));
+      p_desc = tu_desc_next(p_desc);
+    }
+
+    TU_ASSERT(p_audio->clock_id);
+  }
+  else
+  {
+    // Streaming interface: setting 0 has no endpoint, direction is known once host selects a setting
+    TU_VERIFY(AUDIO_SUBCLASS_STREAMING == itf_desc->bInterfaceSubClass && 0 == itf_desc->bNumEndpoints);
+  }
+
+  return true;
+}
+
+bool audiod_set_interface(uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint16_t length)
+{
+  audiod_interface_t* p_audio = &_audiod_itf;
+  uint8_t const itf = itf_desc->bInterfaceNumber;
+
+  // idle setting: stop the stream of this interface
+  if ( 0 == itf_desc->bAlternateSetting )
+  {
+    if ( p_audio->rx.alt && p_audio->rx.itf_num == itf )
+    {
+      tu_varclr(&p_audio->rx);
+      usbd_sof_enable(rhport, SOF_CONSUMER_AUDIO, false); // only needed for feedback of rx stream
+      if ( tud_audio_rx_stream_cb ) tud_audio_rx_stream_cb(false);
+    }
+    else if ( p_audio->tx.alt && p_audio->tx.itf_num == itf )
+    {
+      tu_varclr(&p_audio->tx);
+      if ( tud_audio_tx_stream_cb ) tud_audio_tx_stream_cb(false);
+    }
+
+    return true;
+  }
+
+  // parse format and endpoints of selected setting
+  uint8_t  channels     = 0;
+  uint8_t  subslot_size = 0;
+  uint8_t  ep_data      = 0;
+  uint8_t  ep_fb        = 0;
+  uint8_t  fb_size      = 0;
+  uint16_t ep_size      = 0;
+
+  uint8_t const * p_desc = (uint8_t const *) itf_desc;
+  uint16_t len = 0;
+
+  while ( len < length )
+  {
+    if ( TUSB_DESC_CS_INTERFACE == tu_desc_type(p_desc) )
+    {
+      if ( AUDIO_CS_AS_INTERFACE_GENERAL == p_desc[2] )
+      {
+        channels = ((audio_desc_cs_as_interface_t const*) p_desc)->bNrChannels;
+      }
+      else if ( AUDIO_CS_AS_INTERFACE_FORMAT_TYPE == p_desc[2] )
+      {
+        subslot_size = ((audio_desc_type_I_format_t const*) p_desc)->bSubslotSize;
+      }
+    }
+    else if ( TUSB_DESC_ENDPOINT == tu_desc_type(p_desc) )
+    {
+      tusb_desc_endpoint_t const* desc_ep = (tusb_desc_endpoint_t const*) p_desc;
+      TU_ASSERT(TUSB_XFER_ISOCHRONOUS == desc_ep->bmAttributes.xfer);
+
+      if ( (TUSB_ISO_EP_ATT_EXPLICIT_FB >> 4) == desc_ep->bmAttributes.usage )
+      {
+        ep_fb   = desc_ep->bEndpointAddress;
+        fb_size = (uint8_t) desc_ep->wMaxPacketSize.size;
+      }
+      else
+      {
+        ep_data = desc_ep->bEndpointAddress;
+        ep_size = tu_min16(desc_ep->wMaxPacketSize.size, CFG_TUD_AUDIO_EPSIZE);
+      }
+    }
+
+    len    = (uint16_t) (len + tu_desc_len(p_desc));
+    p_desc = tu_desc_next(p_desc);
+  }
+
+  TU_ASSERT(ep_data && channels && subslot_size);
+
+  bool const is_tx = (TUSB_DIR_IN == tu_edpt_dir(ep_data));
+  audiod_stream_t* stream = is_tx ? &p_audio->tx : &p_audio->rx;
+
+  stream->itf_num    = itf;
+  stream->alt        = itf_desc->bAlternateSetting;
+  stream->ep_data    = ep_data;
+  stream->ep_fb      = ep_fb;
+  stream->fb_size    = fb_size;
+  stream->ep_size    = ep_size;
+  stream->frame_size = (uint8_t) (channels * subslot_size);
+
+  if ( is_tx )
+  {
+    p_audio->tx_remainder = 0;
+    TU_ASSERT( tx_packet_xfer(rhport, p_audio) );
+
+    if ( tud_audio_tx_stream_cb ) tud_audio_tx_stream_cb(true);
+  }
+  else
+  {
+    tu_fifo_clear(&p_audio->rx_ff);
+    TU_ASSERT( usbd_edpt_xfer(rhport, ep_data, p_audio->epout_buf, ep_size) );
+
+    if ( ep_fb )
+    {
+      TU_ASSERT(fb_size == 3 || fb_size == 4);
+
+      // feedback is refreshed on every SOF
+      if ( !p_audio->feedback_app ) p_audio->feedback = nominal_feedback();
+      TU_ASSERT( feedback_xfer(rhport, p_audio) );
+      usbd_sof_enable(rhport, SOF_CONSUMER_AUDIO, true);
+    }
+
+    if ( tud_audio_rx_stream_cb ) tud_audio_rx_stream_cb(true);
+  }
+
+  return true;
+}
+
+// Handle class control request
+// return false to stall control endpoint (e.g unsupported request)
+bool audiod_control_request(uint8_t rhport, tusb_control_request_t const * request)
+{
+  audiod_interface_t* p_audio = &_audiod_itf;
+
+  // Only Audio Control interface entities are supported
+  TU_VERIFY(request->bmRequestType_bit.type == TUSB_REQ_TYPE_CLASS &&
+            request->bmRequestType_bit.recipient == TUSB_REQ_RCPT_INTERFACE &&
+            tu_u16_low(request->wIndex) == p_audio->itf_ac);
+
+  uint8_t const entity = tu_u16_high(request->wIndex);
+  uint8_t const ctrl   = tu_u16_high(request->wValue);
+  uint8_t const ch     = tu_u16_low(request->wValue);
+  uint8_t*      buf    = p_audio->ctrl_buf;
+
+  audiod_feature_unit_t* fu = find_feature_unit(entity);
+
+  // Set request: data is applied when received in audiod_control_complete()
+  if ( request->bmRequestType_bit.direction == TUSB_DIR_OUT )
+  {
+    TU_VERIFY(AUDIO_CS_REQ_CUR == request->bRequest && request->wLength <= sizeof(p_audio->ctrl_buf));
+    TU_VERIFY(entity == p_audio->clock_id || (fu && ch <= CFG_TUD_AUDIO_MAX_CHANNEL));
+
+    return tud_control_xfer(rhport, request, buf, request->wLength);
+  }
+
+  uint16_t len = 0;
+
+  if ( entity == p_audio->clock_id )
+  {
+    if ( AUDIO_CS_CTRL_SAM_FREQ == ctrl && AUDIO_CS_REQ_CUR == request->bRequest )
+    {
+      memcpy(buf, &p_audio->sample_rate, 4);
+      len = 4;
+    }
+    else if ( AUDIO_CS_CTRL_SAM_FREQ == ctrl && AUDIO_CS_REQ_RANGE == request->bRequest )
+    {
+      // Layout 3 parameter block: number of sub-ranges then min, max, resolution of each
+      uint16_t const count = AUDIOD_RATE_COUNT;
+      memcpy(buf, &count, 2);
+      len = 2;
+
+      for(uint8_t i=0; i<AUDIOD_RATE_COUNT; i++)
+      {
+        uint32_t const range[3] = { _audiod_rates[i], _audiod_rates[i], 0 };
+        memcpy(buf + len, range, sizeof(range));
+        len += sizeof(range);
+      }
+    }
+    else if ( AUDIO_CS_CTRL_CLK_VALID == ctrl && AUDIO_CS_REQ_CUR == request->bRequest )
+    {
+      buf[0] = 1;
+      len = 1;
+    }
+    else
+    {
+      return false;
+    }
+  }
+  else if ( fu && ch <= CFG_TUD_AUDIO_MAX_CHANNEL )
+  {
+    if ( AUDIO_FU_CTRL_MUTE == ctrl && AUDIO_CS_REQ_CUR == request->bRequest )
+    {
+      buf[0] = fu->mute[ch];
+      len = 1;
+    }
+    else if ( AUDIO_FU_CTRL_VOLUME == ctrl && AUDIO_CS_REQ_CUR == request->bRequest )
+    {
+      memcpy(buf, &fu->volume[ch], 2);
+      len = 2;
+    }
+    else if ( AUDIO_FU_CTRL_VOLUME == ctrl && AUDIO_CS_REQ_RANGE == request->bRequest )
+    {
+      // Layout 2 parameter block with a single sub-range
+      int16_t const range[4] = { 1, CFG_TUD_AUDIO_VOLUME_MIN, CFG_TUD_AUDIO_VOLUME_MAX, CFG_TUD_AUDIO_VOLUME_RES };
+      memcpy(buf, range, sizeof(range));
+      len = sizeof(range);
+    }
+    else
+    {
+      return false;
+    }
+  }
+  else
+  {
+    return false; // stall unsupported entity
+  }
+
+  return tud_control_xfer(rhport, request, buf, len);
+}
+
+// Apply data of Set request, return false to stall status stage
+bool audiod_control_complete(uint8_t rhport, tusb_control_request_t const * request)
+{
+  (void) rhport;
+
+  // Get request has nothing to apply
+  if ( request->bmRequestType_bit.direction == TUSB_DIR_IN ) return true;
+
+  audiod_interface_t* p_audio = &_audiod_itf;
+
+  uint8_t const entity = tu_u16_high(request->wIndex);
+  uint8_t const ctrl   = tu_u16_high(request->wValue);
+  uint8_t const ch     = tu_u16_low(request->wValue);
+  uint8_t const* buf   = p_audio->ctrl_buf;
+
+  if ( entity == p_audio->clock_id )
+  {
+    TU_VERIFY(AUDIO_CS_CTRL_SAM_FREQ == ctrl && request->wLength == 4);
+
+    uint32_t rate;
+    memcpy(&rate, buf, 4);
+
+    uint8_t i;
+    for(i=0; i<AUDIOD_RATE_COUNT && _audiod_rates[i] != rate; i++) {}
+    TU_VERIFY(i < AUDIOD_RATE_COUNT);
+
+    if ( tud_audio_sample_rate_cb ) TU_VERIFY( tud_audio_sample_rate_cb(rate) );
+
+    p_audio->sample_rate = rate;
+    if ( !p_audio->feedback_app ) p_audio->feedback = nominal_feedback();
+
+    return true;
+  }
+
+  audiod_feature_unit_t* fu = find_feature_unit(entity);
+  TU_VERIFY(fu);
+
+  if ( AUDIO_FU_CTRL_MUTE == ctrl )
+  {
+    TU_VERIFY(request->wLength == 1);
+    fu->mute[ch] = (buf[0] != 0);
+
+    if ( tud_audio_mute_cb ) tud_audio_mute_cb(entity, ch, fu->mute[ch]);
+  }
+  else if ( AUDIO_FU_CTRL_VOLUME == ctrl )
+  {
+    TU_VERIFY(request->wLength == 2);
+
+    int16_t volume;
+    memcpy(&volume, buf, 2);
+    TU_VERIFY(CFG_TUD_AUDIO_VOLUME_MIN <= volume && volume <= CFG_TUD_AUDIO_VOLUME_MAX);
+
+    fu->volume[ch] = volume;
+    if ( tud_audio_volume_cb ) tud_audio_volume_cb(entity, ch, volume);
+  }
+  else
+  {
+    return false;
+  }
+
+  return true;
+}
+
+bool audiod_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+{
+  audiod_interface_t* p_audio = &_audiod_itf;
+
+  if ( p_audio->rx.alt && ep_addr == p_audio->rx.ep_data )
+  {
+    // corrupted isochronous packet is dropped
+    if ( XFER_RESULT_SUCCESS == result && xferred_bytes )
+    {
+      tu_fifo_write_n(&p_audio->rx_ff, p_audio->epout_buf, (uint16_t) xferred_bytes);
+      if ( tud_audio_rx_cb ) tud_audio_rx_cb();
+    }
+
+    TU_ASSERT( usbd_edpt_xfer(rhport, p_audio->rx.ep_data, p_audio->epout_buf, p_audio->rx.ep_size) );
+  }
+  else if ( p_audio->rx.alt && ep_addr == p_audio->rx.ep_fb )
+  {
+    TU_ASSERT( feedback_xfer(rhport, p_audio) );
+  }
+  else if ( p_audio->tx.alt && ep_addr == p_audio->tx.ep_data )
+  {
+    TU_ASSERT( tx_packet_xfer(rhport, p_audio) );
+  }
+
+  return true;
+}
+
+// Track fifo level once per frame so that feedback follows the rate host is actually sending at
+void audiod_sof(uint8_t rhport, uint32_t frame_count)
+{
+  (void) rhport;
+  (void) frame_count;
+
+  audiod_interface_t* p_audio = &_audiod_itf;
+
+  if ( p_audio->rx.alt && p_audio->rx.ep_fb && !p_audio->feedback_app )
+  {
+    p_audio->feedback = fifo_feedback(p_audio);
+  }
+}
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _TUSB_AUDIO_DEVICE_H_
+#define _TUSB_AUDIO_DEVICE_H_
+
+#include "common/tusb_common.h"
+#include "device/usbd.h"
+
+#include "audio.h"
+
+//--------------------------------------------------------------------+
+// Class Driver Configuration
+//--------------------------------------------------------------------+
+
+// Max size of isochronous data packet, default is 48 kHz 16-bit stereo with room for one extra sample
+#ifndef CFG_TUD_AUDIO_EPSIZE
+#define CFG_TUD_AUDIO_EPSIZE      196
+#endif
+
+// Speaker (OUT) stream fifo, feedback endpoint keeps it half full
+#ifndef CFG_TUD_AUDIO_RX_BUFSIZE
+#define CFG_TUD_AUDIO_RX_BUFSIZE  (4*CFG_TUD_AUDIO_EPSIZE)
+#endif
+
+// Microphone (IN) stream fifo
+#ifndef CFG_TUD_AUDIO_TX_BUFSIZE
+#define CFG_TUD_AUDIO_TX_BUFSIZE  (4*CFG_TUD_AUDIO_EPSIZE)
+#endif
+
+// Comma separated list of sample rates in Hz reported to host, first one is the default
+#ifndef CFG_TUD_AUDIO_SAMPLE_RATES
+#define CFG_TUD_AUDIO_SAMPLE_RATES  48000
+#endif
+
+// Channels per feature unit with mute & volume control, not counting master channel 0
+#ifndef CFG_TUD_AUDIO_MAX_CHANNEL
+#define CFG_TUD_AUDIO_MAX_CHANNEL   2
+#endif
+
+// Volume range in 1/256 dB
+#ifndef CFG_TUD_AUDIO_VOLUME_MIN
+#define CFG_TUD_AUDIO_VOLUME_MIN    (-90*256)
+#endif
+
+#ifndef CFG_TUD_AUDIO_VOLUME_MAX
+#define CFG_TUD_AUDIO_VOLUME_MAX    0
+#endif
+
+#ifndef CFG_TUD_AUDIO_VOLUME_RES
+#define CFG_TUD_AUDIO_VOLUME_RES    256
+#endif
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/** \addtogroup ClassDriver_Audio
+ *  @{
+ *  \defgroup   Audio_Device Device
+ *  @{ */
+
+//--------------------------------------------------------------------+
+// Application API
+// Audio 2.0 function with one speaker (OUT) and/or one microphone (IN) stream
+//--------------------------------------------------------------------+
+
+// Check if speaker/microphone stream is selected by host (alternate setting is not zero)
+bool     tud_audio_rx_streaming   (void);
+bool     tud_audio_tx_streaming   (void);
+
+// Current sample rate in Hz
+uint32_t tud_audio_sample_rate    (void);
+
+// Speaker data received from host
+uint16_t tud_audio_available      (void);
+uint16_t tud_audio_read           (void* buffer, uint16_t bufsize);
+void     tud_audio_read_flush     (void);
+
+// Microphone data sent to host, one packet per frame at current sample rate
+uint16_t tud_audio_write          (void const* buffer, uint16_t bufsize);
+uint16_t tud_audio_write_available(void);
+
+// Get mute & volume (1/256 dB) of a feature unit channel, channel 0 is master
+bool     tud_audio_get_mute       (uint8_t unit_id, uint8_t channel);
+int16_t  tud_audio_get_volume     (uint8_t unit_id, uint8_t channel);
+
+// Set speaker feedback in 16.16 samples per frame e.g measured from the codec clock.
+// By default feedback is derived from rx fifo level, 0 switches back to it.
+void     tud_audio_set_feedback   (uint32_t feedback);
+
+//--------------------------------------------------------------------+
+// Application Callback API (weak is optional)
+//--------------------------------------------------------------------+
+
+// Invoked when speaker data is received
+TU_ATTR_WEAK void tud_audio_rx_cb(void);
+
+// Invoked when host starts or stops speaker/microphone stream
+TU_ATTR_WEAK void tud_audio_rx_stream_cb(bool streaming);
+TU_ATTR_WEAK void tud_audio_tx_stream_cb(bool streaming);
+
+// Invoked when host sets sample rate, rate is one of CFG_TUD_AUDIO_SAMPLE_RATES.
+// Return false if codec cannot switch to it
+TU_ATTR_WEAK bool tud_audio_sample_rate_cb(uint32_t sample_rate);
+
+// Invoked when host changes mute or volume (1/256 dB) of a feature unit channel
+TU_ATTR_WEAK void tud_audio_mute_cb(uint8_t unit_id, uint8_t channel, bool mute);
+TU_ATTR_WEAK void tud_audio_volume_cb(uint8_t unit_id, uint8_t channel, int16_t volume);
+
+/** @} */
+/** @} */
+
+//--------------------------------------------------------------------+
+// Internal Class Driver API
+//--------------------------------------------------------------------+
+void audiod_init             (void);
+void audiod_reset            (uint8_t rhport);
+bool audiod_open             (uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint16_t *p_length);
+bool audiod_set_interface    (uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint16_t length);
+bool audiod_control_request  (uint8_t rhport, tusb_control_request_t const * request);
+bool audiod_control_complete (uint8_t rhport, tusb_control_request_t const * request);
+bool audiod_xfer_cb          (uint8_t rhport, uint8_t edpt_addr, xfer_result_t result, uint32_t xferred_bytes);
+void audiod_sof              (uint8_t rhport, uint32_t frame_count);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _TUSB_AUDIO_DEVICE_H_ */
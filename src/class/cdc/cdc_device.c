@@ -44,25 +44,46 @@ typedef struct
   // Bit 0:  DTR (Data Terminal Ready), Bit 1: RTS (Request to Send)
   uint8_t line_state;
 
+  // OUT transfer destination: either rx fifo storage or epout_buf
+  uint8_t* epout_ptr;
+
+  // IN ping-pong: epin_buf[epin_idx] is (or was last) on the bus while the other one is staged
+  uint8_t  epin_idx;
+  uint16_t epin_staged;
+
+  // SOFs counted since last write while tx data is pending
+  uint16_t tx_sof_idle;
+
   /*------------- From this point, data is not cleared by bus reset -------------*/
   char    wanted_char;
   cdc_line_coding_t line_coding;
 
+  // tx auto flush policy, 0 is disabled
+  uint16_t tx_flush_threshold; // bytes queued
+  uint16_t tx_flush_sof;       // SOFs without write
+
+  bool rx_multi_packet;
+
   // FIFO
   tu_fifo_t rx_ff;
   tu_fifo_t tx_ff;
 
-  uint8_t rx_ff_buf[CFG_TUD_CDC_RX_BUFSIZE];
+  // rx fifo storage is also used as OUT transfer buffer
+  CFG_TUSB_MEM_ALIGN uint8_t rx_ff_buf[CFG_TUD_CDC_RX_BUFSIZE];
   uint8_t tx_ff_buf[CFG_TUD_CDC_TX_BUFSIZE];
 
 #if CFG_FIFO_MUTEX
   osal_mutex_def_t rx_ff_mutex;
   osal_mutex_def_t tx_ff_mutex;
+
+  // serialize tx fifo reading and IN transfer between application flush and usbd task
+  osal_mutex_def_t tx_xfer_mutex_def;
+  osal_mutex_t     tx_xfer_mutex;
 #endif
 
   // Endpoint Transfer buffer
   CFG_TUSB_MEM_ALIGN uint8_t epout_buf[CFG_TUD_CDC_EPSIZE];
-  CFG_TUSB_MEM_ALIGN uint8_t epin_buf[CFG_TUD_CDC_EPSIZE];
+  CFG_TUSB_MEM_ALIGN uint8_t epin_buf[2][CFG_TUD_CDC_EP_BUFSIZE];
 
 }cdcd_interface_t;
 
@@ -81,13 +102,132 @@ static void _prep_out_transaction (uint8_t itf)
   if ( usbd_edpt_busy(TUD_OPT_RHPORT, p_cdc->ep_out) ) return;
 
   // Prepare for incoming data but only allow what we can store in the ring buffer.
-  uint16_t max_read = tu_fifo_remaining(&p_cdc->rx_ff);
-  if ( max_read >= CFG_TUD_CDC_EPSIZE )
+  // Receive straight into fifo storage when its linear free space holds a full packet (or as many whole
+  // packets as it can in multi packet mode), a full packet must never overrun.
+  // Transfer buffer must be word aligned for DMA.
+  tu_fifo_buffer_info_t info;
+  tu_fifo_get_write_info(&p_cdc->rx_ff, &info);
+
+  uint16_t xfer_len = (uint16_t) (info.len_lin - (info.len_lin % CFG_TUD_CDC_EPSIZE));
+  if ( !p_cdc->rx_multi_packet ) xfer_len = tu_min16(xfer_len, CFG_TUD_CDC_EPSIZE);
+
+  if ( xfer_len && (((uintptr_t) info.ptr_lin) & 3) == 0 )
+  {
+    p_cdc->epout_ptr = (uint8_t*) info.ptr_lin;
+    usbd_edpt_xfer(TUD_OPT_RHPORT, p_cdc->ep_out, p_cdc->epout_ptr, xfer_len);
+  }
+  else if ( tu_fifo_remaining(&p_cdc->rx_ff) >= CFG_TUD_CDC_EPSIZE )
   {
+    // free space wraps around or is not aligned: receive one packet then copy
+    p_cdc->epout_ptr = p_cdc->epout_buf;
     usbd_edpt_xfer(TUD_OPT_RHPORT, p_cdc->ep_out, p_cdc->epout_buf, CFG_TUD_CDC_EPSIZE);
   }
 }
 
+#if CFG_FIFO_MUTEX
+static inline void _tx_lock(cdcd_interface_t* p_cdc)
+{
+  osal_mutex_lock(p_cdc->tx_xfer_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+}
+
+static inline void _tx_unlock(cdcd_interface_t* p_cdc)
+{
+  osal_mutex_unlock(p_cdc->tx_xfer_mutex);
+}
+#else
+#define _tx_lock(_p_cdc)     (void) (_p_cdc)
+#define _tx_unlock(_p_cdc)   (void) (_p_cdc)
+#endif
+
+// Start IN transfer with staged buffer (if any) and stage the next one from tx fifo,
+// so that it is ready as soon as the current one completes. Must be called with tx lock held
+static bool _xmit_packet(uint8_t itf)
+{
+  cdcd_interface_t* p_cdc = &_cdcd_itf[itf];
+  uint8_t const idle = p_cdc->epin_idx ^ 1;
+
+  // stage data into idle buffer
+  if ( !p_cdc->epin_staged )
+  {
+    p_cdc->epin_staged = tu_fifo_read_n(&p_cdc->tx_ff, p_cdc->epin_buf[idle], CFG_TUD_CDC_EP_BUFSIZE);
+  }
+
+  // current transfer is on the bus, staged buffer will be sent on its completion
+  if ( usbd_edpt_busy(TUD_OPT_RHPORT, p_cdc->ep_in) ) return true;
+
+  uint16_t const count = p_cdc->epin_staged;
+  if ( !count ) return true;
+
+  p_cdc->epin_staged = 0;
+
+  TU_VERIFY( tud_cdc_n_connected(itf) ); // fifo is empty if not connected
+  TU_ASSERT( usbd_edpt_xfer(TUD_OPT_RHPORT, p_cdc->ep_in, p_cdc->epin_buf[idle], count) );
+  p_cdc->epin_idx = idle;
+
+  // stage next one while this one is on the bus
+  p_cdc->epin_staged = tu_fifo_read_n(&p_cdc->tx_ff, p_cdc->epin_buf[idle ^ 1], CFG_TUD_CDC_EP_BUFSIZE);
+
+  return true;
+}
+
+// Return index of first occurrence of c in buf[start..len), len if not found.
+// Compares a 32-bit word at a time: a byte of (w ^ pattern) is zero where c is.
+static uint16_t _find_char(uint8_t const* buf, uint16_t start, uint16_t len, uint8_t c)
+{
+  uint16_t i = start;
+
+  // bytewise until word aligned
+  while ( (i < len) && (((uintptr_t) (buf + i)) & 3) )
+  {
+    if ( buf[i] == c ) return i;
+    i++;
+  }
+
+  uint32_t const pattern = 0x01010101UL * c;
+
+  for( ; i + 4 <= len; i += 4)
+  {
+    // memcpy instead of pointer cast to keep strict aliasing, compiles to a single load
+    uint32_t word;
+    memcpy(&word, buf + i, 4);
+    uint32_t const x = word ^ pattern;
+
+    // non-zero if any byte of x is zero
+    if ( (x - 0x01010101UL) & ~x & 0x80808080UL ) break;
+  }
+
+  // locate within the word (endian agnostic) or the tail
+  for( ; i < len; i++)
+  {
+    if ( buf[i] == c ) return i;
+  }
+
+  return len;
+}
+
+// Partial tx data is waiting to be flushed on SOF
+static inline bool _tx_sof_wanted(cdcd_interface_t* p_cdc)
+{
+  return p_cdc->tx_flush_sof && p_cdc->ep_in && !tu_fifo_empty(&p_cdc->tx_ff);
+}
+
+// SOF is only requested while there is something to flush, not to wake up usbd task every frame
+static inline void _tx_sof_request(cdcd_interface_t* p_cdc)
+{
+  if ( _tx_sof_wanted(p_cdc) ) usbd_sof_enable(TUD_OPT_RHPORT, SOF_CONSUMER_CDC, true);
+}
+
+// Find interface owning the endpoint
+static uint8_t _find_itf(uint8_t ep_addr)
+{
+  uint8_t itf;
+  for(itf=0; itf<CFG_TUD_CDC; itf++)
+  {
+    if ( (ep_addr == _cdcd_itf[itf].ep_out) || (ep_addr == _cdcd_itf[itf].ep_in) ) break;
+  }
+  return itf;
+}
+
 //--------------------------------------------------------------------+
 // APPLICATION API
 //--------------------------------------------------------------------+
@@ -112,6 +252,23 @@ void tud_cdc_n_set_wanted_char (uint8_t itf, char wanted)
   _cdcd_itf[itf].wanted_char = wanted;
 }
 
+void tud_cdc_n_set_tx_flush_policy (uint8_t itf, uint16_t threshold, uint16_t sof_count)
+{
+  cdcd_interface_t* p_cdc = &_cdcd_itf[itf];
+
+  p_cdc->tx_flush_threshold = threshold;
+  p_cdc->tx_flush_sof       = sof_count;
+
+  // data may be pending already, SOF is released by cdcd_sof() once nothing is
+  _tx_sof_request(p_cdc);
+}
+
+void tud_cdc_n_set_rx_multi_packet (uint8_t itf, bool enabled)
+{
+  // applies from next OUT transfer
+  _cdcd_itf[itf].rx_multi_packet = enabled;
+}
+
 
 //--------------------------------------------------------------------+
 // READ API
@@ -135,7 +292,9 @@ bool tud_cdc_n_peek(uint8_t itf, int pos, uint8_t* chr)
 
 void tud_cdc_n_read_flush (uint8_t itf)
 {
-  tu_fifo_clear(&_cdcd_itf[itf].rx_ff);
+  // discard by consuming: an OUT transfer may be writing into fifo storage at the write index
+  tu_fifo_t* ff = &_cdcd_itf[itf].rx_ff;
+  tu_fifo_advance_read(ff, tu_fifo_count(ff));
   _prep_out_transaction(itf);
 }
 
@@ -144,15 +303,20 @@ void tud_cdc_n_read_flush (uint8_t itf)
 //--------------------------------------------------------------------+
 uint32_t tud_cdc_n_write(uint8_t itf, void const* buffer, uint32_t bufsize)
 {
-  uint16_t ret = tu_fifo_write_n(&_cdcd_itf[itf].tx_ff, buffer, bufsize);
+  cdcd_interface_t* p_cdc = &_cdcd_itf[itf];
+  uint16_t ret = tu_fifo_write_n(&p_cdc->tx_ff, buffer, bufsize);
+
+  // restart timeout of partial data
+  p_cdc->tx_sof_idle = 0;
 
-#if 0 // TODO issue with circuitpython's REPL
-  // flush if queue more than endpoint size
-  if ( tu_fifo_count(&_cdcd_itf[itf].tx_ff) >= CFG_TUD_CDC_EPSIZE )
+  // flush if queued data reaches threshold
+  if ( p_cdc->tx_flush_threshold && (tu_fifo_count(&p_cdc->tx_ff) >= p_cdc->tx_flush_threshold) )
   {
     tud_cdc_n_write_flush(itf);
   }
-#endif
+
+  // partial data left: flush it on SOF
+  _tx_sof_request(p_cdc);
 
   return ret;
 }
@@ -160,16 +324,13 @@ uint32_t tud_cdc_n_write(uint8_t itf, void const* buffer, uint32_t bufsize)
 bool tud_cdc_n_write_flush (uint8_t itf)
 {
   cdcd_interface_t* p_cdc = &_cdcd_itf[itf];
-  TU_VERIFY( !usbd_edpt_busy(TUD_OPT_RHPORT, p_cdc->ep_in) ); // skip if previous transfer not complete
 
-  uint16_t count = tu_fifo_read_n(&_cdcd_itf[itf].tx_ff, p_cdc->epin_buf, CFG_TUD_CDC_EPSIZE);
-  if ( count )
-  {
-    TU_VERIFY( tud_cdc_n_connected(itf) ); // fifo is empty if not connected
-    TU_ASSERT( usbd_edpt_xfer(TUD_OPT_RHPORT, p_cdc->ep_in, p_cdc->epin_buf, count) );
-  }
+  // If previous transfer is not complete, data is staged and sent on its completion
+  _tx_lock(p_cdc);
+  bool const ret = _xmit_packet(itf);
+  _tx_unlock(p_cdc);
 
-  return true;
+  return ret;
 }
 
 uint32_t tud_cdc_n_write_available (uint8_t itf)
@@ -191,6 +352,11 @@ void cdcd_init(void)
 
     p_cdc->wanted_char = -1;
 
+    p_cdc->tx_flush_threshold = CFG_TUD_CDC_TX_FLUSH_THRESHOLD;
+    p_cdc->tx_flush_sof       = CFG_TUD_CDC_TX_FLUSH_SOF;
+
+    p_cdc->rx_multi_packet    = CFG_TUD_CDC_RX_MULTI_PACKET;
+
     // default line coding is : stop bit = 1, parity = none, data bits = 8
     p_cdc->line_coding.bit_rate = 115200;
     p_cdc->line_coding.stop_bits = 0;
@@ -202,8 +368,10 @@ void cdcd_init(void)
     tu_fifo_config(&p_cdc->tx_ff, p_cdc->tx_ff_buf, CFG_TUD_CDC_TX_BUFSIZE, 1, false);
 
 #if CFG_FIFO_MUTEX
-    tu_fifo_config_mutex(&p_cdc->rx_ff, osal_mutex_create(&p_cdc->rx_ff_mutex));
-    tu_fifo_config_mutex(&p_cdc->tx_ff, osal_mutex_create(&p_cdc->tx_ff_mutex));
+    // rx fifo is only written by usbd task, tx fifo is only read with tx_xfer_mutex held: lock the application side only
+    tu_fifo_config_mutex(&p_cdc->rx_ff, NULL, osal_mutex_create(&p_cdc->rx_ff_mutex));
+    tu_fifo_config_mutex(&p_cdc->tx_ff, osal_mutex_create(&p_cdc->tx_ff_mutex), NULL);
+    p_cdc->tx_xfer_mutex = osal_mutex_create(&p_cdc->tx_xfer_mutex_def);
 #endif
   }
 }
@@ -282,6 +450,9 @@ bool cdcd_open(uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint16_t
   // Prepare for incoming data
   _prep_out_transaction(cdc_id);
 
+  // data written before mount is flushed on SOF
+  _tx_sof_request(p_cdc);
+
   return true;
 }
 
@@ -348,26 +519,75 @@ bool cdcd_control_request(uint8_t rhport, tusb_control_request_t const * request
   return true;
 }
 
+// Flush partial tx data that has been waiting for tx_flush_sof frames
+void cdcd_sof(uint8_t rhport, uint32_t frame_count)
+{
+  (void) frame_count;
+
+  bool pending = false;
+
+  for(uint8_t itf=0; itf<CFG_TUD_CDC; itf++)
+  {
+    cdcd_interface_t* p_cdc = &_cdcd_itf[itf];
+
+    if ( !_tx_sof_wanted(p_cdc) ) continue;
+
+    // IN completion keeps draining while a transfer is on the bus
+    if ( !usbd_edpt_busy(rhport, p_cdc->ep_in) && (++p_cdc->tx_sof_idle >= p_cdc->tx_flush_sof) )
+    {
+      p_cdc->tx_sof_idle = 0;
+      tud_cdc_n_write_flush(itf);
+    }
+
+    pending = pending || _tx_sof_wanted(p_cdc);
+  }
+
+  // stop waking up every frame once everything is flushed
+  if ( !pending )
+  {
+    usbd_sof_enable(rhport, SOF_CONSUMER_CDC, false);
+
+    // application may have written meanwhile, its request must not be lost
+    for(uint8_t itf=0; itf<CFG_TUD_CDC; itf++) _tx_sof_request(&_cdcd_itf[itf]);
+  }
+}
+
 bool cdcd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
 {
   (void) rhport;
   (void) result;
 
-  // TODO Support multiple interfaces
-  uint8_t const itf = 0;
+  uint8_t const itf = _find_itf(ep_addr);
+  TU_VERIFY(itf < CFG_TUD_CDC);
   cdcd_interface_t* p_cdc = &_cdcd_itf[itf];
 
   // Received new data
   if ( ep_addr == p_cdc->ep_out )
   {
-    for(uint32_t i=0; i<xferred_bytes; i++)
+    uint8_t const* buf = p_cdc->epout_ptr;
+    uint16_t const len = (uint16_t) xferred_bytes;
+    uint16_t const pos = tu_fifo_count(&p_cdc->rx_ff); // fifo position of received data
+
+    if ( buf == p_cdc->epout_buf )
+    {
+      tu_fifo_write_n(&p_cdc->rx_ff, buf, len);
+    }
+    else
     {
-      tu_fifo_write(&p_cdc->rx_ff, &p_cdc->epout_buf[i]);
+      // data is already in fifo storage, just publish it
+      tu_fifo_advance_write(&p_cdc->rx_ff, len);
+    }
 
-      // Check for wanted char and invoke callback if needed
-      if ( tud_cdc_rx_wanted_cb && ( ((signed char) p_cdc->wanted_char) != -1 ) && ( p_cdc->wanted_char == p_cdc->epout_buf[i] ) )
+    // Check for wanted char and invoke callback for every hit
+    if ( (tud_cdc_rx_wanted_cb || tud_cdc_rx_wanted_pos_cb) && ( ((signed char) p_cdc->wanted_char) != -1 ) )
+    {
+      uint16_t i = 0;
+
+      while ( (i = _find_char(buf, i, len, (uint8_t) p_cdc->wanted_char)) < len )
       {
-        tud_cdc_rx_wanted_cb(itf, p_cdc->wanted_char);
+        if ( tud_cdc_rx_wanted_cb     ) tud_cdc_rx_wanted_cb(itf, p_cdc->wanted_char);
+        if ( tud_cdc_rx_wanted_pos_cb ) tud_cdc_rx_wanted_pos_cb(itf, p_cdc->wanted_char, (uint32_t) (pos + i));
+        i++;
       }
     }
 
@@ -378,13 +598,21 @@ bool cdcd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_
     _prep_out_transaction(itf);
   }
 
-  // Data sent to host, we could continue to fetch data tx fifo to send.
-  // But it will cause incorrect baudrate set in line coding.
-  // Though maybe the baudrate is not really important !!!
-//  if ( ep_addr == p_cdc->ep_in )
-//  {
-//
-//  }
+  // Data sent to host: keep draining tx fifo, starting with the staged buffer
+  if ( ep_addr == p_cdc->ep_in )
+  {
+    _tx_lock(p_cdc);
+
+    _xmit_packet(itf);
+
+    // Transfer ended on a packet boundary and there is no more data: send ZLP so that host completes its read
+    if ( !usbd_edpt_busy(rhport, p_cdc->ep_in) && xferred_bytes && (0 == (xferred_bytes % CFG_TUD_CDC_EPSIZE)) )
+    {
+      usbd_edpt_xfer(rhport, p_cdc->ep_in, NULL, 0);
+    }
+
+    _tx_unlock(p_cdc);
+  }
 
   // nothing to do with notif endpoint for now
 
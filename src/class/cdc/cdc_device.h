@@ -38,6 +38,26 @@
 #define CFG_TUD_CDC_EPSIZE 64
 #endif
 
+// Size of each of the two IN transfer buffers (ping-pong), a multiple of CFG_TUD_CDC_EPSIZE
+// allows multi-packet IN transfers
+#ifndef CFG_TUD_CDC_EP_BUFSIZE
+#define CFG_TUD_CDC_EP_BUFSIZE CFG_TUD_CDC_EPSIZE
+#endif
+
+// Default tx auto flush policy, see tud_cdc_n_set_tx_flush_policy()
+#ifndef CFG_TUD_CDC_TX_FLUSH_THRESHOLD
+#define CFG_TUD_CDC_TX_FLUSH_THRESHOLD 0
+#endif
+
+#ifndef CFG_TUD_CDC_TX_FLUSH_SOF
+#define CFG_TUD_CDC_TX_FLUSH_SOF 0
+#endif
+
+// Default OUT transfer mode, see tud_cdc_n_set_rx_multi_packet()
+#ifndef CFG_TUD_CDC_RX_MULTI_PACKET
+#define CFG_TUD_CDC_RX_MULTI_PACKET 0
+#endif
+
 #ifdef __cplusplus
  extern "C" {
 #endif
@@ -56,6 +76,18 @@ uint8_t  tud_cdc_n_get_line_state  (uint8_t itf);
 void     tud_cdc_n_get_line_coding (uint8_t itf, cdc_line_coding_t* coding);
 void     tud_cdc_n_set_wanted_char (uint8_t itf, char wanted);
 
+// Tx auto flush: write flushes once threshold bytes are queued, partial data is flushed after sof_count
+// SOFs (1 ms each at full speed) without write. 0 disables either. SOF requires DCD port support.
+// Once flushed, tx fifo is drained continuously from IN transfer completion.
+void     tud_cdc_n_set_tx_flush_policy (uint8_t itf, uint16_t threshold, uint16_t sof_count);
+
+// Rx multi packet: OUT transfers span as many packets as rx fifo linear free space can hold, only complete
+// on a short packet. Host must end every write that is a multiple of CFG_TUD_CDC_EPSIZE with a ZLP,
+// most serial drivers don't. Disabled: one packet per transfer.
+// Either way, data goes straight into fifo storage only when write position is word aligned, which is
+// usually not the case after a short packet: such packet is received into a bounce buffer then copied.
+void     tud_cdc_n_set_rx_multi_packet (uint8_t itf, bool enabled);
+
 uint32_t tud_cdc_n_available       (uint8_t itf);
 uint32_t tud_cdc_n_read            (uint8_t itf, void* buffer, uint32_t bufsize);
 void     tud_cdc_n_read_flush      (uint8_t itf);
@@ -75,6 +107,8 @@ static inline bool     tud_cdc_connected       (void);
 static inline uint8_t  tud_cdc_get_line_state  (void);
 static inline void     tud_cdc_get_line_coding (cdc_line_coding_t* coding);
 static inline void     tud_cdc_set_wanted_char (char wanted);
+static inline void     tud_cdc_set_tx_flush_policy (uint16_t threshold, uint16_t sof_count);
+static inline void     tud_cdc_set_rx_multi_packet (bool enabled);
 
 static inline uint32_t tud_cdc_available       (void);
 static inline int32_t  tud_cdc_read_char       (void);
@@ -95,9 +129,13 @@ static inline uint32_t tud_cdc_write_available (void);
 // Invoked when received new data
 TU_ATTR_WEAK void tud_cdc_rx_cb(uint8_t itf);
 
-// Invoked when received `wanted_char`
+// Invoked when received `wanted_char`, once for every occurrence
 TU_ATTR_WEAK void tud_cdc_rx_wanted_cb(uint8_t itf, char wanted_char);
 
+// Invoked when received `wanted_char`, once for every occurrence with its position in rx fifo
+// i.e tud_cdc_n_read() of pos+1 bytes gets data up to and including it (unless rx fifo is read concurrently)
+TU_ATTR_WEAK void tud_cdc_rx_wanted_pos_cb(uint8_t itf, char wanted_char, uint32_t pos);
+
 // Invoked when line state DTR & RTS are changed via SET_CONTROL_LINE_STATE
 TU_ATTR_WEAK void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts);
 
@@ -143,6 +181,16 @@ static inline void tud_cdc_set_wanted_char (char wanted)
   tud_cdc_n_set_wanted_char(0, wanted);
 }
 
+static inline void tud_cdc_set_tx_flush_policy (uint16_t threshold, uint16_t sof_count)
+{
+  tud_cdc_n_set_tx_flush_policy(0, threshold, sof_count);
+}
+
+static inline void tud_cdc_set_rx_multi_packet (bool enabled)
+{
+  tud_cdc_n_set_rx_multi_packet(0, enabled);
+}
+
 static inline uint32_t tud_cdc_available (void)
 {
   return tud_cdc_n_available(0);
@@ -205,6 +253,7 @@ bool cdcd_open             (uint8_t rhport, tusb_desc_interface_t const * itf_de
 bool cdcd_control_request  (uint8_t rhport, tusb_control_request_t const * request);
 bool cdcd_control_complete (uint8_t rhport, tusb_control_request_t const * request);
 bool cdcd_xfer_cb          (uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes);
+void cdcd_sof              (uint8_t rhport, uint32_t frame_count);
 
 #ifdef __cplusplus
  }
@@ -52,8 +52,11 @@ typedef struct
   uint8_t tx_ff_buf[CFG_TUD_MIDI_TX_BUFSIZE];
 
   #if CFG_FIFO_MUTEX
-  osal_mutex_def_t rx_ff_mutex;
-  osal_mutex_def_t tx_ff_mutex;
+  // fifos are overwritable: producer moves read index on overflow, needs both mutexes
+  osal_mutex_def_t rx_ff_mutex_wr;
+  osal_mutex_def_t rx_ff_mutex_rd;
+  osal_mutex_def_t tx_ff_mutex_wr;
+  osal_mutex_def_t tx_ff_mutex_rd;
   #endif
 
   // We need to pack messages into words before queueing their transmission so buffer across write
@@ -234,8 +237,8 @@ void midid_init(void)
     tu_fifo_config(&midi->tx_ff, midi->tx_ff_buf, CFG_TUD_MIDI_TX_BUFSIZE, 1, true);
 
     #if CFG_FIFO_MUTEX
-    tu_fifo_config_mutex(&midi->rx_ff, osal_mutex_create(&midi->rx_ff_mutex));
-    tu_fifo_config_mutex(&midi->tx_ff, osal_mutex_create(&midi->tx_ff_mutex));
+    tu_fifo_config_mutex(&midi->rx_ff, osal_mutex_create(&midi->rx_ff_mutex_wr), osal_mutex_create(&midi->rx_ff_mutex_rd));
+    tu_fifo_config_mutex(&midi->tx_ff, osal_mutex_create(&midi->tx_ff_mutex_wr), osal_mutex_create(&midi->tx_ff_mutex_rd));
     #endif
   }
 }
@@ -65,7 +65,8 @@ typedef enum
 {
   MSC_PROTOCOL_CBI              = 0 ,  ///< Control/Bulk/Interrupt protocol (with command completion interrupt)
   MSC_PROTOCOL_CBI_NO_INTERRUPT = 1 ,  ///< Control/Bulk/Interrupt protocol (without command completion interrupt)
-  MSC_PROTOCOL_BOT              = 0x50 ///< Bulk-Only Transport
+  MSC_PROTOCOL_BOT              = 0x50,///< Bulk-Only Transport
+  MSC_PROTOCOL_UAS              = 0x62 ///< USB Attached SCSI
 }msc_protocol_type_t;
 
 /// MassStorage Class-Specific Control Request
@@ -110,6 +111,123 @@ typedef struct TU_ATTR_PACKED
 
 TU_VERIFY_STATIC(sizeof(msc_csw_t) == 13, "size is not correct");
 
+//--------------------------------------------------------------------+
+// USB Attached SCSI (UAS)
+// NOTE: All multi-byte fields in Information Units are in Big Endian
+//--------------------------------------------------------------------+
+
+/// Descriptor type of Pipe Usage descriptor following each UAS endpoint
+enum { UAS_DESC_PIPE_USAGE = 0x24 };
+
+/// UAS Pipe ID in Pipe Usage descriptor
+typedef enum
+{
+  UAS_PIPE_COMMAND  = 1,
+  UAS_PIPE_STATUS   = 2,
+  UAS_PIPE_DATA_IN  = 3,
+  UAS_PIPE_DATA_OUT = 4
+}uas_pipe_id_t;
+
+/// UAS Information Unit ID
+typedef enum
+{
+  UAS_IU_COMMAND     = 0x01,
+  UAS_IU_SENSE       = 0x03,
+  UAS_IU_RESPONSE    = 0x04,
+  UAS_IU_TASK_MGMT   = 0x05,
+  UAS_IU_READ_READY  = 0x06,
+  UAS_IU_WRITE_READY = 0x07
+}uas_iu_id_t;
+
+/// Response code of Response IU
+typedef enum
+{
+  UAS_RESPONSE_TMF_COMPLETE      = 0x00,
+  UAS_RESPONSE_INVALID_IU        = 0x02,
+  UAS_RESPONSE_TMF_NOT_SUPPORTED = 0x04,
+  UAS_RESPONSE_TMF_FAILED        = 0x05,
+  UAS_RESPONSE_TMF_SUCCEEDED     = 0x08,
+  UAS_RESPONSE_INCORRECT_LUN     = 0x09,
+  UAS_RESPONSE_OVERLAPPED_TAG    = 0x0A
+}uas_response_code_t;
+
+/// Task Management function of Task Management IU
+typedef enum
+{
+  UAS_TMF_ABORT_TASK         = 0x01,
+  UAS_TMF_ABORT_TASK_SET     = 0x02,
+  UAS_TMF_CLEAR_TASK_SET     = 0x04,
+  UAS_TMF_LOGICAL_UNIT_RESET = 0x08,
+  UAS_TMF_IT_NEXUS_RESET     = 0x10,
+  UAS_TMF_QUERY_TASK         = 0x80
+}uas_tmf_t;
+
+/// Command IU
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  iu_id       ; ///< \ref UAS_IU_COMMAND
+  uint8_t  reserved1   ;
+  uint16_t tag         ; ///< Tag identifying this command in following IUs and data transfers
+  uint8_t  prio_attr   ; ///< Task priority and attribute
+  uint8_t  reserved5   ;
+  uint8_t  add_cdb_len ; ///< Additional CDB length in dwords (bits 7..2)
+  uint8_t  reserved7   ;
+  uint8_t  lun[8]      ; ///< SAM Logical Unit Number
+  uint8_t  cdb[16]     ; ///< SCSI command
+}uas_command_iu_t;
+
+TU_VERIFY_STATIC(sizeof(uas_command_iu_t) == 32, "size is not correct");
+
+/// Task Management IU
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  iu_id     ; ///< \ref UAS_IU_TASK_MGMT
+  uint8_t  reserved1 ;
+  uint16_t tag       ;
+  uint8_t  function  ; ///< Values from \ref uas_tmf_t
+  uint8_t  reserved5 ;
+  uint16_t task_tag  ; ///< Tag of the command to be managed
+  uint8_t  lun[8]    ;
+}uas_task_mgmt_iu_t;
+
+TU_VERIFY_STATIC(sizeof(uas_task_mgmt_iu_t) == 16, "size is not correct");
+
+/// Sense IU, header of sense data completing a command
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  iu_id        ; ///< \ref UAS_IU_SENSE
+  uint8_t  reserved1    ;
+  uint16_t tag          ;
+  uint16_t status_qual  ;
+  uint8_t  status       ; ///< SCSI status: 0 Good, 2 Check Condition
+  uint8_t  reserved7[7] ;
+  uint16_t length       ; ///< Length of following sense data
+}uas_sense_iu_t;
+
+TU_VERIFY_STATIC(sizeof(uas_sense_iu_t) == 16, "size is not correct");
+
+/// Response IU, completes a Task Management function or reports an invalid IU
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  iu_id         ; ///< \ref UAS_IU_RESPONSE
+  uint8_t  reserved1     ;
+  uint16_t tag           ;
+  uint8_t  add_info[3]   ;
+  uint8_t  response_code ; ///< Values from \ref uas_response_code_t
+}uas_response_iu_t;
+
+TU_VERIFY_STATIC(sizeof(uas_response_iu_t) == 8, "size is not correct");
+
+/// Read Ready and Write Ready IU, announce data transfer of a command
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  iu_id     ; ///< \ref UAS_IU_READ_READY or \ref UAS_IU_WRITE_READY
+  uint8_t  reserved1 ;
+  uint16_t tag       ;
+}uas_ready_iu_t;
+
+TU_VERIFY_STATIC(sizeof(uas_ready_iu_t) == 4, "size is not correct");
+
 //--------------------------------------------------------------------+
 // SCSI Constant
 //--------------------------------------------------------------------+
@@ -128,6 +246,10 @@ typedef enum
   SCSI_CMD_READ_FORMAT_CAPACITY         = 0x23, ///< The command allows the Host to request a list of the possible format capacities for an installed writable media. This command also has the capability to report the writable capacity for a media when it is installed
   SCSI_CMD_READ_10                      = 0x28, ///< The READ (10) command requests that the device server read the specified logical block(s) and transfer them to the data-in buffer.
   SCSI_CMD_WRITE_10                     = 0x2A, ///< The WRITE (10) command requests thatthe device server transfer the specified logical block(s) from the data-out buffer and write them.
+  SCSI_CMD_SYNCHRONIZE_CACHE_10         = 0x35, ///< Ensures that logical blocks in the volatile cache are written to the medium.
+  SCSI_CMD_READ_16                      = 0x88, ///< Same as READ (10) with 64-bit logical block address and 32-bit transfer length.
+  SCSI_CMD_WRITE_16                     = 0x8A, ///< Same as WRITE (10) with 64-bit logical block address and 32-bit transfer length.
+  SCSI_CMD_SERVICE_ACTION_IN_16         = 0x9E, ///< Group of commands selected by service action, e.g \ref SCSI_SERVICE_ACTION_READ_CAPACITY_16
 }scsi_cmd_type_t;
 
 /// SCSI Sense Key
@@ -382,6 +504,52 @@ typedef struct TU_ATTR_PACKED
 TU_VERIFY_STATIC(sizeof(scsi_read10_t) == 10, "size is not correct");
 TU_VERIFY_STATIC(sizeof(scsi_write10_t) == 10, "size is not correct");
 
+/// SCSI Read 16 Command
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  cmd_code    ; ///< SCSI OpCode
+  uint8_t  flags       ;
+  uint64_t lba         ; ///< The first Logical Block Address (LBA) accessed by this command
+  uint32_t block_count ; ///< Number of Blocks used by this command
+  uint8_t  group_num   ;
+  uint8_t  control     ;
+} scsi_read16_t, scsi_write16_t;
+
+TU_VERIFY_STATIC(sizeof(scsi_read16_t) == 16, "size is not correct");
+TU_VERIFY_STATIC(sizeof(scsi_write16_t) == 16, "size is not correct");
+
+/// Service actions of \ref SCSI_CMD_SERVICE_ACTION_IN_16
+enum
+{
+  SCSI_SERVICE_ACTION_READ_CAPACITY_16 = 0x10
+};
+
+/// SCSI Read Capacity 16 Command
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  cmd_code       ; ///< SCSI OpCode for \ref SCSI_CMD_SERVICE_ACTION_IN_16
+  uint8_t  service_action ; ///< \ref SCSI_SERVICE_ACTION_READ_CAPACITY_16 in lower 5 bits
+  uint64_t lba            ; ///< Obsolete
+  uint32_t alloc_length   ; ///< Maximum number of bytes host expects
+  uint8_t  reserved       ;
+  uint8_t  control        ;
+} scsi_read_capacity16_t;
+
+TU_VERIFY_STATIC(sizeof(scsi_read_capacity16_t) == 16, "size is not correct");
+
+/// SCSI Read Capacity 16 Response Data
+typedef struct TU_ATTR_PACKED
+{
+  uint64_t last_lba        ; ///< The last Logical Block Address of the device
+  uint32_t block_size      ; ///< Block size in bytes
+  uint8_t  protection      ;
+  uint8_t  blocks_exponent ; ///< Logical blocks per physical block exponent
+  uint16_t lowest_aligned  ; ///< Lowest aligned Logical Block Address
+  uint8_t  reserved[16]    ;
+} scsi_read_capacity16_resp_t;
+
+TU_VERIFY_STATIC(sizeof(scsi_read_capacity16_resp_t) == 32, "size is not correct");
+
 #ifdef __cplusplus
  }
 #endif
@@ -0,0 +1,312 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "tusb_option.h"
+
+#if (TUSB_OPT_DEVICE_ENABLED && CFG_TUD_MSC)
+
+#include "common/tusb_common.h"
+#include "msc_device.h"
+
+// cache is configured by msc_cache.h
+#if CFG_TUD_MSC_CACHE_BLOCKS
+
+//--------------------------------------------------------------------+
+// MACRO CONSTANT TYPEDEF
+//--------------------------------------------------------------------+
+enum
+{
+  BLOCK_SIZE = CFG_TUD_MSC_CACHE_BLOCK_SIZE
+};
+
+typedef struct
+{
+  uint64_t lba;
+  uint32_t stamp;  // time of last access, the oldest one is evicted first
+  uint8_t  lun;
+  bool     valid;
+  bool     dirty;
+}cache_entry_t;
+
+typedef struct
+{
+  cache_entry_t entry[CFG_TUD_MSC_CACHE_BLOCKS];
+  uint32_t      stamp;
+
+  tud_msc_cache_stats_t stats;
+}msc_cache_t;
+
+static msc_cache_t _cache;
+static uint8_t _cache_data[CFG_TUD_MSC_CACHE_BLOCKS][BLOCK_SIZE];
+
+//--------------------------------------------------------------------+
+// INTERNAL OBJECT & FUNCTION DECLARATION
+//--------------------------------------------------------------------+
+
+static inline uint8_t* entry_data(cache_entry_t const* entry)
+{
+  return _cache_data[entry - _cache.entry];
+}
+
+static inline void entry_touch(cache_entry_t* entry)
+{
+  entry->stamp = ++_cache.stamp;
+}
+
+static cache_entry_t* cache_lookup(uint8_t lun, uint64_t lba)
+{
+  for(uint8_t i=0; i<CFG_TUD_MSC_CACHE_BLOCKS; i++)
+  {
+    cache_entry_t* entry = &_cache.entry[i];
+    if ( entry->valid && entry->lun == lun && entry->lba == lba ) return entry;
+  }
+
+  return NULL;
+}
+
+// Only LUNs whose block matches cache block are cached, block size is kept in LUN state
+static bool lun_cacheable(uint8_t lun)
+{
+  return mscd_get_block_size(lun) == BLOCK_SIZE;
+}
+
+// Write dirty block to application, which must write it right away
+static bool entry_write_back(cache_entry_t* entry)
+{
+  uint32_t offset = 0;
+
+  while ( offset < BLOCK_SIZE )
+  {
+    int32_t nbytes = mscd_app_write(entry->lun, entry->lba, offset, entry_data(entry) + offset, BLOCK_SIZE - offset);
+
+    // error, not ready or asynchronous write: keep it dirty
+    if ( nbytes <= 0 ) return false;
+
+    offset += (uint32_t) nbytes;
+  }
+
+  entry->dirty = false;
+  _cache.stats.write_back++;
+  _cache.stats.dirty--;
+
+  return true;
+}
+
+// Get an entry for new block: free one first, then least recently used clean one.
+// Least recently used dirty one is written back only if allowed.
+static cache_entry_t* cache_alloc(uint8_t lun, uint64_t lba, bool allow_write_back)
+{
+  cache_entry_t* clean = NULL;
+  cache_entry_t* dirty = NULL;
+
+  for(uint8_t i=0; i<CFG_TUD_MSC_CACHE_BLOCKS; i++)
+  {
+    cache_entry_t* entry = &_cache.entry[i];
+
+    if ( !entry->valid )
+    {
+      clean = entry;
+      break;
+    }
+
+    // stamp wraps around, compare the distance
+    cache_entry_t** lru = entry->dirty ? &dirty : &clean;
+    if ( !(*lru) || (int32_t) (entry->stamp - (*lru)->stamp) < 0 ) *lru = entry;
+  }
+
+  cache_entry_t* entry = clean;
+
+  if ( !entry )
+  {
+    if ( !allow_write_back || !entry_write_back(dirty) ) return NULL;
+    entry = dirty;
+  }
+
+  entry->valid = true;
+  entry->dirty = false;
+  entry->lun   = lun;
+  entry->lba   = lba;
+  entry_touch(entry);
+
+  return entry;
+}
+
+// Number of bytes from (lba, offset) before the first cached block, up to bufsize
+static uint32_t uncached_len(uint8_t lun, uint64_t lba, uint32_t offset, uint32_t bufsize)
+{
+  uint32_t len = 0;
+
+  while ( len < bufsize )
+  {
+    uint32_t const pos = offset + len;
+    if ( cache_lookup(lun, lba + pos / BLOCK_SIZE) ) break;
+
+    len += tu_min32(BLOCK_SIZE - (pos % BLOCK_SIZE), bufsize - len);
+  }
+
+  return len;
+}
+
+//--------------------------------------------------------------------+
+// Cache API
+//--------------------------------------------------------------------+
+
+// Serve leading cached blocks, otherwise read from application up to the next cached block
+// so that dirty blocks are never read back stale from the medium.
+int32_t mscd_cache_read(uint8_t lun, uint64_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+{
+  if ( !lun_cacheable(lun) ) return mscd_app_read(lun, lba, offset, buffer, bufsize);
+
+  uint32_t count = 0;
+
+  while ( count < bufsize )
+  {
+    uint32_t const pos = offset + count;
+    cache_entry_t* entry = cache_lookup(lun, lba + pos / BLOCK_SIZE);
+    if ( !entry ) break;
+
+    uint32_t const nbytes = tu_min32(BLOCK_SIZE - (pos % BLOCK_SIZE), bufsize - count);
+    memcpy(buffer + count, entry_data(entry) + (pos % BLOCK_SIZE), nbytes);
+    entry_touch(entry);
+
+    _cache.stats.hit++;
+    count += nbytes;
+  }
+
+  if ( count ) return (int32_t) count;
+
+  int32_t const nread = mscd_app_read(lun, lba, offset, buffer, uncached_len(lun, lba, offset, bufsize));
+  if ( nread <= 0 ) return nread;
+
+  _cache.stats.miss += ((offset % BLOCK_SIZE) + (uint32_t) nread + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+  // Keep the whole blocks read, reads never write back to make room
+  uint32_t const first = (offset + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  uint32_t const last  = (offset + (uint32_t) nread) / BLOCK_SIZE;
+
+  for(uint32_t i=first; i<last; i++)
+  {
+    cache_entry_t* entry = cache_alloc(lun, lba + i, false);
+    if ( !entry ) break;
+
+    memcpy(entry_data(entry), buffer + (i*BLOCK_SIZE - offset), BLOCK_SIZE);
+  }
+
+  return nread;
+}
+
+// Write into cache: cached blocks are updated, whole blocks allocate an entry. Partial write of
+// an uncached block goes to application directly.
+int32_t mscd_cache_write(uint8_t lun, uint64_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+{
+  if ( !lun_cacheable(lun) ) return mscd_app_write(lun, lba, offset, buffer, bufsize);
+
+  uint32_t count = 0;
+
+  while ( count < bufsize )
+  {
+    uint32_t const pos    = offset + count;
+    uint32_t const ofs    = pos % BLOCK_SIZE;
+    uint32_t const nbytes = tu_min32(BLOCK_SIZE - ofs, bufsize - count);
+
+    cache_entry_t* entry = cache_lookup(lun, lba + pos / BLOCK_SIZE);
+
+    if ( entry )
+    {
+      entry_touch(entry);
+    }
+    else if ( nbytes == BLOCK_SIZE )
+    {
+      entry = cache_alloc(lun, lba + pos / BLOCK_SIZE, true);
+    }
+
+    if ( !entry ) break;
+
+    memcpy(entry_data(entry) + ofs, buffer + count, nbytes);
+
+    if ( !entry->dirty )
+    {
+      entry->dirty = true;
+      _cache.stats.dirty++;
+    }
+
+    count += nbytes;
+  }
+
+  if ( count ) return (int32_t) count;
+
+  return mscd_app_write(lun, lba, offset, buffer, uncached_len(lun, lba, offset, bufsize));
+}
+
+bool mscd_cache_flush(uint8_t lun)
+{
+  bool ret = true;
+
+  for(uint8_t i=0; i<CFG_TUD_MSC_CACHE_BLOCKS; i++)
+  {
+    cache_entry_t* entry = &_cache.entry[i];
+
+    if ( entry->valid && entry->dirty && entry->lun == lun )
+    {
+      if ( !entry_write_back(entry) ) ret = false;
+    }
+  }
+
+  return ret;
+}
+
+void mscd_cache_invalidate(uint8_t lun)
+{
+  for(uint8_t i=0; i<CFG_TUD_MSC_CACHE_BLOCKS; i++)
+  {
+    cache_entry_t* entry = &_cache.entry[i];
+
+    if ( entry->valid && entry->lun == lun )
+    {
+      if ( entry->dirty ) _cache.stats.dirty--;
+
+      entry->valid = false;
+      entry->dirty = false;
+    }
+  }
+}
+
+//--------------------------------------------------------------------+
+// APPLICATION API
+//--------------------------------------------------------------------+
+bool tud_msc_cache_flush(uint8_t lun)
+{
+  return mscd_cache_flush(lun);
+}
+
+void tud_msc_cache_get_stats(tud_msc_cache_stats_t* stats)
+{
+  (*stats) = _cache.stats;
+}
+
+#endif
+
+#endif
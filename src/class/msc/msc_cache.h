@@ -0,0 +1,96 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _TUSB_MSC_CACHE_H_
+#define _TUSB_MSC_CACHE_H_
+
+#include "common/tusb_common.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// Configuration
+//--------------------------------------------------------------------+
+
+// Number of blocks in write-back cache between host and READ/WRITE callbacks, 0 to disable.
+// Least recently used block is evicted first, dirty blocks are written back on SYNCHRONIZE CACHE,
+// START STOP UNIT, first TEST UNIT READY after bus reset or tud_msc_cache_flush().
+// Only LUNs with CFG_TUD_MSC_CACHE_BLOCK_SIZE blocks are cached, their callbacks must not return
+// TUD_MSC_RET_ASYNC.
+#ifndef CFG_TUD_MSC_CACHE_BLOCKS
+  #define CFG_TUD_MSC_CACHE_BLOCKS      0
+#endif
+
+#ifndef CFG_TUD_MSC_CACHE_BLOCK_SIZE
+  #define CFG_TUD_MSC_CACHE_BLOCK_SIZE  512
+#endif
+
+TU_VERIFY_STATIC(CFG_TUD_MSC_CACHE_BLOCKS < 256, "Cache block count is not correct");
+
+#if CFG_TUD_MSC_CACHE_BLOCKS
+
+/** \addtogroup ClassDriver_MSC
+ *  @{
+ * \defgroup MSC_Cache Block Cache
+ *  @{ */
+
+typedef struct
+{
+  uint32_t hit;        ///< blocks read from cache
+  uint32_t miss;       ///< blocks read from application
+  uint32_t write_back; ///< dirty blocks written to application
+  uint16_t dirty;      ///< blocks currently waiting to be written back
+}tud_msc_cache_stats_t;
+
+// Write back dirty blocks of LUN e.g before going to sleep, return false if application failed to write
+bool tud_msc_cache_flush(uint8_t lun);
+
+// Get block cache counters
+void tud_msc_cache_get_stats(tud_msc_cache_stats_t* stats);
+
+/** @} */
+/** @} */
+
+//--------------------------------------------------------------------+
+// Internal API, used by MSC driver in place of READ/WRITE callbacks
+//--------------------------------------------------------------------+
+
+// Same return value as application callbacks, may consume less than bufsize
+int32_t mscd_cache_read      (uint8_t lun, uint64_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize);
+int32_t mscd_cache_write     (uint8_t lun, uint64_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize);
+
+bool    mscd_cache_flush     (uint8_t lun);
+void    mscd_cache_invalidate(uint8_t lun);
+
+#endif
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _TUSB_MSC_CACHE_H_ */
@@ -42,12 +42,38 @@ enum
   MSC_STAGE_STATUS
 };
 
+// Application callback results cached in mscd_lun_t
+enum
+{
+  MSC_LUN_CACHED_READY    = 0x01,
+  MSC_LUN_CACHED_WRITABLE = 0x02,
+  MSC_LUN_CACHED_CAPACITY = 0x04
+};
+
+typedef struct
+{
+  // Sense Response Data
+  uint8_t  sense_key;
+  uint8_t  add_sense_code;
+  uint8_t  add_sense_qualifier;
+
+  uint8_t  cached;      // MSC_LUN_CACHED_* of valid entries below
+  bool     writable;
+  uint32_t block_size;
+  uint64_t block_count;
+
+#if CFG_TUD_MSC_CACHE_BLOCKS
+  bool     flush_pending; // dirty blocks left by bus reset, written back on next TEST UNIT READY
+#endif
+}mscd_lun_t;
+
 typedef struct
 {
   // TODO optimize alignment
   CFG_TUSB_MEM_ALIGN msc_cbw_t cbw;
   CFG_TUSB_MEM_ALIGN msc_csw_t csw;
 
+  uint8_t  rhport;
   uint8_t  itf_num;
   uint8_t  ep_in;
   uint8_t  ep_out;
@@ -57,56 +83,306 @@ typedef struct
   uint32_t total_len;
   uint32_t xferred_len; // numbered of bytes transferred so far in the Data Stage
 
-  // Sense Response Data
-  uint8_t sense_key;
-  uint8_t add_sense_code;
-  uint8_t add_sense_qualifier;
+  // READ/WRITE pipeline: buffers are used as a ring, one is on the bus while the others
+  // are filled (READ) or drained (WRITE) by application
+  uint32_t app_len;    // number of bytes read or written by application callback so far
+  uint16_t buf_len[CFG_TUD_MSC_BUF_COUNT];
+  uint16_t buf_ofs;    // bytes of oldest buffer already consumed by write callback
+  uint8_t  buf_rd;     // oldest buffer in use
+  uint8_t  buf_count;  // number of buffers in use, including the one on the bus
+  bool     xfer_busy;  // data transfer in progress on the bus
+  bool     app_failed; // read callback returned error
+
+  // Asynchronous read/write request, completed by tud_msc_async_done()
+  bool             async_pending;
+  volatile int32_t async_len;
+  uint32_t         async_seq;  // identifies current request, advanced for each callback and on reset
+
+  mscd_lun_t lun[CFG_TUD_MSC_MAX_LUN];
 }mscd_interface_t;
 
 CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static mscd_interface_t _mscd_itf;
-CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static uint8_t _mscd_buf[CFG_TUD_MSC_BUFSIZE];
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static uint8_t _mscd_buf[CFG_TUD_MSC_BUF_COUNT][CFG_TUD_MSC_BUFSIZE];
 
 //--------------------------------------------------------------------+
 // INTERNAL OBJECT & FUNCTION DECLARATION
 //--------------------------------------------------------------------+
-static void proc_read10_cmd(uint8_t rhport, mscd_interface_t* p_msc);
-static void proc_write10_cmd(uint8_t rhport, mscd_interface_t* p_msc);
+static void proc_read_cmd(uint8_t rhport, mscd_interface_t* p_msc);
+static void proc_write_cmd(uint8_t rhport, mscd_interface_t* p_msc);
+static void proc_write_data(uint8_t rhport, mscd_interface_t* p_msc);
+static bool read_result(uint8_t rhport, mscd_interface_t* p_msc, uint8_t idx, int32_t nbytes);
+static bool write_result(uint8_t rhport, mscd_interface_t* p_msc, int32_t nbytes);
+static void proc_status_stage(uint8_t rhport, mscd_interface_t* p_msc);
+
+//--------------------------------------------------------------------+
+// SCSI helpers, also used by UAS driver
+//--------------------------------------------------------------------+
+uint64_t mscd_rdwr_get_lba(uint8_t const command[])
+{
+  if ( (command[0] == SCSI_CMD_READ_16) || (command[0] == SCSI_CMD_WRITE_16) )
+  {
+    // read16 & write16 has the same format
+    scsi_write16_t const* p_rdwr16 = (scsi_write16_t const*) command;
+
+    // lba is in Big Endian format, read byte-wise to prevent mis-aligned access
+    uint8_t const* p_lba = (uint8_t const*) &p_rdwr16->lba;
+    uint64_t lba = 0;
+    for(uint8_t i=0; i<8; i++) lba = (lba << 8) | p_lba[i];
+
+    return lba;
+  }
+  else
+  {
+    // read10 & write10 has the same format
+    scsi_write10_t const* p_rdwr10 = (scsi_write10_t const*) command;
+
+    // copy first to prevent mis-aligned access
+    uint32_t lba;
+    memcpy(&lba, &p_rdwr10->lba, 4);
+
+    // lba is in Big Endian format
+    return tu_ntohl(lba);
+  }
+}
+
+uint32_t mscd_rdwr_get_blockcount(uint8_t const command[])
+{
+  if ( (command[0] == SCSI_CMD_READ_16) || (command[0] == SCSI_CMD_WRITE_16) )
+  {
+    scsi_write16_t const* p_rdwr16 = (scsi_write16_t const*) command;
+
+    // copy first to prevent mis-aligned access
+    uint32_t block_count;
+    memcpy(&block_count, &p_rdwr16->block_count, 4);
+
+    return tu_ntohl(block_count);
+  }
+  else
+  {
+    scsi_write10_t const* p_rdwr10 = (scsi_write10_t const*) command;
+
+    // copy first to prevent mis-aligned access
+    uint16_t block_count;
+    memcpy(&block_count, &p_rdwr10->block_count, 2);
+
+    return tu_ntohs(block_count);
+  }
+}
+
+// 64-bit lba is only passed to application implementing the 64-bit callbacks
+int32_t mscd_app_read(uint8_t lun, uint64_t lba, uint32_t offset, void* buffer, uint32_t bufsize)
+{
+  if ( tud_msc_read16_cb ) return tud_msc_read16_cb(lun, lba, offset, buffer, bufsize);
+
+  TU_VERIFY(lba <= UINT32_MAX, -1);
+  return tud_msc_read10_cb(lun, (uint32_t) lba, offset, buffer, bufsize);
+}
+
+int32_t mscd_app_write(uint8_t lun, uint64_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+{
+  if ( tud_msc_write16_cb ) return tud_msc_write16_cb(lun, lba, offset, buffer, bufsize);
+
+  TU_VERIFY(lba <= UINT32_MAX, -1);
+  return tud_msc_write10_cb(lun, (uint32_t) lba, offset, buffer, bufsize);
+}
+
+// READ/WRITE data goes through block cache if enabled
+int32_t mscd_read_cb(uint8_t lun, uint64_t lba, uint32_t offset, void* buffer, uint32_t bufsize)
+{
+#if CFG_TUD_MSC_CACHE_BLOCKS
+  return mscd_cache_read(lun, lba, offset, (uint8_t*) buffer, bufsize);
+#else
+  return mscd_app_read(lun, lba, offset, buffer, bufsize);
+#endif
+}
+
+int32_t mscd_write_cb(uint8_t lun, uint64_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+{
+#if CFG_TUD_MSC_CACHE_BLOCKS
+  return mscd_cache_write(lun, lba, offset, buffer, bufsize);
+#else
+  return mscd_app_write(lun, lba, offset, buffer, bufsize);
+#endif
+}
+
+void mscd_get_capacity(uint8_t lun, uint64_t* block_count, uint32_t* block_size)
+{
+  *block_count = 0;
+  *block_size  = 0;
+  TU_VERIFY(lun < CFG_TUD_MSC_MAX_LUN, );
+
+  mscd_lun_t* p_lun = &_mscd_itf.lun[lun];
+
+  if ( !(p_lun->cached & MSC_LUN_CACHED_CAPACITY) )
+  {
+    if ( tud_msc_capacity16_cb )
+    {
+      tud_msc_capacity16_cb(lun, block_count, block_size);
+    }
+    else
+    {
+      uint32_t block_count_u32;
+      uint16_t block_size_u16;
+
+      tud_msc_capacity_cb(lun, &block_count_u32, &block_size_u16);
+
+      *block_count = block_count_u32;
+      *block_size  = block_size_u16;
+    }
+
+    // zero capacity usually means no medium, ask again next time
+    if ( (*block_count == 0) || (*block_size == 0) ) return;
+
+    p_lun->block_count = *block_count;
+    p_lun->block_size  = *block_size;
+    p_lun->cached     |= MSC_LUN_CACHED_CAPACITY;
+  }
+
+  *block_count = p_lun->block_count;
+  *block_size  = p_lun->block_size;
+}
+
+uint32_t mscd_get_block_size(uint8_t lun)
+{
+  TU_VERIFY(lun < CFG_TUD_MSC_MAX_LUN, 0);
+
+  mscd_lun_t const* p_lun = &_mscd_itf.lun[lun];
+  if ( p_lun->cached & MSC_LUN_CACHED_CAPACITY ) return p_lun->block_size;
+
+  uint64_t block_count;
+  uint32_t block_size;
+  mscd_get_capacity(lun, &block_count, &block_size);
+
+  return block_size;
+}
+
+bool mscd_is_writable(uint8_t lun)
+{
+  TU_VERIFY(lun < CFG_TUD_MSC_MAX_LUN);
+
+  mscd_lun_t* p_lun = &_mscd_itf.lun[lun];
 
-static inline uint32_t rdwr10_get_lba(uint8_t const command[])
+  if ( !(p_lun->cached & MSC_LUN_CACHED_WRITABLE) )
+  {
+    p_lun->writable = tud_msc_is_writable_cb ? tud_msc_is_writable_cb(lun) : true;
+    p_lun->cached  |= MSC_LUN_CACHED_WRITABLE;
+  }
+
+  return p_lun->writable;
+}
+
+// Only ready state is cached: host keeps polling a LUN which is not ready
+static bool lun_is_ready(uint8_t lun)
 {
-  // read10 & write10 has the same format
-  scsi_write10_t* p_rdwr10 = (scsi_write10_t*) command;
+  mscd_lun_t* p_lun = &_mscd_itf.lun[lun];
 
-  // copy first to prevent mis-aligned access
-  uint32_t lba;
-  memcpy(&lba, &p_rdwr10->lba, 4);
+  if ( !(p_lun->cached & MSC_LUN_CACHED_READY) )
+  {
+    if ( !tud_msc_test_unit_ready_cb(lun) ) return false;
+    p_lun->cached |= MSC_LUN_CACHED_READY;
+  }
 
-  // lba is in Big Endian format
-  return tu_ntohl(lba);
+  return true;
 }
 
-static inline uint16_t rdwr10_get_blockcount(uint8_t const command[])
+#if CFG_TUD_MSC_CACHE_BLOCKS
+// Write back dirty blocks, Write Error sense on failure
+static bool lun_cache_flush(uint8_t lun)
 {
-  // read10 & write10 has the same format
-  scsi_write10_t* p_rdwr10 = (scsi_write10_t*) command;
+  mscd_lun_t* p_lun = &_mscd_itf.lun[lun];
 
-  // copy first to prevent mis-aligned access
-  uint16_t block_count;
-  memcpy(&block_count, &p_rdwr10->block_count, 2);
+  if ( !mscd_cache_flush(lun) )
+  {
+    tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00); // Write Error
+    return false;
+  }
 
-  return tu_ntohs(block_count);
+  p_lun->flush_pending = false;
+  return true;
 }
+#endif
 
 //--------------------------------------------------------------------+
 // APPLICATION API
 //--------------------------------------------------------------------+
 bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code, uint8_t add_sense_qualifier)
 {
-  (void) lun;
+  TU_VERIFY(lun < CFG_TUD_MSC_MAX_LUN);
+
+  mscd_lun_t* p_lun = &_mscd_itf.lun[lun];
 
-  _mscd_itf.sense_key           = sense_key;
-  _mscd_itf.add_sense_code      = add_sense_code;
-  _mscd_itf.add_sense_qualifier = add_sense_qualifier;
+  p_lun->sense_key           = sense_key;
+  p_lun->add_sense_code      = add_sense_code;
+  p_lun->add_sense_qualifier = add_sense_qualifier;
+
+  return true;
+}
+
+void tud_msc_lun_invalidate(uint8_t lun)
+{
+  TU_VERIFY(lun < CFG_TUD_MSC_MAX_LUN, );
+  _mscd_itf.lun[lun].cached = 0;
+
+#if CFG_TUD_MSC_CACHE_BLOCKS
+  // blocks of previous medium are dropped, even if not yet written
+  mscd_cache_invalidate(lun);
+#endif
+}
+
+void mscd_get_sense(uint8_t lun, uint8_t* sense_key, uint8_t* add_sense_code, uint8_t* add_sense_qualifier)
+{
+  if ( lun >= CFG_TUD_MSC_MAX_LUN )
+  {
+    // Illegal Request, Logical Unit Not Supported
+    *sense_key           = SCSI_SENSE_ILLEGAL_REQUEST;
+    *add_sense_code      = 0x25;
+    *add_sense_qualifier = 0x00;
+    return;
+  }
+
+  mscd_lun_t const* p_lun = &_mscd_itf.lun[lun];
+
+  *sense_key           = p_lun->sense_key;
+  *add_sense_code      = p_lun->add_sense_code;
+  *add_sense_qualifier = p_lun->add_sense_qualifier;
+}
+
+// Resume BOT state machine in usbd task with result of an asynchronous request
+static void async_resume(void* param)
+{
+  mscd_interface_t* p_msc = &_mscd_itf;
+  uint8_t const rhport = p_msc->rhport;
+
+  // stale completion e.g interface is reset meanwhile and a new request may be pending already
+  if ( ((uint32_t) (uintptr_t) param) != p_msc->async_seq ) return;
+  if ( !p_msc->async_pending || (p_msc->stage != MSC_STAGE_DATA) ) return;
+
+  p_msc->async_pending = false;
+
+  if ( mscd_is_read_cmd(p_msc->cbw.command[0]) )
+  {
+    // pending request is always for the buffer following the ones in use
+    uint8_t const idx = (p_msc->buf_rd + p_msc->buf_count) % CFG_TUD_MSC_BUF_COUNT;
+
+    read_result(rhport, p_msc, idx, p_msc->async_len);
+    proc_read_cmd(rhport, p_msc);
+  }
+  else
+  {
+    write_result(rhport, p_msc, p_msc->async_len);
+    if ( p_msc->stage == MSC_STAGE_DATA ) proc_write_data(rhport, p_msc);
+  }
+
+  if ( p_msc->stage == MSC_STAGE_STATUS ) proc_status_stage(rhport, p_msc);
+}
+
+bool tud_msc_async_done(uint8_t lun, int32_t nbytes, bool in_isr)
+{
+  TU_VERIFY(lun == _mscd_itf.cbw.lun);
+
+  // request may complete before its callback even returns, state is only checked in usbd task
+  _mscd_itf.async_len = nbytes;
+  usbd_defer_func(async_resume, (void*) (uintptr_t) _mscd_itf.async_seq, in_isr);
 
   return true;
 }
@@ -122,13 +398,23 @@ void mscd_init(void)
 void mscd_reset(uint8_t rhport)
 {
   (void) rhport;
+
+  // completion of a request pending before reset must not be taken for a later one
+  uint32_t const async_seq = _mscd_itf.async_seq;
   tu_memclr(&_mscd_itf, sizeof(mscd_interface_t));
+  _mscd_itf.async_seq = async_seq + 1;
+
+#if CFG_TUD_MSC_CACHE_BLOCKS
+  // host may not come back to synchronize the cache, but don't block reset with application writes:
+  // write back on next TEST UNIT READY, hosts keep polling it
+  for(uint8_t lun=0; lun<CFG_TUD_MSC_MAX_LUN; lun++) _mscd_itf.lun[lun].flush_pending = true;
+#endif
 }
 
 bool mscd_open(uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint16_t *p_len)
 {
-  // only support SCSI's BOT protocol
-  TU_ASSERT(MSC_SUBCLASS_SCSI == itf_desc->bInterfaceSubClass &&
+  // only support SCSI's BOT protocol, UAS is handled by its own driver
+  TU_VERIFY(MSC_SUBCLASS_SCSI == itf_desc->bInterfaceSubClass &&
             MSC_PROTOCOL_BOT  == itf_desc->bInterfaceProtocol);
 
   mscd_interface_t * p_msc = &_mscd_itf;
@@ -136,6 +422,7 @@ bool mscd_open(uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint16_t
   // Open endpoint pair
   TU_ASSERT( usbd_open_edpt_pair(rhport, tu_desc_next(itf_desc), 2, TUSB_XFER_BULK, &p_msc->ep_out, &p_msc->ep_in) );
 
+  p_msc->rhport  = rhport;
   p_msc->itf_num = itf_desc->bInterfaceNumber;
   (*p_len) = sizeof(tusb_desc_interface_t) + 2*sizeof(tusb_desc_endpoint_t);
 
@@ -165,6 +452,9 @@ bool mscd_control_request(uint8_t rhport, tusb_control_request_t const * p_reque
       if (tud_msc_get_maxlun_cb) maxlun = tud_msc_get_maxlun_cb();
       TU_VERIFY(maxlun);
 
+      // each LUN needs its own state, increase CFG_TUD_MSC_MAX_LUN
+      TU_ASSERT(maxlun <= CFG_TUD_MSC_MAX_LUN);
+
       // MAX LUN is minus 1 by specs
       maxlun--;
 
@@ -191,28 +481,52 @@ bool mscd_control_complete(uint8_t rhport, tusb_control_request_t const * reques
 
 // return response's length (copied to buffer). Negative if it is not an built-in command or indicate Failed status (CSW)
 // In case of a failed status, sense key must be set for reason of failure
-int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_t* buffer, uint32_t bufsize)
+int32_t mscd_proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_t* buffer, uint32_t bufsize)
 {
   (void) bufsize; // TODO refractor later
   int32_t resplen;
 
+  TU_VERIFY(lun < CFG_TUD_MSC_MAX_LUN, -1);
+  mscd_lun_t* p_lun = &_mscd_itf.lun[lun];
+
   switch ( scsi_cmd[0] )
   {
     case SCSI_CMD_TEST_UNIT_READY:
       resplen = 0;
-      if ( !tud_msc_test_unit_ready_cb(lun) )
+
+#if CFG_TUD_MSC_CACHE_BLOCKS
+      if ( p_lun->flush_pending && !lun_cache_flush(lun) )
+      {
+        resplen = -1;
+        break;
+      }
+#endif
+
+      if ( !lun_is_ready(lun) )
       {
         // Failed status response
         resplen = - 1;
 
         // If sense key is not set by callback, default to Logical Unit Not Ready, Cause Not Reportable
-        if ( _mscd_itf.sense_key == 0 ) tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x04, 0x00);
+        if ( p_lun->sense_key == 0 ) tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x04, 0x00);
       }
     break;
 
     case SCSI_CMD_START_STOP_UNIT:
       resplen = 0;
 
+#if CFG_TUD_MSC_CACHE_BLOCKS
+      // medium may be ejected or powered down, write back first
+      if ( !lun_cache_flush(lun) )
+      {
+        resplen = -1;
+        break;
+      }
+#endif
+
+      // medium may be loaded or ejected
+      tud_msc_lun_invalidate(lun);
+
       if (tud_msc_start_stop_cb)
       {
         scsi_start_stop_unit_t const * start_stop = (scsi_start_stop_unit_t const *) scsi_cmd;
@@ -222,19 +536,24 @@ int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_t* buff
           resplen = - 1;
 
           // If sense key is not set by callback, default to Logical Unit Not Ready, Cause Not Reportable
-          if ( _mscd_itf.sense_key == 0 ) tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x04, 0x00);
+          if ( p_lun->sense_key == 0 ) tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x04, 0x00);
         }
       }
     break;
 
+#if CFG_TUD_MSC_CACHE_BLOCKS
+    case SCSI_CMD_SYNCHRONIZE_CACHE_10:
+      resplen = 0;
+      if ( !lun_cache_flush(lun) ) resplen = -1;
+    break;
+#endif
+
     case SCSI_CMD_READ_CAPACITY_10:
     {
-      uint32_t block_count;
+      uint64_t block_count;
       uint32_t block_size;
-      uint16_t block_size_u16;
 
-      tud_msc_capacity_cb(lun, &block_count, &block_size_u16);
-      block_size = (uint32_t) block_size_u16;
+      mscd_get_capacity(lun, &block_count, &block_size);
 
       // Invalid block size/count from callback, possibly unit is not ready
       // stall this request, set sense key to NOT READY
@@ -243,12 +562,15 @@ int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_t* buff
         resplen = -1;
 
         // If sense key is not set by callback, default to Logical Unit Not Ready, Cause Not Reportable
-        if ( _mscd_itf.sense_key == 0 ) tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x04, 0x00);
+        if ( p_lun->sense_key == 0 ) tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x04, 0x00);
       }else
       {
         scsi_read_capacity10_resp_t read_capa10;
 
-        read_capa10.last_lba = tu_htonl(block_count-1);
+        // too large for 32-bit lba: report maximum so that host uses READ CAPACITY (16)
+        uint32_t const last_lba = (block_count > UINT32_MAX) ? UINT32_MAX : (uint32_t) (block_count-1);
+
+        read_capa10.last_lba = tu_htonl(last_lba);
         read_capa10.block_size = tu_htonl(block_size);
 
         resplen = sizeof(read_capa10);
@@ -257,6 +579,50 @@ int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_t* buff
     }
     break;
 
+    case SCSI_CMD_SERVICE_ACTION_IN_16:
+    {
+      scsi_read_capacity16_t const * read_capa16_cmd = (scsi_read_capacity16_t const *) scsi_cmd;
+
+      if ( (read_capa16_cmd->service_action & 0x1F) != SCSI_SERVICE_ACTION_READ_CAPACITY_16 )
+      {
+        resplen = -1;
+        break;
+      }
+
+      uint64_t block_count;
+      uint32_t block_size;
+
+      mscd_get_capacity(lun, &block_count, &block_size);
+
+      // Invalid block size/count from callback, possibly unit is not ready
+      // stall this request, set sense key to NOT READY
+      if (block_count == 0 || block_size == 0)
+      {
+        resplen = -1;
+
+        // If sense key is not set by callback, default to Logical Unit Not Ready, Cause Not Reportable
+        if ( p_lun->sense_key == 0 ) tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x04, 0x00);
+      }else
+      {
+        scsi_read_capacity16_resp_t read_capa16;
+        tu_memclr(&read_capa16, sizeof(read_capa16));
+
+        // Big Endian
+        uint64_t const last_lba = block_count - 1;
+        uint8_t* p_lba = (uint8_t*) &read_capa16.last_lba;
+        for(uint8_t i=0; i<8; i++) p_lba[i] = (uint8_t) (last_lba >> (56 - 8*i));
+
+        read_capa16.block_size = tu_htonl(block_size);
+
+        uint32_t alloc_length;
+        memcpy(&alloc_length, &read_capa16_cmd->alloc_length, 4);
+
+        resplen = (int32_t) tu_min32(sizeof(read_capa16), tu_ntohl(alloc_length));
+        memcpy(buffer, &read_capa16, resplen);
+      }
+    }
+    break;
+
     case SCSI_CMD_READ_FORMAT_CAPACITY:
     {
       scsi_read_format_capacity_data_t read_fmt_capa =
@@ -267,10 +633,10 @@ int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_t* buff
           .block_size_u16  = 0
       };
 
-      uint32_t block_count;
-      uint16_t block_size;
+      uint64_t block_count;
+      uint32_t block_size;
 
-      tud_msc_capacity_cb(lun, &block_count, &block_size);
+      mscd_get_capacity(lun, &block_count, &block_size);
 
       // Invalid block size/count from callback, possibly unit is not ready
       // stall this request, set sense key to NOT READY
@@ -279,11 +645,11 @@ int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_t* buff
         resplen = -1;
 
         // If sense key is not set by callback, default to Logical Unit Not Ready, Cause Not Reportable
-        if ( _mscd_itf.sense_key == 0 ) tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x04, 0x00);
+        if ( p_lun->sense_key == 0 ) tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x04, 0x00);
       }else
       {
-        read_fmt_capa.block_num = tu_htonl(block_count);
-        read_fmt_capa.block_size_u16 = tu_htons(block_size);
+        read_fmt_capa.block_num = tu_htonl((block_count > UINT32_MAX) ? UINT32_MAX : (uint32_t) block_count);
+        read_fmt_capa.block_size_u16 = tu_htons((uint16_t) block_size);
 
         resplen = sizeof(read_fmt_capa);
         memcpy(buffer, &read_fmt_capa, resplen);
@@ -323,11 +689,7 @@ int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_t* buff
           .block_descriptor_len = 0  // no block descriptor are included
       };
 
-      bool writable = true;
-      if (tud_msc_is_writable_cb) {
-          writable = tud_msc_is_writable_cb(lun);
-      }
-      mode_resp.write_protected = !writable;
+      mode_resp.write_protected = !mscd_is_writable(lun);
 
       resplen = sizeof(mode_resp);
       memcpy(buffer, &mode_resp, resplen);
@@ -344,9 +706,9 @@ int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_t* buff
 
       sense_rsp.add_sense_len = sizeof(scsi_sense_fixed_resp_t) - 8;
 
-      sense_rsp.sense_key           = _mscd_itf.sense_key;
-      sense_rsp.add_sense_code      = _mscd_itf.add_sense_code;
-      sense_rsp.add_sense_qualifier = _mscd_itf.add_sense_qualifier;
+      sense_rsp.sense_key           = p_lun->sense_key;
+      sense_rsp.add_sense_code      = p_lun->add_sense_code;
+      sense_rsp.add_sense_qualifier = p_lun->add_sense_qualifier;
 
       resplen = sizeof(sense_rsp);
       memcpy(buffer, &sense_rsp, resplen);
@@ -376,7 +738,8 @@ bool mscd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t
       if(ep_addr != p_msc->ep_out) return true;
 
       TU_ASSERT( event == XFER_RESULT_SUCCESS &&
-                 xferred_bytes == sizeof(msc_cbw_t) && p_cbw->signature == MSC_CBW_SIGNATURE );
+                 xferred_bytes == sizeof(msc_cbw_t) && p_cbw->signature == MSC_CBW_SIGNATURE &&
+                 p_cbw->lun < CFG_TUD_MSC_MAX_LUN );
 
       p_csw->signature    = MSC_CSW_SIGNATURE;
       p_csw->tag          = p_cbw->tag;
@@ -387,13 +750,21 @@ bool mscd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t
       p_msc->total_len = p_cbw->total_bytes;
       p_msc->xferred_len = 0;
 
-      if (SCSI_CMD_READ_10 == p_cbw->command[0])
+      p_msc->app_len    = 0;
+      p_msc->buf_ofs    = 0;
+      p_msc->buf_rd     = 0;
+      p_msc->buf_count  = 0;
+      p_msc->xfer_busy  = false;
+      p_msc->app_failed = false;
+      p_msc->async_pending = false;
+
+      if ( mscd_is_read_cmd(p_cbw->command[0]) )
       {
-        proc_read10_cmd(rhport, p_msc);
+        proc_read_cmd(rhport, p_msc);
       }
-      else if (SCSI_CMD_WRITE_10 == p_cbw->command[0])
+      else if ( mscd_is_write_cmd(p_cbw->command[0]) )
       {
-        proc_write10_cmd(rhport, p_msc);
+        proc_write_cmd(rhport, p_msc);
       }
       else
       {
@@ -403,18 +774,18 @@ bool mscd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t
         if ( (p_cbw->total_bytes > 0 ) && !tu_bit_test(p_cbw->dir, 7) )
         {
           // queue transfer
-          TU_ASSERT( usbd_edpt_xfer(rhport, p_msc->ep_out, _mscd_buf, p_msc->total_len) );
+          TU_ASSERT( usbd_edpt_xfer(rhport, p_msc->ep_out, _mscd_buf[0], p_msc->total_len) );
         }else
         {
           int32_t resplen;
 
           // First process if it is a built-in commands
-          resplen = proc_builtin_scsi(p_cbw->lun, p_cbw->command, _mscd_buf, sizeof(_mscd_buf));
+          resplen = mscd_proc_builtin_scsi(p_cbw->lun, p_cbw->command, _mscd_buf[0], CFG_TUD_MSC_BUFSIZE);
 
           // Not built-in, invoke user callback
-          if ( (resplen < 0) && (p_msc->sense_key == 0) )
+          if ( (resplen < 0) && (p_msc->lun[p_cbw->lun].sense_key == 0) )
           {
-            resplen = tud_msc_scsi_cb(p_cbw->lun, p_cbw->command, _mscd_buf, p_msc->total_len);
+            resplen = tud_msc_scsi_cb(p_cbw->lun, p_cbw->command, _mscd_buf[0], p_msc->total_len);
           }
 
           if ( resplen < 0 )
@@ -424,7 +795,7 @@ bool mscd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t
             p_msc->stage = MSC_STAGE_STATUS;
 
             // failed but senskey is not set: default to Illegal Request
-            if ( p_msc->sense_key == 0 ) tud_msc_set_sense(p_cbw->lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
+            if ( p_msc->lun[p_cbw->lun].sense_key == 0 ) tud_msc_set_sense(p_cbw->lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
 
             // Stall bulk In if needed
             if (p_cbw->total_bytes) usbd_edpt_stall(rhport, p_msc->ep_in);
@@ -437,7 +808,7 @@ bool mscd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t
             if (p_msc->total_len)
             {
               TU_ASSERT( p_cbw->total_bytes >= p_msc->total_len ); // cannot return more than host expect
-              TU_ASSERT( usbd_edpt_xfer(rhport, p_msc->ep_in, _mscd_buf, p_msc->total_len) );
+              TU_ASSERT( usbd_edpt_xfer(rhport, p_msc->ep_in, _mscd_buf[0], p_msc->total_len) );
             }else
             {
               p_msc->stage = MSC_STAGE_STATUS;
@@ -448,85 +819,60 @@ bool mscd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t
     break;
 
     case MSC_STAGE_DATA:
-      // OUT transfer, invoke callback if needed
-      if ( !tu_bit_test(p_cbw->dir, 7) )
+      if ( mscd_is_read_cmd(p_cbw->command[0]) )
       {
-        if ( SCSI_CMD_WRITE_10 != p_cbw->command[0] )
+        // Event without transfer in progress is a retry after application was not ready
+        if ( p_msc->xfer_busy && (ep_addr == p_msc->ep_in) )
         {
-          int32_t cb_result = tud_msc_scsi_cb(p_cbw->lun, p_cbw->command, _mscd_buf, p_msc->total_len);
-
-          if ( cb_result < 0 )
-          {
-            p_csw->status = MSC_CSW_STATUS_FAILED;
-            tud_msc_set_sense(p_cbw->lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00); // Sense = Invalid Command Operation
-          }else
-          {
-            p_csw->status = MSC_CSW_STATUS_PASSED;
-          }
+          p_msc->xfer_busy    = false;
+          p_msc->xferred_len += xferred_bytes;
+          p_msc->buf_rd       = (p_msc->buf_rd + 1) % CFG_TUD_MSC_BUF_COUNT;
+          p_msc->buf_count--;
         }
-        else
+
+        proc_read_cmd(rhport, p_msc);
+      }
+      else if ( mscd_is_write_cmd(p_cbw->command[0]) )
+      {
+        // Event without transfer in progress is a retry after application was not ready
+        if ( p_msc->xfer_busy && (ep_addr == p_msc->ep_out) )
         {
-          uint16_t const block_sz = p_cbw->total_bytes / rdwr10_get_blockcount(p_cbw->command);
+          // the newest buffer in use is the one just received
+          uint8_t const idx = (p_msc->buf_rd + p_msc->buf_count - 1) % CFG_TUD_MSC_BUF_COUNT;
 
-          // Adjust lba with transferred bytes
-          uint32_t const lba = rdwr10_get_lba(p_cbw->command) + (p_msc->xferred_len / block_sz);
+          p_msc->xfer_busy    = false;
+          p_msc->buf_len[idx] = (uint16_t) xferred_bytes;
+          p_msc->xferred_len += xferred_bytes;
+        }
 
-          // Application can consume smaller bytes
-          int32_t nbytes = tud_msc_write10_cb(p_cbw->lun, lba, p_msc->xferred_len % block_sz, _mscd_buf, xferred_bytes);
+        proc_write_data(rhport, p_msc);
+      }
+      else
+      {
+        // OUT transfer, invoke callback if needed
+        if ( !tu_bit_test(p_cbw->dir, 7) )
+        {
+          int32_t cb_result = tud_msc_scsi_cb(p_cbw->lun, p_cbw->command, _mscd_buf[0], p_msc->total_len);
 
-          if ( nbytes < 0 )
+          if ( cb_result < 0 )
           {
-            // negative means error -> skip to status phase, status in CSW set to failed
-            p_csw->data_residue = p_cbw->total_bytes - p_msc->xferred_len;
-            p_csw->status       = MSC_CSW_STATUS_FAILED;
-            p_msc->stage        = MSC_STAGE_STATUS;
-
+            p_csw->status = MSC_CSW_STATUS_FAILED;
             tud_msc_set_sense(p_cbw->lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00); // Sense = Invalid Command Operation
-            break;
           }else
           {
-            // Application consume less than what we got (including zero)
-            if ( nbytes < (int32_t) xferred_bytes )
-            {
-              if ( nbytes > 0 )
-              {
-                p_msc->xferred_len += nbytes;
-                memmove(_mscd_buf, _mscd_buf+nbytes, xferred_bytes-nbytes);
-              }
-
-              // simulate an transfer complete with adjusted parameters --> this driver callback will fired again
-              dcd_event_xfer_complete(rhport, p_msc->ep_out, xferred_bytes-nbytes, XFER_RESULT_SUCCESS, false);
-
-              return true; // skip the rest
-            }
-            else
-            {
-              // Application consume all bytes in our buffer. Nothing to do, process with normal flow
-            }
+            p_csw->status = MSC_CSW_STATUS_PASSED;
           }
         }
-      }
 
-      // Accumulate data so far
-      p_msc->xferred_len += xferred_bytes;
+        // Accumulate data so far
+        p_msc->xferred_len += xferred_bytes;
 
-      if ( p_msc->xferred_len >= p_msc->total_len )
-      {
-        // Data Stage is complete
-        p_msc->stage = MSC_STAGE_STATUS;
-      }
-      else
-      {
-        // READ10 & WRITE10 Can be executed with large bulk of data e.g write 8K bytes (several flash write)
-        // We break it into multiple smaller command whose data size is up to CFG_TUD_MSC_BUFSIZE
-        if (SCSI_CMD_READ_10 == p_cbw->command[0])
+        if ( p_msc->xferred_len >= p_msc->total_len )
         {
-          proc_read10_cmd(rhport, p_msc);
+          // Data Stage is complete
+          p_msc->stage = MSC_STAGE_STATUS;
         }
-        else if (SCSI_CMD_WRITE_10 == p_cbw->command[0])
-        {
-          proc_write10_cmd(rhport, p_msc);
-        }else
+        else
         {
           // No other command take more than one transfer yet -> unlikely error
           TU_BREAKPOINT();
@@ -549,107 +895,278 @@ bool mscd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t
     default : break;
   }
 
-  if ( p_msc->stage == MSC_STAGE_STATUS )
-  {
-    // Either endpoints is stalled, need to wait until it is cleared by host
-    if ( usbd_edpt_stalled(rhport,  p_msc->ep_in) || usbd_edpt_stalled(rhport,  p_msc->ep_out) )
-    {
-      // simulate an transfer complete with adjusted parameters --> this driver callback will fired again
-      // and response with status phase after halted endpoints are cleared.
-      // note: use ep_out to prevent confusing with STATUS complete
-      dcd_event_xfer_complete(rhport, p_msc->ep_out, 0, XFER_RESULT_SUCCESS, false);
-    }
-    else
-    {
-      // Send SCSI Status
-      TU_ASSERT(usbd_edpt_xfer(rhport, p_msc->ep_in , (uint8_t*) &p_msc->csw, sizeof(msc_csw_t)));
+  if ( p_msc->stage == MSC_STAGE_STATUS ) proc_status_stage(rhport, p_msc);
 
-      // Invoke complete callback if defined
-      switch(p_cbw->command[0])
-      {
-        case SCSI_CMD_READ_10:
-          if ( tud_msc_read10_complete_cb ) tud_msc_read10_complete_cb(p_cbw->lun);
-        break;
+  return true;
+}
 
-        case SCSI_CMD_WRITE_10:
-          if ( tud_msc_write10_complete_cb ) tud_msc_write10_complete_cb(p_cbw->lun);
-        break;
+/*------------------------------------------------------------------*/
+/* SCSI Command Process
+ *------------------------------------------------------------------*/
+static void proc_status_stage(uint8_t rhport, mscd_interface_t* p_msc)
+{
+  msc_cbw_t const * p_cbw = &p_msc->cbw;
 
-        default:
-          if ( tud_msc_scsi_complete_cb ) tud_msc_scsi_complete_cb(p_cbw->lun, p_cbw->command);
-        break;
-      }
+  // Either endpoints is stalled, need to wait until it is cleared by host
+  if ( usbd_edpt_stalled(rhport,  p_msc->ep_in) || usbd_edpt_stalled(rhport,  p_msc->ep_out) )
+  {
+    // simulate an transfer complete with adjusted parameters --> this driver callback will fired again
+    // and response with status phase after halted endpoints are cleared.
+    // note: use ep_out to prevent confusing with STATUS complete
+    dcd_event_xfer_complete(rhport, p_msc->ep_out, 0, XFER_RESULT_SUCCESS, false);
+  }
+  else
+  {
+    // Send SCSI Status
+    TU_ASSERT(usbd_edpt_xfer(rhport, p_msc->ep_in , (uint8_t*) &p_msc->csw, sizeof(msc_csw_t)), );
+
+    // Invoke complete callback if defined
+    switch(p_cbw->command[0])
+    {
+      case SCSI_CMD_READ_10:
+      case SCSI_CMD_READ_16:
+        if ( tud_msc_read10_complete_cb ) tud_msc_read10_complete_cb(p_cbw->lun);
+      break;
+
+      case SCSI_CMD_WRITE_10:
+      case SCSI_CMD_WRITE_16:
+        if ( tud_msc_write10_complete_cb ) tud_msc_write10_complete_cb(p_cbw->lun);
+      break;
+
+      default:
+        if ( tud_msc_scsi_complete_cb ) tud_msc_scsi_complete_cb(p_cbw->lun, p_cbw->command);
+      break;
     }
   }
+}
 
-  return true;
+// Start transfer of the oldest buffer fetched from application if bus is free
+static void read_xmit(uint8_t rhport, mscd_interface_t* p_msc)
+{
+  if ( p_msc->xfer_busy || (p_msc->buf_count == 0) ) return;
+
+  uint8_t const idx = p_msc->buf_rd;
+  TU_ASSERT( usbd_edpt_xfer(rhport, p_msc->ep_in, _mscd_buf[idx], p_msc->buf_len[idx]), );
+
+  p_msc->xfer_busy = true;
 }
 
-/*------------------------------------------------------------------*/
-/* SCSI Command Process
- *------------------------------------------------------------------*/
-static void proc_read10_cmd(uint8_t rhport, mscd_interface_t* p_msc)
+// READ10/16 can be executed with large bulk of data e.g read 8K bytes (several flash read). It is broken into
+// chunks of up to CFG_TUD_MSC_BUFSIZE, chunk N+1 is fetched from application while chunk N is on the bus.
+static void proc_read_cmd(uint8_t rhport, mscd_interface_t* p_msc)
 {
   msc_cbw_t const * p_cbw = &p_msc->cbw;
   msc_csw_t       * p_csw = &p_msc->csw;
 
-  uint16_t const block_cnt = rdwr10_get_blockcount(p_cbw->command);
-  TU_ASSERT(block_cnt, ); // prevent div by zero
+  if ( p_msc->xferred_len >= p_cbw->total_bytes )
+  {
+    // Data Stage is complete
+    p_msc->stage = MSC_STAGE_STATUS;
+    return;
+  }
+
+  // Keep the bus busy with data fetched earlier
+  read_xmit(rhport, p_msc);
 
-  uint16_t const block_sz = p_cbw->total_bytes / block_cnt;
-  TU_ASSERT(block_sz, ); // prevent div by zero
+  // Fetch ahead into free buffers, one asynchronous request at a time
+  while ( !p_msc->app_failed && !p_msc->async_pending &&
+          (p_msc->buf_count < CFG_TUD_MSC_BUF_COUNT) && (p_msc->app_len < p_cbw->total_bytes) )
+  {
+    uint32_t const block_cnt = mscd_rdwr_get_blockcount(p_cbw->command);
+    TU_ASSERT(block_cnt, ); // prevent div by zero
 
-  // Adjust lba with transferred bytes
-  uint32_t const lba = rdwr10_get_lba(p_cbw->command) + (p_msc->xferred_len / block_sz);
+    uint32_t const block_sz = p_cbw->total_bytes / block_cnt;
+    TU_ASSERT(block_sz, ); // prevent div by zero
 
-  // remaining bytes capped at class buffer
-  int32_t nbytes = (int32_t) tu_min32(sizeof(_mscd_buf), p_cbw->total_bytes-p_msc->xferred_len);
+    uint8_t const idx = (p_msc->buf_rd + p_msc->buf_count) % CFG_TUD_MSC_BUF_COUNT;
 
-  // Application can consume smaller bytes
-  nbytes = tud_msc_read10_cb(p_cbw->lun, lba, p_msc->xferred_len % block_sz, _mscd_buf, (uint32_t) nbytes);
+    // Adjust lba with fetched bytes
+    uint64_t const lba = mscd_rdwr_get_lba(p_cbw->command) + (p_msc->app_len / block_sz);
 
-  if ( nbytes < 0 )
+    // remaining bytes capped at class buffer
+    int32_t nbytes = (int32_t) tu_min32(CFG_TUD_MSC_BUFSIZE, p_cbw->total_bytes-p_msc->app_len);
+
+    // Application can consume smaller bytes, a completion reported later must match this request
+    p_msc->async_seq++;
+    nbytes = mscd_read_cb(p_cbw->lun, lba, p_msc->app_len % block_sz, _mscd_buf[idx], (uint32_t) nbytes);
+
+    if ( !read_result(rhport, p_msc, idx, nbytes) ) break;
+  }
+
+  // asynchronous request will resume us when complete
+  if ( !p_msc->xfer_busy && !p_msc->async_pending )
   {
-    // negative means error -> pipe is stalled & status in CSW set to failed
-    p_csw->data_residue = p_cbw->total_bytes - p_msc->xferred_len;
-    p_csw->status       = MSC_CSW_STATUS_FAILED;
+    if ( p_msc->app_failed )
+    {
+      // pipe is stalled & status in CSW set to failed
+      p_csw->data_residue = p_cbw->total_bytes - p_msc->xferred_len;
+      p_csw->status       = MSC_CSW_STATUS_FAILED;
+      p_msc->stage        = MSC_STAGE_STATUS;
 
-    tud_msc_set_sense(p_cbw->lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00); // Sense = Invalid Command Operation
-    usbd_edpt_stall(rhport, p_msc->ep_in);
+      usbd_edpt_stall(rhport, p_msc->ep_in);
+    }
+    else
+    {
+      // not ready and nothing on the bus -> simulate an transfer complete so that this driver callback will fired again
+      dcd_event_xfer_complete(rhport, p_msc->ep_in, 0, XFER_RESULT_SUCCESS, false);
+    }
+  }
+}
+
+// Process read callback result for buffer idx, return true if next chunk can be fetched right away
+static bool read_result(uint8_t rhport, mscd_interface_t* p_msc, uint8_t idx, int32_t nbytes)
+{
+  if ( nbytes == TUD_MSC_RET_ASYNC )
+  {
+    // buffer is filled later, no polling meanwhile
+    p_msc->async_pending = true;
+    return false;
+  }
+  else if ( nbytes < 0 )
+  {
+    // negative means error -> data fetched so far is still sent, then pipe is stalled
+    p_msc->app_failed = true;
+    tud_msc_set_sense(p_msc->cbw.lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00); // Sense = Invalid Command Operation
+    return false;
   }
   else if ( nbytes == 0 )
   {
-    // zero means not ready -> simulate an transfer complete so that this driver callback will fired again
-    dcd_event_xfer_complete(rhport, p_msc->ep_in, 0, XFER_RESULT_SUCCESS, false);
+    // zero means not ready -> try again later
+    return false;
   }
   else
   {
-    TU_ASSERT( usbd_edpt_xfer(rhport, p_msc->ep_in, _mscd_buf, nbytes), );
+    p_msc->buf_len[idx] = (uint16_t) nbytes;
+    p_msc->buf_count++;
+    p_msc->app_len += (uint32_t) nbytes;
+
+    // send it right away if bus is free, next chunk is fetched while this one is on the bus
+    read_xmit(rhport, p_msc);
+    return true;
   }
 }
 
-static void proc_write10_cmd(uint8_t rhport, mscd_interface_t* p_msc)
+static void proc_write_cmd(uint8_t rhport, mscd_interface_t* p_msc)
 {
   msc_cbw_t const * p_cbw = &p_msc->cbw;
-  bool writable = true;
-  if (tud_msc_is_writable_cb) {
-    writable = tud_msc_is_writable_cb(p_cbw->lun);
-  }
-  if (!writable) {
+
+  if ( !mscd_is_writable(p_cbw->lun) ) {
     msc_csw_t* p_csw = &p_msc->csw;
     p_csw->data_residue = p_cbw->total_bytes;
     p_csw->status       = MSC_CSW_STATUS_FAILED;
+    p_msc->stage        = MSC_STAGE_STATUS;
 
     tud_msc_set_sense(p_cbw->lun, SCSI_SENSE_DATA_PROTECT, 0x27, 0x00); // Sense = Write protected
     usbd_edpt_stall(rhport, p_msc->ep_out);
     return;
   }
 
+  proc_write_data(rhport, p_msc);
+}
+
+// Receive next chunk into a free buffer if bus is free
+static void write_recv(uint8_t rhport, mscd_interface_t* p_msc)
+{
+  if ( p_msc->xfer_busy || (p_msc->buf_count == CFG_TUD_MSC_BUF_COUNT) || (p_msc->xferred_len >= p_msc->cbw.total_bytes) ) return;
+
+  uint8_t const idx = (p_msc->buf_rd + p_msc->buf_count) % CFG_TUD_MSC_BUF_COUNT;
+
   // remaining bytes capped at class buffer
-  int32_t nbytes = (int32_t) tu_min32(sizeof(_mscd_buf), p_cbw->total_bytes-p_msc->xferred_len);
+  uint16_t const nbytes = (uint16_t) tu_min32(CFG_TUD_MSC_BUFSIZE, p_msc->cbw.total_bytes-p_msc->xferred_len);
 
   // Write10 callback will be called later when usb transfer complete
-  TU_ASSERT( usbd_edpt_xfer(rhport, p_msc->ep_out, _mscd_buf, nbytes), );
+  TU_ASSERT( usbd_edpt_xfer(rhport, p_msc->ep_out, _mscd_buf[idx], nbytes), );
+
+  p_msc->buf_len[idx] = 0;
+  p_msc->buf_count++;
+  p_msc->xfer_busy = true;
+}
+
+// WRITE10/16 can be executed with large bulk of data e.g write 8K bytes (several flash write). It is broken into
+// chunks of up to CFG_TUD_MSC_BUFSIZE, chunk N+1 is received from host while chunk N is written by application.
+static void proc_write_data(uint8_t rhport, mscd_interface_t* p_msc)
+{
+  msc_cbw_t const * p_cbw = &p_msc->cbw;
+
+  // Keep the bus busy receiving while application writes
+  write_recv(rhport, p_msc);
+
+  // Hand received buffers to application, oldest first, one asynchronous request at a time
+  while ( !p_msc->async_pending && (p_msc->buf_count > (p_msc->xfer_busy ? 1 : 0)) )
+  {
+    uint32_t const block_cnt = mscd_rdwr_get_blockcount(p_cbw->command);
+    TU_ASSERT(block_cnt, ); // prevent div by zero
+
+    uint32_t const block_sz = p_cbw->total_bytes / block_cnt;
+    TU_ASSERT(block_sz, ); // prevent div by zero
+
+    uint8_t const idx = p_msc->buf_rd;
+
+    // Adjust lba with written bytes
+    uint64_t const lba = mscd_rdwr_get_lba(p_cbw->command) + (p_msc->app_len / block_sz);
+
+    // Application can consume smaller bytes, a completion reported later must match this request
+    p_msc->async_seq++;
+    int32_t nbytes = mscd_write_cb(p_cbw->lun, lba, p_msc->app_len % block_sz,
+                                     _mscd_buf[idx] + p_msc->buf_ofs, p_msc->buf_len[idx] - p_msc->buf_ofs);
+
+    if ( !write_result(rhport, p_msc, nbytes) ) break;
+  }
+
+  if ( p_msc->stage != MSC_STAGE_DATA ) return;
+
+  if ( p_msc->app_len >= p_cbw->total_bytes )
+  {
+    // Data Stage is complete
+    p_msc->stage = MSC_STAGE_STATUS;
+  }
+  else if ( !p_msc->xfer_busy && !p_msc->async_pending )
+  {
+    // not ready and nothing on the bus -> simulate an transfer complete so that this driver callback will fired again
+    dcd_event_xfer_complete(rhport, p_msc->ep_out, 0, XFER_RESULT_SUCCESS, false);
+  }
+}
+
+// Process write callback result for the oldest buffer, return true if it is drained
+static bool write_result(uint8_t rhport, mscd_interface_t* p_msc, int32_t nbytes)
+{
+  msc_cbw_t const * p_cbw = &p_msc->cbw;
+  msc_csw_t       * p_csw = &p_msc->csw;
+
+  if ( nbytes == TUD_MSC_RET_ASYNC )
+  {
+    // buffer is written later, no polling meanwhile
+    p_msc->async_pending = true;
+    return false;
+  }
+
+  if ( nbytes < 0 )
+  {
+    // negative means error -> skip to status phase, status in CSW set to failed
+    p_csw->data_residue = p_cbw->total_bytes - p_msc->app_len;
+    p_csw->status       = MSC_CSW_STATUS_FAILED;
+    p_msc->stage        = MSC_STAGE_STATUS;
+
+    tud_msc_set_sense(p_cbw->lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00); // Sense = Invalid Command Operation
+
+    // host has more data to send, stall it
+    if ( p_msc->xfer_busy || (p_msc->xferred_len < p_cbw->total_bytes) ) usbd_edpt_stall(rhport, p_msc->ep_out);
+    return false;
+  }
+
+  p_msc->app_len += (uint32_t) nbytes;
+  p_msc->buf_ofs += (uint16_t) nbytes;
+
+  // Application consume less than what we got (including zero) -> try again later
+  if ( p_msc->buf_ofs < p_msc->buf_len[p_msc->buf_rd] ) return false;
+
+  // Buffer is drained and can receive again
+  p_msc->buf_ofs = 0;
+  p_msc->buf_rd  = (p_msc->buf_rd + 1) % CFG_TUD_MSC_BUF_COUNT;
+  p_msc->buf_count--;
+
+  write_recv(rhport, p_msc);
+  return true;
 }
 
 #endif
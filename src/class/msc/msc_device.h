@@ -30,6 +30,7 @@
 #include "common/tusb_common.h"
 #include "device/usbd.h"
 #include "msc.h"
+#include "msc_cache.h"
 
 #ifdef __cplusplus
  extern "C" {
@@ -44,13 +45,45 @@ TU_VERIFY_STATIC(CFG_TUD_MSC_BUFSIZE < UINT16_MAX, "Size is not correct");
   #error CFG_TUD_MSC_BUFSIZE must be defined, value of a block size should work well, the more the better
 #endif
 
+// Number of CFG_TUD_MSC_BUFSIZE buffers for READ10/WRITE10. With 2 or more, the next chunk is read from
+// (or written to) storage by application while the current one is being transferred on the bus.
+#ifndef CFG_TUD_MSC_BUF_COUNT
+  #define CFG_TUD_MSC_BUF_COUNT   1
+#endif
+
+TU_VERIFY_STATIC(CFG_TUD_MSC_BUF_COUNT > 0 && CFG_TUD_MSC_BUF_COUNT < 256, "Buffer count is not correct");
+
+// Maximum number of LUNs, each one has its own sense data and cached state
+#ifndef CFG_TUD_MSC_MAX_LUN
+  #define CFG_TUD_MSC_MAX_LUN     4
+#endif
+
+TU_VERIFY_STATIC(CFG_TUD_MSC_MAX_LUN > 0 && CFG_TUD_MSC_MAX_LUN <= 16, "LUN count is not correct");
+
 /** \addtogroup ClassDriver_MSC
  *  @{
  * \defgroup MSC_Device Device
  *  @{ */
 
+// Return value of tud_msc_read10_cb() and tud_msc_write10_cb() for a request completed later by application
+enum
+{
+  TUD_MSC_RET_ASYNC = -16
+};
+
+// Set sense data of LUN, reported to host with the failed status of its current command
 bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code, uint8_t add_sense_qualifier);
 
+// Readiness, write protection and capacity of a LUN are cached once reported by application callbacks.
+// Invalidate them when medium is inserted, removed or changed so that callbacks are invoked again.
+void tud_msc_lun_invalidate(uint8_t lun);
+
+// Complete the read10/write10 request for which callback returned TUD_MSC_RET_ASYNC. nbytes is what the
+// callback would have returned otherwise. Can be called from interrupt e.g storage DMA complete.
+// Completion of a request cancelled by bus reset is ignored, provided it is reported before callback is
+// invoked for the next request.
+bool tud_msc_async_done(uint8_t lun, int32_t nbytes, bool in_isr);
+
 //--------------------------------------------------------------------+
 // Application Callbacks (WEAK is optional)
 //--------------------------------------------------------------------+
@@ -71,6 +104,12 @@ bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code, u
  *
  * \retval      negative    Indicate error e.g reading disk I/O. tinyusb will \b STALL the corresponding
  *                          endpoint and return failed status in command status wrapper phase.
+ *
+ * \retval      TUD_MSC_RET_ASYNC  Request is submitted e.g to DMA, application fills buffer then reports
+ *                          the result with tud_msc_async_done(). tinyusb won't poll meanwhile.
+ *
+ * \note        With CFG_TUD_MSC_BUF_COUNT > 1 this is invoked for the next chunk while data of the previous
+ *              one is still being sent to host.
  */
 int32_t tud_msc_read10_cb (uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize);
 
@@ -90,6 +129,9 @@ int32_t tud_msc_read10_cb (uint8_t lun, uint32_t lba, uint32_t offset, void* buf
  *
  * \retval      negative    Indicate error writing disk I/O. Tinyusb will \b STALL the corresponding
  *                          endpoint and return failed status in command status wrapper phase.
+ *
+ * \retval      TUD_MSC_RET_ASYNC  Request is submitted e.g to DMA, buffer must be kept intact until application
+ *                          reports the result with tud_msc_async_done(). tinyusb won't poll meanwhile.
  */
 int32_t tud_msc_write10_cb (uint8_t lun, uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize);
 
@@ -99,16 +141,18 @@ void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16
 
 // Invoked when received Test Unit Ready command.
 // return true allowing host to read/write this LUN e.g SD card inserted
+// Ready state is cached until tud_msc_lun_invalidate(), not ready state is not cached
 bool tud_msc_test_unit_ready_cb(uint8_t lun);
 
 // Invoked when received SCSI_CMD_READ_CAPACITY_10 and SCSI_CMD_READ_FORMAT_CAPACITY to determine the disk size
-// Application update block count and block size
+// Application update block count and block size, non-zero values are cached until tud_msc_lun_invalidate()
 void tud_msc_capacity_cb(uint8_t lun, uint32_t* block_count, uint16_t* block_size);
 
 /**
  * Invoked when received an SCSI command not in built-in list below.
- * - READ_CAPACITY10, READ_FORMAT_CAPACITY, INQUIRY, TEST_UNIT_READY, START_STOP_UNIT, MODE_SENSE6, REQUEST_SENSE
- * - READ10 and WRITE10 has their own callbacks
+ * - READ_CAPACITY10, READ_CAPACITY16, READ_FORMAT_CAPACITY, INQUIRY, TEST_UNIT_READY, START_STOP_UNIT, MODE_SENSE6, REQUEST_SENSE
+ * - SYNCHRONIZE_CACHE10 when CFG_TUD_MSC_CACHE_BLOCKS is enabled
+ * - READ10/16 and WRITE10/16 has their own callbacks
  *
  * \param[in]   lun         Logical unit number
  * \param[in]   scsi_cmd    SCSI command contents which application must examine to response accordingly
@@ -125,7 +169,7 @@ int32_t tud_msc_scsi_cb (uint8_t lun, uint8_t const scsi_cmd[16], void* buffer,
 
 /*------------- Optional callbacks -------------*/
 
-// Invoked when received GET_MAX_LUN request, required for multiple LUNs implementation
+// Invoked when received GET_MAX_LUN request, required for multiple LUNs implementation, up to CFG_TUD_MSC_MAX_LUN
 TU_ATTR_WEAK uint8_t tud_msc_get_maxlun_cb(void);
 
 // Invoked when received Start Stop Unit command
@@ -133,16 +177,26 @@ TU_ATTR_WEAK uint8_t tud_msc_get_maxlun_cb(void);
 // - Start = 1 : active mode, if load_eject = 1 : load disk storage
 TU_ATTR_WEAK bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, bool load_eject);
 
-// Invoked when Read10 command is complete
+// Invoked when Read10 or Read16 command is complete
 TU_ATTR_WEAK void tud_msc_read10_complete_cb(uint8_t lun);
 
-// Invoke when Write10 command is complete, can be used to flush flash caching
+// Invoke when Write10 or Write16 command is complete, can be used to flush flash caching
 TU_ATTR_WEAK void tud_msc_write10_complete_cb(uint8_t lun);
 
+// Same as tud_msc_read10_cb() / tud_msc_write10_cb() with 64-bit LBA. If implemented, invoked instead of them
+// for both 10 and 16 byte commands. Otherwise READ16/WRITE16 beyond 32-bit LBA fail.
+TU_ATTR_WEAK int32_t tud_msc_read16_cb (uint8_t lun, uint64_t lba, uint32_t offset, void* buffer, uint32_t bufsize);
+TU_ATTR_WEAK int32_t tud_msc_write16_cb (uint8_t lun, uint64_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize);
+
+// Invoked when received SCSI_CMD_READ_CAPACITY_10 and SCSI_CMD_SERVICE_ACTION_IN_16 (READ CAPACITY 16).
+// If implemented, used instead of tud_msc_capacity_cb() for media with more than 2^32 blocks.
+TU_ATTR_WEAK void tud_msc_capacity16_cb(uint8_t lun, uint64_t* block_count, uint32_t* block_size);
+
 // Invoked when command in tud_msc_scsi_cb is complete
 TU_ATTR_WEAK void tud_msc_scsi_complete_cb(uint8_t lun, uint8_t const scsi_cmd[16]);
 
 // Hook to make a mass storage device read-only. TODO remove
+// Result is cached until tud_msc_lun_invalidate()
 TU_ATTR_WEAK bool tud_msc_is_writable_cb(uint8_t lun);
 
 /** @} */
@@ -158,6 +212,29 @@ bool mscd_control_request  (uint8_t rhport, tusb_control_request_t const * p_req
 bool mscd_control_complete (uint8_t rhport, tusb_control_request_t const * p_request);
 bool mscd_xfer_cb          (uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t xferred_bytes);
 
+// SCSI command helpers, shared with UAS driver
+int32_t  mscd_proc_builtin_scsi  (uint8_t lun, uint8_t const scsi_cmd[16], uint8_t* buffer, uint32_t bufsize);
+uint64_t mscd_rdwr_get_lba       (uint8_t const command[]);
+uint32_t mscd_rdwr_get_blockcount(uint8_t const command[]);
+int32_t  mscd_read_cb            (uint8_t lun, uint64_t lba, uint32_t offset, void* buffer, uint32_t bufsize);
+int32_t  mscd_write_cb           (uint8_t lun, uint64_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize);
+int32_t  mscd_app_read           (uint8_t lun, uint64_t lba, uint32_t offset, void* buffer, uint32_t bufsize);
+int32_t  mscd_app_write          (uint8_t lun, uint64_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize);
+void     mscd_get_capacity       (uint8_t lun, uint64_t* block_count, uint32_t* block_size);
+uint32_t mscd_get_block_size     (uint8_t lun); // capacity callback is only invoked until capacity is known
+bool     mscd_is_writable        (uint8_t lun);
+void     mscd_get_sense          (uint8_t lun, uint8_t* sense_key, uint8_t* add_sense_code, uint8_t* add_sense_qualifier);
+
+static inline bool mscd_is_read_cmd(uint8_t cmd_code)
+{
+  return (cmd_code == SCSI_CMD_READ_10) || (cmd_code == SCSI_CMD_READ_16);
+}
+
+static inline bool mscd_is_write_cmd(uint8_t cmd_code)
+{
+  return (cmd_code == SCSI_CMD_WRITE_10) || (cmd_code == SCSI_CMD_WRITE_16);
+}
+
 #ifdef __cplusplus
  }
 #endif
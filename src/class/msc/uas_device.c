@@ -0,0 +1,866 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "tusb_option.h"
+
+#if (TUSB_OPT_DEVICE_ENABLED && CFG_TUD_UAS)
+
+#include "common/tusb_common.h"
+#include "msc_device.h"
+#include "uas_device.h"
+#include "device/usbd_pvt.h"
+
+//--------------------------------------------------------------------+
+// MACRO CONSTANT TYPEDEF
+//--------------------------------------------------------------------+
+enum
+{
+  UAS_CMD_FREE = 0,
+  UAS_CMD_QUEUED , // received, waiting for the data pipes
+  UAS_CMD_WAIT   , // application not ready for it, passed over until next scheduling round
+  UAS_CMD_READY  , // owns the data pipes, Read/Write Ready IU to be sent
+  UAS_CMD_DATA   , // data transfer in progress
+  UAS_CMD_STATUS   // Sense/Response IU to be sent
+};
+
+enum
+{
+  UAS_NO_CMD = 0xff
+};
+
+// SCSI status in Sense IU
+enum
+{
+  UAS_SCSI_STATUS_GOOD            = 0x00,
+  UAS_SCSI_STATUS_CHECK_CONDITION = 0x02
+};
+
+typedef struct
+{
+  // Sense, Response or Read/Write Ready IU of this command
+  CFG_TUSB_MEM_ALIGN uint8_t iu[sizeof(uas_sense_iu_t) + sizeof(scsi_sense_fixed_resp_t)];
+
+  uint8_t  state;
+  uint8_t  lun;
+  uint16_t tag;         // in Big Endian, as received
+  uint16_t iu_len;
+  uint32_t seq;         // arrival order
+  uint8_t  cdb[16];
+
+  uint32_t total_len;   // data length of READ/WRITE, response length of other commands
+  uint32_t xferred_len; // number of bytes transferred on the bus so far
+}uasd_cmd_t;
+
+typedef struct
+{
+  // Command or Task Management IU
+  CFG_TUSB_MEM_ALIGN uas_command_iu_t cmd_iu;
+
+  uint8_t  rhport;
+  uint8_t  itf_num;
+  uint8_t  ep_cmd;
+  uint8_t  ep_status;
+  uint8_t  ep_in;
+  uint8_t  ep_out;
+
+  bool     cmd_armed;    // command pipe is waiting for next IU
+  bool     data_busy;    // transfer in progress on data pipes
+  bool     retry_pending;
+  uint8_t  status_idx;   // command whose IU is on the status pipe
+  uint8_t  data_idx;     // command owning the data pipes
+  uint32_t seq;
+
+  // Data buffer of data_idx command
+  uint32_t app_len;      // number of bytes read or written by application callback so far
+  uint16_t buf_len;
+  uint16_t buf_ofs;      // bytes of buffer already consumed by write callback
+
+  uasd_cmd_t cmd[CFG_TUD_UAS_QUEUE_DEPTH];
+}uasd_interface_t;
+
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static uasd_interface_t _uasd_itf;
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static uint8_t _uasd_buf[CFG_TUD_UAS_BUFSIZE];
+
+//--------------------------------------------------------------------+
+// INTERNAL OBJECT & FUNCTION DECLARATION
+//--------------------------------------------------------------------+
+static void schedule(uint8_t rhport);
+static void data_continue(uint8_t rhport);
+static void data_retry(void);
+static int32_t data_in_fetch(uasd_cmd_t* p_cmd);
+
+static inline uint8_t cmd_index(uasd_cmd_t const* p_cmd)
+{
+  return (uint8_t) (p_cmd - _uasd_itf.cmd);
+}
+
+static uasd_cmd_t* cmd_alloc(void)
+{
+  for(uint8_t i=0; i<CFG_TUD_UAS_QUEUE_DEPTH; i++)
+  {
+    uasd_cmd_t* p_cmd = &_uasd_itf.cmd[i];
+    if ( p_cmd->state == UAS_CMD_FREE )
+    {
+      tu_memclr(p_cmd, sizeof(uasd_cmd_t));
+      p_cmd->seq = _uasd_itf.seq++;
+      return p_cmd;
+    }
+  }
+
+  return NULL;
+}
+
+// Find the oldest command in given state
+static uasd_cmd_t* cmd_find_oldest(uint8_t state)
+{
+  uasd_cmd_t* oldest = NULL;
+
+  for(uint8_t i=0; i<CFG_TUD_UAS_QUEUE_DEPTH; i++)
+  {
+    uasd_cmd_t* p_cmd = &_uasd_itf.cmd[i];
+    if ( p_cmd->state != state ) continue;
+
+    // sequence wraps around, compare the distance
+    if ( !oldest || (int32_t) (p_cmd->seq - oldest->seq) < 0 ) oldest = p_cmd;
+  }
+
+  return oldest;
+}
+
+static uasd_cmd_t* cmd_find_tag(uint16_t tag)
+{
+  for(uint8_t i=0; i<CFG_TUD_UAS_QUEUE_DEPTH; i++)
+  {
+    uasd_cmd_t* p_cmd = &_uasd_itf.cmd[i];
+    if ( p_cmd->state != UAS_CMD_FREE && p_cmd->tag == tag ) return p_cmd;
+  }
+
+  return NULL;
+}
+
+// Allocation length of a data-in SCSI command, zero if it has none
+static uint32_t scsi_alloc_length(uint8_t const cdb[])
+{
+  switch ( cdb[0] >> 5 )
+  {
+    case 0:
+      // INQUIRY has 16-bit allocation length (SPC-4)
+      if ( cdb[0] == SCSI_CMD_INQUIRY ) return tu_u16(cdb[3], cdb[4]);
+      return cdb[4];
+
+    case 1:
+    case 2:
+      return tu_u16(cdb[7], cdb[8]);
+
+    case 4:
+      return tu_u32(cdb[10], cdb[11], cdb[12], cdb[13]);
+
+    case 5:
+      return tu_u32(cdb[6], cdb[7], cdb[8], cdb[9]);
+
+    default: return 0;
+  }
+}
+
+//--------------------------------------------------------------------+
+// Information Units
+//--------------------------------------------------------------------+
+
+// Complete command with Sense IU, sense data is taken from MSC driver then cleared
+static void cmd_complete(uasd_cmd_t* p_cmd, bool passed)
+{
+  uas_sense_iu_t* p_sense = (uas_sense_iu_t*) p_cmd->iu;
+  tu_memclr(p_cmd->iu, sizeof(p_cmd->iu));
+
+  p_sense->iu_id  = UAS_IU_SENSE;
+  p_sense->tag    = p_cmd->tag;
+  p_cmd->iu_len   = sizeof(uas_sense_iu_t);
+
+  if ( passed )
+  {
+    p_sense->status = UAS_SCSI_STATUS_GOOD;
+  }
+  else
+  {
+    scsi_sense_fixed_resp_t* p_data = (scsi_sense_fixed_resp_t*) (p_cmd->iu + sizeof(uas_sense_iu_t));
+
+    uint8_t key, asc, ascq;
+    mscd_get_sense(p_cmd->lun, &key, &asc, &ascq);
+
+    // failed command must have sense key set, default to illegal request
+    if ( key == SCSI_SENSE_NONE )
+    {
+      key = SCSI_SENSE_ILLEGAL_REQUEST;
+      asc = 0x20;
+      ascq = 0x00;
+    }
+
+    p_data->response_code       = 0x70;
+    p_data->valid               = 1;
+    p_data->sense_key           = key;
+    p_data->add_sense_len       = sizeof(scsi_sense_fixed_resp_t) - 8;
+    p_data->add_sense_code      = asc;
+    p_data->add_sense_qualifier = ascq;
+
+    p_sense->status = UAS_SCSI_STATUS_CHECK_CONDITION;
+    p_sense->length = tu_htons(sizeof(scsi_sense_fixed_resp_t));
+    p_cmd->iu_len  += sizeof(scsi_sense_fixed_resp_t);
+  }
+
+  // sense is reported with its command, host does not send REQUEST SENSE
+  tud_msc_set_sense(p_cmd->lun, 0, 0, 0);
+
+  p_cmd->state = UAS_CMD_STATUS;
+  if ( _uasd_itf.data_idx == cmd_index(p_cmd) ) _uasd_itf.data_idx = UAS_NO_CMD;
+}
+
+static void cmd_respond(uasd_cmd_t* p_cmd, uint8_t response_code)
+{
+  uas_response_iu_t* p_resp = (uas_response_iu_t*) p_cmd->iu;
+  tu_memclr(p_cmd->iu, sizeof(p_cmd->iu));
+
+  p_resp->iu_id         = UAS_IU_RESPONSE;
+  p_resp->tag           = p_cmd->tag;
+  p_resp->response_code = response_code;
+
+  p_cmd->iu_len = sizeof(uas_response_iu_t);
+  p_cmd->state  = UAS_CMD_STATUS;
+}
+
+// Give the data pipes to command, data transfer starts once Read/Write Ready IU is sent
+static void cmd_ready(uasd_cmd_t* p_cmd, bool is_write)
+{
+  uas_ready_iu_t* p_ready = (uas_ready_iu_t*) p_cmd->iu;
+  tu_memclr(p_cmd->iu, sizeof(p_cmd->iu));
+
+  p_ready->iu_id = is_write ? UAS_IU_WRITE_READY : UAS_IU_READ_READY;
+  p_ready->tag   = p_cmd->tag;
+
+  p_cmd->iu_len  = sizeof(uas_ready_iu_t);
+  p_cmd->state   = UAS_CMD_READY;
+
+  _uasd_itf.data_idx = cmd_index(p_cmd);
+}
+
+//--------------------------------------------------------------------+
+// SCSI Command
+//--------------------------------------------------------------------+
+
+// Result of read/write callback is an error. Asynchronous completion is only supported by MSC (BOT) driver,
+// a request left to tud_msc_async_done() would never complete here: fail the command instead.
+static inline bool app_failed(int32_t nbytes)
+{
+  TU_ASSERT(nbytes != TUD_MSC_RET_ASYNC, true);
+  return nbytes < 0;
+}
+
+static inline bool is_nodata_cmd(uint8_t cmd_code)
+{
+  return (cmd_code == SCSI_CMD_TEST_UNIT_READY) || (cmd_code == SCSI_CMD_START_STOP_UNIT);
+}
+
+// Same as BOT: built-in command first then application callback
+static int32_t exec_scsi(uasd_cmd_t* p_cmd, uint8_t* buffer, uint32_t bufsize)
+{
+  uint8_t key, asc, ascq;
+
+  tud_msc_set_sense(p_cmd->lun, 0, 0, 0);
+
+  int32_t resplen = mscd_proc_builtin_scsi(p_cmd->lun, p_cmd->cdb, buffer, bufsize);
+
+  mscd_get_sense(p_cmd->lun, &key, &asc, &ascq);
+  if ( (resplen < 0) && (key == SCSI_SENSE_NONE) )
+  {
+    // not built-in command, buffer is not touched by no-data commands
+    if ( buffer ) resplen = tud_msc_scsi_cb(p_cmd->lun, p_cmd->cdb, buffer, (uint16_t) bufsize);
+  }
+
+  return resplen;
+}
+
+// Start command taking the data pipes, may complete right away.
+// Return false if application is not ready for it, command stays queued and leaves the pipes to others.
+static bool cmd_start(uasd_cmd_t* p_cmd)
+{
+  uasd_interface_t* p_uas = &_uasd_itf;
+  uint8_t const cmd_code = p_cmd->cdb[0];
+
+  p_uas->app_len = 0;
+  p_uas->buf_len = 0;
+  p_uas->buf_ofs = 0;
+
+  if ( mscd_is_read_cmd(cmd_code) || mscd_is_write_cmd(cmd_code) )
+  {
+    uint64_t block_count;
+    uint32_t block_size;
+
+    tud_msc_set_sense(p_cmd->lun, 0, 0, 0);
+    mscd_get_capacity(p_cmd->lun, &block_count, &block_size);
+
+    uint64_t const total = (uint64_t) mscd_rdwr_get_blockcount(p_cmd->cdb) * block_size;
+
+    if ( block_size == 0 )
+    {
+      tud_msc_set_sense(p_cmd->lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
+      cmd_complete(p_cmd, false);
+    }
+    else if ( total > UINT32_MAX )
+    {
+      tud_msc_set_sense(p_cmd->lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x24, 0x00);
+      cmd_complete(p_cmd, false);
+    }
+    else if ( mscd_is_write_cmd(cmd_code) && !mscd_is_writable(p_cmd->lun) )
+    {
+      tud_msc_set_sense(p_cmd->lun, SCSI_SENSE_DATA_PROTECT, 0x27, 0x00);
+      cmd_complete(p_cmd, false);
+    }
+    else if ( total == 0 )
+    {
+      cmd_complete(p_cmd, true);
+    }
+    else if ( mscd_is_write_cmd(cmd_code) )
+    {
+      p_cmd->total_len = (uint32_t) total;
+      cmd_ready(p_cmd, true);
+    }
+    else
+    {
+      // first chunk is fetched before Read Ready IU: a READ whose data is not there yet does not hold up
+      // the ones queued after it
+      p_cmd->total_len = (uint32_t) total;
+
+      int32_t const nread = data_in_fetch(p_cmd);
+      if ( nread == 0 ) return false;
+
+      if ( nread < 0 )
+      {
+        cmd_complete(p_cmd, false);
+      }
+      else
+      {
+        cmd_ready(p_cmd, false);
+      }
+    }
+  }
+  else
+  {
+    // other commands are data-in, response is prepared at once in the buffer
+    int32_t resplen = exec_scsi(p_cmd, _uasd_buf, CFG_TUD_UAS_BUFSIZE);
+
+    if ( resplen < 0 )
+    {
+      cmd_complete(p_cmd, false);
+    }
+    else if ( resplen == 0 )
+    {
+      cmd_complete(p_cmd, true);
+    }
+    else
+    {
+      uint32_t const alloc_len = scsi_alloc_length(p_cmd->cdb);
+      uint32_t len = tu_min32((uint32_t) resplen, CFG_TUD_UAS_BUFSIZE);
+      if ( alloc_len ) len = tu_min32(len, alloc_len);
+
+      p_cmd->total_len = len;
+      p_uas->buf_len   = (uint16_t) len;
+      p_uas->app_len   = len;
+      cmd_ready(p_cmd, false);
+    }
+  }
+
+  return true;
+}
+
+static void proc_command_iu(uint8_t rhport, uasd_cmd_t* p_cmd)
+{
+  (void) rhport;
+  uas_command_iu_t const* p_iu = &_uasd_itf.cmd_iu;
+
+  p_cmd->tag = p_iu->tag;
+  p_cmd->lun = p_iu->lun[1];
+  memcpy(p_cmd->cdb, p_iu->cdb, sizeof(p_cmd->cdb));
+
+  if ( p_cmd->lun >= CFG_TUD_MSC_MAX_LUN )
+  {
+    // sense is Logical Unit Not Supported
+    cmd_complete(p_cmd, false);
+  }
+  // command without data completes right away, possibly ahead of commands queued before it
+  else if ( is_nodata_cmd(p_cmd->cdb[0]) )
+  {
+    cmd_complete(p_cmd, exec_scsi(p_cmd, NULL, 0) >= 0);
+  }
+  else
+  {
+    p_cmd->state = UAS_CMD_QUEUED;
+  }
+}
+
+static void proc_task_mgmt_iu(uasd_cmd_t* p_cmd)
+{
+  uas_task_mgmt_iu_t const* p_iu = (uas_task_mgmt_iu_t const*) &_uasd_itf.cmd_iu;
+
+  p_cmd->tag = p_iu->tag;
+  p_cmd->lun = p_iu->lun[1];
+
+  uint8_t response = UAS_RESPONSE_TMF_COMPLETE;
+
+  switch ( p_iu->function )
+  {
+    case UAS_TMF_ABORT_TASK:
+    {
+      uasd_cmd_t* p_task = cmd_find_tag(p_iu->task_tag);
+
+      // only commands not yet started can be aborted
+      if ( p_task && p_task != p_cmd )
+      {
+        if ( p_task->state == UAS_CMD_QUEUED )
+        {
+          p_task->state = UAS_CMD_FREE;
+        }
+        else
+        {
+          response = UAS_RESPONSE_TMF_FAILED;
+        }
+      }
+    }
+    break;
+
+    case UAS_TMF_ABORT_TASK_SET:
+    case UAS_TMF_CLEAR_TASK_SET:
+    case UAS_TMF_LOGICAL_UNIT_RESET:
+    case UAS_TMF_IT_NEXUS_RESET:
+      for(uint8_t i=0; i<CFG_TUD_UAS_QUEUE_DEPTH; i++)
+      {
+        uasd_cmd_t* p_task = &_uasd_itf.cmd[i];
+        bool const lun_match = (p_iu->function == UAS_TMF_IT_NEXUS_RESET) || (p_task->lun == p_cmd->lun);
+
+        if ( p_task->state == UAS_CMD_QUEUED && lun_match ) p_task->state = UAS_CMD_FREE;
+      }
+    break;
+
+    case UAS_TMF_QUERY_TASK:
+    {
+      uasd_cmd_t* p_task = cmd_find_tag(p_iu->task_tag);
+      if ( p_task && p_task != p_cmd ) response = UAS_RESPONSE_TMF_SUCCEEDED;
+    }
+    break;
+
+    default: response = UAS_RESPONSE_TMF_NOT_SUPPORTED; break;
+  }
+
+  cmd_respond(p_cmd, response);
+}
+
+static void proc_iu(uint8_t rhport, uint32_t len)
+{
+  uas_command_iu_t const* p_iu = &_uasd_itf.cmd_iu;
+
+  // command pipe is only armed with a free slot
+  uasd_cmd_t* p_cmd = cmd_alloc();
+  TU_ASSERT(p_cmd, );
+
+  if ( (p_iu->iu_id == UAS_IU_COMMAND || p_iu->iu_id == UAS_IU_TASK_MGMT) && cmd_find_tag(p_iu->tag) )
+  {
+    // tag of new IU is still in use
+    p_cmd->tag = p_iu->tag;
+    cmd_respond(p_cmd, UAS_RESPONSE_OVERLAPPED_TAG);
+  }
+  else if ( p_iu->iu_id == UAS_IU_COMMAND && len >= sizeof(uas_command_iu_t) )
+  {
+    proc_command_iu(rhport, p_cmd);
+  }
+  else if ( p_iu->iu_id == UAS_IU_TASK_MGMT && len >= sizeof(uas_task_mgmt_iu_t) )
+  {
+    proc_task_mgmt_iu(p_cmd);
+  }
+  else
+  {
+    p_cmd->tag = p_iu->tag;
+    cmd_respond(p_cmd, UAS_RESPONSE_INVALID_IU);
+  }
+}
+
+//--------------------------------------------------------------------+
+// Data pipes
+//--------------------------------------------------------------------+
+
+static void retry_func(void* param)
+{
+  (void) param;
+
+  _uasd_itf.retry_pending = false;
+  data_continue(_uasd_itf.rhport);
+  schedule(_uasd_itf.rhport);
+}
+
+// Application is not ready, try again later
+static void data_retry(void)
+{
+  if ( _uasd_itf.retry_pending ) return;
+
+  _uasd_itf.retry_pending = true;
+  usbd_defer_func(retry_func, NULL, false);
+}
+
+// Fetch next chunk of READ command into buffer, return its length, 0 if application is not ready
+// or -1 on error
+static int32_t data_in_fetch(uasd_cmd_t* p_cmd)
+{
+  uasd_interface_t* p_uas = &_uasd_itf;
+
+  uint64_t block_count;
+  uint32_t block_size;
+  mscd_get_capacity(p_cmd->lun, &block_count, &block_size);
+
+  uint32_t const nbytes = tu_min32(CFG_TUD_UAS_BUFSIZE, p_cmd->total_len - p_uas->app_len);
+  uint64_t const lba    = mscd_rdwr_get_lba(p_cmd->cdb) + (p_uas->app_len / block_size);
+
+  int32_t const nread = mscd_read_cb(p_cmd->lun, lba, p_uas->app_len % block_size, _uasd_buf, nbytes);
+
+  if ( app_failed(nread) ) return -1;
+  if ( nread == 0 ) return 0;
+
+  p_uas->buf_len  = (uint16_t) tu_min32((uint32_t) nread, nbytes);
+  p_uas->app_len += p_uas->buf_len;
+
+  return p_uas->buf_len;
+}
+
+static void data_in_continue(uint8_t rhport, uasd_cmd_t* p_cmd)
+{
+  uasd_interface_t* p_uas = &_uasd_itf;
+
+  if ( p_cmd->xferred_len >= p_cmd->total_len )
+  {
+    cmd_complete(p_cmd, true);
+    return;
+  }
+
+  if ( p_uas->data_busy ) return;
+
+  // fetch next chunk, response of other commands is already in buffer
+  if ( p_uas->buf_len == 0 )
+  {
+    int32_t const nread = data_in_fetch(p_cmd);
+
+    if ( nread < 0 )
+    {
+      cmd_complete(p_cmd, false);
+      return;
+    }
+
+    if ( nread == 0 )
+    {
+      data_retry();
+      return;
+    }
+  }
+
+  p_uas->data_busy = true;
+  TU_ASSERT( usbd_edpt_xfer(rhport, p_uas->ep_in, _uasd_buf, p_uas->buf_len), );
+}
+
+static void data_out_continue(uint8_t rhport, uasd_cmd_t* p_cmd)
+{
+  uasd_interface_t* p_uas = &_uasd_itf;
+
+  // drain received chunk, application may consume it partially
+  if ( p_uas->buf_ofs < p_uas->buf_len )
+  {
+    uint64_t block_count;
+    uint32_t block_size;
+    mscd_get_capacity(p_cmd->lun, &block_count, &block_size);
+
+    uint64_t const lba = mscd_rdwr_get_lba(p_cmd->cdb) + (p_uas->app_len / block_size);
+    uint32_t const nbytes = (uint32_t) (p_uas->buf_len - p_uas->buf_ofs);
+
+    int32_t const nwrite = mscd_write_cb(p_cmd->lun, lba, p_uas->app_len % block_size,
+                                         _uasd_buf + p_uas->buf_ofs, nbytes);
+
+    if ( app_failed(nwrite) )
+    {
+      cmd_complete(p_cmd, false);
+      return;
+    }
+
+    uint32_t const consumed = tu_min32((uint32_t) nwrite, nbytes);
+    p_uas->buf_ofs += (uint16_t) consumed;
+    p_uas->app_len += consumed;
+
+    if ( p_uas->buf_ofs < p_uas->buf_len )
+    {
+      data_retry();
+      return;
+    }
+  }
+
+  if ( p_uas->app_len >= p_cmd->total_len )
+  {
+    cmd_complete(p_cmd, true);
+    return;
+  }
+
+  if ( p_uas->data_busy || p_cmd->xferred_len >= p_cmd->total_len ) return;
+
+  p_uas->buf_len = 0;
+  p_uas->buf_ofs = 0;
+  p_uas->data_busy = true;
+
+  uint16_t const nbytes = (uint16_t) tu_min32(CFG_TUD_UAS_BUFSIZE, p_cmd->total_len - p_cmd->xferred_len);
+  TU_ASSERT( usbd_edpt_xfer(rhport, p_uas->ep_out, _uasd_buf, nbytes), );
+}
+
+static void data_continue(uint8_t rhport)
+{
+  uasd_interface_t* p_uas = &_uasd_itf;
+  if ( p_uas->data_idx == UAS_NO_CMD ) return;
+
+  uasd_cmd_t* p_cmd = &p_uas->cmd[p_uas->data_idx];
+  if ( p_cmd->state != UAS_CMD_DATA ) return;
+
+  if ( mscd_is_write_cmd(p_cmd->cdb[0]) )
+  {
+    data_out_continue(rhport, p_cmd);
+  }
+  else
+  {
+    data_in_continue(rhport, p_cmd);
+  }
+}
+
+//--------------------------------------------------------------------+
+// Pipe scheduling
+//--------------------------------------------------------------------+
+
+static void schedule(uint8_t rhport)
+{
+  uasd_interface_t* p_uas = &_uasd_itf;
+
+  // Data pipes: serve queued commands in arrival order, skipping the ones application is not ready for.
+  // Their turn comes again next round, which is forced if nothing else would trigger it.
+  while ( p_uas->data_idx == UAS_NO_CMD )
+  {
+    uasd_cmd_t* p_cmd = cmd_find_oldest(UAS_CMD_QUEUED);
+    if ( !p_cmd ) break;
+
+    if ( !cmd_start(p_cmd) ) p_cmd->state = UAS_CMD_WAIT;
+  }
+
+  for(uint8_t i=0; i<CFG_TUD_UAS_QUEUE_DEPTH; i++)
+  {
+    uasd_cmd_t* p_cmd = &p_uas->cmd[i];
+    if ( p_cmd->state != UAS_CMD_WAIT ) continue;
+
+    p_cmd->state = UAS_CMD_QUEUED;
+    if ( p_uas->data_idx == UAS_NO_CMD ) data_retry();
+  }
+
+  // Status pipe: Ready IU of data command first since it holds up the data pipes
+  if ( p_uas->status_idx == UAS_NO_CMD )
+  {
+    uasd_cmd_t* p_cmd = NULL;
+
+    if ( p_uas->data_idx != UAS_NO_CMD && p_uas->cmd[p_uas->data_idx].state == UAS_CMD_READY )
+    {
+      p_cmd = &p_uas->cmd[p_uas->data_idx];
+    }
+    else
+    {
+      p_cmd = cmd_find_oldest(UAS_CMD_STATUS);
+    }
+
+    if ( p_cmd )
+    {
+      p_uas->status_idx = cmd_index(p_cmd);
+      TU_ASSERT( usbd_edpt_xfer(rhport, p_uas->ep_status, p_cmd->iu, p_cmd->iu_len), );
+    }
+  }
+
+  // Command pipe: accept next IU as long as there is room for it
+  if ( !p_uas->cmd_armed )
+  {
+    for(uint8_t i=0; i<CFG_TUD_UAS_QUEUE_DEPTH; i++)
+    {
+      if ( p_uas->cmd[i].state == UAS_CMD_FREE )
+      {
+        p_uas->cmd_armed = true;
+        TU_ASSERT( usbd_edpt_xfer(rhport, p_uas->ep_cmd, (uint8_t*) &p_uas->cmd_iu, sizeof(uas_command_iu_t)), );
+        break;
+      }
+    }
+  }
+}
+
+//--------------------------------------------------------------------+
+// USBD Driver API
+//--------------------------------------------------------------------+
+void uasd_init(void)
+{
+  tu_memclr(&_uasd_itf, sizeof(uasd_interface_t));
+  _uasd_itf.status_idx = UAS_NO_CMD;
+  _uasd_itf.data_idx   = UAS_NO_CMD;
+}
+
+void uasd_reset(uint8_t rhport)
+{
+  (void) rhport;
+  uasd_init();
+}
+
+bool uasd_open(uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint16_t *p_len)
+{
+  TU_VERIFY(MSC_SUBCLASS_SCSI == itf_desc->bInterfaceSubClass &&
+            MSC_PROTOCOL_UAS  == itf_desc->bInterfaceProtocol);
+
+  uasd_interface_t * p_uas = &_uasd_itf;
+
+  uint8_t const * p_desc = tu_desc_next(itf_desc);
+  (*p_len) = sizeof(tusb_desc_interface_t);
+
+  // Each bulk endpoint is followed by Pipe Usage descriptor telling its role
+  for(uint8_t i=0; i<itf_desc->bNumEndpoints; i++)
+  {
+    tusb_desc_endpoint_t const * desc_ep = (tusb_desc_endpoint_t const *) p_desc;
+    TU_ASSERT(TUSB_DESC_ENDPOINT == desc_ep->bDescriptorType && TUSB_XFER_BULK == desc_ep->bmAttributes.xfer);
+
+    uint8_t const * p_usage = tu_desc_next(p_desc);
+    TU_ASSERT(UAS_DESC_PIPE_USAGE == tu_desc_type(p_usage));
+
+    switch ( p_usage[2] )
+    {
+      case UAS_PIPE_COMMAND : p_uas->ep_cmd    = desc_ep->bEndpointAddress; break;
+      case UAS_PIPE_STATUS  : p_uas->ep_status = desc_ep->bEndpointAddress; break;
+      case UAS_PIPE_DATA_IN : p_uas->ep_in     = desc_ep->bEndpointAddress; break;
+      case UAS_PIPE_DATA_OUT: p_uas->ep_out    = desc_ep->bEndpointAddress; break;
+      default: return false;
+    }
+
+    TU_ASSERT( dcd_edpt_open(rhport, desc_ep) );
+
+    (*p_len) += (uint16_t) (desc_ep->bLength + tu_desc_len(p_usage));
+    p_desc = tu_desc_next(p_usage);
+  }
+
+  TU_ASSERT(p_uas->ep_cmd && p_uas->ep_status && p_uas->ep_in && p_uas->ep_out);
+
+  p_uas->rhport  = rhport;
+  p_uas->itf_num = itf_desc->bInterfaceNumber;
+
+  // Prepare for Command IU
+  schedule(rhport);
+
+  return true;
+}
+
+// Handle class control request
+// return false to stall control endpoint (e.g unsupported request)
+bool uasd_control_request(uint8_t rhport, tusb_control_request_t const * p_request)
+{
+  (void) rhport;
+  (void) p_request;
+
+  // UAS has no class request, Max LUN is reported by REPORT LUNS command
+  return false;
+}
+
+// Invoked when class request DATA stage is finished.
+bool uasd_control_complete(uint8_t rhport, tusb_control_request_t const * request)
+{
+  (void) rhport;
+  (void) request;
+
+  // nothing to do
+  return true;
+}
+
+bool uasd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t xferred_bytes)
+{
+  uasd_interface_t* p_uas = &_uasd_itf;
+
+  if ( ep_addr == p_uas->ep_cmd )
+  {
+    p_uas->cmd_armed = false;
+    if ( event == XFER_RESULT_SUCCESS ) proc_iu(rhport, xferred_bytes);
+  }
+  else if ( ep_addr == p_uas->ep_status )
+  {
+    TU_ASSERT(p_uas->status_idx != UAS_NO_CMD);
+
+    uasd_cmd_t* p_cmd = &p_uas->cmd[p_uas->status_idx];
+    p_uas->status_idx = UAS_NO_CMD;
+
+    if ( p_cmd->state == UAS_CMD_READY )
+    {
+      // host is now ready for the data transfer
+      p_cmd->state = UAS_CMD_DATA;
+      data_continue(rhport);
+    }
+    else
+    {
+      p_cmd->state = UAS_CMD_FREE;
+    }
+  }
+  else if ( (ep_addr == p_uas->ep_in) || (ep_addr == p_uas->ep_out) )
+  {
+    TU_ASSERT(p_uas->data_idx != UAS_NO_CMD);
+
+    uasd_cmd_t* p_cmd = &p_uas->cmd[p_uas->data_idx];
+    p_uas->data_busy = false;
+
+    if ( event != XFER_RESULT_SUCCESS )
+    {
+      tud_msc_set_sense(p_cmd->lun, SCSI_SENSE_ABORTED_COMMAND, 0x00, 0x00);
+      cmd_complete(p_cmd, false);
+    }
+    else
+    {
+      p_cmd->xferred_len += xferred_bytes;
+
+      if ( ep_addr == p_uas->ep_in )
+      {
+        p_uas->buf_len = 0;
+      }
+      else
+      {
+        p_uas->buf_len = (uint16_t) xferred_bytes;
+        p_uas->buf_ofs = 0;
+      }
+
+      data_continue(rhport);
+    }
+  }
+  else
+  {
+    return false;
+  }
+
+  schedule(rhport);
+
+  return true;
+}
+
+#endif
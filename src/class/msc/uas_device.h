@@ -0,0 +1,90 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _TUSB_UAS_DEVICE_H_
+#define _TUSB_UAS_DEVICE_H_
+
+#include "common/tusb_common.h"
+#include "device/usbd.h"
+#include "msc.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// Class Driver Configuration
+//--------------------------------------------------------------------+
+
+// UAS shares SCSI command handling, sense data and application callbacks (tud_msc_*_cb) with MSC driver
+#if !CFG_TUD_MSC
+  #error CFG_TUD_UAS requires CFG_TUD_MSC
+#endif
+
+// Number of commands host can queue, each is identified by its tag
+#ifndef CFG_TUD_UAS_QUEUE_DEPTH
+  #define CFG_TUD_UAS_QUEUE_DEPTH   4
+#endif
+
+// Data stage buffer, shared by queued commands since data pipes serve one command at a time
+#ifndef CFG_TUD_UAS_BUFSIZE
+  #define CFG_TUD_UAS_BUFSIZE       CFG_TUD_MSC_BUFSIZE
+#endif
+
+TU_VERIFY_STATIC(CFG_TUD_UAS_QUEUE_DEPTH > 0 && CFG_TUD_UAS_QUEUE_DEPTH < 255, "Queue depth is not correct");
+TU_VERIFY_STATIC(CFG_TUD_UAS_BUFSIZE < UINT16_MAX, "Size is not correct");
+
+/** \addtogroup ClassDriver_MSC
+ *  @{
+ * \defgroup UAS_Device USB Attached SCSI Device
+ *  @{
+ *
+ * Uses the command, status, data-in and data-out pipes of USB 2.0 UAS (without streams). Host can queue up
+ * to CFG_TUD_UAS_QUEUE_DEPTH tagged commands. Commands without data (e.g TEST UNIT READY) complete as soon as
+ * they are received, others take the data pipes in arrival order and are announced with READ/WRITE READY IU.
+ * A READ whose first data is not ready yet (read callback returns 0) lets the commands queued after it go first.
+ *
+ * Application implements the same callbacks as for MSC driver. Commands other than READ/WRITE are assumed
+ * to be data-in or no-data. Read/write callbacks must not return TUD_MSC_RET_ASYNC, this is asserted and
+ * fails the command.
+ *  @} */
+/** @} */
+
+//--------------------------------------------------------------------+
+// Internal Class Driver API
+//--------------------------------------------------------------------+
+void uasd_init             (void);
+void uasd_reset            (uint8_t rhport);
+bool uasd_open             (uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint16_t *p_length);
+bool uasd_control_request  (uint8_t rhport, tusb_control_request_t const * p_request);
+bool uasd_control_complete (uint8_t rhport, tusb_control_request_t const * p_request);
+bool uasd_xfer_cb          (uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t xferred_bytes);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _TUSB_UAS_DEVICE_H_ */
@@ -79,6 +79,9 @@
   #define TU_BSWAP16(u16) (__builtin_bswap16(u16))
   #define TU_BSWAP32(u32) (__builtin_bswap32(u32))
 
+  // Memory barrier: neither compiler nor cpu can move memory access across it (except store followed by load)
+  #define tu_mem_barrier()  __atomic_thread_fence(__ATOMIC_ACQ_REL)
+
 #elif defined(__TI_COMPILER_VERSION__)
   #define TU_ATTR_ALIGNED(Bytes)        __attribute__ ((aligned(Bytes)))
   #define TU_ATTR_SECTION(sec_name)     __attribute__ ((section(#sec_name)))
@@ -99,6 +102,8 @@
   #define TU_BSWAP16(u16) (__builtin_bswap16(u16))
   #define TU_BSWAP32(u32) (__builtin_bswap32(u32))
 
+  #define tu_mem_barrier()  __sync_synchronize()
+
 #else
   #error "Compiler attribute porting is required"
 #endif
@@ -32,72 +32,110 @@
 // implement mutex lock and unlock
 #if CFG_FIFO_MUTEX
 
-static void tu_fifo_lock(tu_fifo_t *f)
+static void tu_fifo_lock(tu_fifo_mutex_t mutex)
 {
-  if (f->mutex)
+  if (mutex)
   {
-    osal_mutex_lock(f->mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+    osal_mutex_lock(mutex, OSAL_TIMEOUT_WAIT_FOREVER);
   }
 }
 
-static void tu_fifo_unlock(tu_fifo_t *f)
+static void tu_fifo_unlock(tu_fifo_mutex_t mutex)
 {
-  if (f->mutex)
+  if (mutex)
   {
-    osal_mutex_unlock(f->mutex);
+    osal_mutex_unlock(mutex);
   }
 }
 
 #else
 
-#define tu_fifo_lock(_ff)
-#define tu_fifo_unlock(_ff)
+#define tu_fifo_lock(_mutex)
+#define tu_fifo_unlock(_mutex)
 
 #endif
 
 bool tu_fifo_config(tu_fifo_t *f, void* buffer, uint16_t depth, uint16_t item_size, bool overwritable)
 {
-  tu_fifo_lock(f);
+  // indices run within [0, 2*depth)
+  TU_VERIFY(depth <= 0x8000);
+
+  tu_fifo_lock(f->mutex_wr);
+  tu_fifo_lock(f->mutex_rd);
 
   f->buffer = (uint8_t*) buffer;
   f->depth  = depth;
   f->item_size = item_size;
   f->overwritable = overwritable;
 
-  f->rd_idx = f->wr_idx = f->count = 0;
+  f->rd_idx = f->wr_idx = 0;
 
-  tu_fifo_unlock(f);
+  tu_fifo_unlock(f->mutex_rd);
+  tu_fifo_unlock(f->mutex_wr);
 
   return true;
 }
 
-// retrieve data from fifo
-static void _tu_ff_pull(tu_fifo_t* f, void * buffer)
+// advance index by n items (n <= depth) within [0, 2*depth), without division
+static inline uint16_t _ff_advance(tu_fifo_t* f, uint16_t idx, uint16_t n)
 {
-  memcpy(buffer,
-         f->buffer + (f->rd_idx * f->item_size),
-         f->item_size);
+  uint32_t next = (uint32_t) idx + n;
+  if ( next >= 2u*f->depth ) next -= 2u*f->depth;
+  return (uint16_t) next;
+}
 
-  f->rd_idx = (f->rd_idx + 1) % f->depth;
-  f->count--;
+// convert index to buffer position
+static inline uint16_t _ff_pos(tu_fifo_t* f, uint16_t idx)
+{
+  return (idx >= f->depth) ? (uint16_t) (idx - f->depth) : idx;
 }
 
-// send data to fifo
-static void _tu_ff_push(tu_fifo_t* f, void const * data)
+// retrieve n items (n <= count) from fifo, at most 2 memcpy: up to the wrap point then the rest
+// Only modify read index, safe against a concurrent producer.
+static void _tu_ff_pull_n(tu_fifo_t* f, void * buffer, uint16_t n)
 {
-  memcpy( f->buffer + (f->wr_idx * f->item_size),
-          data,
-          f->item_size);
+  uint8_t* buf8 = (uint8_t*) buffer;
 
-  f->wr_idx = (f->wr_idx + 1) % f->depth;
+  uint16_t const rd_idx = f->rd_idx;
+  uint16_t const pos    = _ff_pos(f, rd_idx);
+  uint16_t const lin    = tu_min16(n, (uint16_t) (f->depth - pos));
 
-  if (tu_fifo_full(f))
-  {
-    f->rd_idx = f->wr_idx; // keep the full state (rd == wr && len = size)
-  }
-  else
+  // items must be read only after their write index is observed
+  tu_mem_barrier();
+
+  memcpy(buf8, f->buffer + (pos * f->item_size), lin*f->item_size);
+  if ( n > lin ) memcpy(buf8 + lin*f->item_size, f->buffer, (n-lin)*f->item_size);
+
+  // items must be consumed before their space is released to producer
+  tu_mem_barrier();
+
+  f->rd_idx = _ff_advance(f, rd_idx, n);
+}
+
+// send n items (n <= depth) to fifo, at most 2 memcpy: up to the wrap point then the rest
+// Only modify write index, safe against a concurrent consumer. Except when an overwritable fifo overflows:
+// read index is moved as well, caller must hold the read mutex.
+static void _tu_ff_push_n(tu_fifo_t* f, void const * data, uint16_t n)
+{
+  uint8_t const* buf8 = (uint8_t const*) data;
+
+  uint16_t const wr_idx = f->wr_idx;
+  uint16_t const pos    = _ff_pos(f, wr_idx);
+  uint16_t const lin    = tu_min16(n, (uint16_t) (f->depth - pos));
+
+  memcpy(f->buffer + (pos * f->item_size), buf8, lin*f->item_size);
+  if ( n > lin ) memcpy(f->buffer, buf8 + lin*f->item_size, (n-lin)*f->item_size);
+
+  // items must be written before they are published to consumer
+  tu_mem_barrier();
+
+  uint16_t const count = tu_fifo_count(f);
+  f->wr_idx = _ff_advance(f, wr_idx, n);
+
+  if ( count + n > f->depth )
   {
-    f->count++;
+    // overwritable fifo overflowed: drop oldest items to keep the full state (wr - rd == depth)
+    f->rd_idx = _ff_advance(f, f->wr_idx, f->depth);
   }
 }
 
@@ -119,15 +157,15 @@ static void _tu_ff_push(tu_fifo_t* f, void const * data)
 /******************************************************************************/
 bool tu_fifo_read(tu_fifo_t* f, void * buffer)
 {
-  if( tu_fifo_empty(f) ) return false;
-
-  tu_fifo_lock(f);
+  tu_fifo_lock(f->mutex_rd);
 
-  _tu_ff_pull(f, buffer);
+  // checked under lock: another reader may have taken the last item
+  bool const success = !tu_fifo_empty(f);
+  if ( success ) _tu_ff_pull_n(f, buffer, 1);
 
-  tu_fifo_unlock(f);
+  tu_fifo_unlock(f->mutex_rd);
 
-  return true;
+  return success;
 }
 
 /******************************************************************************/
@@ -150,25 +188,16 @@ uint16_t tu_fifo_read_n (tu_fifo_t* f, void * buffer, uint16_t count)
 {
   if( tu_fifo_empty(f) ) return 0;
 
-  tu_fifo_lock(f);
+  tu_fifo_lock(f->mutex_rd);
 
   /* Limit up to fifo's count */
-  if ( count > f->count ) count = f->count;
-
-  uint8_t* buf8 = (uint8_t*) buffer;
-  uint16_t len = 0;
-
-  while (len < count)
-  {
-    _tu_ff_pull(f, buf8);
+  count = tu_min16(count, tu_fifo_count(f));
 
-    len++;
-    buf8 += f->item_size;
-  }
+  _tu_ff_pull_n(f, buffer, count);
 
-  tu_fifo_unlock(f);
+  tu_fifo_unlock(f->mutex_rd);
 
-  return len;
+  return count;
 }
 
 /******************************************************************************/
@@ -187,10 +216,14 @@ uint16_t tu_fifo_read_n (tu_fifo_t* f, void * buffer, uint16_t count)
 /******************************************************************************/
 bool tu_fifo_peek_at(tu_fifo_t* f, uint16_t pos, void * p_buffer)
 {
-  if ( pos >= f->count ) return false;
+  uint16_t const rd_idx = f->rd_idx;
+
+  if ( pos >= _tu_fifo_count(f, f->wr_idx, rd_idx) ) return false;
+
+  tu_mem_barrier();
 
   // rd_idx is pos=0
-  uint16_t index = (f->rd_idx + pos) % f->depth;
+  uint16_t index = _ff_pos(f, _ff_advance(f, rd_idx, pos));
   memcpy(p_buffer,
          f->buffer + (index * f->item_size),
          f->item_size);
@@ -217,15 +250,7 @@ bool tu_fifo_peek_at(tu_fifo_t* f, uint16_t pos, void * p_buffer)
 /******************************************************************************/
 bool tu_fifo_write (tu_fifo_t* f, const void * data)
 {
-  if ( tu_fifo_full(f) && !f->overwritable ) return false;
-
-  tu_fifo_lock(f);
-
-  _tu_ff_push(f, data);
-
-  tu_fifo_unlock(f);
-
-  return true;
+  return tu_fifo_write_n(f, data, 1) == 1;
 }
 
 /******************************************************************************/
@@ -247,25 +272,135 @@ uint16_t tu_fifo_write_n (tu_fifo_t* f, const void * data, uint16_t count)
 {
   if ( count == 0 ) return 0;
 
-  tu_fifo_lock(f);
+  uint8_t const* buf8 = (uint8_t const*) data;
+  uint16_t const total = count;
 
-  // Not overwritable limit up to full
-  if (!f->overwritable) count = tu_min16(count, tu_fifo_remaining(f));
+  if (!f->overwritable)
+  {
+    tu_fifo_lock(f->mutex_wr);
 
-  uint8_t const* buf8 = (uint8_t const*) data;
-  uint16_t len = 0;
+    // Not overwritable limit up to full
+    count = tu_min16(count, tu_fifo_remaining(f));
+    if ( count ) _tu_ff_push_n(f, buf8, count);
+
+    tu_fifo_unlock(f->mutex_wr);
 
-  while (len < count)
+    return count;
+  }
+  else
   {
-    _tu_ff_push(f, buf8);
+    // Overflow also moves read index, consumer must be locked out as well
+    tu_fifo_lock(f->mutex_wr);
+    tu_fifo_lock(f->mutex_rd);
+
+    if (count > f->depth)
+    {
+      // only the last depth items survive, skip the rest
+      buf8 += (count - f->depth)*f->item_size;
+      count = f->depth;
+    }
 
-    len++;
-    buf8 += f->item_size;
+    _tu_ff_push_n(f, buf8, count);
+
+    tu_fifo_unlock(f->mutex_rd);
+    tu_fifo_unlock(f->mutex_wr);
+
+    return total;
   }
+}
+
+// fill in region info starting at index idx with n items
+static void _ff_get_info(tu_fifo_t* f, uint16_t idx, uint16_t n, tu_fifo_buffer_info_t* info)
+{
+  uint16_t const pos = _ff_pos(f, idx);
+
+  info->len_lin  = tu_min16(n, (uint16_t) (f->depth - pos));
+  info->len_wrap = (uint16_t) (n - info->len_lin);
+  info->ptr_lin  = f->buffer + (pos * f->item_size);
+  info->ptr_wrap = info->len_wrap ? f->buffer : NULL;
+}
+
+/******************************************************************************/
+/*!
+    @brief Get the readable region(s) of the fifo storage without copying.
+    Data can be consumed in place, then tu_fifo_advance_read() releases it.
+
+    @param[in]  f
+                Pointer to the FIFO buffer to manipulate
+    @param[out] info
+                Linear and wrapped region with their length in items
+*/
+/******************************************************************************/
+void tu_fifo_get_read_info(tu_fifo_t* f, tu_fifo_buffer_info_t* info)
+{
+  uint16_t const rd_idx = f->rd_idx;
+  uint16_t const count  = _tu_fifo_count(f, f->wr_idx, rd_idx);
+
+  // items must be read only after their write index is observed
+  tu_mem_barrier();
+
+  _ff_get_info(f, rd_idx, count, info);
+}
+
+/******************************************************************************/
+/*!
+    @brief Get the writable (free) region(s) of the fifo storage without copying.
+    Data can be produced in place, then tu_fifo_advance_write() publishes it.
+
+    @param[in]  f
+                Pointer to the FIFO buffer to manipulate
+    @param[out] info
+                Linear and wrapped region with their length in items
+*/
+/******************************************************************************/
+void tu_fifo_get_write_info(tu_fifo_t* f, tu_fifo_buffer_info_t* info)
+{
+  uint16_t const wr_idx = f->wr_idx;
+  uint16_t const count  = _tu_fifo_count(f, wr_idx, f->rd_idx);
+
+  _ff_get_info(f, wr_idx, (uint16_t) (f->depth - count), info);
+}
+
+/******************************************************************************/
+/*!
+    @brief Release n items consumed in place, n is capped at fifo's count
+
+    @param[in]  f
+                Pointer to the FIFO buffer to manipulate
+    @param[in]  n
+                Number of items consumed
+*/
+/******************************************************************************/
+void tu_fifo_advance_read(tu_fifo_t* f, uint16_t n)
+{
+  uint16_t const rd_idx = f->rd_idx;
+  n = tu_min16(n, _tu_fifo_count(f, f->wr_idx, rd_idx));
+
+  // items must be consumed before their space is released to producer
+  tu_mem_barrier();
+
+  f->rd_idx = _ff_advance(f, rd_idx, n);
+}
+
+/******************************************************************************/
+/*!
+    @brief Publish n items produced in place, n is capped at fifo's free space
+
+    @param[in]  f
+                Pointer to the FIFO buffer to manipulate
+    @param[in]  n
+                Number of items produced
+*/
+/******************************************************************************/
+void tu_fifo_advance_write(tu_fifo_t* f, uint16_t n)
+{
+  uint16_t const wr_idx = f->wr_idx;
+  n = tu_min16(n, (uint16_t) (f->depth - _tu_fifo_count(f, wr_idx, f->rd_idx)));
 
-  tu_fifo_unlock(f);
+  // items must be written before they are published to consumer
+  tu_mem_barrier();
 
-  return len;
+  f->wr_idx = _ff_advance(f, wr_idx, n);
 }
 
 /******************************************************************************/
@@ -278,11 +413,13 @@ uint16_t tu_fifo_write_n (tu_fifo_t* f, const void * data, uint16_t count)
 /******************************************************************************/
 bool tu_fifo_clear(tu_fifo_t *f)
 {
-  tu_fifo_lock(f);
+  tu_fifo_lock(f->mutex_wr);
+  tu_fifo_lock(f->mutex_rd);
 
-  f->rd_idx = f->wr_idx = f->count = 0;
+  f->rd_idx = f->wr_idx = 0;
 
-  tu_fifo_unlock(f);
+  tu_fifo_unlock(f->mutex_rd);
+  tu_fifo_unlock(f->mutex_wr);
 
   return true;
 }
@@ -49,6 +49,13 @@
 
 /** \struct tu_fifo_t
  * \brief Simple Circular FIFO
+ *
+ * Read and write indices run freely within [0, 2*depth) so that full and empty can be told apart
+ * without a shared item count. The producer only modifies wr_idx and the consumer only modifies rd_idx,
+ * therefore a single producer and a single consumer (e.g ISR and task) can access the fifo concurrently
+ * without any locking. Exceptions are tu_fifo_clear() and an overwritable fifo that overflows: both
+ * touch the read index and must not run concurrently with the consumer. An overwritable fifo shared by
+ * producer and consumer of different threads therefore needs both mutexes, see tu_fifo_config_mutex().
  */
 typedef struct
 {
@@ -57,16 +64,27 @@ typedef struct
            uint16_t item_size ; ///< size of each item
            bool overwritable  ;
 
-  volatile uint16_t count     ; ///< number of items in queue
-  volatile uint16_t wr_idx    ; ///< write pointer
-  volatile uint16_t rd_idx    ; ///< read pointer
+  volatile uint16_t wr_idx    ; ///< write index, only modified by producer
+  volatile uint16_t rd_idx    ; ///< read index, only modified by consumer
 
 #if CFG_FIFO_MUTEX
-  tu_fifo_mutex_t mutex;
+  tu_fifo_mutex_t mutex_wr;   ///< serialize multiple producers, NULL if there is only one
+  tu_fifo_mutex_t mutex_rd;   ///< serialize multiple consumers, NULL if there is only one
 #endif
 
 } tu_fifo_t;
 
+/** \struct tu_fifo_buffer_info_t
+ * \brief Contiguous region(s) of fifo storage, the second one is only used when the region wraps around
+ */
+typedef struct
+{
+  uint16_t len_lin  ; ///< linear length in items
+  uint16_t len_wrap ; ///< wrapped length in items, zero if region does not wrap
+  void*    ptr_lin  ; ///< start of linear part
+  void*    ptr_wrap ; ///< start of wrapped part (fifo buffer), NULL if region does not wrap
+} tu_fifo_buffer_info_t;
+
 #define TU_FIFO_DEF(_name, _depth, _type, _overwritable) \
   uint8_t _name##_buf[_depth*sizeof(_type)]; \
   tu_fifo_t _name = {                        \
@@ -80,9 +98,13 @@ bool tu_fifo_clear(tu_fifo_t *f);
 bool tu_fifo_config(tu_fifo_t *f, void* buffer, uint16_t depth, uint16_t item_size, bool overwritable);
 
 #if CFG_FIFO_MUTEX
-static inline void tu_fifo_config_mutex(tu_fifo_t *f, tu_fifo_mutex_t mutex_hdl)
+// Mutex is only required on the side that has more than one accessor e.g
+// tx fifo written by several application tasks: write mutex only, read mutex = NULL
+// Overwritable fifo needs both: producer also moves the read index when it overflows
+static inline void tu_fifo_config_mutex(tu_fifo_t *f, tu_fifo_mutex_t write_mutex_hdl, tu_fifo_mutex_t read_mutex_hdl)
 {
-  f->mutex = mutex_hdl;
+  f->mutex_wr = write_mutex_hdl;
+  f->mutex_rd = read_mutex_hdl;
 }
 #endif
 
@@ -94,29 +116,43 @@ uint16_t tu_fifo_read_n  (tu_fifo_t* f, void * p_buffer, uint16_t count);
 
 bool     tu_fifo_peek_at (tu_fifo_t* f, uint16_t pos, void * p_buffer);
 
+// Zero-copy access: get readable/writable region(s) of fifo storage, then advance read/write index by
+// the number of items actually consumed/produced. No locking is done, caller must be the only consumer
+// (read info) or producer (write info) from getting the info until advancing.
+void     tu_fifo_get_read_info  (tu_fifo_t* f, tu_fifo_buffer_info_t* info);
+void     tu_fifo_get_write_info (tu_fifo_t* f, tu_fifo_buffer_info_t* info);
+void     tu_fifo_advance_read   (tu_fifo_t* f, uint16_t n);
+void     tu_fifo_advance_write  (tu_fifo_t* f, uint16_t n);
+
 static inline bool tu_fifo_peek(tu_fifo_t* f, void * p_buffer)
 {
   return tu_fifo_peek_at(f, 0, p_buffer);
 }
 
-static inline bool tu_fifo_empty(tu_fifo_t* f)
+// number of items between read and write index
+static inline uint16_t _tu_fifo_count(tu_fifo_t* f, uint16_t wr_idx, uint16_t rd_idx)
 {
-  return (f->count == 0);
+  return (wr_idx >= rd_idx) ? (uint16_t) (wr_idx - rd_idx) : (uint16_t) (2*f->depth - (rd_idx - wr_idx));
 }
 
-static inline bool tu_fifo_full(tu_fifo_t* f)
+static inline uint16_t tu_fifo_count(tu_fifo_t* f)
 {
-  return (f->count == f->depth);
+  return _tu_fifo_count(f, f->wr_idx, f->rd_idx);
 }
 
-static inline uint16_t tu_fifo_count(tu_fifo_t* f)
+static inline bool tu_fifo_empty(tu_fifo_t* f)
+{
+  return f->wr_idx == f->rd_idx;
+}
+
+static inline bool tu_fifo_full(tu_fifo_t* f)
 {
-  return f->count;
+  return tu_fifo_count(f) == f->depth;
 }
 
 static inline uint16_t tu_fifo_remaining(tu_fifo_t* f)
 {
-  return f->depth - f->count;
+  return f->depth - tu_fifo_count(f);
 }
 
 static inline uint16_t tu_fifo_depth(tu_fifo_t* f)
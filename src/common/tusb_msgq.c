@@ -0,0 +1,283 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <string.h>
+
+#include "tusb_common.h"
+#include "tusb_msgq.h"
+
+// Message layout: 16-bit little endian length followed by payload, messages are stored back to back.
+// When a message does not fit before the end of buffer, it is placed at the start instead and the tail
+// is skipped: with a SKIP marker if there is room for a header, implicitly otherwise.
+// wr_idx is never allowed to catch up with rd_idx from behind, so wr_idx == rd_idx means empty.
+#define MSGQ_SKIP   0xFFFFu
+
+static inline uint16_t _msgq_get_len(tu_msgq_t* q, uint16_t pos)
+{
+  return tu_u16(q->buffer[pos+1], q->buffer[pos]);
+}
+
+static inline void _msgq_set_len(tu_msgq_t* q, uint16_t pos, uint16_t len)
+{
+  q->buffer[pos]   = tu_u16_low(len);
+  q->buffer[pos+1] = tu_u16_high(len);
+}
+
+// offset following a message at pos
+static inline uint16_t _msgq_next(tu_msgq_t* q, uint16_t pos, uint16_t len)
+{
+  uint32_t next = (uint32_t) pos + TU_MSGQ_MSG_SIZE(len);
+  if ( next >= q->size ) next = 0;
+  return (uint16_t) next;
+}
+
+// locate message at read offset, return its length. Only called when queue is not empty
+static uint16_t _msgq_head(tu_msgq_t* q, uint16_t* pos)
+{
+  uint16_t rd_idx = q->rd_idx;
+
+  if ( q->size - rd_idx < TU_MSGQ_HDR_SIZE ) rd_idx = 0;
+
+  uint16_t len = _msgq_get_len(q, rd_idx);
+  if ( len == MSGQ_SKIP )
+  {
+    rd_idx = 0;
+    len = _msgq_get_len(q, rd_idx);
+  }
+
+  *pos = rd_idx;
+  return len;
+}
+
+bool tu_msgq_config(tu_msgq_t* q, void* buffer, uint16_t size)
+{
+  // room for at least a 1-byte message, length must not collide with skip marker
+  TU_VERIFY(size > TU_MSGQ_MSG_SIZE(1) && size < MSGQ_SKIP);
+
+  q->buffer = (uint8_t*) buffer;
+  q->size   = size;
+
+  tu_msgq_clear(q);
+
+  return true;
+}
+
+/******************************************************************************/
+/*!
+    @brief Discard all messages. Must not run concurrently with producer or
+    consumer.
+
+    @param[in]  q
+                Pointer to the message queue to manipulate
+*/
+/******************************************************************************/
+void tu_msgq_clear(tu_msgq_t* q)
+{
+  q->rd_idx   = q->wr_idx   = 0;
+  q->rd_count = q->wr_count = 0;
+  q->wr_rsv   = 0;
+}
+
+/******************************************************************************/
+/*!
+    @brief Reserve contiguous room for a message of up to max_len bytes. The
+    payload is filled in place, then tu_msgq_write_commit() publishes it.
+    Reserving again without commit discards the previous reservation.
+
+    @param[in]  q
+                Pointer to the message queue to manipulate
+    @param[in]  max_len
+                Maximum payload length that will be written
+
+    @returns pointer to payload area, NULL if there is not enough room
+*/
+/******************************************************************************/
+void* tu_msgq_write_reserve(tu_msgq_t* q, uint16_t max_len)
+{
+  TU_VERIFY(max_len && max_len <= tu_msgq_max_len(q), NULL);
+
+  uint16_t const wr_idx = q->wr_idx;
+  uint16_t const rd_idx = q->rd_idx;
+  uint16_t const need   = TU_MSGQ_MSG_SIZE(max_len);
+  uint16_t pos;
+
+  if ( wr_idx >= rd_idx )
+  {
+    uint16_t const tail = (uint16_t) (q->size - wr_idx);
+
+    if ( (need < tail) || (need == tail && rd_idx > 0) )
+    {
+      pos = wr_idx;
+    }
+    else if ( need < rd_idx )
+    {
+      // wrap around: mark the unused tail if a header fits there. The marker lies beyond wr_idx
+      // and is not visible to consumer until the message is committed.
+      if ( tail >= TU_MSGQ_HDR_SIZE ) _msgq_set_len(q, wr_idx, MSGQ_SKIP);
+      pos = 0;
+    }
+    else
+    {
+      return NULL;
+    }
+  }
+  else
+  {
+    if ( need >= rd_idx - wr_idx ) return NULL;
+    pos = wr_idx;
+  }
+
+  q->wr_rsv = pos;
+
+  return q->buffer + pos + TU_MSGQ_HDR_SIZE;
+}
+
+/******************************************************************************/
+/*!
+    @brief Publish the message previously reserved with tu_msgq_write_reserve()
+
+    @param[in]  q
+                Pointer to the message queue to manipulate
+    @param[in]  len
+                Actual payload length, non zero and not more than reserved
+*/
+/******************************************************************************/
+void tu_msgq_write_commit(tu_msgq_t* q, uint16_t len)
+{
+  uint16_t const pos = q->wr_rsv;
+
+  _msgq_set_len(q, pos, len);
+
+  // message must be written before it is published to consumer
+  tu_mem_barrier();
+
+  q->wr_idx = _msgq_next(q, pos, len);
+  q->wr_count++;
+}
+
+/******************************************************************************/
+/*!
+    @brief Get the oldest message in place without removing it, then
+    tu_msgq_read_commit() releases it.
+
+    @param[in]  q
+                Pointer to the message queue to manipulate
+    @param[out] len
+                Payload length of the message
+
+    @returns pointer to payload, NULL if queue is empty
+*/
+/******************************************************************************/
+void const* tu_msgq_peek(tu_msgq_t* q, uint16_t* len)
+{
+  if ( tu_msgq_empty(q) ) return NULL;
+
+  // message must be read only after its write index is observed
+  tu_mem_barrier();
+
+  uint16_t pos;
+  *len = _msgq_head(q, &pos);
+
+  return q->buffer + pos + TU_MSGQ_HDR_SIZE;
+}
+
+/******************************************************************************/
+/*!
+    @brief Remove the oldest message, e.g after it is consumed with
+    tu_msgq_peek(). Does nothing if queue is empty.
+
+    @param[in]  q
+                Pointer to the message queue to manipulate
+*/
+/******************************************************************************/
+void tu_msgq_read_commit(tu_msgq_t* q)
+{
+  if ( tu_msgq_empty(q) ) return;
+
+  tu_mem_barrier();
+
+  uint16_t pos;
+  uint16_t const len = _msgq_head(q, &pos);
+
+  // message must be consumed before its space is released to producer
+  tu_mem_barrier();
+
+  q->rd_idx = _msgq_next(q, pos, len);
+  q->rd_count++;
+}
+
+/******************************************************************************/
+/*!
+    @brief Copy a message into the queue
+
+    @param[in]  q
+                Pointer to the message queue to manipulate
+    @param[in]  data
+                Message payload
+    @param[in]  len
+                Payload length, must not be zero
+
+    @returns TRUE if there was enough room for the message
+*/
+/******************************************************************************/
+bool tu_msgq_write(tu_msgq_t* q, void const* data, uint16_t len)
+{
+  void* ptr = tu_msgq_write_reserve(q, len);
+  TU_VERIFY(ptr);
+
+  memcpy(ptr, data, len);
+  tu_msgq_write_commit(q, len);
+
+  return true;
+}
+
+/******************************************************************************/
+/*!
+    @brief Copy the oldest message out of the queue and remove it. If the
+    message is larger than bufsize, the excess is discarded.
+
+    @param[in]  q
+                Pointer to the message queue to manipulate
+    @param[in]  buffer
+                Place holder for the payload
+    @param[in]  bufsize
+                Size of buffer
+
+    @returns number of bytes copied, zero if queue is empty
+*/
+/******************************************************************************/
+uint16_t tu_msgq_read(tu_msgq_t* q, void* buffer, uint16_t bufsize)
+{
+  uint16_t len;
+  void const* ptr = tu_msgq_peek(q, &len);
+  if ( ptr == NULL ) return 0;
+
+  len = tu_min16(len, bufsize);
+  memcpy(buffer, ptr, len);
+  tu_msgq_read_commit(q);
+
+  return len;
+}
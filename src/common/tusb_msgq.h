@@ -0,0 +1,120 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+/** \ingroup Group_Common
+ * \defgroup group_msgq msgq
+ *  @{ */
+
+#ifndef _TUSB_MSGQ_H_
+#define _TUSB_MSGQ_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+// size of the length prefix stored in front of each message
+#define TU_MSGQ_HDR_SIZE    2
+
+// storage overhead of a message with given payload length, useful for sizing the queue buffer
+#define TU_MSGQ_MSG_SIZE(_len)    ((_len) + TU_MSGQ_HDR_SIZE)
+
+/** \struct tu_msgq_t
+ * \brief Queue of variable length messages
+ *
+ * Messages are stored back to back in a byte ring, each prefixed with its length, so that packet boundaries
+ * are kept and short packets don't occupy a whole endpoint-sized slot. A message is never split across the
+ * end of the buffer: its payload is always contiguous and can be accessed in place (e.g by DMA) with
+ * tu_msgq_write_reserve() / tu_msgq_write_commit() and tu_msgq_peek() / tu_msgq_read_commit().
+ *
+ * Same as tu_fifo_t, the producer only modifies wr_idx and the consumer only modifies rd_idx, therefore
+ * a single producer and a single consumer can access the queue concurrently without locking. No mutex is
+ * provided, caller must serialize if there is more than one producer or consumer.
+ */
+typedef struct
+{
+           uint8_t* buffer    ; ///< buffer pointer
+           uint16_t size      ; ///< buffer size in bytes
+
+  volatile uint16_t wr_idx    ; ///< write byte offset, only modified by producer
+  volatile uint16_t rd_idx    ; ///< read byte offset, only modified by consumer
+
+  volatile uint16_t wr_count  ; ///< number of messages written, only modified by producer
+  volatile uint16_t rd_count  ; ///< number of messages read, only modified by consumer
+
+           uint16_t wr_rsv    ; ///< offset of the message reserved by producer, private to producer
+} tu_msgq_t;
+
+#define TU_MSGQ_DEF(_name, _size)    \
+  uint8_t _name##_buf[_size];        \
+  tu_msgq_t _name = {                \
+      .buffer = _name##_buf,         \
+      .size   = _size,               \
+  }
+
+bool        tu_msgq_config       (tu_msgq_t* q, void* buffer, uint16_t size);
+void        tu_msgq_clear        (tu_msgq_t* q);
+
+// Copy access, zero length messages are not supported
+bool        tu_msgq_write        (tu_msgq_t* q, void const* data, uint16_t len);
+uint16_t    tu_msgq_read         (tu_msgq_t* q, void* buffer, uint16_t bufsize);
+
+// Zero-copy access: reserve contiguous room for a message of up to max_len bytes, fill it in place then
+// commit its actual length. Peek the oldest message in place then commit its removal.
+void*       tu_msgq_write_reserve(tu_msgq_t* q, uint16_t max_len);
+void        tu_msgq_write_commit (tu_msgq_t* q, uint16_t len);
+void const* tu_msgq_peek         (tu_msgq_t* q, uint16_t* len);
+void        tu_msgq_read_commit  (tu_msgq_t* q);
+
+// number of messages in queue
+static inline uint16_t tu_msgq_count(tu_msgq_t* q)
+{
+  return (uint16_t) (q->wr_count - q->rd_count);
+}
+
+static inline bool tu_msgq_empty(tu_msgq_t* q)
+{
+  return q->wr_idx == q->rd_idx;
+}
+
+// Upper bound of message length, only guaranteed to fit in an empty queue whose offsets are at the start
+// of buffer e.g after tu_msgq_clear(). Offsets are owned by producer and consumer separately and are not reset
+// when queue drains: a drained queue takes what fits from its offset to the end of buffer or before it,
+// e.g offsets at 50 in a 100 bytes queue take at most 48 bytes.
+static inline uint16_t tu_msgq_max_len(tu_msgq_t* q)
+{
+  return (uint16_t) (q->size - TU_MSGQ_HDR_SIZE - 1);
+}
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _TUSB_MSGQ_H_ */
+
+/** @} */
@@ -60,6 +60,19 @@ typedef enum
   TUSB_XFER_INTERRUPT
 }tusb_xfer_type_t;
 
+/// Isochronous endpoint's bmAttributes synchronization (bit 3..2) & usage (bit 5..4) type
+typedef enum
+{
+  TUSB_ISO_EP_ATT_NO_SYNC       = 0x00,
+  TUSB_ISO_EP_ATT_ASYNCHRONOUS  = 0x04,
+  TUSB_ISO_EP_ATT_ADAPTIVE      = 0x08,
+  TUSB_ISO_EP_ATT_SYNCHRONOUS   = 0x0C,
+
+  TUSB_ISO_EP_ATT_DATA          = 0x00,
+  TUSB_ISO_EP_ATT_EXPLICIT_FB   = 0x10,
+  TUSB_ISO_EP_ATT_IMPLICIT_FB   = 0x20,
+}tusb_iso_ep_attribute_t;
+
 typedef enum
 {
   TUSB_DIR_OUT = 0,
@@ -216,6 +229,7 @@ typedef enum
   XFER_RESULT_SUCCESS,
   XFER_RESULT_FAILED,
   XFER_RESULT_STALLED,
+  XFER_RESULT_MISSED,   ///< isochronous packet was not transferred in its (micro)frame
 }xfer_result_t;
 
 enum // TODO remove
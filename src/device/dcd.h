@@ -69,8 +69,16 @@ typedef struct TU_ATTR_ALIGNED(4)
       uint8_t  ep_addr;
       uint8_t  result;
       uint32_t len;
+      #if CFG_TUD_STATS
+      uint32_t stamp; // tud_stats_time_cb() when queued, set by stack
+      #endif
     }xfer_complete;
 
+    // DCD_EVENT_SOF
+    struct {
+      uint32_t frame_count; // frame number of the SOF packet, 0 if port does not report it
+    }sof;
+
     // USBD_EVENT_FUNC_CALL
     struct {
       void (*func) (void*);
@@ -81,6 +89,15 @@ typedef struct TU_ATTR_ALIGNED(4)
 
 //TU_VERIFY_STATIC(sizeof(dcd_event_t) <= 12, "size is not correct");
 
+// Isochronous packet, one per (micro)frame. Packets of a transfer are back to back in buffer,
+// each one takes up its length even when fewer bytes are received.
+typedef struct
+{
+  uint16_t length;  // bytes to send (IN) or room for received bytes (OUT), set by stack
+  uint16_t actual;  // bytes transferred, set by DCD
+  uint8_t  result;  // xfer_result_t set by DCD, XFER_RESULT_MISSED if nothing was transferred in its frame
+}dcd_iso_packet_t;
+
 /*------------------------------------------------------------------*/
 /* Device API
  *------------------------------------------------------------------*/
@@ -122,6 +139,16 @@ void dcd_edpt_stall       (uint8_t rhport, uint8_t ep_addr);
 // clear stall, data toggle is also reset to DATA0
 void dcd_edpt_clear_stall (uint8_t rhport, uint8_t ep_addr);
 
+// Close endpoint and abort its transfer, used when switching interface alternate setting.
+// Optional, a port without it keeps the endpoint open until it is opened again.
+TU_ATTR_WEAK void dcd_edpt_close(uint8_t rhport, uint8_t ep_addr);
+
+// Submit an isochronous transfer of count packets, one per (micro)frame starting with the next one.
+// Once all packets are done dcd_event_xfer_complete() is invoked with the total bytes transferred,
+// result is XFER_RESULT_FAILED if any packet did not succeed. Packet results are in packets[].
+// Optional, only ports supporting isochronous endpoints implement it.
+TU_ATTR_WEAK bool dcd_edpt_iso_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, dcd_iso_packet_t* packets, uint8_t count);
+
 //--------------------------------------------------------------------+
 // Event API (Implemented by device stack)
 //--------------------------------------------------------------------+
@@ -138,6 +165,9 @@ extern void dcd_event_setup_received(uint8_t rhport, uint8_t const * setup, bool
 // helper to send transfer complete event
 extern void dcd_event_xfer_complete (uint8_t rhport, uint8_t ep_addr, uint32_t xferred_bytes, uint8_t result, bool in_isr);
 
+// helper to send SOF event with frame number
+extern void dcd_event_sof(uint8_t rhport, uint32_t frame_count, bool in_isr);
+
 #ifdef __cplusplus
  }
 #endif
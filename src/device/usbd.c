@@ -37,6 +37,18 @@
 #define CFG_TUD_TASK_QUEUE_SZ   16
 #endif
 
+// Number of events dequeued at once by tud_task(), taken from stack
+#ifndef CFG_TUD_TASK_BATCH_SZ
+#define CFG_TUD_TASK_BATCH_SZ   4
+#endif
+
+// Queue a single event for XFER_COMPLETE of all non-control endpoints, while it is pending completions are
+// kept per endpoint, so that queue usage does not depend on the number of busy endpoints. Each transfer is
+// still reported on its own, a second completion of an endpoint before task takes the first one is queued.
+#ifndef CFG_TUD_XFER_COALESCE
+#define CFG_TUD_XFER_COALESCE   0
+#endif
+
 //--------------------------------------------------------------------+
 // Device Data
 //--------------------------------------------------------------------+
@@ -52,42 +64,68 @@ typedef struct {
     uint8_t self_powered          : 1; // configuration descriptor's attribute
   };
 
-  uint8_t itf2drv[16];     // map interface number to driver (0xff is invalid)
-  uint8_t ep2drv[8][2];    // map endpoint to driver ( 0xff is invalid )
+  uint8_t cfg_num;         // current configuration
+  uint8_t itf2drv[16];     // map interface number to driver (DRVID_INVALID is invalid)
+  uint8_t itf_alt[16];     // current alternate setting of interface
 
   struct TU_ATTR_PACKED
   {
+    uint8_t drv_id        : 4; // map endpoint to driver (DRVID_INVALID is invalid)
     volatile bool busy    : 1;
     volatile bool stalled : 1;
+    volatile bool iso     : 1; // isochronous endpoint, set when it is mapped or opened
+  }ep_status[CFG_TUD_ENDPOINT_MAX][2];
 
-    // TODO merge ep2drv here, 4-bit should be sufficient
-  }ep_status[8][2];
+  volatile bool sof_en[SOF_CONSUMER_COUNT]; // SOF events are requested by a class driver
+  volatile bool sof_pending;  // a SOF event is in the queue
+  volatile uint32_t frame_count; // of the latest SOF, queued SOF may be stale
 }usbd_device_t;
 
 static usbd_device_t _usbd_dev;
 
-// Invalid driver ID in itf2drv[] ep2drv[][] mapping
-enum { DRVID_INVALID = 0xFFu };
+// Invalid driver ID in itf2drv[] and ep_status[][].drv_id mapping, driver ID is 4-bit wide
+enum { DRVID_INVALID = 0x0Fu };
+
+#if CFG_TUD_STATS
+// Transfer counters are written by usbd task, and by whoever queues transfers (errors when DCD rejects
+// one). Queue counters are kept per producer context, isr and task, and merged by tud_stats_get(), so
+// that an isr never interrupts an update of the same counter. Producers and drivers running in several
+// tasks (RTOS) may lose an increment, counters are not locked against each other.
+typedef struct
+{
+  tud_stats_t stats;
+  uint32_t    xfer_len[CFG_TUD_ENDPOINT_MAX][2];  // queued bytes of transfer in progress, to detect short one
+  uint32_t    queue_max[2];                       // indexed by in_isr
+  uint32_t    queue_full[2];
+}usbd_stats_t;
+
+static usbd_stats_t _usbd_stats;
+
+TU_VERIFY_STATIC((unsigned) TUD_STATS_DRIVER_MAX == (unsigned) DRVID_INVALID, "Driver statistics must cover all driver IDs");
+TU_VERIFY_STATIC(sizeof(tud_stats_t) % 4 == 0, "Statistics are copied word by word");
+#endif
+
+#if CFG_TUD_XFER_COALESCE
+// Completion kept for an endpoint: producer fills event then sets pending, task copies event then
+// clears pending. Only task clears queued, before it scans the endpoints.
+typedef struct
+{
+  dcd_event_t   event[CFG_TUD_ENDPOINT_MAX][2];
+  volatile bool pending[CFG_TUD_ENDPOINT_MAX][2];
+  volatile bool queued; // event for the endpoints is in queue
+}usbd_xfer_coalesce_t;
+
+static usbd_xfer_coalesce_t _usbd_xfer;
+#endif
 
 //--------------------------------------------------------------------+
 // Class Driver
 //--------------------------------------------------------------------+
-typedef struct {
-  uint8_t class_code;
-
-  void (* init             ) (void);
-  void (* reset            ) (uint8_t rhport);
-  bool (* open             ) (uint8_t rhport, tusb_desc_interface_t const * desc_intf, uint16_t* p_length);
-  bool (* control_request  ) (uint8_t rhport, tusb_control_request_t const * request);
-  bool (* control_complete ) (uint8_t rhport, tusb_control_request_t const * request);
-  bool (* xfer_cb          ) (uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t xferred_bytes);
-  void (* sof              ) (uint8_t rhport);
-} usbd_class_driver_t;
-
 static usbd_class_driver_t const _usbd_driver[] =
 {
   #if CFG_TUD_CDC
   {
+      USBD_DRIVER_NAME("CDC")
       .class_code       = TUSB_CLASS_CDC,
       .init             = cdcd_init,
       .reset            = cdcd_reset,
@@ -95,13 +133,16 @@ static usbd_class_driver_t const _usbd_driver[] =
       .control_request  = cdcd_control_request,
       .control_complete = cdcd_control_complete,
       .xfer_cb          = cdcd_xfer_cb,
-      .sof              = NULL
+      .sof              = cdcd_sof
   },
   #endif
 
   #if CFG_TUD_MSC
   {
+      USBD_DRIVER_NAME("MSC")
       .class_code       = TUSB_CLASS_MSC,
+      .protocol_code    = MSC_PROTOCOL_BOT,
+      .match            = USBD_MATCH_PROTOCOL,
       .init             = mscd_init,
       .reset            = mscd_reset,
       .open             = mscd_open,
@@ -112,8 +153,25 @@ static usbd_class_driver_t const _usbd_driver[] =
   },
   #endif
 
+  #if CFG_TUD_UAS
+  {
+      USBD_DRIVER_NAME("UAS")
+      .class_code       = TUSB_CLASS_MSC,
+      .protocol_code    = MSC_PROTOCOL_UAS,
+      .match            = USBD_MATCH_PROTOCOL,
+      .init             = uasd_init,
+      .reset            = uasd_reset,
+      .open             = uasd_open,
+      .control_request  = uasd_control_request,
+      .control_complete = uasd_control_complete,
+      .xfer_cb          = uasd_xfer_cb,
+      .sof              = NULL
+  },
+  #endif
+
   #if CFG_TUD_HID
   {
+      USBD_DRIVER_NAME("HID")
       .class_code       = TUSB_CLASS_HID,
       .init             = hidd_init,
       .reset            = hidd_reset,
@@ -127,7 +185,10 @@ static usbd_class_driver_t const _usbd_driver[] =
 
   #if CFG_TUD_MIDI
   {
+      USBD_DRIVER_NAME("MIDI")
       .class_code       = TUSB_CLASS_AUDIO,
+      .protocol_code    = AUDIO_PROTOCOL_V1,
+      .match            = USBD_MATCH_PROTOCOL,
       .init             = midid_init,
       .open             = midid_open,
       .reset            = midid_reset,
@@ -138,8 +199,26 @@ static usbd_class_driver_t const _usbd_driver[] =
   },
   #endif
 
+  #if CFG_TUD_AUDIO
+  {
+      USBD_DRIVER_NAME("Audio")
+      .class_code       = TUSB_CLASS_AUDIO,
+      .protocol_code    = AUDIO_PROTOCOL_V2,
+      .match            = USBD_MATCH_PROTOCOL,
+      .init             = audiod_init,
+      .reset            = audiod_reset,
+      .open             = audiod_open,
+      .set_interface    = audiod_set_interface,
+      .control_request  = audiod_control_request,
+      .control_complete = audiod_control_complete,
+      .xfer_cb          = audiod_xfer_cb,
+      .sof              = audiod_sof
+  },
+  #endif
+
   #if CFG_TUD_VENDOR
   {
+      USBD_DRIVER_NAME("Vendor")
       .class_code       = TUSB_CLASS_VENDOR_SPECIFIC,
       .init             = vendord_init,
       .reset            = vendord_reset,
@@ -152,12 +231,11 @@ static usbd_class_driver_t const _usbd_driver[] =
   #endif
 
   #if CFG_TUD_USBTMC
-  // Presently USBTMC is the only defined class with the APP_SPECIFIC class code.
-  // We maybe need to add subclass codes here, or a callback to ask if a driver can
-  // handle a particular interface.
   {
+      USBD_DRIVER_NAME("USBTMC")
       .class_code       = TUD_USBTMC_APP_CLASS,
-    //.subclass_code    = TUD_USBTMC_APP_SUBCLASS
+      .subclass_code    = TUD_USBTMC_APP_SUBCLASS,
+      .match            = USBD_MATCH_SUBCLASS,
       .init             = usbtmcd_init_cb,
       .reset            = usbtmcd_reset_cb,
       .open             = usbtmcd_open_cb,
@@ -170,8 +248,10 @@ static usbd_class_driver_t const _usbd_driver[] =
 
   #if CFG_TUD_DFU_RT
   {
+      USBD_DRIVER_NAME("DFU-RT")
       .class_code       = TUD_DFU_APP_CLASS,
-    //.subclass_code    = TUD_DFU_APP_SUBCLASS
+      .subclass_code    = TUD_DFU_APP_SUBCLASS,
+      .match            = USBD_MATCH_SUBCLASS,
       .init             = dfu_rtd_init,
       .reset            = dfu_rtd_reset,
       .open             = dfu_rtd_open,
@@ -185,6 +265,35 @@ static usbd_class_driver_t const _usbd_driver[] =
 
 enum { USBD_CLASS_DRIVER_COUNT = TU_ARRAY_SIZE(_usbd_driver) };
 
+TU_VERIFY_STATIC((unsigned) USBD_CLASS_DRIVER_COUNT < (unsigned) DRVID_INVALID, "Too many class drivers for 4-bit driver ID");
+
+// Additional class drivers supplied by application, they take driver IDs before built-in ones
+static usbd_class_driver_t const * _app_driver = NULL;
+static uint8_t _app_driver_count = 0;
+
+#define TOTAL_DRIVER_COUNT    (_app_driver_count + USBD_CLASS_DRIVER_COUNT)
+
+// Get driver by ID, NULL if ID is invalid
+static inline usbd_class_driver_t const * get_driver(uint8_t drvid)
+{
+  if ( drvid < _app_driver_count ) return &_app_driver[drvid];
+
+  drvid = (uint8_t) (drvid - _app_driver_count);
+  if ( drvid < USBD_CLASS_DRIVER_COUNT ) return &_usbd_driver[drvid];
+
+  return NULL;
+}
+
+// Check if driver handles the interface by its class and optionally subclass & protocol
+static bool driver_match(usbd_class_driver_t const * driver, tusb_desc_interface_t const * desc_itf)
+{
+  if ( driver->class_code != desc_itf->bInterfaceClass ) return false;
+  if ( (driver->match & USBD_MATCH_SUBCLASS) && driver->subclass_code != desc_itf->bInterfaceSubClass ) return false;
+  if ( (driver->match & USBD_MATCH_PROTOCOL) && driver->protocol_code != desc_itf->bInterfaceProtocol ) return false;
+
+  return true;
+}
+
 //--------------------------------------------------------------------+
 // DCD Event
 //--------------------------------------------------------------------+
@@ -194,12 +303,36 @@ enum { USBD_CLASS_DRIVER_COUNT = TU_ARRAY_SIZE(_usbd_driver) };
 OSAL_QUEUE_DEF(OPT_MODE_DEVICE, _usbd_qdef, CFG_TUD_TASK_QUEUE_SZ, dcd_event_t);
 static osal_queue_t _usbd_q;
 
+static inline bool queue_event(dcd_event_t const * event, bool in_isr)
+{
+#if CFG_TUD_STATS
+  bool const success = osal_queue_send(_usbd_q, event, in_isr);
+
+  if ( success )
+  {
+    // includes this event unless task took it already, good enough for a high-water mark
+    uint32_t const count = osal_queue_count(_usbd_q, in_isr);
+    if ( count > _usbd_stats.queue_max[in_isr] ) _usbd_stats.queue_max[in_isr] = count;
+  }
+  else
+  {
+    _usbd_stats.queue_full[in_isr]++;
+  }
+
+  return success;
+#else
+  return osal_queue_send(_usbd_q, event, in_isr);
+#endif
+}
+
 //--------------------------------------------------------------------+
 // Prototypes
 //--------------------------------------------------------------------+
-static void mark_interface_endpoint(uint8_t ep2drv[8][2], uint8_t const* p_desc, uint16_t desc_len, uint8_t driver_id);
+static bool mark_interface_endpoint(uint8_t const* p_desc, uint16_t desc_len, uint8_t driver_id);
+static uint16_t interface_desc_len(uint8_t const* p_desc, uint8_t const* desc_end);
 static bool process_control_request(uint8_t rhport, tusb_control_request_t const * p_request);
 static bool process_set_config(uint8_t rhport, uint8_t cfg_num);
+static bool process_set_interface(uint8_t rhport, uint8_t itf, uint8_t alt);
 static bool process_get_descriptor(uint8_t rhport, tusb_control_request_t const * p_request);
 
 void usbd_control_reset (uint8_t rhport);
@@ -224,28 +357,6 @@ static char const* const _usbd_event_str[DCD_EVENT_COUNT] =
   "FUNC_CALL"
 };
 
-// must be same driver order as usbd_class_drivers[]
-static char const* const _usbd_driver_str[USBD_CLASS_DRIVER_COUNT] =
-{
-  #if CFG_TUD_CDC
-    "CDC",
-  #endif
-  #if CFG_TUD_MSC
-    "MSC",
-  #endif
-  #if CFG_TUD_HID
-    "HID",
-  #endif
-  #if CFG_TUD_MIDI
-    "MIDI",
-  #endif
-  #if CFG_TUD_VENDOR
-    "Vendor",
-  #endif
-  #if CFG_TUD_USBTMC
-    "USBTMC"
-  #endif
-};
 
 static char const* const _tusb_std_request_str[] =
 {
@@ -287,6 +398,30 @@ bool tud_remote_wakeup(void)
   return true;
 }
 
+#if CFG_TUD_STATS
+void tud_stats_get(tud_stats_t* stats)
+{
+  // word by word so that no counter is torn by an update in between
+  uint32_t const volatile * src = (uint32_t const volatile *) &_usbd_stats.stats;
+  uint32_t* dst = (uint32_t*) stats;
+
+  for(uint32_t i=0; i<sizeof(tud_stats_t)/4; i++) dst[i] = src[i];
+
+  stats->queue_max  = tu_max32(_usbd_stats.queue_max[0], _usbd_stats.queue_max[1]);
+  stats->queue_full = _usbd_stats.queue_full[0] + _usbd_stats.queue_full[1];
+}
+
+void tud_stats_clear(void)
+{
+  // task writers are excluded by calling from usbd task context, isr ones by disabling it
+  dcd_int_disable(TUD_OPT_RHPORT);
+  tu_varclr(&_usbd_stats.stats);
+  tu_varclr(&_usbd_stats.queue_max);
+  tu_varclr(&_usbd_stats.queue_full);
+  dcd_int_enable(TUD_OPT_RHPORT);
+}
+#endif
+
 //--------------------------------------------------------------------+
 // USBD Task
 //--------------------------------------------------------------------+
@@ -300,11 +435,20 @@ bool tud_init (void)
   _usbd_q = osal_queue_create(&_usbd_qdef);
   TU_ASSERT(_usbd_q != NULL);
 
+  // Get application drivers if available
+  if ( usbd_app_driver_get_cb )
+  {
+    _app_driver = usbd_app_driver_get_cb(&_app_driver_count);
+    if ( !_app_driver ) _app_driver_count = 0;
+  }
+  TU_ASSERT(TOTAL_DRIVER_COUNT < DRVID_INVALID);
+
   // Init class drivers
-  for (uint8_t i = 0; i < USBD_CLASS_DRIVER_COUNT; i++)
+  for (uint8_t i = 0; i < TOTAL_DRIVER_COUNT; i++)
   {
-    TU_LOG2("%s init\r\n", _usbd_driver_str[i]);
-    _usbd_driver[i].init();
+    usbd_class_driver_t const * driver = get_driver(i);
+    TU_LOG2("%s init\r\n", driver->name);
+    driver->init();
   }
 
   // Init device controller driver
@@ -319,133 +463,252 @@ static void usbd_reset(uint8_t rhport)
   tu_varclr(&_usbd_dev);
 
   memset(_usbd_dev.itf2drv, DRVID_INVALID, sizeof(_usbd_dev.itf2drv)); // invalid mapping
-  memset(_usbd_dev.ep2drv , DRVID_INVALID, sizeof(_usbd_dev.ep2drv )); // invalid mapping
+
+  for (uint8_t epnum = 0; epnum < CFG_TUD_ENDPOINT_MAX; epnum++)
+  {
+    _usbd_dev.ep_status[epnum][TUSB_DIR_OUT].drv_id = DRVID_INVALID;
+    _usbd_dev.ep_status[epnum][TUSB_DIR_IN ].drv_id = DRVID_INVALID;
+  }
+
+#if CFG_TUD_XFER_COALESCE
+  // completions kept for endpoints of previous configuration are dropped
+  memset((void*) _usbd_xfer.pending, 0, sizeof(_usbd_xfer.pending));
+#endif
 
   usbd_control_reset(rhport);
 
-  for (uint8_t i = 0; i < USBD_CLASS_DRIVER_COUNT; i++)
+  for (uint8_t i = 0; i < TOTAL_DRIVER_COUNT; i++)
   {
-    if ( _usbd_driver[i].reset ) _usbd_driver[i].reset( rhport );
+    usbd_class_driver_t const * driver = get_driver(i);
+    if ( driver->reset ) driver->reset( rhport );
   }
 }
 
-/* USB Device Driver task
- * This top level thread manages all device controller event and delegates events to class-specific drivers.
- * This should be called periodically within the mainloop or rtos thread.
- *
-   @code
-    int main(void)
-    {
-      application_init();
-      tusb_init();
+#if CFG_TUD_STATS
+static inline uint32_t stats_time(void)
+{
+  return tud_stats_time_cb ? tud_stats_time_cb() : 0;
+}
 
-      while(1) // the mainloop
-      {
-        application_code();
-        tud_task(); // tinyusb device task
-      }
-    }
-    @endcode
- */
-void tud_task (void)
+// Counters of class driver owning the endpoint, NULL for control endpoint or unmapped one
+static tud_stats_count_t* stats_driver(uint8_t epnum, uint8_t dir)
 {
-  // Skip if stack is not initialized
-  if ( !tusb_inited() ) return;
+  uint8_t const drv_id = _usbd_dev.ep_status[epnum][dir].drv_id;
+  return (epnum && drv_id < TUD_STATS_DRIVER_MAX) ? &_usbd_stats.stats.driver[drv_id] : NULL;
+}
+
+static void stats_count_xfer(tud_stats_count_t* count, xfer_result_t result, uint32_t len, bool is_short, uint32_t latency)
+{
+  count->bytes += len;
+  count->xfers++;
+  if ( is_short ) count->short_xfers++;
+  if ( result != XFER_RESULT_SUCCESS ) count->errors++;
+
+  count->latency_sum += latency;
+  if ( latency > count->latency_max ) count->latency_max = latency;
+}
 
-  // Loop until there is no more events in the queue
-  while (1)
+static void stats_xfer_complete(uint8_t epnum, uint8_t dir, xfer_result_t result, uint32_t len, uint32_t stamp)
+{
+  uint32_t const latency = stats_time() - stamp;
+
+  // control transfers are queued to DCD directly, their length is unknown
+  bool const is_short = epnum && (len < _usbd_stats.xfer_len[epnum][dir]);
+
+  tud_stats_count_t* drv = stats_driver(epnum, dir);
+
+  stats_count_xfer(&_usbd_stats.stats.edpt[epnum][dir], result, len, is_short, latency);
+  if ( drv ) stats_count_xfer(drv, result, len, is_short, latency);
+}
+
+static void stats_xfer_queued(uint8_t epnum, uint8_t dir, uint32_t len, bool queued)
+{
+  _usbd_stats.xfer_len[epnum][dir] = len;
+
+  if ( !queued )
   {
-    dcd_event_t event;
+    tud_stats_count_t* drv = stats_driver(epnum, dir);
 
-    if ( !osal_queue_receive(_usbd_q, &event) ) return;
+    _usbd_stats.stats.edpt[epnum][dir].errors++;
+    if ( drv ) drv->errors++;
+  }
+}
 
-    TU_LOG2("USBD: event %s\r\n", event.event_id < DCD_EVENT_COUNT ? _usbd_event_str[event.event_id] : "CORRUPTED");
+static void stats_stall(uint8_t epnum, uint8_t dir)
+{
+  tud_stats_count_t* drv = stats_driver(epnum, dir);
 
-    switch ( event.event_id )
-    {
-      case DCD_EVENT_BUS_RESET:
-        usbd_reset(event.rhport);
-      break;
+  _usbd_stats.stats.edpt[epnum][dir].stalls++;
+  if ( drv ) drv->stalls++;
+}
+#endif
+
+// Process one event from the device event queue
+static void process_event(dcd_event_t const * event)
+{
+  TU_LOG2("USBD: event %s\r\n", event->event_id < DCD_EVENT_COUNT ? _usbd_event_str[event->event_id] : "CORRUPTED");
 
-      case DCD_EVENT_UNPLUGGED:
-        usbd_reset(event.rhport);
+  switch ( event->event_id )
+  {
+    case DCD_EVENT_BUS_RESET:
+      usbd_reset(event->rhport);
+    break;
 
-        // invoke callback
-        if (tud_umount_cb) tud_umount_cb();
-      break;
+    case DCD_EVENT_UNPLUGGED:
+      usbd_reset(event->rhport);
 
-      case DCD_EVENT_SETUP_RECEIVED:
-        TU_LOG2("  ");
-        TU_LOG1_MEM(&event.setup_received, 1, 8);
+      // invoke callback
+      if (tud_umount_cb) tud_umount_cb();
+    break;
 
-        // Mark as connected after receiving 1st setup packet.
-        // But it is easier to set it every time instead of wasting time to check then set
-        _usbd_dev.connected = 1;
+    case DCD_EVENT_SETUP_RECEIVED:
+      TU_LOG2("  ");
+      TU_LOG1_MEM(&event->setup_received, 1, 8);
 
-        // Process control request
-        if ( !process_control_request(event.rhport, &event.setup_received) )
-        {
-          TU_LOG1("  Stall EP0\r\n");
-          // Failed -> stall both control endpoint IN and OUT
-          dcd_edpt_stall(event.rhport, 0);
-          dcd_edpt_stall(event.rhport, 0 | TUSB_DIR_IN_MASK);
-        }
-      break;
+      // Mark as connected after receiving 1st setup packet.
+      // But it is easier to set it every time instead of wasting time to check then set
+      _usbd_dev.connected = 1;
 
-      case DCD_EVENT_XFER_COMPLETE:
+      // Process control request
+      if ( !process_control_request(event->rhport, &event->setup_received) )
       {
-        // Invoke the class callback associated with the endpoint address
-        uint8_t const ep_addr = event.xfer_complete.ep_addr;
-        uint8_t const epnum   = tu_edpt_number(ep_addr);
-        uint8_t const ep_dir  = tu_edpt_dir(ep_addr);
+        TU_LOG1("  Stall EP0\r\n");
+        // Failed -> stall both control endpoint IN and OUT
+        dcd_edpt_stall(event->rhport, 0);
+        dcd_edpt_stall(event->rhport, 0 | TUSB_DIR_IN_MASK);
+
+#if CFG_TUD_STATS
+        stats_stall(0, TUSB_DIR_OUT);
+        stats_stall(0, TUSB_DIR_IN);
+#endif
+      }
+    break;
 
-        TU_LOG2("  Endpoint: 0x%02X, Bytes: %ld\r\n", ep_addr, event.xfer_complete.len);
+    case DCD_EVENT_XFER_COMPLETE:
+    {
+      // Invoke the class callback associated with the endpoint address
+      uint8_t const ep_addr = event->xfer_complete.ep_addr;
+      uint8_t const epnum   = tu_edpt_number(ep_addr);
+      uint8_t const ep_dir  = tu_edpt_dir(ep_addr);
 
-        _usbd_dev.ep_status[epnum][ep_dir].busy = false;
+      xfer_result_t const result = (xfer_result_t) event->xfer_complete.result;
+      uint32_t      const len    = event->xfer_complete.len;
 
-        if ( 0 == epnum )
-        {
-          TU_LOG1("  EP Addr = 0x%02X, len = %ld\r\n", ep_addr, event.xfer_complete.len);
-          usbd_control_xfer_cb(event.rhport, ep_addr, event.xfer_complete.result, event.xfer_complete.len);
-        }
-        else
-        {
-          uint8_t const drv_id = _usbd_dev.ep2drv[epnum][ep_dir];
-          TU_ASSERT(drv_id < USBD_CLASS_DRIVER_COUNT,);
+      TU_LOG2("  Endpoint: 0x%02X, Bytes: %ld\r\n", ep_addr, len);
 
-          TU_LOG2("  %s xfer callback\r\n", _usbd_driver_str[drv_id]);
-          _usbd_driver[drv_id].xfer_cb(event.rhport, ep_addr, event.xfer_complete.result, event.xfer_complete.len);
-        }
+      TU_ASSERT(epnum < CFG_TUD_ENDPOINT_MAX,);
+      _usbd_dev.ep_status[epnum][ep_dir].busy = false;
+
+#if CFG_TUD_STATS
+      stats_xfer_complete(epnum, ep_dir, result, len, event->xfer_complete.stamp);
+#endif
+
+      if ( 0 == epnum )
+      {
+        TU_LOG1("  EP Addr = 0x%02X, len = %ld\r\n", ep_addr, len);
+        usbd_control_xfer_cb(event->rhport, ep_addr, result, len);
       }
-      break;
+      else
+      {
+        usbd_class_driver_t const * driver = get_driver(_usbd_dev.ep_status[epnum][ep_dir].drv_id);
+        TU_ASSERT(driver,);
 
-      case DCD_EVENT_SUSPEND:
-        if (tud_suspend_cb) tud_suspend_cb(_usbd_dev.remote_wakeup_en);
-      break;
+        TU_LOG2("  %s xfer callback\r\n", driver->name);
+        driver->xfer_cb(event->rhport, ep_addr, result, len);
+      }
+    }
+    break;
 
-      case DCD_EVENT_RESUME:
-        if (tud_resume_cb) tud_resume_cb();
-      break;
+    case DCD_EVENT_SUSPEND:
+      if (tud_suspend_cb) tud_suspend_cb(_usbd_dev.remote_wakeup_en);
+    break;
 
-      case DCD_EVENT_SOF:
-        for ( uint8_t i = 0; i < USBD_CLASS_DRIVER_COUNT; i++ )
+    case DCD_EVENT_RESUME:
+      if (tud_resume_cb) tud_resume_cb();
+    break;
+
+    case DCD_EVENT_SOF:
+      _usbd_dev.sof_pending = false;
+
+      for ( uint8_t i = 0; i < TOTAL_DRIVER_COUNT; i++ )
+      {
+        usbd_class_driver_t const * driver = get_driver(i);
+        if ( driver->sof )
         {
-          if ( _usbd_driver[i].sof )
-          {
-            _usbd_driver[i].sof(event.rhport);
-          }
+          driver->sof(event->rhport, _usbd_dev.frame_count);
         }
-      break;
+      }
+    break;
 
-      case USBD_EVENT_FUNC_CALL:
-        if ( event.func_call.func ) event.func_call.func(event.func_call.param);
-      break;
+    case USBD_EVENT_FUNC_CALL:
+      if ( event->func_call.func ) event->func_call.func(event->func_call.param);
+    break;
 
-      default:
-        TU_BREAKPOINT();
-      break;
+    default:
+      TU_BREAKPOINT();
+    break;
+  }
+}
+
+/* USB Device Driver task
+ * This top level thread manages all device controller event and delegates events to class-specific drivers.
+ * This should be called periodically within the mainloop or rtos thread.
+ *
+   @code
+    int main(void)
+    {
+      application_init();
+      tusb_init();
+
+      while(1) // the mainloop
+      {
+        application_code();
+        tud_task(); // tinyusb device task
+      }
     }
+    @endcode
+ */
+void tud_task (void)
+{
+  // Loop until there is no more events in the queue (or forever with RTOS)
+  (void) tud_task_ext(0, OSAL_TIMEOUT_WAIT_FOREVER);
+}
+
+/* USB Device Driver task with a bounded budget, so that application can interleave
+ * USB processing with its own (real-time) work predictably.
+ *
+ * Events are dequeued in batches of up to CFG_TUD_TASK_BATCH_SZ, each batch with a single queue access
+ * where the OS allows it (FreeRTOS takes one event per access).
+ * - max_events: maximum number of events to process, 0 for no limit (until queue is empty)
+ * - timeout_ms: RTOS only, time to wait for the first event when queue is empty. Subsequent events are
+ *   only taken if already queued, unless timeout_ms is OSAL_TIMEOUT_WAIT_FOREVER.
+ *
+ * Return number of events processed.
+ */
+uint32_t tud_task_ext(uint32_t max_events, uint32_t timeout_ms)
+{
+  // Skip if stack is not initialized
+  if ( !tusb_inited() ) return 0;
+
+  dcd_event_t events[CFG_TUD_TASK_BATCH_SZ];
+  uint32_t total = 0;
+
+  while ( (max_events == 0) || (total < max_events) )
+  {
+    uint16_t count = CFG_TUD_TASK_BATCH_SZ;
+    if ( max_events && (max_events - total < count) ) count = (uint16_t) (max_events - total);
+
+    count = osal_queue_receive_n(_usbd_q, events, count, timeout_ms);
+    if ( count == 0 ) break;
+
+    for(uint16_t i=0; i<count; i++) process_event(&events[i]);
+
+    total += count;
+
+    if ( timeout_ms != OSAL_TIMEOUT_WAIT_FOREVER ) timeout_ms = OSAL_TIMEOUT_NOTIMEOUT;
   }
+
+  return total;
 }
 
 //--------------------------------------------------------------------+
@@ -455,11 +718,12 @@ void tud_task (void)
 // Helper to invoke class driver control request handler
 static bool invoke_class_control(uint8_t rhport, uint8_t drvid, tusb_control_request_t const * request)
 {
-  TU_ASSERT(_usbd_driver[drvid].control_request);
+  usbd_class_driver_t const * driver = get_driver(drvid);
+  TU_ASSERT(driver && driver->control_request);
 
-  usbd_control_set_complete_callback(_usbd_driver[drvid].control_complete);
-  TU_LOG2("  %s control request\r\n", _usbd_driver_str[drvid]);
-  return _usbd_driver[drvid].control_request(rhport, request);
+  usbd_control_set_complete_callback(driver->control_complete);
+  TU_LOG2("  %s control request\r\n", driver->name);
+  return driver->control_request(rhport, request);
 }
 
 // This handles the actual request and its response.
@@ -569,7 +833,7 @@ static bool process_control_request(uint8_t rhport, tusb_control_request_t const
       TU_VERIFY(itf < TU_ARRAY_SIZE(_usbd_dev.itf2drv));
 
       uint8_t const drvid = _usbd_dev.itf2drv[itf];
-      TU_VERIFY(drvid < USBD_CLASS_DRIVER_COUNT);
+      TU_VERIFY(drvid < TOTAL_DRIVER_COUNT);
 
       if (p_request->bmRequestType_bit.type == TUSB_REQ_TYPE_STANDARD)
       {
@@ -577,8 +841,7 @@ static bool process_control_request(uint8_t rhport, tusb_control_request_t const
         {
           case TUSB_REQ_GET_INTERFACE:
           {
-            // TODO not support alternate interface yet
-            uint8_t alternate = 0;
+            uint8_t alternate = _usbd_dev.itf_alt[itf];
             tud_control_xfer(rhport, p_request, &alternate, 1);
           }
           break;
@@ -587,8 +850,7 @@ static bool process_control_request(uint8_t rhport, tusb_control_request_t const
           {
             uint8_t const alternate = (uint8_t) p_request->wValue;
 
-            // TODO not support alternate interface yet
-            TU_ASSERT(alternate == 0);
+            TU_VERIFY( process_set_interface(rhport, itf, alternate) );
             tud_control_status(rhport, p_request);
           }
           break;
@@ -614,10 +876,10 @@ static bool process_control_request(uint8_t rhport, tusb_control_request_t const
       uint8_t const ep_num  = tu_edpt_number(ep_addr);
       uint8_t const ep_dir  = tu_edpt_dir(ep_addr);
 
-      TU_ASSERT(ep_num < TU_ARRAY_SIZE(_usbd_dev.ep2drv) );
+      TU_ASSERT(ep_num < CFG_TUD_ENDPOINT_MAX);
 
-      uint8_t const drvid = _usbd_dev.ep2drv[ep_num][ep_dir];
-      TU_ASSERT(drvid < USBD_CLASS_DRIVER_COUNT);
+      uint8_t const drvid = _usbd_dev.ep_status[ep_num][ep_dir].drv_id;
+      TU_ASSERT(drvid < TOTAL_DRIVER_COUNT);
 
       bool ret = false;
 
@@ -689,6 +951,8 @@ static bool process_set_config(uint8_t rhport, uint8_t cfg_num)
   tusb_desc_configuration_t const * desc_cfg = (tusb_desc_configuration_t const *) tud_descriptor_configuration_cb(cfg_num-1); // index is cfg_num-1
   TU_ASSERT(desc_cfg != NULL && desc_cfg->bDescriptorType == TUSB_DESC_CONFIGURATION);
 
+  _usbd_dev.cfg_num = cfg_num;
+
   // Parse configuration descriptor
   _usbd_dev.remote_wakeup_support = (desc_cfg->bmAttributes & TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP) ? 1 : 0;
   _usbd_dev.self_powered = (desc_cfg->bmAttributes & TUSB_DESC_CONFIG_ATT_SELF_POWERED) ? 1 : 0;
@@ -708,25 +972,43 @@ static bool process_set_config(uint8_t rhport, uint8_t cfg_num)
       TU_ASSERT( TUSB_DESC_INTERFACE == tu_desc_type(p_desc) );
 
       tusb_desc_interface_t* desc_itf = (tusb_desc_interface_t*) p_desc;
+      TU_ASSERT( desc_itf->bInterfaceNumber < TU_ARRAY_SIZE(_usbd_dev.itf2drv) );
 
-      // Check if class is supported
-      uint8_t drv_id;
-      for (drv_id = 0; drv_id < USBD_CLASS_DRIVER_COUNT; drv_id++)
+      // Alternate setting not consumed by driver's open() belongs to the driver of setting 0.
+      // Only its endpoints are mapped here, they are opened by SET_INTERFACE.
+      if ( desc_itf->bAlternateSetting )
       {
-        if ( _usbd_driver[drv_id].class_code == desc_itf->bInterfaceClass ) break;
+        uint8_t const drv_id = _usbd_dev.itf2drv[desc_itf->bInterfaceNumber];
+        TU_ASSERT( drv_id != DRVID_INVALID );
+
+        uint16_t const alt_len = interface_desc_len(p_desc, desc_end);
+        TU_ASSERT( mark_interface_endpoint(p_desc, alt_len, drv_id) );
+
+        p_desc += alt_len;
+        continue;
       }
-      TU_ASSERT( drv_id < USBD_CLASS_DRIVER_COUNT );
 
-      // Interface number must not be used already TODO alternate interface
+      // Interface number must not be used already
       TU_ASSERT( DRVID_INVALID == _usbd_dev.itf2drv[desc_itf->bInterfaceNumber] );
-      _usbd_dev.itf2drv[desc_itf->bInterfaceNumber] = drv_id;
 
+      // First matching driver accepting the interface takes it, application drivers are tried first.
+      // Driver can still reject an interface with TU_VERIFY() in its open().
+      uint8_t drv_id;
       uint16_t itf_len=0;
-      TU_LOG2("  %s open\r\n", _usbd_driver_str[drv_id]);
-      TU_ASSERT( _usbd_driver[drv_id].open(rhport, desc_itf, &itf_len) );
+      for (drv_id = 0; drv_id < TOTAL_DRIVER_COUNT; drv_id++)
+      {
+        usbd_class_driver_t const * driver = get_driver(drv_id);
+        if ( !driver_match(driver, desc_itf) ) continue;
+
+        TU_LOG2("  %s open\r\n", driver->name);
+        if ( driver->open(rhport, desc_itf, &itf_len) ) break;
+      }
+      TU_ASSERT( drv_id < TOTAL_DRIVER_COUNT );
       TU_ASSERT( itf_len >= sizeof(tusb_desc_interface_t) );
 
-      mark_interface_endpoint(_usbd_dev.ep2drv, p_desc, itf_len, drv_id);
+      _usbd_dev.itf2drv[desc_itf->bInterfaceNumber] = drv_id;
+
+      TU_ASSERT( mark_interface_endpoint(p_desc, itf_len, drv_id) );
 
       p_desc += itf_len; // next interface
     }
@@ -738,8 +1020,49 @@ static bool process_set_config(uint8_t rhport, uint8_t cfg_num)
   return true;
 }
 
-// Helper marking endpoint of interface belongs to class driver
-static void mark_interface_endpoint(uint8_t ep2drv[8][2], uint8_t const* p_desc, uint16_t desc_len, uint8_t driver_id)
+// Length of interface descriptor with its class-specific and endpoint descriptors,
+// i.e up to the next interface or association descriptor
+static uint16_t interface_desc_len(uint8_t const* p_desc, uint8_t const* desc_end)
+{
+  uint8_t const* p_next = tu_desc_next(p_desc);
+
+  while ( p_next < desc_end &&
+          TUSB_DESC_INTERFACE != tu_desc_type(p_next) && TUSB_DESC_INTERFACE_ASSOCIATION != tu_desc_type(p_next) )
+  {
+    p_next = tu_desc_next(p_next);
+  }
+
+  return (uint16_t) (p_next - p_desc);
+}
+
+// Find interface descriptor by number and alternate setting in current configuration
+static tusb_desc_interface_t const* find_interface(uint8_t itf, uint8_t alt, uint16_t* p_length)
+{
+  tusb_desc_configuration_t const * desc_cfg = (tusb_desc_configuration_t const *) tud_descriptor_configuration_cb(_usbd_dev.cfg_num-1);
+  TU_VERIFY(desc_cfg != NULL, NULL);
+
+  uint8_t const * p_desc   = ((uint8_t const*) desc_cfg) + sizeof(tusb_desc_configuration_t);
+  uint8_t const * desc_end = ((uint8_t const*) desc_cfg) + desc_cfg->wTotalLength;
+
+  while( p_desc < desc_end )
+  {
+    tusb_desc_interface_t const* desc_itf = (tusb_desc_interface_t const*) p_desc;
+
+    if ( TUSB_DESC_INTERFACE == tu_desc_type(p_desc) &&
+         desc_itf->bInterfaceNumber == itf && desc_itf->bAlternateSetting == alt )
+    {
+      *p_length = interface_desc_len(p_desc, desc_end);
+      return desc_itf;
+    }
+
+    p_desc = tu_desc_next(p_desc);
+  }
+
+  return NULL;
+}
+
+// Close endpoints of an interface alternate setting
+static void close_interface_endpoint(uint8_t rhport, uint8_t const* p_desc, uint16_t desc_len)
 {
   uint16_t len = 0;
 
@@ -748,8 +1071,13 @@ static void mark_interface_endpoint(uint8_t ep2drv[8][2], uint8_t const* p_desc,
     if ( TUSB_DESC_ENDPOINT == tu_desc_type(p_desc) )
     {
       uint8_t const ep_addr = ((tusb_desc_endpoint_t const*) p_desc)->bEndpointAddress;
+      uint8_t const epnum   = tu_edpt_number(ep_addr);
+      uint8_t const dir     = tu_edpt_dir(ep_addr);
 
-      ep2drv[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)] = driver_id;
+      if ( dcd_edpt_close ) dcd_edpt_close(rhport, ep_addr);
+
+      _usbd_dev.ep_status[epnum][dir].busy    = false;
+      _usbd_dev.ep_status[epnum][dir].stalled = false;
     }
 
     len   = (uint16_t)(len + tu_desc_len(p_desc));
@@ -757,6 +1085,90 @@ static void mark_interface_endpoint(uint8_t ep2drv[8][2], uint8_t const* p_desc,
   }
 }
 
+// Open endpoints of an interface alternate setting for class driver
+static bool open_interface_endpoint(uint8_t rhport, uint8_t const* p_desc, uint16_t desc_len, uint8_t driver_id)
+{
+  uint16_t len = 0;
+
+  while( len < desc_len )
+  {
+    if ( TUSB_DESC_ENDPOINT == tu_desc_type(p_desc) )
+    {
+      tusb_desc_endpoint_t const* desc_ep = (tusb_desc_endpoint_t const*) p_desc;
+      uint8_t const epnum = tu_edpt_number(desc_ep->bEndpointAddress);
+      uint8_t const dir   = tu_edpt_dir(desc_ep->bEndpointAddress);
+
+      TU_ASSERT(epnum < CFG_TUD_ENDPOINT_MAX);
+      TU_ASSERT(dcd_edpt_open(rhport, desc_ep));
+
+      _usbd_dev.ep_status[epnum][dir].drv_id  = driver_id;
+      _usbd_dev.ep_status[epnum][dir].busy    = false;
+      _usbd_dev.ep_status[epnum][dir].stalled = false;
+      _usbd_dev.ep_status[epnum][dir].iso     = (desc_ep->bmAttributes.xfer == TUSB_XFER_ISOCHRONOUS);
+    }
+
+    len   = (uint16_t)(len + tu_desc_len(p_desc));
+    p_desc = tu_desc_next(p_desc);
+  }
+
+  return true;
+}
+
+// Process Set Interface Request
+// Close endpoints of current alternate setting, open the new ones then notify class driver
+static bool process_set_interface(uint8_t rhport, uint8_t itf, uint8_t alt)
+{
+  uint8_t const drv_id = _usbd_dev.itf2drv[itf];
+  usbd_class_driver_t const * driver = get_driver(drv_id);
+  TU_VERIFY(driver);
+
+  // driver without alternate settings keeps its endpoints as they are
+  if ( !driver->set_interface ) return alt == 0;
+
+  uint16_t new_len;
+  tusb_desc_interface_t const* new_itf = find_interface(itf, alt, &new_len);
+  TU_VERIFY(new_itf);
+
+  uint16_t cur_len;
+  tusb_desc_interface_t const* cur_itf = find_interface(itf, _usbd_dev.itf_alt[itf], &cur_len);
+
+  if ( cur_itf ) close_interface_endpoint(rhport, (uint8_t const*) cur_itf, cur_len);
+  TU_ASSERT( open_interface_endpoint(rhport, (uint8_t const*) new_itf, new_len, drv_id) );
+
+  _usbd_dev.itf_alt[itf] = alt;
+
+  TU_LOG2("  %s set interface %u alt %u\r\n", driver->name, itf, alt);
+  return driver->set_interface(rhport, new_itf, new_len);
+}
+
+// Helper marking endpoint of interface belongs to class driver
+// Return false if an endpoint number is beyond CFG_TUD_ENDPOINT_MAX
+static bool mark_interface_endpoint(uint8_t const* p_desc, uint16_t desc_len, uint8_t driver_id)
+{
+  uint16_t len = 0;
+
+  while( len < desc_len )
+  {
+    if ( TUSB_DESC_ENDPOINT == tu_desc_type(p_desc) )
+    {
+      tusb_desc_endpoint_t const* desc_ep = (tusb_desc_endpoint_t const*) p_desc;
+      uint8_t const epnum = tu_edpt_number(desc_ep->bEndpointAddress);
+      uint8_t const dir   = tu_edpt_dir(desc_ep->bEndpointAddress);
+
+      TU_ASSERT(epnum < CFG_TUD_ENDPOINT_MAX);
+      _usbd_dev.ep_status[epnum][dir].drv_id = driver_id;
+
+      // class driver opens endpoint itself, alternate settings may reuse the number for another type
+      if ( desc_ep->bmAttributes.xfer == TUSB_XFER_ISOCHRONOUS ) _usbd_dev.ep_status[epnum][dir].iso = true;
+    }
+
+    len   = (uint16_t)(len + tu_desc_len(p_desc));
+    p_desc = tu_desc_next(p_desc);
+  }
+
+  return true;
+}
+
 // return descriptor's buffer and update desc_len
 static bool process_get_descriptor(uint8_t rhport, tusb_control_request_t const * p_request)
 {
@@ -823,6 +1235,94 @@ static bool process_get_descriptor(uint8_t rhport, tusb_control_request_t const
   return true;
 }
 
+#if CFG_TUD_XFER_COALESCE
+// Deferred by xfer_coalesce_keep(): report completions kept for endpoints
+static void xfer_coalesce_task(void* param)
+{
+  (void) param;
+
+  // a completion kept from now on queues a new event
+  _usbd_xfer.queued = false;
+  tu_mem_barrier();
+
+  for(uint8_t epnum = 1; epnum < CFG_TUD_ENDPOINT_MAX; epnum++)
+  {
+    for(uint8_t dir = 0; dir < 2; dir++)
+    {
+      if ( !_usbd_xfer.pending[epnum][dir] ) continue;
+
+      // event must be read before slot is released to producer
+      tu_mem_barrier();
+      dcd_event_t const event = _usbd_xfer.event[epnum][dir];
+      tu_mem_barrier();
+      _usbd_xfer.pending[epnum][dir] = false;
+
+      process_event(&event);
+    }
+  }
+}
+
+// Keep completion of a non-control endpoint for xfer_coalesce_task(), return false if it must be queued:
+// control endpoint, or previous completion of the endpoint is still kept (it is never overwritten).
+// Endpoints are reported in order of their number, completions of the same endpoint in order of arrival.
+static bool xfer_coalesce_keep(dcd_event_t const * event, bool in_isr)
+{
+  uint8_t const epnum = tu_edpt_number(event->xfer_complete.ep_addr);
+  uint8_t const dir   = tu_edpt_dir(event->xfer_complete.ep_addr);
+
+  if ( (epnum == 0) || (epnum >= CFG_TUD_ENDPOINT_MAX) || _usbd_xfer.pending[epnum][dir] ) return false;
+
+  dcd_event_t wakeup = { .rhport = event->rhport, .event_id = USBD_EVENT_FUNC_CALL };
+  wakeup.func_call.func  = xfer_coalesce_task;
+  wakeup.func_call.param = NULL;
+
+  // wakeup is queued before slot is published, queue full: completion is lost (and counted) once like any event
+  if ( !_usbd_xfer.queued )
+  {
+    _usbd_xfer.queued = true;
+    if ( !queue_event(&wakeup, in_isr) )
+    {
+      _usbd_xfer.queued = false;
+      return true;
+    }
+  }
+
+  _usbd_xfer.event[epnum][dir] = *event;
+
+  // event must be written before it is published to task
+  tu_mem_barrier();
+  _usbd_xfer.pending[epnum][dir] = true;
+  tu_mem_barrier();
+
+  // producer outside of ISR was preempted by task which already took the wakeup, an extra one is harmless
+  if ( !_usbd_xfer.queued )
+  {
+    _usbd_xfer.queued = true;
+    if ( !queue_event(&wakeup, in_isr) ) _usbd_xfer.queued = false;
+  }
+
+  return true;
+}
+#endif
+
+static void queue_xfer_complete(dcd_event_t const * event, bool in_isr)
+{
+#if CFG_TUD_XFER_COALESCE
+  if ( xfer_coalesce_keep(event, in_isr) ) return;
+#endif
+
+  queue_event(event, in_isr);
+}
+
+static inline bool sof_requested(void)
+{
+  for(uint8_t i=0; i<SOF_CONSUMER_COUNT; i++)
+  {
+    if ( _usbd_dev.sof_en[i] ) return true;
+  }
+  return false;
+}
+
 //--------------------------------------------------------------------+
 // DCD Event Handler
 //--------------------------------------------------------------------+
@@ -831,18 +1331,26 @@ void dcd_event_handler(dcd_event_t const * event, bool in_isr)
   switch (event->event_id)
   {
     case DCD_EVENT_BUS_RESET:
-      osal_queue_send(_usbd_q, event, in_isr);
+      queue_event(event, in_isr);
     break;
 
     case DCD_EVENT_UNPLUGGED:
       _usbd_dev.connected = 0;
       _usbd_dev.configured = 0;
       _usbd_dev.suspended = 0;
-      osal_queue_send(_usbd_q, event, in_isr);
+      queue_event(event, in_isr);
     break;
 
     case DCD_EVENT_SOF:
-      // nothing to do now
+      _usbd_dev.frame_count = event->sof.frame_count;
+
+      // Only queue if requested by a class driver, and at most one at a time:
+      // a late task would otherwise get a burst of stale SOFs (and a full queue)
+      if ( sof_requested() && !_usbd_dev.sof_pending )
+      {
+        _usbd_dev.sof_pending = true;
+        queue_event(event, in_isr);
+      }
     break;
 
     case DCD_EVENT_SUSPEND:
@@ -852,7 +1360,7 @@ void dcd_event_handler(dcd_event_t const * event, bool in_isr)
       if ( _usbd_dev.connected )
       {
         _usbd_dev.suspended = 1;
-        osal_queue_send(_usbd_q, event, in_isr);
+        queue_event(event, in_isr);
       }
     break;
 
@@ -860,22 +1368,35 @@ void dcd_event_handler(dcd_event_t const * event, bool in_isr)
       if ( _usbd_dev.connected )
       {
         _usbd_dev.suspended = 0;
-        osal_queue_send(_usbd_q, event, in_isr);
+        queue_event(event, in_isr);
       }
     break;
 
     case DCD_EVENT_SETUP_RECEIVED:
-      osal_queue_send(_usbd_q, event, in_isr);
+      queue_event(event, in_isr);
     break;
 
     case DCD_EVENT_XFER_COMPLETE:
-      osal_queue_send(_usbd_q, event, in_isr);
-      TU_ASSERT(event->xfer_complete.result == XFER_RESULT_SUCCESS,);
+    {
+#if CFG_TUD_STATS
+      // bus-to-task latency starts here
+      dcd_event_t stamped = *event;
+      stamped.xfer_complete.stamp = stats_time();
+      queue_xfer_complete(&stamped, in_isr);
+#else
+      queue_xfer_complete(event, in_isr);
+#endif
+      // missed frames fail isochronous transfers (with or without usbd_edpt_iso_xfer), others must succeed
+      uint8_t const epnum = tu_edpt_number(event->xfer_complete.ep_addr);
+      uint8_t const dir   = tu_edpt_dir(event->xfer_complete.ep_addr);
+      TU_ASSERT(epnum < CFG_TUD_ENDPOINT_MAX,);
+      TU_ASSERT(event->xfer_complete.result == XFER_RESULT_SUCCESS || _usbd_dev.ep_status[epnum][dir].iso,);
+    }
     break;
 
     // Not an DCD event, just a convenient way to defer ISR function should we need to
     case USBD_EVENT_FUNC_CALL:
-      osal_queue_send(_usbd_q, event, in_isr);
+      queue_event(event, in_isr);
     break;
 
     default: break;
@@ -907,6 +1428,14 @@ void dcd_event_xfer_complete (uint8_t rhport, uint8_t ep_addr, uint32_t xferred_
   dcd_event_handler(&event, in_isr);
 }
 
+void dcd_event_sof(uint8_t rhport, uint32_t frame_count, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_SOF };
+  event.sof.frame_count = frame_count;
+
+  dcd_event_handler(&event, in_isr);
+}
+
 //--------------------------------------------------------------------+
 // Helper
 //--------------------------------------------------------------------+
@@ -950,6 +1479,17 @@ void usbd_defer_func(osal_task_func_t func, void* param, bool in_isr)
   dcd_event_handler(&event, in_isr);
 }
 
+// Request SOF events to be passed to class drivers' sof(), disabled by bus reset.
+// SOF is only generated if the DCD port reports it.
+void usbd_sof_enable(uint8_t rhport, sof_consumer_t consumer, bool en)
+{
+  (void) rhport;
+  TU_ASSERT(consumer < SOF_CONSUMER_COUNT, );
+
+  // each consumer only writes its own flag, no locking against other drivers or the ISR
+  _usbd_dev.sof_en[consumer] = en;
+}
+
 //--------------------------------------------------------------------+
 // USBD Endpoint API
 //--------------------------------------------------------------------+
@@ -959,7 +1499,45 @@ bool usbd_edpt_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, uint16_t
   uint8_t const epnum = tu_edpt_number(ep_addr);
   uint8_t const dir   = tu_edpt_dir(ep_addr);
 
-  TU_VERIFY( dcd_edpt_xfer(rhport, ep_addr, buffer, total_bytes) );
+  TU_ASSERT( epnum < CFG_TUD_ENDPOINT_MAX );
+
+  bool const queued = dcd_edpt_xfer(rhport, ep_addr, buffer, total_bytes);
+#if CFG_TUD_STATS
+  stats_xfer_queued(epnum, dir, total_bytes, queued);
+#endif
+  TU_VERIFY( queued );
+
+  _usbd_dev.ep_status[epnum][dir].busy = true;
+
+  return true;
+}
+
+bool usbd_edpt_iso_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, dcd_iso_packet_t* packets, uint8_t count)
+{
+  uint8_t const epnum = tu_edpt_number(ep_addr);
+  uint8_t const dir   = tu_edpt_dir(ep_addr);
+
+  TU_ASSERT( epnum < CFG_TUD_ENDPOINT_MAX && count );
+  TU_VERIFY( dcd_edpt_iso_xfer );
+
+  // stack sets the requested length only, DCD fills in the rest
+  for(uint8_t i=0; i<count; i++)
+  {
+    packets[i].actual = 0;
+    packets[i].result = XFER_RESULT_MISSED;
+  }
+
+  // endpoint outside of any interface descriptor is only known as isochronous from here on,
+  // set before controller may complete it
+  _usbd_dev.ep_status[epnum][dir].iso = true;
+
+  bool const queued = dcd_edpt_iso_xfer(rhport, ep_addr, buffer, packets, count);
+#if CFG_TUD_STATS
+  // missed packets do not make a short transfer
+  stats_xfer_queued(epnum, dir, 0, queued);
+#endif
+  TU_VERIFY( queued );
+
   _usbd_dev.ep_status[epnum][dir].busy = true;
 
   return true;
@@ -983,6 +1561,10 @@ void usbd_edpt_stall(uint8_t rhport, uint8_t ep_addr)
   dcd_edpt_stall(rhport, ep_addr);
   _usbd_dev.ep_status[epnum][dir].stalled = true;
   _usbd_dev.ep_status[epnum][dir].busy = true;
+
+#if CFG_TUD_STATS
+  stats_stall(epnum, dir);
+#endif
 }
 
 void usbd_edpt_clear_stall(uint8_t rhport, uint8_t ep_addr)
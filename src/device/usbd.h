@@ -47,6 +47,10 @@ bool tud_init (void);
 // Task function should be called in main/rtos loop
 void tud_task (void);
 
+// Task function with bounded budget: process at most max_events (0 for no limit) events,
+// waiting up to timeout_ms for the first one (RTOS only). Return number of events processed
+uint32_t tud_task_ext(uint32_t max_events, uint32_t timeout_ms);
+
 // Interrupt handler, name alias to DCD
 #define tud_isr   dcd_isr
 
@@ -65,6 +69,42 @@ static inline bool tud_ready(void)
 // Remote wake up host, only if suspended and enabled by host
 bool tud_remote_wakeup(void);
 
+#if CFG_TUD_STATS
+// Transfer counters of an endpoint or a class driver. They are 32-bit and wrap around,
+// rates are taken from the difference of two snapshots.
+typedef struct
+{
+  uint32_t bytes;        // transferred
+  uint32_t xfers;        // completed transfers
+  uint32_t short_xfers;  // completed with fewer bytes than queued, control endpoint is not counted
+  uint32_t stalls;
+  uint32_t errors;       // rejected by DCD or completed with an error
+  uint32_t latency_sum;  // bus-to-task latency from DCD reporting a completion to tud_task() processing it,
+  uint32_t latency_max;  // in tud_stats_time_cb() unit, 0 without it
+}tud_stats_count_t;
+
+// Driver ID is 4-bit wide, 0x0F being invalid
+enum { TUD_STATS_DRIVER_MAX = 15 };
+
+typedef struct
+{
+  tud_stats_count_t edpt[CFG_TUD_ENDPOINT_MAX][2];  // by endpoint number and direction
+  tud_stats_count_t driver[TUD_STATS_DRIVER_MAX];   // by driver ID: application drivers first, then built-in ones as enabled
+  uint32_t queue_max;   // high-water mark of event queue, out of CFG_TUD_TASK_QUEUE_SZ
+  uint32_t queue_full;  // events lost because queue was full
+}tud_stats_t;
+
+// Get a snapshot of counters, which are kept across bus reset. Counters are updated without lock:
+// each one is read whole, but they may be a few events apart from each other. Counters are exact when
+// transfers are only queued from usbd task, an application task queuing them concurrently (e.g CDC
+// write flush with RTOS) may make a counter lose an increment.
+void tud_stats_get(tud_stats_t* stats);
+
+// Reset all counters to zero, must be called from the task running tud_task() (e.g in a callback
+// or between two calls) so that it does not race with counter updates.
+void tud_stats_clear(void);
+#endif
+
 // Carry out Data and Status stage of control transfer
 // - If len = 0, it is equivalent to sending status only
 // - If len > wLength : it will be truncated
@@ -106,6 +146,12 @@ TU_ATTR_WEAK void tud_suspend_cb(bool remote_wakeup_en);
 // Invoked when usb bus is resumed
 TU_ATTR_WEAK void tud_resume_cb(void);
 
+#if CFG_TUD_STATS
+// Invoked to timestamp transfer completions, from DCD event handler (usually in interrupt) and by tud_task()
+// Application return a free running counter e.g cycle counter or microsecond timer
+TU_ATTR_WEAK uint32_t tud_stats_time_cb(void);
+#endif
+
 // Invoked when received control request with VENDOR TYPE
 TU_ATTR_WEAK bool tud_vendor_control_request_cb(uint8_t rhport, tusb_control_request_t const * request);
 TU_ATTR_WEAK bool tud_vendor_control_complete_cb(uint8_t rhport, tusb_control_request_t const * request);
@@ -203,6 +249,26 @@ TU_ATTR_WEAK bool tud_vendor_control_complete_cb(uint8_t rhport, tusb_control_re
   /* Endpoint In */\
   7, TUSB_DESC_ENDPOINT, _epin, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0
 
+// Length of template descriptor: 53 bytes
+#define TUD_UAS_DESC_LEN    (9 + 4*(7 + 4))
+
+// Interface number, string index, EP Command (Out), EP Status (In), EP Data In & Data Out address, EP size
+#define TUD_UAS_DESCRIPTOR(_itfnum, _stridx, _epcmd, _epstatus, _epdatain, _epdataout, _epsize) \
+  /* Interface */\
+  9, TUSB_DESC_INTERFACE, _itfnum, 0, 4, TUSB_CLASS_MSC, MSC_SUBCLASS_SCSI, MSC_PROTOCOL_UAS, _stridx,\
+  /* Endpoint Command + Pipe Usage */\
+  7, TUSB_DESC_ENDPOINT, _epcmd, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0,\
+  4, UAS_DESC_PIPE_USAGE, UAS_PIPE_COMMAND, 0,\
+  /* Endpoint Status + Pipe Usage */\
+  7, TUSB_DESC_ENDPOINT, _epstatus, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0,\
+  4, UAS_DESC_PIPE_USAGE, UAS_PIPE_STATUS, 0,\
+  /* Endpoint Data In + Pipe Usage */\
+  7, TUSB_DESC_ENDPOINT, _epdatain, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0,\
+  4, UAS_DESC_PIPE_USAGE, UAS_PIPE_DATA_IN, 0,\
+  /* Endpoint Data Out + Pipe Usage */\
+  7, TUSB_DESC_ENDPOINT, _epdataout, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0,\
+  4, UAS_DESC_PIPE_USAGE, UAS_PIPE_DATA_OUT, 0
+
 //------------- HID -------------//
 
 // Length of template descriptor: 25 bytes
@@ -267,6 +333,69 @@ TU_ATTR_WEAK bool tud_vendor_control_complete_cb(uint8_t rhport, tusb_control_re
   /* MS Endpoint (connected to embedded jack out) */\
   5, TUSB_DESC_CS_ENDPOINT, MIDI_CS_ENDPOINT_GENERAL, 1, 3
 
+//------------- Audio 2.0 -------------//
+
+// Length of template descriptor (245 bytes)
+#define TUD_AUDIO_HEADSET_STEREO_DESC_LEN (8 + 9 + 9 + 8 + 17 + 18 + 12 + 17 + 18 + 12 +\
+                                           9 + 9 + 16 + 6 + 7 + 8 + 7 + 9 + 9 + 16 + 6 + 7 + 8)
+
+// Audio 2.0 headset descriptor, speaker and microphone are both stereo
+// - Clock Source 1 shared by both streams
+// - Speaker: Input Terminal 2 (USB) -> Feature Unit 3 -> Output Terminal 4, asynchronous OUT with feedback
+// - Microphone: Input Terminal 5 -> Feature Unit 6 -> Output Terminal 7 (USB), asynchronous IN
+// Interface number, string index, bytes per sample, bits per sample, EP OUT & feedback & IN address, EP size
+#define TUD_AUDIO_HEADSET_STEREO_DESCRIPTOR(_itfnum, _stridx, _nbytes, _nbits, _epout, _epfb, _epin, _epsize) \
+  /* Interface Associate */\
+  8, TUSB_DESC_INTERFACE_ASSOCIATION, _itfnum, 3, TUSB_CLASS_AUDIO, AUDIO_SUBCLASS_UNDEFINED, AUDIO_PROTOCOL_V2, 0,\
+  /* Audio Control (AC) Interface */\
+  9, TUSB_DESC_INTERFACE, _itfnum, 0, 0, TUSB_CLASS_AUDIO, AUDIO_SUBCLASS_CONTROL, AUDIO_PROTOCOL_V2, _stridx,\
+  /* AC Header */\
+  9, TUSB_DESC_CS_INTERFACE, AUDIO_CS_INTERFACE_HEADER, U16_TO_U8S_LE(0x0200), AUDIO_FUNC_HEADSET, U16_TO_U8S_LE(111), 0,\
+  /* Clock Source */\
+  8, TUSB_DESC_CS_INTERFACE, AUDIO_CS_INTERFACE_CLOCK_SOURCE, 1, AUDIO_CLOCK_SOURCE_ATT_INT_PRO_CLK, AUDIO_CLOCK_SOURCE_CTRL_FREQ_RW | AUDIO_CLOCK_SOURCE_CTRL_VALID_RO, 0, 0,\
+  /* Speaker Input Terminal (USB streaming) */\
+  17, TUSB_DESC_CS_INTERFACE, AUDIO_CS_INTERFACE_INPUT_TERMINAL, 2, U16_TO_U8S_LE(AUDIO_TERM_TYPE_USB_STREAMING), 0, 1, 2, U32_TO_U8S_LE(0x00000003), 0, U16_TO_U8S_LE(0), 0,\
+  /* Speaker Feature Unit, mute & volume on master and both channels */\
+  18, TUSB_DESC_CS_INTERFACE, AUDIO_CS_INTERFACE_FEATURE_UNIT, 3, 2,\
+    U32_TO_U8S_LE(AUDIO_FU_CTRL_MUTE_RW | AUDIO_FU_CTRL_VOLUME_RW), U32_TO_U8S_LE(AUDIO_FU_CTRL_MUTE_RW | AUDIO_FU_CTRL_VOLUME_RW),\
+    U32_TO_U8S_LE(AUDIO_FU_CTRL_MUTE_RW | AUDIO_FU_CTRL_VOLUME_RW), 0,\
+  /* Speaker Output Terminal */\
+  12, TUSB_DESC_CS_INTERFACE, AUDIO_CS_INTERFACE_OUTPUT_TERMINAL, 4, U16_TO_U8S_LE(AUDIO_TERM_TYPE_OUT_HEADPHONES), 0, 3, 1, U16_TO_U8S_LE(0), 0,\
+  /* Microphone Input Terminal */\
+  17, TUSB_DESC_CS_INTERFACE, AUDIO_CS_INTERFACE_INPUT_TERMINAL, 5, U16_TO_U8S_LE(AUDIO_TERM_TYPE_IN_MICROPHONE), 0, 1, 2, U32_TO_U8S_LE(0x00000003), 0, U16_TO_U8S_LE(0), 0,\
+  /* Microphone Feature Unit, mute & volume on master and both channels */\
+  18, TUSB_DESC_CS_INTERFACE, AUDIO_CS_INTERFACE_FEATURE_UNIT, 6, 5,\
+    U32_TO_U8S_LE(AUDIO_FU_CTRL_MUTE_RW | AUDIO_FU_CTRL_VOLUME_RW), U32_TO_U8S_LE(AUDIO_FU_CTRL_MUTE_RW | AUDIO_FU_CTRL_VOLUME_RW),\
+    U32_TO_U8S_LE(AUDIO_FU_CTRL_MUTE_RW | AUDIO_FU_CTRL_VOLUME_RW), 0,\
+  /* Microphone Output Terminal (USB streaming) */\
+  12, TUSB_DESC_CS_INTERFACE, AUDIO_CS_INTERFACE_OUTPUT_TERMINAL, 7, U16_TO_U8S_LE(AUDIO_TERM_TYPE_USB_STREAMING), 0, 6, 1, U16_TO_U8S_LE(0), 0,\
+  /* Speaker Audio Streaming (AS) Interface, alternate 0 has no endpoint */\
+  9, TUSB_DESC_INTERFACE, (uint8_t)((_itfnum)+1), 0, 0, TUSB_CLASS_AUDIO, AUDIO_SUBCLASS_STREAMING, AUDIO_PROTOCOL_V2, 0,\
+  /* Speaker AS Interface, alternate 1 */\
+  9, TUSB_DESC_INTERFACE, (uint8_t)((_itfnum)+1), 1, 2, TUSB_CLASS_AUDIO, AUDIO_SUBCLASS_STREAMING, AUDIO_PROTOCOL_V2, 0,\
+  /* AS General */\
+  16, TUSB_DESC_CS_INTERFACE, AUDIO_CS_AS_INTERFACE_GENERAL, 2, 0, AUDIO_FORMAT_TYPE_I, U32_TO_U8S_LE(AUDIO_DATA_FORMAT_TYPE_I_PCM), 2, U32_TO_U8S_LE(0x00000003), 0,\
+  /* Type I Format */\
+  6, TUSB_DESC_CS_INTERFACE, AUDIO_CS_AS_INTERFACE_FORMAT_TYPE, AUDIO_FORMAT_TYPE_I, _nbytes, _nbits,\
+  /* Endpoint Out */\
+  7, TUSB_DESC_ENDPOINT, _epout, TUSB_XFER_ISOCHRONOUS | TUSB_ISO_EP_ATT_ASYNCHRONOUS | TUSB_ISO_EP_ATT_DATA, U16_TO_U8S_LE(_epsize), 1,\
+  /* AS Isochronous Data Endpoint */\
+  8, TUSB_DESC_CS_ENDPOINT, AUDIO_CS_ENDPOINT_GENERAL, 0, 0, 0, U16_TO_U8S_LE(0),\
+  /* Endpoint Feedback, 10.14 format at full speed */\
+  7, TUSB_DESC_ENDPOINT, _epfb, TUSB_XFER_ISOCHRONOUS | TUSB_ISO_EP_ATT_NO_SYNC | TUSB_ISO_EP_ATT_EXPLICIT_FB, U16_TO_U8S_LE(3), 1,\
+  /* Microphone AS Interface, alternate 0 has no endpoint */\
+  9, TUSB_DESC_INTERFACE, (uint8_t)((_itfnum)+2), 0, 0, TUSB_CLASS_AUDIO, AUDIO_SUBCLASS_STREAMING, AUDIO_PROTOCOL_V2, 0,\
+  /* Microphone AS Interface, alternate 1 */\
+  9, TUSB_DESC_INTERFACE, (uint8_t)((_itfnum)+2), 1, 1, TUSB_CLASS_AUDIO, AUDIO_SUBCLASS_STREAMING, AUDIO_PROTOCOL_V2, 0,\
+  /* AS General */\
+  16, TUSB_DESC_CS_INTERFACE, AUDIO_CS_AS_INTERFACE_GENERAL, 7, 0, AUDIO_FORMAT_TYPE_I, U32_TO_U8S_LE(AUDIO_DATA_FORMAT_TYPE_I_PCM), 2, U32_TO_U8S_LE(0x00000003), 0,\
+  /* Type I Format */\
+  6, TUSB_DESC_CS_INTERFACE, AUDIO_CS_AS_INTERFACE_FORMAT_TYPE, AUDIO_FORMAT_TYPE_I, _nbytes, _nbits,\
+  /* Endpoint In */\
+  7, TUSB_DESC_ENDPOINT, _epin, TUSB_XFER_ISOCHRONOUS | TUSB_ISO_EP_ATT_ASYNCHRONOUS | TUSB_ISO_EP_ATT_DATA, U16_TO_U8S_LE(_epsize), 1,\
+  /* AS Isochronous Data Endpoint */\
+  8, TUSB_DESC_CS_ENDPOINT, AUDIO_CS_ENDPOINT_GENERAL, 0, 0, 0, U16_TO_U8S_LE(0)
+
 //------------- TUD_USBTMC/USB488 -------------//
 #define TUD_USBTMC_APP_CLASS    (TUSB_CLASS_APPLICATION_SPECIFIC)
 #define TUD_USBTMC_APP_SUBCLASS 0x03u
@@ -33,6 +33,54 @@
  extern "C" {
 #endif
 
+//--------------------------------------------------------------------+
+// Class Driver API
+//--------------------------------------------------------------------+
+
+// Interface fields matched in addition to class code
+enum
+{
+  USBD_MATCH_SUBCLASS = TU_BIT(0),
+  USBD_MATCH_PROTOCOL = TU_BIT(1),
+};
+
+#if CFG_TUSB_DEBUG > 1
+  #define USBD_DRIVER_NAME(_name)   .name = _name,
+#else
+  #define USBD_DRIVER_NAME(_name)
+#endif
+
+typedef struct {
+  #if CFG_TUSB_DEBUG > 1
+  char const* name;
+  #endif
+
+  uint8_t class_code;
+  uint8_t subclass_code;
+  uint8_t protocol_code;
+  uint8_t match;          // USBD_MATCH_* flags, 0 to match class code only
+
+  void (* init             ) (void);
+  void (* reset            ) (uint8_t rhport);
+  bool (* open             ) (uint8_t rhport, tusb_desc_interface_t const * desc_intf, uint16_t* p_length);
+  bool (* set_interface    ) (uint8_t rhport, tusb_desc_interface_t const * desc_intf, uint16_t length); // optional
+  bool (* control_request  ) (uint8_t rhport, tusb_control_request_t const * request);
+  bool (* control_complete ) (uint8_t rhport, tusb_control_request_t const * request);
+  bool (* xfer_cb          ) (uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t xferred_bytes);
+  void (* sof              ) (uint8_t rhport, uint32_t frame_count);
+} usbd_class_driver_t;
+
+// set_interface() is invoked when host selects an alternate setting, after endpoints of previous setting are
+// closed and the ones of desc_intf are opened. Without it only alternate setting 0 is accepted.
+
+// sof() gets the frame number of the latest SOF. SOFs are not queued while one is pending,
+// a busy task therefore sees frame numbers skip ahead.
+
+// Invoked by tud_init() to get application class drivers, e.g custom vendor drivers.
+// They are matched before built-in drivers and can therefore take over an interface.
+// Built-in and application drivers together must be less than 15.
+TU_ATTR_WEAK usbd_class_driver_t const* usbd_app_driver_get_cb(uint8_t* driver_count);
+
 //--------------------------------------------------------------------+
 // USBD Endpoint API
 //--------------------------------------------------------------------+
@@ -42,6 +90,10 @@
 // Submit a usb transfer
 bool usbd_edpt_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes);
 
+// Submit an isochronous transfer of count packets (one per frame), completed with a single xfer_cb().
+// Return false if port does not support it, driver can fall back to usbd_edpt_xfer() per packet.
+bool usbd_edpt_iso_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, dcd_iso_packet_t* packets, uint8_t count);
+
 // Check if endpoint transferring is complete
 bool usbd_edpt_busy(uint8_t rhport, uint8_t ep_addr);
 
@@ -67,6 +119,18 @@ bool usbd_edpt_ready(uint8_t rhport, uint8_t ep_addr)
 bool usbd_open_edpt_pair(uint8_t rhport, uint8_t const* p_desc, uint8_t ep_count, uint8_t xfer_type, uint8_t* ep_out, uint8_t* ep_in);
 void usbd_defer_func( osal_task_func_t func, void* param, bool in_isr );
 
+// Class drivers requesting SOF events, each one enables and disables only its own request
+typedef enum
+{
+  SOF_CONSUMER_CDC = 0,
+  SOF_CONSUMER_AUDIO,
+  SOF_CONSUMER_COUNT
+} sof_consumer_t;
+
+// Request SOF events for class drivers' sof() callback. They are queued while any consumer
+// requests them. Bus reset disables all requests.
+void usbd_sof_enable(uint8_t rhport, sof_consumer_t consumer, bool en);
+
 
 #ifdef __cplusplus
  }
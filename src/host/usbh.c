@@ -528,9 +528,10 @@ bool enum_task(hcd_event_t* event)
 
   //------------- parse configuration & install drivers -------------//
   uint8_t const* p_desc = _usbh_ctrl_buf + sizeof(tusb_desc_configuration_t);
+  uint8_t const* desc_end = _usbh_ctrl_buf + ((tusb_desc_configuration_t*)_usbh_ctrl_buf)->wTotalLength;
 
   // parse each interfaces
-  while( p_desc < _usbh_ctrl_buf + ((tusb_desc_configuration_t*)_usbh_ctrl_buf)->wTotalLength )
+  while( p_desc < desc_end )
   {
     // skip until we see interface descriptor
     if ( TUSB_DESC_INTERFACE != tu_desc_type(p_desc) )
@@ -568,10 +569,21 @@ bool enum_task(hcd_event_t* event)
         {
           uint16_t itf_len = 0;
 
+          // Route endpoints of this interface to driver while it opens, e.g MSC issues SCSI commands in open
+          uint8_t const* p_end = tu_desc_next(p_desc);
+          while ( p_end < desc_end && TUSB_DESC_INTERFACE != tu_desc_type(p_end) ) p_end = tu_desc_next(p_end);
+          mark_interface_endpoint(new_dev->ep2drv, p_desc, (uint16_t) (p_end - p_desc), drv_id);
+
           if ( usbh_class_drivers[drv_id].open(new_dev->rhport, new_addr, desc_itf, &itf_len) )
           {
             mark_interface_endpoint(new_dev->ep2drv, p_desc, itf_len, drv_id);
           }
+          else
+          {
+            // driver did not take the interface, its endpoints must not be routed to it
+            mark_interface_endpoint(new_dev->ep2drv, p_desc, (uint16_t) (p_end - p_desc), 0xff);
+            new_dev->itf2drv[desc_itf->bInterfaceNumber] = 0xff;
+          }
 
           TU_ASSERT( itf_len >= sizeof(tusb_desc_interface_t) );
           p_desc += itf_len;
@@ -77,7 +77,9 @@ static inline bool osal_mutex_unlock(osal_mutex_t mutex_hdl);
 //------------- Queue -------------//
 static inline osal_queue_t osal_queue_create(osal_queue_def_t* qdef);
 static inline bool osal_queue_receive(osal_queue_t const qhdl, void* data);
+static inline uint16_t osal_queue_receive_n(osal_queue_t const qhdl, void* data, uint16_t count, uint32_t msec);
 static inline bool osal_queue_send(osal_queue_t const qhdl, void const * data, bool in_isr);
+static inline uint16_t osal_queue_count(osal_queue_t const qhdl, bool in_isr);
 
 #if 0  // TODO remove subtask related macros later
 // Sub Task
@@ -123,11 +123,26 @@ static inline bool osal_queue_receive(osal_queue_t const queue_hdl, void* data)
   return xQueueReceive(queue_hdl, data, portMAX_DELAY);
 }
 
+// FreeRTOS has no batch receive and the item size is not known from the handle: take one item,
+// waiting up to msec. Caller takes the following ones with another call without timeout.
+static inline uint16_t osal_queue_receive_n(osal_queue_t const queue_hdl, void* data, uint16_t count, uint32_t msec)
+{
+  TickType_t const ticks = (msec == OSAL_TIMEOUT_WAIT_FOREVER) ? portMAX_DELAY : pdMS_TO_TICKS(msec);
+
+  if ( count == 0 ) return 0;
+  return xQueueReceive(queue_hdl, data, ticks) ? 1 : 0;
+}
+
 static inline bool osal_queue_send(osal_queue_t const queue_hdl, void const * data, bool in_isr)
 {
   return in_isr ? xQueueSendToBackFromISR(queue_hdl, data, NULL) : xQueueSendToBack(queue_hdl, data, OSAL_TIMEOUT_WAIT_FOREVER);
 }
 
+static inline uint16_t osal_queue_count(osal_queue_t const queue_hdl, bool in_isr)
+{
+  return (uint16_t) (in_isr ? uxQueueMessagesWaitingFromISR(queue_hdl) : uxQueueMessagesWaiting(queue_hdl));
+}
+
 #ifdef __cplusplus
  }
 #endif
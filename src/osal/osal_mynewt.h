@@ -125,18 +125,55 @@ static inline osal_queue_t osal_queue_create(osal_queue_def_t* qdef)
   return (osal_queue_t) qdef;
 }
 
+static inline void _osal_q_take(osal_queue_t const qhdl, struct os_event* ev, void* data)
+{
+  memcpy(data, ev->ev_arg, qhdl->item_sz); // copy message
+  os_memblock_put(&qhdl->mpool, ev->ev_arg); // put back mem block
+  os_memblock_put(&qhdl->epool, ev);         // put back ev block
+}
+
 static inline bool osal_queue_receive(osal_queue_t const qhdl, void* data)
 {
   struct os_event* ev;
   ev = os_eventq_get(&qhdl->evq);
 
-  memcpy(data, ev->ev_arg, qhdl->item_sz); // copy message
-  os_memblock_put(&qhdl->mpool, ev->ev_arg); // put back mem block
-  os_memblock_put(&qhdl->epool, ev);         // put back ev block
+  _osal_q_take(qhdl, ev, data);
 
   return true;
 }
 
+// wait up to msec for the first item, then take the ones already queued without blocking
+static inline uint16_t osal_queue_receive_n(osal_queue_t const qhdl, void* data, uint16_t count, uint32_t msec)
+{
+  uint8_t* buf8 = (uint8_t*) data;
+  uint16_t n;
+
+  for(n = 0; n < count; n++)
+  {
+    struct os_event* ev;
+
+    if ( n == 0 && msec == OSAL_TIMEOUT_WAIT_FOREVER )
+    {
+      ev = os_eventq_get(&qhdl->evq);
+    }
+    else if ( n == 0 && msec != OSAL_TIMEOUT_NOTIMEOUT )
+    {
+      struct os_eventq* evq = &qhdl->evq;
+      ev = os_eventq_poll(&evq, 1, os_time_ms_to_ticks32(msec));
+    }
+    else
+    {
+      ev = os_eventq_get_no_wait(&qhdl->evq);
+    }
+
+    if ( !ev ) break;
+
+    _osal_q_take(qhdl, ev, buf8 + n*qhdl->item_sz);
+  }
+
+  return n;
+}
+
 static inline bool osal_queue_send(osal_queue_t const qhdl, void const * data, bool in_isr)
 {
   (void) in_isr;
@@ -161,6 +198,13 @@ static inline bool osal_queue_send(osal_queue_t const qhdl, void const * data, b
   return true;
 }
 
+// every queued item holds a data block until it is taken
+static inline uint16_t osal_queue_count(osal_queue_t const qhdl, bool in_isr)
+{
+  (void) in_isr;
+  return (uint16_t) (qhdl->depth - qhdl->mpool.mp_num_free);
+}
+
 #ifdef __cplusplus
  }
 #endif
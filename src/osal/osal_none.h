@@ -177,17 +177,24 @@ static inline osal_queue_t osal_queue_create(osal_queue_def_t* qdef)
 }
 
 // non blocking
+// Task is the only consumer and fifo is single producer single consumer safe,
+// there is no need to disable usb isr here.
 static inline bool osal_queue_receive(osal_queue_t const qhdl, void* data)
 {
-  _osal_q_lock(qhdl);
-  bool success = tu_fifo_read(&qhdl->ff, data);
-  _osal_q_unlock(qhdl);
+  return tu_fifo_read(&qhdl->ff, data);
+}
 
-  return success;
+// non blocking, msec is ignored: without RTOS there is nothing to wait for.
+// All available items (up to count) are taken with a single read index update.
+static inline uint16_t osal_queue_receive_n(osal_queue_t const qhdl, void* data, uint16_t count, uint32_t msec)
+{
+  (void) msec;
+  return tu_fifo_read_n(&qhdl->ff, data, count);
 }
 
 static inline bool osal_queue_send(osal_queue_t const qhdl, void const * data, bool in_isr)
 {
+  // Both isr and task can send, lock to prevent task and isr from producing at the same time
   if (!in_isr) {
     _osal_q_lock(qhdl);
   }
@@ -203,6 +210,13 @@ static inline bool osal_queue_send(osal_queue_t const qhdl, void const * data, b
   return success;
 }
 
+// fifo count only reads both indices, no need to lock
+static inline uint16_t osal_queue_count(osal_queue_t const qhdl, bool in_isr)
+{
+  (void) in_isr;
+  return tu_fifo_count(&qhdl->ff);
+}
+
 #ifdef __cplusplus
  }
 #endif
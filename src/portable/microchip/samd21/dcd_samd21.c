@@ -299,7 +299,7 @@ void USB_Handler(void)
   /*------------- Interrupt Processing -------------*/
   if ( int_status & USB_DEVICE_INTFLAG_SOF )
   {
-    dcd_event_bus_signal(0, DCD_EVENT_SOF, true);
+    dcd_event_sof(0, USB->DEVICE.FNUM.bit.FNUM, true);
   }
 
   // SAMD doesn't distinguish between Suspend and Disconnect state.
@@ -310,7 +310,7 @@ void USB_0_Handler(void) {
 /* USB_SOF_HSOF */
 void USB_1_Handler(void) {
   USB->DEVICE.INTFLAG.reg = USB_DEVICE_INTFLAG_SOF;
-  dcd_event_bus_signal(0, DCD_EVENT_SOF, true);
+  dcd_event_sof(0, USB->DEVICE.FNUM.bit.FNUM, true);
 }
 
 void transfer_complete(uint8_t direction) {
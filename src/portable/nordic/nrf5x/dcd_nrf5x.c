@@ -53,6 +53,9 @@ enum
   // Max allowed by USB specs
   MAX_PACKET_SIZE   = 64,
 
+  // Endpoint 8 is the only isochronous endpoint
+  EP_ISO_NUM        = 8,
+
   // Mask of all END event (IN & OUT) for all endpoints. ENDEPIN0-7, ENDEPOUT0-7, ENDISOIN, ENDISOOUT
   EDPT_END_ALL_MASK = (0xff << USBD_INTEN_ENDEPIN0_Pos) | (0xff << USBD_INTEN_ENDEPOUT0_Pos) |
                       USBD_INTENCLR_ENDISOIN_Msk | USBD_INTEN_ENDISOOUT_Msk
@@ -72,12 +75,33 @@ typedef struct
 
 } xfer_td_t;
 
+// Isochronous transfer descriptor, one packet is moved per frame on SOF
+typedef struct
+{
+  uint8_t* buffer;
+  dcd_iso_packet_t* packets;
+  uint8_t  count;       // 0 if no transfer
+  uint8_t  index;       // current packet
+  uint16_t offset;      // of current packet in buffer
+  uint32_t total_len;
+  bool     failed;      // any packet is not successful
+
+  volatile bool loaded; // ISO IN packet is moved to endpoint buffer
+  bool     load_pending;// ISO IN packet waits for DMA busy at SOF, started on END event
+  bool     truncated;   // ISO OUT packet is larger than its room
+
+  dcd_iso_packet_t packet; // used by dcd_edpt_xfer() as single packet transfer
+}iso_td_t;
+
 // Data for managing dcd
 static struct
 {
   // All 8 endpoints including control IN & OUT (offset 1)
   xfer_td_t xfer[8][2];
 
+  // Isochronous endpoint IN & OUT
+  iso_td_t iso[2];
+
   // Only one DMA can run at a time
   volatile bool dma_running;
 }_dcd;
@@ -180,6 +204,103 @@ static void xact_in_prepare(uint8_t epnum)
   edpt_dma_start(&NRF_USBD->TASKS_STARTEPIN[epnum]);
 }
 
+/*------------------------------------------------------------------*/
+/* Isochronous Transfer
+ *------------------------------------------------------------------*/
+
+// Start DMA of current ISO IN packet, it is sent to host in the next frame
+static void iso_in_load(iso_td_t* iso)
+{
+  iso->loaded = false;
+
+  NRF_USBD->ISOIN.PTR    = (uint32_t) (iso->buffer + iso->offset);
+  NRF_USBD->ISOIN.MAXCNT = iso->packets[iso->index].length;
+
+  edpt_dma_start(&NRF_USBD->TASKS_STARTISOIN);
+}
+
+// Current packet is done, complete the transfer after the last one
+static void iso_packet_done(uint8_t dir, uint16_t len, uint8_t result)
+{
+  iso_td_t* iso = &_dcd.iso[dir];
+  dcd_iso_packet_t* packet = &iso->packets[iso->index];
+
+  packet->actual = len;
+  packet->result = result;
+
+  iso->offset     = (uint16_t) (iso->offset + packet->length);
+  iso->total_len += len;
+  if ( result != XFER_RESULT_SUCCESS ) iso->failed = true;
+
+  if ( ++iso->index == iso->count )
+  {
+    iso->count = 0;
+
+    uint8_t const ep_addr = EP_ISO_NUM | (dir ? TUSB_DIR_IN_MASK : 0);
+    dcd_event_xfer_complete(0, ep_addr, iso->total_len, iso->failed ? XFER_RESULT_FAILED : XFER_RESULT_SUCCESS, true);
+  }
+}
+
+// On SOF the endpoint buffers are swapped: ISO IN packet loaded in previous frame goes to the bus,
+// ISO OUT packet received in previous frame is ready for DMA.
+// ISO OUT goes first since its endpoint buffer is overwritten in this frame, next ISO IN packet
+// is loaded once that DMA is done (chained from END event) rather than deferred to usbd task.
+static void iso_sof(void)
+{
+  iso_td_t* iso = &_dcd.iso[TUSB_DIR_OUT];
+
+  if ( iso->index < iso->count )
+  {
+    uint32_t const size = NRF_USBD->SIZE.ISOOUT;
+    uint16_t const xact_len = (uint16_t) (size & USBD_SIZE_ISOOUT_SIZE_Msk);
+
+    if ( size & USBD_SIZE_ISOOUT_ZERO_Msk )
+    {
+      // zero-length packet
+      iso_packet_done(TUSB_DIR_OUT, 0, XFER_RESULT_SUCCESS);
+    }
+    else if ( xact_len == 0 )
+    {
+      // host did not send anything in previous frame
+      iso_packet_done(TUSB_DIR_OUT, 0, XFER_RESULT_MISSED);
+    }
+    else
+    {
+      uint16_t const room = iso->packets[iso->index].length;
+      iso->truncated = (xact_len > room);
+
+      // Trigger DMA move data from Endpoint -> SRAM, packet is done on ENDISOOUT
+      NRF_USBD->ISOOUT.PTR    = (uint32_t) (iso->buffer + iso->offset);
+      NRF_USBD->ISOOUT.MAXCNT = tu_min16(xact_len, room);
+
+      edpt_dma_start(&NRF_USBD->TASKS_STARTISOOUT);
+    }
+  }
+
+  iso = &_dcd.iso[TUSB_DIR_IN];
+
+  if ( iso->index < iso->count )
+  {
+    // DMA did not make it before SOF: host gets a zero-length packet
+    bool const loaded = iso->loaded;
+    iso_packet_done(TUSB_DIR_IN, loaded ? iso->packets[iso->index].length : 0, loaded ? XFER_RESULT_SUCCESS : XFER_RESULT_MISSED);
+
+    if ( iso->count )
+    {
+      iso->loaded = false;
+
+      if ( _dcd.dma_running )
+      {
+        iso->load_pending = true;
+      }
+      else
+      {
+        iso_in_load(iso);
+      }
+    }
+  }
+}
+
 //--------------------------------------------------------------------+
 // Controller API
 //--------------------------------------------------------------------+
@@ -247,6 +368,34 @@ bool dcd_edpt_open (uint8_t rhport, tusb_desc_endpoint_t const * desc_edpt)
   uint8_t const epnum = tu_edpt_number(desc_edpt->bEndpointAddress);
   uint8_t const dir   = tu_edpt_dir(desc_edpt->bEndpointAddress);
 
+  if ( TUSB_XFER_ISOCHRONOUS == desc_edpt->bmAttributes.xfer )
+  {
+    TU_ASSERT(epnum == EP_ISO_NUM);
+
+    if ( dir == TUSB_DIR_OUT )
+    {
+      NRF_USBD->INTENSET = USBD_INTEN_ENDISOOUT_Msk;
+      NRF_USBD->EPOUTEN |= USBD_EPOUTEN_ISOOUT_Msk;
+    }else
+    {
+      // Send zero-length packet when no data is loaded
+      NRF_USBD->ISOINCONFIG = USBD_ISOINCONFIG_RESPONSE_ZeroData << USBD_ISOINCONFIG_RESPONSE_Pos;
+
+      NRF_USBD->INTENSET = USBD_INTEN_ENDISOIN_Msk;
+      NRF_USBD->EPINEN  |= USBD_EPINEN_ISOIN_Msk;
+    }
+
+    // Split endpoint buffer if both directions are used
+    bool const both = (NRF_USBD->EPOUTEN & USBD_EPOUTEN_ISOOUT_Msk) && (NRF_USBD->EPINEN & USBD_EPINEN_ISOIN_Msk);
+    NRF_USBD->ISOSPLIT = (both ? USBD_ISOSPLIT_SPLIT_HalfIN : USBD_ISOSPLIT_SPLIT_OneDir) << USBD_ISOSPLIT_SPLIT_Pos;
+
+    // Packets are moved on SOF
+    NRF_USBD->INTENSET = USBD_INTEN_SOF_Msk;
+    __ISB(); __DSB();
+
+    return true;
+  }
+
   _dcd.xfer[epnum][dir].mps = desc_edpt->wMaxPacketSize.size;
 
   if ( dir == TUSB_DIR_OUT )
@@ -263,6 +412,43 @@ bool dcd_edpt_open (uint8_t rhport, tusb_desc_endpoint_t const * desc_edpt)
   return true;
 }
 
+void dcd_edpt_close (uint8_t rhport, uint8_t ep_addr)
+{
+  (void) rhport;
+
+  uint8_t const epnum = tu_edpt_number(ep_addr);
+  uint8_t const dir   = tu_edpt_dir(ep_addr);
+
+  if ( epnum == EP_ISO_NUM )
+  {
+    if ( dir == TUSB_DIR_OUT )
+    {
+      NRF_USBD->INTENCLR = USBD_INTEN_ENDISOOUT_Msk;
+      NRF_USBD->EPOUTEN &= ~USBD_EPOUTEN_ISOOUT_Msk;
+    }else
+    {
+      NRF_USBD->INTENCLR = USBD_INTEN_ENDISOIN_Msk;
+      NRF_USBD->EPINEN  &= ~USBD_EPINEN_ISOIN_Msk;
+    }
+
+    // drop pending transfer
+    _dcd.iso[dir].count = 0;
+  }
+  else if ( dir == TUSB_DIR_OUT )
+  {
+    NRF_USBD->INTENCLR = TU_BIT(USBD_INTEN_ENDEPOUT0_Pos + epnum);
+    NRF_USBD->EPOUTEN &= ~TU_BIT(epnum);
+    tu_varclr(get_td(epnum, dir));
+  }else
+  {
+    NRF_USBD->INTENCLR = TU_BIT(USBD_INTEN_ENDEPIN0_Pos + epnum);
+    NRF_USBD->EPINEN  &= ~TU_BIT(epnum);
+    tu_varclr(get_td(epnum, dir));
+  }
+
+  __ISB(); __DSB();
+}
+
 bool dcd_edpt_xfer (uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes)
 {
   (void) rhport;
@@ -270,6 +456,13 @@ bool dcd_edpt_xfer (uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, uint16_t
   uint8_t const epnum = tu_edpt_number(ep_addr);
   uint8_t const dir   = tu_edpt_dir(ep_addr);
 
+  // Isochronous endpoint transfers a single packet in the next frame
+  if ( epnum == EP_ISO_NUM )
+  {
+    _dcd.iso[dir].packet.length = total_bytes;
+    return dcd_edpt_iso_xfer(rhport, ep_addr, buffer, &_dcd.iso[dir].packet, 1);
+  }
+
   xfer_td_t* xfer = get_td(epnum, dir);
 
   xfer->buffer     = buffer;
@@ -307,6 +500,30 @@ bool dcd_edpt_xfer (uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, uint16_t
   return true;
 }
 
+bool dcd_edpt_iso_xfer (uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, dcd_iso_packet_t* packets, uint8_t count)
+{
+  (void) rhport;
+
+  TU_ASSERT(tu_edpt_number(ep_addr) == EP_ISO_NUM && count);
+
+  uint8_t const dir = tu_edpt_dir(ep_addr);
+  iso_td_t* iso = &_dcd.iso[dir];
+
+  iso->buffer    = buffer;
+  iso->packets   = packets;
+  iso->index     = 0;
+  iso->offset    = 0;
+  iso->total_len = 0;
+  iso->failed    = false;
+  iso->load_pending = false;
+  iso->count     = count;
+
+  // First IN packet must be in endpoint buffer before next SOF, the following ones are loaded on SOF
+  if ( dir == TUSB_DIR_IN ) iso_in_load(iso);
+
+  return true;
+}
+
 void dcd_edpt_stall (uint8_t rhport, uint8_t ep_addr)
 {
   (void) rhport;
@@ -382,11 +599,6 @@ void USBD_IRQHandler(void)
     dcd_event_bus_signal(0, DCD_EVENT_BUS_RESET, true);
   }
 
-  if ( int_status & USBD_INTEN_SOF_Msk )
-  {
-    dcd_event_bus_signal(0, DCD_EVENT_SOF, true);
-  }
-
   if ( int_status & USBD_INTEN_USBEVENT_Msk )
   {
     uint32_t const evt_cause = NRF_USBD->EVENTCAUSE & (USBD_EVENTCAUSE_SUSPEND_Msk | USBD_EVENTCAUSE_RESUME_Msk);
@@ -413,6 +625,36 @@ void USBD_IRQHandler(void)
     // DMA complete move data from SRAM -> Endpoint
     edpt_dma_end();
   }
+
+  // ISO IN: RAM -> Endpoint, sent to host in next frame
+  if ( int_status & USBD_INTEN_ENDISOIN_Msk )
+  {
+    _dcd.iso[TUSB_DIR_IN].loaded = true;
+  }
+
+  // ISO OUT: Endpoint -> RAM (packet complete)
+  if ( int_status & USBD_INTEN_ENDISOOUT_Msk )
+  {
+    iso_td_t* iso = &_dcd.iso[TUSB_DIR_OUT];
+    if ( iso->index < iso->count )
+    {
+      iso_packet_done(TUSB_DIR_OUT, (uint16_t) NRF_USBD->ISOOUT.AMOUNT, iso->truncated ? XFER_RESULT_FAILED : XFER_RESULT_SUCCESS);
+    }
+  }
+
+  // ISO IN packet waiting for DMA since SOF
+  if ( _dcd.iso[TUSB_DIR_IN].load_pending && !_dcd.dma_running )
+  {
+    _dcd.iso[TUSB_DIR_IN].load_pending = false;
+    if ( _dcd.iso[TUSB_DIR_IN].count ) iso_in_load(&_dcd.iso[TUSB_DIR_IN]);
+  }
+
+  // SOF is handled after END events so that DMA of previous frame is complete
+  if ( int_status & USBD_INTEN_SOF_Msk )
+  {
+    iso_sof();
+    dcd_event_sof(0, NRF_USBD->FRAMECNTR, true);
+  }
  
   // Setup tokens are specific to the Control endpoint.
   if ( int_status & USBD_INTEN_EP0SETUP_Msk )
@@ -529,7 +529,8 @@ void dcd_isr(uint8_t rhport)
 
   if (int_status & INTR_SOF)
   {
-    dcd_event_bus_signal(rhport, DCD_EVENT_SOF, true);
+    // FRINDEX counts microframes, frame number is in bit 13:3
+    dcd_event_sof(rhport, (dcd_reg->FRINDEX >> 3) & 0x7FF, true);
   }
 
   if (int_status & INTR_NAK) {}
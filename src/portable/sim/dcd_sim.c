@@ -0,0 +1,583 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // recursive mutex initializer
+#endif
+
+#include "tusb_option.h"
+
+#if TUSB_OPT_DEVICE_ENABLED && CFG_TUSB_MCU == OPT_MCU_SIM
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "device/dcd.h"
+#include "dcd_sim.h"
+
+/*------------------------------------------------------------------*/
+/* MACRO TYPEDEF CONSTANT ENUM
+ *------------------------------------------------------------------*/
+enum
+{
+  EP_MAX    = 16,
+  FRAME_MAX = 0x7FF // 11-bit frame number
+};
+
+typedef struct
+{
+  uint8_t* buffer;
+  uint16_t total_len;
+  uint16_t actual_len;
+  uint16_t mps;
+  uint8_t  xfer_type;
+  bool     opened;
+  bool     armed;     // transfer in progress
+  bool     stalled;
+
+  // Isochronous transfer
+  dcd_iso_packet_t* packets;
+  uint8_t  iso_count;
+  uint8_t  iso_index;
+  uint16_t iso_offset;
+  uint32_t iso_total;
+  bool     iso_failed;
+  bool     iso_serviced;  // current packet is moved in this frame
+
+  dcd_iso_packet_t packet; // used by dcd_edpt_xfer() as single packet transfer
+}sim_edpt_t;
+
+static struct
+{
+  // Held by host thread while it plays the controller (interrupt context), and by dcd_int_disable().
+  // Recursive since stack may call dcd API with interrupt disabled.
+  pthread_mutex_t irq_mutex;
+  pthread_cond_t  cond;       // device connected or endpoint armed/stalled
+  uint32_t event_count;       // number of times cond is signaled
+
+  bool     connected;
+  uint8_t  dev_addr;
+  uint32_t frame_count;
+
+  sim_edpt_t edpt[EP_MAX][2];
+}_sim =
+{
+  .irq_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP,
+  .cond      = PTHREAD_COND_INITIALIZER
+};
+
+/*------------------------------------------------------------------*/
+/* INTERNAL FUNCTION
+ *------------------------------------------------------------------*/
+
+static inline void sim_lock(void)
+{
+  pthread_mutex_lock(&_sim.irq_mutex);
+}
+
+static inline void sim_unlock(void)
+{
+  pthread_mutex_unlock(&_sim.irq_mutex);
+}
+
+static inline sim_edpt_t* get_edpt(uint8_t ep_addr)
+{
+  return &_sim.edpt[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)];
+}
+
+static void edpt_reset(sim_edpt_t* ep, uint16_t mps, uint8_t xfer_type)
+{
+  tu_varclr(ep);
+  ep->mps       = mps;
+  ep->xfer_type = xfer_type;
+  ep->opened    = (mps != 0);
+}
+
+// Wake up host waiting for device, lock is held
+static void sim_notify(void)
+{
+  _sim.event_count++;
+  pthread_cond_broadcast(&_sim.cond);
+}
+
+static struct timespec deadline_after(uint32_t timeout_us)
+{
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+
+  deadline.tv_sec  += timeout_us / 1000000;
+  deadline.tv_nsec += (long) (timeout_us % 1000000) * 1000L;
+  if ( deadline.tv_nsec >= 1000000000L )
+  {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  return deadline;
+}
+
+// Wait for condition with lock held, return false on timeout
+static bool wait_until(bool (*cond)(sim_edpt_t const*), sim_edpt_t const* ep, uint32_t timeout_ms)
+{
+  if ( timeout_ms == 0 ) return cond(ep);
+
+  struct timespec const deadline = deadline_after(timeout_ms * 1000);
+
+  while ( !cond(ep) )
+  {
+    if ( ETIMEDOUT == pthread_cond_timedwait(&_sim.cond, &_sim.irq_mutex, &deadline) ) return cond(ep);
+  }
+
+  return true;
+}
+
+static bool is_connected(sim_edpt_t const* ep)
+{
+  (void) ep;
+  return _sim.connected;
+}
+
+static bool is_ready(sim_edpt_t const* ep)
+{
+  return ep->armed || ep->stalled;
+}
+
+// Whole transfer is done, lock is held
+static void xfer_done(uint8_t ep_addr, uint32_t len, uint8_t result)
+{
+  get_edpt(ep_addr)->armed = false;
+  dcd_event_xfer_complete(0, ep_addr, len, result, true);
+}
+
+// Current isochronous packet is done
+static void iso_packet_done(uint8_t ep_addr, uint16_t len, uint8_t result)
+{
+  sim_edpt_t* ep = get_edpt(ep_addr);
+  dcd_iso_packet_t* packet = &ep->packets[ep->iso_index];
+
+  packet->actual = len;
+  packet->result = result;
+
+  ep->iso_offset    = (uint16_t) (ep->iso_offset + packet->length);
+  ep->iso_total    += len;
+  ep->iso_serviced  = true;
+  if ( result != XFER_RESULT_SUCCESS ) ep->iso_failed = true;
+
+  if ( ++ep->iso_index == ep->iso_count )
+  {
+    xfer_done(ep_addr, ep->iso_total, ep->iso_failed ? XFER_RESULT_FAILED : XFER_RESULT_SUCCESS);
+  }
+}
+
+//--------------------------------------------------------------------+
+// Controller API
+//--------------------------------------------------------------------+
+
+// Pull-up is enabled: virtual host can start
+void dcd_init (uint8_t rhport)
+{
+  (void) rhport;
+
+  sim_lock();
+  _sim.connected = true;
+  sim_notify();
+  sim_unlock();
+}
+
+// No real interrupt: host thread plays the controller
+void dcd_isr (uint8_t rhport)
+{
+  (void) rhport;
+}
+
+void dcd_int_disable(uint8_t rhport)
+{
+  (void) rhport;
+  sim_lock();
+}
+
+// tud_init() enables interrupt without disabling it first, unlocking a recursive mutex
+// that is not owned simply fails with EPERM.
+void dcd_int_enable(uint8_t rhport)
+{
+  (void) rhport;
+  sim_unlock();
+}
+
+void dcd_set_address (uint8_t rhport, uint8_t dev_addr)
+{
+  sim_lock();
+  _sim.dev_addr = dev_addr;
+  sim_unlock();
+
+  // Response with status first before changing device address
+  dcd_edpt_xfer(rhport, tu_edpt_addr(0, TUSB_DIR_IN), NULL, 0);
+}
+
+void dcd_set_config (uint8_t rhport, uint8_t config_num)
+{
+  (void) rhport;
+  (void) config_num;
+}
+
+// Host resumes the bus right away
+void dcd_remote_wakeup(uint8_t rhport)
+{
+  dcd_event_bus_signal(rhport, DCD_EVENT_RESUME, false);
+}
+
+//--------------------------------------------------------------------+
+// Endpoint API
+//--------------------------------------------------------------------+
+bool dcd_edpt_open (uint8_t rhport, tusb_desc_endpoint_t const * desc_edpt)
+{
+  (void) rhport;
+
+  TU_ASSERT(tu_edpt_number(desc_edpt->bEndpointAddress) < EP_MAX);
+
+  sim_lock();
+  edpt_reset(get_edpt(desc_edpt->bEndpointAddress), desc_edpt->wMaxPacketSize.size, desc_edpt->bmAttributes.xfer);
+  sim_unlock();
+
+  return true;
+}
+
+void dcd_edpt_close (uint8_t rhport, uint8_t ep_addr)
+{
+  (void) rhport;
+
+  sim_lock();
+  edpt_reset(get_edpt(ep_addr), 0, 0);
+  sim_unlock();
+}
+
+bool dcd_edpt_xfer (uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes)
+{
+  sim_edpt_t* ep = get_edpt(ep_addr);
+
+  // Isochronous endpoint transfers a single packet
+  if ( TUSB_XFER_ISOCHRONOUS == ep->xfer_type )
+  {
+    ep->packet.length = total_bytes;
+    return dcd_edpt_iso_xfer(rhport, ep_addr, buffer, &ep->packet, 1);
+  }
+
+  sim_lock();
+
+  ep->buffer     = buffer;
+  ep->total_len  = total_bytes;
+  ep->actual_len = 0;
+  ep->armed      = true;
+
+  sim_notify();
+  sim_unlock();
+
+  return true;
+}
+
+bool dcd_edpt_iso_xfer (uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, dcd_iso_packet_t* packets, uint8_t count)
+{
+  (void) rhport;
+
+  sim_edpt_t* ep = get_edpt(ep_addr);
+  TU_ASSERT(TUSB_XFER_ISOCHRONOUS == ep->xfer_type && count);
+
+  sim_lock();
+
+  ep->buffer       = buffer;
+  ep->packets      = packets;
+  ep->iso_count    = count;
+  ep->iso_index    = 0;
+  ep->iso_offset   = 0;
+  ep->iso_total    = 0;
+  ep->iso_failed   = false;
+  ep->iso_serviced = false;
+  ep->armed        = true;
+
+  sim_notify();
+  sim_unlock();
+
+  return true;
+}
+
+void dcd_edpt_stall (uint8_t rhport, uint8_t ep_addr)
+{
+  (void) rhport;
+
+  sim_lock();
+  get_edpt(ep_addr)->stalled = true;
+  sim_notify();
+  sim_unlock();
+}
+
+void dcd_edpt_clear_stall (uint8_t rhport, uint8_t ep_addr)
+{
+  (void) rhport;
+
+  sim_lock();
+  get_edpt(ep_addr)->stalled = false;
+  sim_unlock();
+}
+
+//--------------------------------------------------------------------+
+// Virtual Host Bus API
+//--------------------------------------------------------------------+
+bool sim_host_wait_connect(uint32_t timeout_ms)
+{
+  sim_lock();
+  bool const ret = wait_until(is_connected, NULL, timeout_ms);
+  sim_unlock();
+
+  return ret;
+}
+
+void sim_host_bus_reset(void)
+{
+  sim_lock();
+
+  for(uint8_t i=0; i<EP_MAX; i++)
+  {
+    edpt_reset(&_sim.edpt[i][TUSB_DIR_OUT], 0, 0);
+    edpt_reset(&_sim.edpt[i][TUSB_DIR_IN ], 0, 0);
+  }
+
+  edpt_reset(&_sim.edpt[0][TUSB_DIR_OUT], CFG_TUD_ENDPOINT0_SIZE, TUSB_XFER_CONTROL);
+  edpt_reset(&_sim.edpt[0][TUSB_DIR_IN ], CFG_TUD_ENDPOINT0_SIZE, TUSB_XFER_CONTROL);
+  _sim.dev_addr = 0;
+
+  dcd_event_bus_signal(0, DCD_EVENT_BUS_RESET, true);
+
+  sim_unlock();
+}
+
+void sim_host_suspend(void)
+{
+  sim_lock();
+  dcd_event_bus_signal(0, DCD_EVENT_SUSPEND, true);
+  sim_unlock();
+}
+
+void sim_host_resume(void)
+{
+  sim_lock();
+  dcd_event_bus_signal(0, DCD_EVENT_RESUME, true);
+  sim_unlock();
+}
+
+void sim_host_frame(void)
+{
+  sim_lock();
+
+  // Isochronous packet not moved in previous frame is lost
+  for(uint8_t i=0; i<EP_MAX; i++)
+  {
+    for(uint8_t dir=0; dir<2; dir++)
+    {
+      sim_edpt_t* ep = &_sim.edpt[i][dir];
+      if ( TUSB_XFER_ISOCHRONOUS != ep->xfer_type || !ep->armed ) continue;
+
+      if ( !ep->iso_serviced ) iso_packet_done(tu_edpt_addr(i, dir), 0, XFER_RESULT_MISSED);
+      ep->iso_serviced = false;
+    }
+  }
+
+  _sim.frame_count = (_sim.frame_count + 1) & FRAME_MAX;
+  dcd_event_sof(0, _sim.frame_count, true);
+
+  sim_unlock();
+}
+
+uint32_t sim_host_frame_count(void)
+{
+  return _sim.frame_count;
+}
+
+uint32_t sim_host_event_count(void)
+{
+  sim_lock();
+  uint32_t const count = _sim.event_count;
+  sim_unlock();
+
+  return count;
+}
+
+bool sim_host_wait_event(uint32_t count, uint32_t timeout_us)
+{
+  struct timespec const deadline = deadline_after(timeout_us);
+  bool ret = true;
+
+  sim_lock();
+
+  while ( _sim.event_count == count )
+  {
+    if ( ETIMEDOUT == pthread_cond_timedwait(&_sim.cond, &_sim.irq_mutex, &deadline) )
+    {
+      ret = (_sim.event_count != count);
+      break;
+    }
+  }
+
+  sim_unlock();
+
+  return ret;
+}
+
+void sim_host_notify(void)
+{
+  sim_lock();
+  sim_notify();
+  sim_unlock();
+}
+
+uint16_t sim_host_edpt_size(uint8_t ep_addr)
+{
+  sim_lock();
+  uint16_t const mps = get_edpt(ep_addr)->mps;
+  sim_unlock();
+
+  return mps;
+}
+
+bool sim_host_edpt_ready(uint8_t ep_addr)
+{
+  sim_lock();
+  bool const ready = is_ready(get_edpt(ep_addr));
+  sim_unlock();
+
+  return ready;
+}
+
+// Setup packet is always accepted, it aborts control transfer in progress and clears stall
+sim_xact_t sim_host_setup(tusb_control_request_t const * request)
+{
+  sim_lock();
+
+  _sim.edpt[0][TUSB_DIR_OUT].armed   = _sim.edpt[0][TUSB_DIR_IN].armed   = false;
+  _sim.edpt[0][TUSB_DIR_OUT].stalled = _sim.edpt[0][TUSB_DIR_IN].stalled = false;
+
+  dcd_event_setup_received(0, (uint8_t const*) request, true);
+
+  sim_unlock();
+
+  return SIM_XACT_ACK;
+}
+
+sim_xact_t sim_host_out(uint8_t ep_addr, void const * data, uint16_t len)
+{
+  sim_edpt_t* ep = get_edpt(ep_addr);
+  sim_xact_t ret = SIM_XACT_NAK;
+
+  sim_lock();
+
+  if ( ep->opened && wait_until(is_ready, ep, CFG_SIM_HOST_WAIT_MS) )
+  {
+    if ( ep->stalled )
+    {
+      ret = SIM_XACT_STALL;
+    }
+    else if ( TUSB_XFER_ISOCHRONOUS == ep->xfer_type )
+    {
+      dcd_iso_packet_t const* packet = &ep->packets[ep->iso_index];
+      uint16_t const count = tu_min16(len, packet->length);
+
+      if ( count ) memcpy(ep->buffer + ep->iso_offset, data, count);
+      iso_packet_done(ep_addr, count, (count < len) ? XFER_RESULT_FAILED : XFER_RESULT_SUCCESS);
+
+      ret = SIM_XACT_ACK;
+    }
+    else
+    {
+      // Data beyond transfer length is dropped as controller would do
+      uint16_t const count = tu_min16(len, ep->total_len - ep->actual_len);
+
+      if ( count ) memcpy(ep->buffer + ep->actual_len, data, count);
+      ep->actual_len = (uint16_t) (ep->actual_len + count);
+
+      // Short packet or all bytes received
+      if ( (len < ep->mps) || (ep->actual_len == ep->total_len) )
+      {
+        xfer_done(ep_addr, ep->actual_len, XFER_RESULT_SUCCESS);
+      }
+
+      ret = SIM_XACT_ACK;
+    }
+  }
+
+  sim_unlock();
+
+  return ret;
+}
+
+sim_xact_t sim_host_in(uint8_t ep_addr, void * buffer, uint16_t bufsize, uint16_t* len)
+{
+  sim_edpt_t* ep = get_edpt(ep_addr);
+  sim_xact_t ret = SIM_XACT_NAK;
+
+  (*len) = 0;
+
+  sim_lock();
+
+  if ( ep->opened && wait_until(is_ready, ep, CFG_SIM_HOST_WAIT_MS) )
+  {
+    if ( ep->stalled )
+    {
+      ret = SIM_XACT_STALL;
+    }
+    else if ( TUSB_XFER_ISOCHRONOUS == ep->xfer_type )
+    {
+      uint16_t const count = ep->packets[ep->iso_index].length;
+
+      if ( buffer && count ) memcpy(buffer, ep->buffer + ep->iso_offset, tu_min16(count, bufsize));
+      (*len) = count;
+
+      iso_packet_done(ep_addr, count, XFER_RESULT_SUCCESS);
+      ret = SIM_XACT_ACK;
+    }
+    else
+    {
+      uint16_t const count = tu_min16(ep->mps, ep->total_len - ep->actual_len);
+
+      if ( buffer && count ) memcpy(buffer, ep->buffer + ep->actual_len, tu_min16(count, bufsize));
+      ep->actual_len = (uint16_t) (ep->actual_len + count);
+      (*len) = count;
+
+      // Short packet or all bytes sent
+      if ( (count < ep->mps) || (ep->actual_len == ep->total_len) )
+      {
+        xfer_done(ep_addr, ep->actual_len, XFER_RESULT_SUCCESS);
+      }
+
+      ret = SIM_XACT_ACK;
+    }
+  }
+
+  sim_unlock();
+
+  return ret;
+}
+
+#endif
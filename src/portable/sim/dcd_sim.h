@@ -0,0 +1,172 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+/** \ingroup group_dcd
+ * \defgroup group_dcd_sim Simulation
+ *  Full speed device controller simulated in a Linux process, with a virtual host running in its own thread.
+ *  Host transactions play the role of the controller interrupt: they are serialized with
+ *  dcd_int_disable()/dcd_int_enable() while tud_task() runs in the application thread as on real hardware.
+ *  @{ */
+
+#ifndef _TUSB_DCD_SIM_H_
+#define _TUSB_DCD_SIM_H_
+
+#include "common/tusb_common.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+// Time host waits for device to arm an endpoint before the transaction is NAKed.
+// Loopback HCD polls endpoints every frame as a real controller does, it never waits.
+#ifndef CFG_SIM_HOST_WAIT_MS
+  #if TUSB_OPT_HOST_ENABLED
+    #define CFG_SIM_HOST_WAIT_MS  0
+  #else
+    #define CFG_SIM_HOST_WAIT_MS  100
+  #endif
+#endif
+
+// Loopback HCD bus model: full speed with 1 ms frame, or high speed with 125 us microframe
+#ifndef CFG_SIM_HCD_HIGH_SPEED
+#define CFG_SIM_HCD_HIGH_SPEED  0
+#endif
+
+// Limit bytes per (micro)frame including protocol overhead as on a real bus, 0 for unlimited
+#ifndef CFG_SIM_HCD_BANDWIDTH
+#define CFG_SIM_HCD_BANDWIDTH   1
+#endif
+
+// Bus time between end of transfer and its completion reported to host stack
+#ifndef CFG_SIM_HCD_LATENCY_US
+#define CFG_SIM_HCD_LATENCY_US  0
+#endif
+
+// Pace (micro)frames at wall clock, otherwise bus time runs as fast as both stacks go
+#ifndef CFG_SIM_HCD_REALTIME
+#define CFG_SIM_HCD_REALTIME    0
+#endif
+
+// USB/IP server: URBs in flight on all endpoints, one submitted beyond that fails right away with -ENOMEM
+#ifndef CFG_SIM_USBIP_URB_MAX
+#define CFG_SIM_USBIP_URB_MAX   64
+#endif
+
+typedef enum
+{
+  SIM_XACT_ACK,
+  SIM_XACT_NAK,   // endpoint is not armed (or not opened)
+  SIM_XACT_STALL,
+}sim_xact_t;
+
+//--------------------------------------------------------------------+
+// Virtual Host Bus API, called from host thread
+//--------------------------------------------------------------------+
+
+// Wait for device to connect i.e dcd_init() is called, return false on timeout
+bool       sim_host_wait_connect(uint32_t timeout_ms);
+
+void       sim_host_bus_reset(void);
+void       sim_host_suspend(void);
+void       sim_host_resume(void);
+
+// Start a new frame: packets of isochronous transfers not serviced in previous frame are missed, then SOF
+void       sim_host_frame(void);
+uint32_t   sim_host_frame_count(void);
+
+// Single transaction. Isochronous endpoint moves the current packet of its transfer.
+sim_xact_t sim_host_setup(tusb_control_request_t const * request);
+sim_xact_t sim_host_out  (uint8_t ep_addr, void const * data, uint16_t len);
+sim_xact_t sim_host_in   (uint8_t ep_addr, void * buffer, uint16_t bufsize, uint16_t* len);
+
+// Bus event counter, bumped when device connects, arms or stalls an endpoint, or by sim_host_notify().
+// Host running its own scheduler samples it before polling endpoints and sleeps with sim_host_wait_event()
+// when all of them NAKed, without missing an endpoint armed in between.
+uint32_t   sim_host_event_count(void);
+bool       sim_host_wait_event(uint32_t count, uint32_t timeout_us); // false on timeout
+void       sim_host_notify(void);
+
+// Max packet size of opened endpoint, 0 if not opened
+uint16_t   sim_host_edpt_size(uint8_t ep_addr);
+
+// Endpoint is armed or stalled i.e next transaction is not NAKed, without waiting for device
+bool       sim_host_edpt_ready(uint8_t ep_addr);
+
+//--------------------------------------------------------------------+
+// Virtual Host API (sim_host.c)
+//--------------------------------------------------------------------+
+
+// Control transfer with setup, data and status stages. Data is sent or received according
+// to request direction, len is the number of data bytes. Return false if stalled or not responding.
+bool sim_host_control(tusb_control_request_t const * request, void* data, uint16_t* len);
+
+// Bus reset, get device & configuration descriptors, set address and set configuration 1
+bool sim_host_enumerate(void);
+
+// Run script, return false at the first failed command. Each line is one command, '#' starts a comment.
+//   enumerate
+//   reset | suspend | resume
+//   control <bmRequestType> <bRequest> <wValue> <wIndex> <wLength> [OUT data bytes ...]
+//   out <ep> <total bytes> [packets per frame]   send counting pattern
+//   in  <ep> <total bytes> [packets per frame]   receive and discard
+//   frames <count>                               idle frames
+//   realtime <0|1>                               pace frames at 1 ms, default is as fast as device goes
+// Numbers are decimal or 0x hex. Traffic commands print bytes, frames and wall time.
+bool sim_host_run_script(char const* path);
+
+// Start host thread running script (NULL to only enumerate).
+// Process exits when it is done, with status 0 if all commands succeed.
+bool sim_host_start(char const* script_path);
+
+//--------------------------------------------------------------------+
+// Loopback HCD API (hcd_sim.c)
+// Host stack on the other roothub port drives this device controller in the same process, in place of
+// sim_host.c. Controller runs in its own thread, application runs tuh_task() and tud_task() in two
+// threads since host stack blocks on control transfers without RTOS.
+//--------------------------------------------------------------------+
+
+// Bus time elapsed since hcd_init(), used to measure throughput independently of host machine load
+uint64_t sim_hcd_time_us(void);
+
+//--------------------------------------------------------------------+
+// USB/IP Server API (usbip_server.c)
+// Remote host attaches the device over TCP in place of sim_host.c e.g with Linux vhci-hcd:
+//   usbip list -r 127.0.0.1 && sudo usbip attach -r 127.0.0.1 -b 1-1
+// Server thread passes URBs to its controller thread, which services every endpoint queue as a host
+// controller would and returns each URB when its transfer completes, several URBs may be in flight per endpoint.
+//--------------------------------------------------------------------+
+
+// Listen on loopback TCP port (0 for any free one) and serve one client at a time.
+// Return the listening port, 0 on error.
+uint16_t sim_usbip_start(uint16_t port);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _TUSB_DCD_SIM_H_ */
+
+/// @}
@@ -0,0 +1,616 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // recursive mutex initializer
+#endif
+
+#include "tusb_option.h"
+
+#if TUSB_OPT_HOST_ENABLED && CFG_TUSB_MCU == OPT_MCU_SIM
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "host/hcd.h"
+#include "dcd_sim.h"
+
+/*------------------------------------------------------------------*/
+/* MACRO TYPEDEF CONSTANT ENUM
+ *------------------------------------------------------------------*/
+
+// Approximate bus budget: bulk reaches 19 x 64 bytes per full speed frame, 13 x 512 bytes per high speed microframe
+#if CFG_SIM_HCD_HIGH_SPEED
+enum
+{
+  FRAME_US       = 125,
+  FRAME_BYTES    = 7500,
+  XACT_OVERHEAD  = 55,
+};
+#else
+enum
+{
+  FRAME_US       = 1000,
+  FRAME_BYTES    = 1500,
+  XACT_OVERHEAD  = 13,
+};
+#endif
+
+enum
+{
+  EP_MAX         = 16,
+  TD_MAX         = 4,   // queued transfers per pipe
+  COMPLETE_MAX   = 16,  // completions waiting for latency
+  LATENCY_FRAMES = (CFG_SIM_HCD_LATENCY_US + FRAME_US - 1) / FRAME_US,
+  CONNECT_POLL_MS = 100,
+};
+
+typedef struct
+{
+  uint8_t* buffer;
+  uint16_t total_len;
+  uint16_t actual_len;
+  uint8_t  ep_addr;     // direction of control pipe stages
+  bool     setup;
+  bool     ioc;         // report completion
+}sim_td_t;
+
+typedef struct
+{
+  uint16_t mps;
+  uint8_t  xfer_type;
+  bool     opened;
+  bool     started;     // queued transfers are scheduled
+  bool     halted;      // stalled by device
+
+  uint8_t  head;
+  uint8_t  count;
+  sim_td_t td[TD_MAX];
+}sim_pipe_t;
+
+typedef struct
+{
+  uint64_t due_frame;
+  uint32_t len;
+  uint8_t  dev_addr;
+  uint8_t  ep_addr;
+  uint8_t  result;
+}sim_complete_t;
+
+static struct
+{
+  pthread_mutex_t irq_mutex;  // held by controller thread while it plays the interrupt
+  pthread_cond_t  cond;       // new transfer is queued
+
+  volatile bool connected;
+  uint64_t frame;             // (micro)frames since init
+
+  sim_pipe_t pipe[CFG_TUSB_HOST_DEVICE_MAX+1][EP_MAX][2]; // control pipe is [dev][0][0]
+
+  sim_complete_t complete[COMPLETE_MAX];
+  uint8_t complete_count;
+}_hcd =
+{
+  .irq_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP,
+  .cond      = PTHREAD_COND_INITIALIZER
+};
+
+/*------------------------------------------------------------------*/
+/* INTERNAL FUNCTION
+ *------------------------------------------------------------------*/
+
+static inline void hcd_lock(void)
+{
+  pthread_mutex_lock(&_hcd.irq_mutex);
+}
+
+static inline void hcd_unlock(void)
+{
+  pthread_mutex_unlock(&_hcd.irq_mutex);
+}
+
+static inline sim_pipe_t* get_pipe(uint8_t dev_addr, uint8_t ep_addr)
+{
+  uint8_t const epnum = tu_edpt_number(ep_addr);
+  return &_hcd.pipe[dev_addr][epnum][epnum ? tu_edpt_dir(ep_addr) : 0];
+}
+
+static bool td_queue(sim_pipe_t* pipe, sim_td_t const* td, bool start)
+{
+  TU_ASSERT(pipe->opened && pipe->count < TD_MAX);
+
+  pipe->td[(pipe->head + pipe->count) % TD_MAX] = *td;
+  pipe->count++;
+
+  if ( start )
+  {
+    pipe->started = true;
+    pthread_cond_signal(&_hcd.cond);
+  }
+
+  return true;
+}
+
+static void report_complete(uint8_t dev_addr, uint8_t ep_addr, uint8_t result, uint32_t len)
+{
+  if ( LATENCY_FRAMES == 0 )
+  {
+    hcd_event_xfer_complete(dev_addr, ep_addr, (xfer_result_t) result, len);
+    return;
+  }
+
+  TU_ASSERT(_hcd.complete_count < COMPLETE_MAX, );
+
+  _hcd.complete[_hcd.complete_count++] = (sim_complete_t)
+  {
+    .due_frame = _hcd.frame + LATENCY_FRAMES,
+    .len       = len,
+    .dev_addr  = dev_addr,
+    .ep_addr   = ep_addr,
+    .result    = result
+  };
+}
+
+// Report completions whose latency has elapsed, in order
+static void deliver_complete(void)
+{
+  uint8_t count = 0;
+
+  while ( count < _hcd.complete_count && _hcd.complete[count].due_frame <= _hcd.frame )
+  {
+    sim_complete_t const* complete = &_hcd.complete[count++];
+    hcd_event_xfer_complete(complete->dev_addr, complete->ep_addr, (xfer_result_t) complete->result, complete->len);
+  }
+
+  if ( count )
+  {
+    _hcd.complete_count = (uint8_t) (_hcd.complete_count - count);
+    memmove(_hcd.complete, _hcd.complete + count, _hcd.complete_count * sizeof(sim_complete_t));
+  }
+}
+
+static void td_done(sim_pipe_t* pipe, uint8_t dev_addr, uint8_t result)
+{
+  sim_td_t const* td = &pipe->td[pipe->head];
+
+  pipe->head = (uint8_t) ((pipe->head + 1) % TD_MAX);
+  pipe->count--;
+  if ( pipe->count == 0 ) pipe->started = false;
+
+  if ( result == XFER_RESULT_STALLED ) pipe->halted = true;
+
+  // errors are always reported
+  if ( td->ioc || result != XFER_RESULT_SUCCESS ) report_complete(dev_addr, td->ep_addr, result, td->actual_len);
+}
+
+// One transaction of head transfer, return false if NAKed or out of bandwidth
+static bool pipe_xact(sim_pipe_t* pipe, uint8_t dev_addr, uint32_t* budget)
+{
+  sim_td_t* td = &pipe->td[pipe->head];
+
+  // Stalled control transfer: remaining stages are not sent until next setup
+  if ( pipe->halted )
+  {
+    td_done(pipe, dev_addr, XFER_RESULT_STALLED);
+    return true;
+  }
+
+  if ( td->setup )
+  {
+    uint32_t const cost = sizeof(tusb_control_request_t) + XACT_OVERHEAD;
+    if ( cost > *budget ) return false;
+
+    (*budget) -= cost;
+    sim_host_setup((tusb_control_request_t const*) td->buffer);
+    td->actual_len = sizeof(tusb_control_request_t);
+    td_done(pipe, dev_addr, XFER_RESULT_SUCCESS);
+
+    return true;
+  }
+
+  uint16_t const remaining = (uint16_t) (td->total_len - td->actual_len);
+  uint32_t const cost = tu_min16(pipe->mps, remaining) + XACT_OVERHEAD;
+  if ( cost > *budget ) return false;
+
+  uint8_t* buf = td->buffer ? (td->buffer + td->actual_len) : NULL;
+  sim_xact_t ret;
+  uint16_t xferred;
+
+  if ( tu_edpt_dir(td->ep_addr) == TUSB_DIR_OUT )
+  {
+    xferred = tu_min16(pipe->mps, remaining);
+    ret = sim_host_out(td->ep_addr, buf, xferred);
+  }
+  else
+  {
+    ret = sim_host_in(td->ep_addr, buf, remaining, &xferred);
+  }
+
+  // NAK costs bandwidth as well but it is not worth modeling
+  if ( ret == SIM_XACT_NAK ) return false;
+
+  (*budget) -= cost;
+
+  if ( ret == SIM_XACT_STALL )
+  {
+    td_done(pipe, dev_addr, XFER_RESULT_STALLED);
+    return true;
+  }
+
+  // Babble: device sends more than requested
+  if ( xferred > remaining )
+  {
+    td->actual_len = td->total_len;
+    td_done(pipe, dev_addr, XFER_RESULT_FAILED);
+    return true;
+  }
+
+  td->actual_len = (uint16_t) (td->actual_len + xferred);
+
+  // Short packet or all bytes transferred
+  if ( xferred < pipe->mps || td->actual_len == td->total_len ) td_done(pipe, dev_addr, XFER_RESULT_SUCCESS);
+
+  return true;
+}
+
+// Halted control pipe still flushes its queued stages
+static inline bool pipe_ready(sim_pipe_t const* pipe)
+{
+  return pipe->opened && pipe->started && pipe->count && (!pipe->halted || pipe->xfer_type == TUSB_XFER_CONTROL);
+}
+
+// Schedule one (micro)frame: control and interrupt pipes get one transaction, then bulk pipes share
+// what is left round robin. Return true if any transaction is acknowledged.
+static bool schedule_frame(void)
+{
+  uint32_t budget = CFG_SIM_HCD_BANDWIDTH ? FRAME_BYTES : UINT32_MAX;
+  bool progress = false;
+
+  for(uint8_t dev_addr=0; dev_addr <= CFG_TUSB_HOST_DEVICE_MAX; dev_addr++)
+  {
+    for(uint8_t epnum=0; epnum<EP_MAX; epnum++)
+    {
+      for(uint8_t dir=0; dir<2; dir++)
+      {
+        sim_pipe_t* pipe = &_hcd.pipe[dev_addr][epnum][dir];
+        if ( !pipe_ready(pipe) || pipe->xfer_type == TUSB_XFER_BULK ) continue;
+
+        // control transfer in progress gets all its transactions, each stage is queued by usbh after previous one
+        while ( pipe_ready(pipe) && pipe_xact(pipe, dev_addr, &budget) )
+        {
+          progress = true;
+          if ( pipe->xfer_type != TUSB_XFER_CONTROL ) break;
+        }
+      }
+    }
+  }
+
+  bool more;
+  do
+  {
+    more = false;
+
+    for(uint8_t dev_addr=0; dev_addr <= CFG_TUSB_HOST_DEVICE_MAX; dev_addr++)
+    {
+      for(uint8_t epnum=1; epnum<EP_MAX; epnum++)
+      {
+        for(uint8_t dir=0; dir<2; dir++)
+        {
+          sim_pipe_t* pipe = &_hcd.pipe[dev_addr][epnum][dir];
+          if ( !pipe_ready(pipe) || pipe->xfer_type != TUSB_XFER_BULK ) continue;
+
+          if ( pipe_xact(pipe, dev_addr, &budget) ) more = true;
+        }
+      }
+    }
+
+    if ( more ) progress = true;
+  } while ( more );
+
+  return progress;
+}
+
+static bool transfer_pending(void)
+{
+  for(uint8_t dev_addr=0; dev_addr <= CFG_TUSB_HOST_DEVICE_MAX; dev_addr++)
+  {
+    for(uint8_t epnum=0; epnum<EP_MAX; epnum++)
+    {
+      if ( pipe_ready(&_hcd.pipe[dev_addr][epnum][0]) || pipe_ready(&_hcd.pipe[dev_addr][epnum][1]) ) return true;
+    }
+  }
+
+  return _hcd.complete_count > 0;
+}
+
+static void timespec_add_us(struct timespec* ts, uint32_t us)
+{
+  ts->tv_nsec += (long) us * 1000L;
+  while ( ts->tv_nsec >= 1000000000L )
+  {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000L;
+  }
+}
+
+// Controller thread: (micro)frame scheduler
+static void* controller_thread(void* param)
+{
+  (void) param;
+
+  // Wait for device pull-up
+  while ( !sim_host_wait_connect(CONNECT_POLL_MS) ) {}
+
+  hcd_lock();
+  _hcd.connected = true;
+  hcd_event_device_attach(TUH_OPT_RHPORT);
+  hcd_unlock();
+
+  struct timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  while (1)
+  {
+    hcd_lock();
+
+    deliver_complete();
+    bool const progress = schedule_frame();
+
+    // SOF once per 1 ms frame
+    _hcd.frame++;
+    if ( 0 == (_hcd.frame % (1000/FRAME_US)) ) sim_host_frame();
+
+    if ( !CFG_SIM_HCD_REALTIME && !progress )
+    {
+      if ( transfer_pending() )
+      {
+        // let device task arm its endpoints
+        hcd_unlock();
+        sched_yield();
+        hcd_lock();
+      }
+      else
+      {
+        // idle bus: wait for next transfer
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        timespec_add_us(&deadline, 1000);
+
+        pthread_cond_timedwait(&_hcd.cond, &_hcd.irq_mutex, &deadline);
+      }
+    }
+
+    hcd_unlock();
+
+    if ( CFG_SIM_HCD_REALTIME )
+    {
+      timespec_add_us(&next, FRAME_US);
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+  }
+
+  return NULL;
+}
+
+/*------------------------------------------------------------------*/
+/* Controller API
+ *------------------------------------------------------------------*/
+bool hcd_init(void)
+{
+  pthread_t thread;
+
+  TU_ASSERT(0 == pthread_create(&thread, NULL, controller_thread, NULL));
+  pthread_detach(thread);
+
+  return true;
+}
+
+// No real interrupt: controller thread plays it
+void hcd_isr(uint8_t hostid)
+{
+  (void) hostid;
+}
+
+// usbh_init() enables interrupt without disabling it first, unlocking a recursive mutex
+// that is not owned simply fails with EPERM.
+void hcd_int_enable(uint8_t rhport)
+{
+  (void) rhport;
+  hcd_unlock();
+}
+
+void hcd_int_disable(uint8_t rhport)
+{
+  (void) rhport;
+  hcd_lock();
+}
+
+uint64_t sim_hcd_time_us(void)
+{
+  return _hcd.frame * FRAME_US;
+}
+
+/*------------------------------------------------------------------*/
+/* Port API
+ *------------------------------------------------------------------*/
+bool hcd_port_connect_status(uint8_t hostid)
+{
+  (void) hostid;
+  return _hcd.connected;
+}
+
+void hcd_port_reset(uint8_t hostid)
+{
+  (void) hostid;
+  sim_host_bus_reset();
+}
+
+tusb_speed_t hcd_port_speed_get(uint8_t hostid)
+{
+  (void) hostid;
+  return CFG_SIM_HCD_HIGH_SPEED ? TUSB_SPEED_HIGH : TUSB_SPEED_FULL;
+}
+
+void hcd_device_close(uint8_t rhport, uint8_t dev_addr)
+{
+  (void) rhport;
+
+  hcd_lock();
+  tu_memclr(_hcd.pipe[dev_addr], sizeof(_hcd.pipe[dev_addr]));
+  hcd_unlock();
+}
+
+/*------------------------------------------------------------------*/
+/* Endpoint API
+ *------------------------------------------------------------------*/
+bool hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const * ep_desc)
+{
+  (void) rhport;
+
+  TU_ASSERT(dev_addr <= CFG_TUSB_HOST_DEVICE_MAX && tu_edpt_number(ep_desc->bEndpointAddress) < EP_MAX);
+
+  hcd_lock();
+
+  sim_pipe_t* pipe = get_pipe(dev_addr, ep_desc->bEndpointAddress);
+  tu_varclr(pipe);
+
+  pipe->mps       = ep_desc->wMaxPacketSize.size;
+  pipe->xfer_type = ep_desc->bmAttributes.xfer;
+  pipe->opened    = true;
+
+  hcd_unlock();
+
+  return true;
+}
+
+bool hcd_setup_send(uint8_t rhport, uint8_t dev_addr, uint8_t const setup_packet[8])
+{
+  (void) rhport;
+
+  sim_td_t const td =
+  {
+    .buffer    = (uint8_t*) setup_packet,
+    .total_len = 8,
+    .ep_addr   = 0x00,
+    .setup     = true,
+    .ioc       = true
+  };
+
+  hcd_lock();
+
+  // Setup clears halt of control pipe
+  sim_pipe_t* pipe = get_pipe(dev_addr, 0);
+  pipe->halted = false;
+  bool const ret = td_queue(pipe, &td, true);
+
+  hcd_unlock();
+
+  return ret;
+}
+
+bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint16_t buflen)
+{
+  (void) rhport;
+
+  sim_td_t const td =
+  {
+    .buffer    = buffer,
+    .total_len = buflen,
+    .ep_addr   = ep_addr,
+    .ioc       = true
+  };
+
+  hcd_lock();
+  bool const ret = td_queue(get_pipe(dev_addr, ep_addr), &td, true);
+  hcd_unlock();
+
+  return ret;
+}
+
+bool hcd_edpt_busy(uint8_t dev_addr, uint8_t ep_addr)
+{
+  return get_pipe(dev_addr, ep_addr)->count > 0;
+}
+
+bool hcd_edpt_stalled(uint8_t dev_addr, uint8_t ep_addr)
+{
+  return get_pipe(dev_addr, ep_addr)->halted;
+}
+
+// Clear halt of host pipe, queued transfers are resumed
+bool hcd_edpt_clear_stall(uint8_t dev_addr, uint8_t ep_addr)
+{
+  hcd_lock();
+
+  sim_pipe_t* pipe = get_pipe(dev_addr, ep_addr);
+  pipe->halted  = false;
+  pipe->started = (pipe->count > 0);
+  pthread_cond_signal(&_hcd.cond);
+
+  hcd_unlock();
+
+  return true;
+}
+
+/*------------------------------------------------------------------*/
+/* Pipe API
+ *------------------------------------------------------------------*/
+bool hcd_pipe_queue_xfer(uint8_t dev_addr, uint8_t ep_addr, uint8_t buffer[], uint16_t total_bytes)
+{
+  sim_td_t const td =
+  {
+    .buffer    = buffer,
+    .total_len = total_bytes,
+    .ep_addr   = ep_addr,
+    .ioc       = false
+  };
+
+  hcd_lock();
+  bool const ret = td_queue(get_pipe(dev_addr, ep_addr), &td, false);
+  hcd_unlock();
+
+  return ret;
+}
+
+bool hcd_pipe_xfer(uint8_t dev_addr, uint8_t ep_addr, uint8_t buffer[], uint16_t total_bytes, bool int_on_complete)
+{
+  sim_td_t const td =
+  {
+    .buffer    = buffer,
+    .total_len = total_bytes,
+    .ep_addr   = ep_addr,
+    .ioc       = int_on_complete
+  };
+
+  hcd_lock();
+  bool const ret = td_queue(get_pipe(dev_addr, ep_addr), &td, true);
+  hcd_unlock();
+
+  return ret;
+}
+
+#endif
@@ -0,0 +1,417 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "tusb_option.h"
+
+#if TUSB_OPT_DEVICE_ENABLED && CFG_TUSB_MCU == OPT_MCU_SIM
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dcd_sim.h"
+
+//--------------------------------------------------------------------+
+// MACRO CONSTANT TYPEDEF
+//--------------------------------------------------------------------+
+enum
+{
+  DEV_ADDR               = 1,
+  NAK_LIMIT              = 10,   // consecutive NAKs (each after CFG_SIM_HOST_WAIT_MS) before giving up
+  CONNECT_WAIT_MS        = 5000,
+  BULK_PACKETS_PER_FRAME = 19,   // full speed bulk bandwidth with 64-byte packets
+  SCRIPT_LINE_MAX        = 256,
+  CONTROL_DATA_MAX       = 4096
+};
+
+static bool _realtime = false;
+static struct timespec _next_frame;
+
+//--------------------------------------------------------------------+
+// INTERNAL FUNCTION
+//--------------------------------------------------------------------+
+
+static uint64_t time_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec)*1000000 + ((uint64_t) ts.tv_nsec)/1000;
+}
+
+// New frame, wait for 1 ms boundary in realtime mode
+static void next_frame(void)
+{
+  if ( _realtime )
+  {
+    _next_frame.tv_nsec += 1000000L;
+    if ( _next_frame.tv_nsec >= 1000000000L )
+    {
+      _next_frame.tv_sec++;
+      _next_frame.tv_nsec -= 1000000000L;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &_next_frame, NULL);
+  }
+
+  sim_host_frame();
+}
+
+static bool xact_out(uint8_t ep_addr, void const * data, uint16_t len)
+{
+  for(uint8_t nak=0; nak<NAK_LIMIT; nak++)
+  {
+    sim_xact_t const ret = sim_host_out(ep_addr, data, len);
+
+    if ( ret == SIM_XACT_ACK   ) return true;
+    if ( ret == SIM_XACT_STALL ) return false;
+  }
+
+  printf("sim: endpoint 0x%02X not responding\r\n", ep_addr);
+  return false;
+}
+
+static bool xact_in(uint8_t ep_addr, void * buffer, uint16_t bufsize, uint16_t* len)
+{
+  for(uint8_t nak=0; nak<NAK_LIMIT; nak++)
+  {
+    sim_xact_t const ret = sim_host_in(ep_addr, buffer, bufsize, len);
+
+    if ( ret == SIM_XACT_ACK   ) return true;
+    if ( ret == SIM_XACT_STALL ) return false;
+  }
+
+  printf("sim: endpoint 0x%02X not responding\r\n", ep_addr);
+  return false;
+}
+
+//--------------------------------------------------------------------+
+// Virtual Host API
+//--------------------------------------------------------------------+
+
+bool sim_host_control(tusb_control_request_t const * request, void* data, uint16_t* len)
+{
+  uint8_t* buf = (uint8_t*) data;
+  uint16_t const ep0_size = CFG_TUD_ENDPOINT0_SIZE;
+  uint16_t count = 0;
+
+  if ( len ) (*len) = 0;
+
+  sim_host_setup(request);
+
+  if ( request->bmRequestType_bit.direction == TUSB_DIR_IN )
+  {
+    // Data stage until short packet or wLength
+    while ( count < request->wLength )
+    {
+      uint16_t xferred;
+      TU_VERIFY( xact_in(0x80, buf + count, (uint16_t) (request->wLength - count), &xferred) );
+
+      count = (uint16_t) (count + xferred);
+      if ( xferred < ep0_size ) break;
+    }
+
+    // Status stage
+    TU_VERIFY( xact_out(0x00, NULL, 0) );
+  }
+  else
+  {
+    while ( count < request->wLength )
+    {
+      uint16_t const xferred = tu_min16(ep0_size, (uint16_t) (request->wLength - count));
+      TU_VERIFY( xact_out(0x00, buf + count, xferred) );
+
+      count = (uint16_t) (count + xferred);
+    }
+
+    uint16_t zlp;
+    TU_VERIFY( xact_in(0x80, NULL, 0, &zlp) );
+  }
+
+  if ( len ) (*len) = count;
+
+  return true;
+}
+
+bool sim_host_enumerate(void)
+{
+  uint8_t desc[256];
+  uint16_t len;
+
+  sim_host_bus_reset();
+  next_frame();
+
+  tusb_control_request_t request =
+  {
+    .bmRequestType = 0x80,
+    .bRequest      = TUSB_REQ_GET_DESCRIPTOR,
+    .wValue        = TUSB_DESC_DEVICE << 8,
+    .wIndex        = 0,
+    .wLength       = sizeof(tusb_desc_device_t)
+  };
+  TU_VERIFY( sim_host_control(&request, desc, &len) && len == sizeof(tusb_desc_device_t) );
+
+  request = (tusb_control_request_t)
+  {
+    .bmRequestType = 0x00,
+    .bRequest      = TUSB_REQ_SET_ADDRESS,
+    .wValue        = DEV_ADDR
+  };
+  TU_VERIFY( sim_host_control(&request, NULL, NULL) );
+
+  // configuration descriptor header then the whole of it
+  request = (tusb_control_request_t)
+  {
+    .bmRequestType = 0x80,
+    .bRequest      = TUSB_REQ_GET_DESCRIPTOR,
+    .wValue        = TUSB_DESC_CONFIGURATION << 8,
+    .wLength       = sizeof(tusb_desc_configuration_t)
+  };
+  TU_VERIFY( sim_host_control(&request, desc, &len) && len == sizeof(tusb_desc_configuration_t) );
+
+  request.wLength = tu_min16(((tusb_desc_configuration_t const*) desc)->wTotalLength, sizeof(desc));
+  TU_VERIFY( sim_host_control(&request, desc, &len) );
+
+  request = (tusb_control_request_t)
+  {
+    .bmRequestType = 0x00,
+    .bRequest      = TUSB_REQ_SET_CONFIGURATION,
+    .wValue        = 1
+  };
+  TU_VERIFY( sim_host_control(&request, NULL, NULL) );
+
+  printf("sim: enumerated, configuration %u bytes\r\n", (unsigned) len);
+
+  return true;
+}
+
+// Move total bytes in max packet size transactions, at most packets_per_frame in each frame
+static bool run_traffic(uint8_t ep_addr, uint32_t total, uint32_t packets_per_frame)
+{
+  static uint8_t buf[1023];
+
+  uint16_t const mps = sim_host_edpt_size(ep_addr);
+  if ( !mps )
+  {
+    printf("sim: endpoint 0x%02X is not opened\r\n", ep_addr);
+    return false;
+  }
+
+  uint32_t count  = 0;
+  uint32_t frames = 0;
+  uint32_t packets = 0;
+  uint64_t const start = time_us();
+
+  while ( count < total )
+  {
+    uint16_t xferred;
+
+    if ( tu_edpt_dir(ep_addr) == TUSB_DIR_OUT )
+    {
+      xferred = (uint16_t) tu_min32(mps, total - count);
+      for(uint16_t i=0; i<xferred; i++) buf[i] = (uint8_t) (count + i);
+
+      TU_VERIFY( xact_out(ep_addr, buf, xferred) );
+    }
+    else
+    {
+      TU_VERIFY( xact_in(ep_addr, buf, sizeof(buf), &xferred) );
+    }
+
+    count += xferred;
+
+    if ( ++packets == packets_per_frame )
+    {
+      packets = 0;
+      frames++;
+      next_frame();
+    }
+  }
+
+  uint64_t const elapsed = tu_max32((uint32_t) (time_us() - start), 1);
+
+  printf("sim: %s 0x%02X %lu bytes, %lu frames, %lu us, %lu KB/s\r\n", tu_edpt_dir(ep_addr) ? "in" : "out", ep_addr,
+         (unsigned long) count, (unsigned long) frames, (unsigned long) elapsed,
+         (unsigned long) ((((uint64_t) count) * 1000000 / elapsed) / 1024));
+
+  return true;
+}
+
+static bool run_command(char* line)
+{
+  char* argv[8 + 64];
+  uint32_t argc = 0;
+
+  // strip comment
+  char* comment = strchr(line, '#');
+  if ( comment ) *comment = 0;
+
+  for(char* tok = strtok(line, " \t\r\n"); tok && argc < TU_ARRAY_SIZE(argv); tok = strtok(NULL, " \t\r\n"))
+  {
+    argv[argc++] = tok;
+  }
+
+  if ( argc == 0 ) return true;
+
+  uint32_t arg[TU_ARRAY_SIZE(argv)];
+  for(uint32_t i=1; i<argc; i++) arg[i] = (uint32_t) strtoul(argv[i], NULL, 0);
+
+  char const* cmd = argv[0];
+
+  if ( !strcmp(cmd, "enumerate") ) return sim_host_enumerate();
+
+  if ( !strcmp(cmd, "reset") )
+  {
+    sim_host_bus_reset();
+    return true;
+  }
+
+  if ( !strcmp(cmd, "suspend") )
+  {
+    sim_host_suspend();
+    return true;
+  }
+
+  if ( !strcmp(cmd, "resume") )
+  {
+    sim_host_resume();
+    return true;
+  }
+
+  if ( !strcmp(cmd, "frames") && argc == 2 )
+  {
+    for(uint32_t i=0; i<arg[1]; i++) next_frame();
+    return true;
+  }
+
+  if ( !strcmp(cmd, "realtime") && argc == 2 )
+  {
+    _realtime = (arg[1] != 0);
+    clock_gettime(CLOCK_MONOTONIC, &_next_frame);
+    return true;
+  }
+
+  if ( !strcmp(cmd, "control") && argc >= 6 )
+  {
+    static uint8_t data[CONTROL_DATA_MAX];
+
+    tusb_control_request_t const request =
+    {
+      .bmRequestType = (uint8_t) arg[1],
+      .bRequest      = (uint8_t) arg[2],
+      .wValue        = (uint16_t) arg[3],
+      .wIndex        = (uint16_t) arg[4],
+      .wLength       = (uint16_t) tu_min32(arg[5], sizeof(data))
+    };
+
+    // OUT data, missing bytes are zero
+    tu_memclr(data, sizeof(data));
+    for(uint32_t i=6; i<argc; i++) data[i-6] = (uint8_t) arg[i];
+
+    uint16_t len;
+    if ( !sim_host_control(&request, data, &len) )
+    {
+      printf("sim: control request 0x%02X stalled\r\n", request.bRequest);
+      return false;
+    }
+
+    if ( request.bmRequestType_bit.direction == TUSB_DIR_IN )
+    {
+      printf("sim: control in");
+      for(uint16_t i=0; i<len; i++) printf(" %02X", data[i]);
+      printf("\r\n");
+    }
+
+    return true;
+  }
+
+  if ( (!strcmp(cmd, "out") || !strcmp(cmd, "in")) && argc >= 3 )
+  {
+    uint8_t const ep_addr = (uint8_t) ( (arg[1] & 0x0f) | (!strcmp(cmd, "in") ? TUSB_DIR_IN_MASK : 0) );
+    uint32_t const ppf = (argc > 3) ? arg[3] : BULK_PACKETS_PER_FRAME;
+
+    return run_traffic(ep_addr, arg[2], ppf ? ppf : BULK_PACKETS_PER_FRAME);
+  }
+
+  printf("sim: unknown command '%s'\r\n", cmd);
+  return false;
+}
+
+bool sim_host_run_script(char const* path)
+{
+  FILE* file = fopen(path, "r");
+  if ( !file )
+  {
+    printf("sim: cannot open %s\r\n", path);
+    return false;
+  }
+
+  char line[SCRIPT_LINE_MAX];
+  uint32_t lineno = 0;
+  bool ret = true;
+
+  while ( ret && fgets(line, sizeof(line), file) )
+  {
+    lineno++;
+    ret = run_command(line);
+    if ( !ret ) printf("sim: %s:%lu failed\r\n", path, (unsigned long) lineno);
+  }
+
+  fclose(file);
+
+  return ret;
+}
+
+static void* host_thread(void* param)
+{
+  char const* script_path = (char const*) param;
+  bool ret = sim_host_wait_connect(CONNECT_WAIT_MS);
+
+  if ( ret )
+  {
+    ret = script_path ? sim_host_run_script(script_path) : sim_host_enumerate();
+  }else
+  {
+    printf("sim: device is not connected\r\n");
+  }
+
+  fflush(stdout);
+  exit(ret ? 0 : 1);
+
+  return NULL;
+}
+
+bool sim_host_start(char const* script_path)
+{
+  pthread_t thread;
+
+  TU_VERIFY( 0 == pthread_create(&thread, NULL, host_thread, (void*) script_path) );
+  pthread_detach(thread);
+
+  return true;
+}
+
+#endif
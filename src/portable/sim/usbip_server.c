@@ -0,0 +1,1096 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "tusb_option.h"
+
+#if TUSB_OPT_DEVICE_ENABLED && CFG_TUSB_MCU == OPT_MCU_SIM
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dcd_sim.h"
+
+//--------------------------------------------------------------------+
+// MACRO CONSTANT TYPEDEF
+// USB/IP protocol version 1.1.1, all fields are big endian except setup packet
+//--------------------------------------------------------------------+
+enum
+{
+  USBIP_VERSION    = 0x0111,
+
+  OP_REQ_DEVLIST   = 0x8005,
+  OP_REP_DEVLIST   = 0x0005,
+  OP_REQ_IMPORT    = 0x8003,
+  OP_REP_IMPORT    = 0x0003,
+
+  USBIP_CMD_SUBMIT = 1,
+  USBIP_CMD_UNLINK = 2,
+  USBIP_RET_SUBMIT = 3,
+  USBIP_RET_UNLINK = 4,
+
+  USBIP_DIR_OUT    = 0,
+  USBIP_DIR_IN     = 1,
+
+  // Linux URB transfer flags
+  URB_SHORT_NOT_OK = 0x0001,
+  URB_ZERO_PACKET  = 0x0040,
+
+  // Linux usb_device_speed
+  USBIP_SPEED_FULL = 2
+};
+
+enum
+{
+  BUSNUM             = 1,
+  DEVNUM             = 1,
+  URB_BUFSIZE_MAX    = 1024*1024,
+  ISO_PACKET_MAX     = 256,
+  QUEUE_COUNT        = 32,   // one per endpoint address, control endpoint uses queue 0 for both directions
+  PACKETS_PER_PASS   = 32,   // packets moved on one endpoint before serving the next one
+  IDLE_WAIT_US       = 100000,
+  CONNECT_WAIT_MS    = 5000,
+  CONTROL_TIMEOUT_MS = 1000,
+  CONFIG_DESC_MAX    = 1024
+};
+
+#define USBIP_BUSID   "1-1"
+
+typedef struct TU_ATTR_PACKED
+{
+  uint16_t version;
+  uint16_t code;
+  uint32_t status;
+}op_header_t;
+
+typedef struct TU_ATTR_PACKED
+{
+  char     path[256];
+  char     busid[32];
+  uint32_t busnum;
+  uint32_t devnum;
+  uint32_t speed;
+  uint16_t idVendor;
+  uint16_t idProduct;
+  uint16_t bcdDevice;
+  uint8_t  bDeviceClass;
+  uint8_t  bDeviceSubClass;
+  uint8_t  bDeviceProtocol;
+  uint8_t  bConfigurationValue;
+  uint8_t  bNumConfigurations;
+  uint8_t  bNumInterfaces;
+}op_device_t;
+
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t bInterfaceClass;
+  uint8_t bInterfaceSubClass;
+  uint8_t bInterfaceProtocol;
+  uint8_t padding;
+}op_interface_t;
+
+typedef struct TU_ATTR_PACKED
+{
+  uint32_t command;
+  uint32_t seqnum;
+  uint32_t devid;
+  uint32_t direction;
+  uint32_t ep;
+
+  union
+  {
+    struct TU_ATTR_PACKED
+    {
+      uint32_t transfer_flags;
+      int32_t  transfer_buffer_length;
+      int32_t  start_frame;
+      int32_t  number_of_packets;
+      int32_t  interval;
+      uint8_t  setup[8];
+    }cmd_submit;
+
+    struct TU_ATTR_PACKED
+    {
+      int32_t  status;
+      int32_t  actual_length;
+      int32_t  start_frame;
+      int32_t  number_of_packets;
+      int32_t  error_count;
+    }ret_submit;
+
+    struct TU_ATTR_PACKED
+    {
+      uint32_t seqnum;
+    }cmd_unlink;
+
+    struct TU_ATTR_PACKED
+    {
+      int32_t  status;
+    }ret_unlink;
+  };
+}urb_header_t;
+
+typedef struct TU_ATTR_PACKED
+{
+  uint32_t offset;
+  uint32_t length;
+  uint32_t actual_length;
+  int32_t  status;
+}iso_packet_t;
+
+TU_VERIFY_STATIC( sizeof(op_device_t)  == 312, "size is not correct");
+TU_VERIFY_STATIC( sizeof(urb_header_t) == 48 , "size is not correct");
+TU_VERIFY_STATIC( sizeof(iso_packet_t) == 16 , "size is not correct");
+
+enum
+{
+  STAGE_SETUP,
+  STAGE_DATA,
+  STAGE_STATUS
+};
+
+typedef struct urb_s
+{
+  struct urb_s* next;
+
+  bool     used;
+  bool     internal;   // submitted by server itself, completion is not sent to client
+  bool     done;
+  bool     dir_in;
+  uint8_t  ep_addr;
+  uint8_t  queue;
+  uint8_t  stage;      // control transfer
+
+  uint32_t seqnum;
+  uint32_t flags;
+  int32_t  number_of_packets; // as submitted, returned unchanged
+  tusb_control_request_t setup;
+
+  uint8_t* buffer;
+  uint32_t length;
+  uint32_t actual;
+  int32_t  status;
+
+  // Isochronous transfer, one packet per frame
+  iso_packet_t* iso;   // host byte order
+  uint32_t iso_count;
+  uint32_t iso_index;
+  uint32_t start_frame;
+  uint32_t error_count;
+}urb_t;
+
+static struct
+{
+  pthread_mutex_t mutex;     // URBs and queues, taken before device lock of dcd_sim
+  pthread_cond_t  cond;      // URB completed or freed
+  pthread_mutex_t tx_mutex;  // replies are sent by both server and controller thread
+
+  int  listen_fd;
+  int  fd;                   // attached client
+  bool attached;             // frames run while a client has imported device
+
+  urb_t  urb[CFG_SIM_USBIP_URB_MAX];
+  urb_t* queue[QUEUE_COUNT]; // in flight, oldest first
+  urb_t* done;               // waiting for RET_SUBMIT, oldest first
+}_usbip =
+{
+  .mutex    = PTHREAD_MUTEX_INITIALIZER,
+  .cond     = PTHREAD_COND_INITIALIZER,
+  .tx_mutex = PTHREAD_MUTEX_INITIALIZER,
+  .fd       = -1
+};
+
+//--------------------------------------------------------------------+
+// INTERNAL FUNCTION
+//--------------------------------------------------------------------+
+
+static uint64_t time_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec)*1000000 + ((uint64_t) ts.tv_nsec)/1000;
+}
+
+static bool sock_recv(int fd, void* buffer, size_t len)
+{
+  uint8_t* buf = (uint8_t*) buffer;
+
+  while ( len )
+  {
+    ssize_t const count = recv(fd, buf, len, 0);
+    if ( count < 0 && errno == EINTR ) continue;
+    if ( count <= 0 ) return false;
+
+    buf += count;
+    len -= (size_t) count;
+  }
+
+  return true;
+}
+
+// Client may be gone already, error is noticed by server thread on next receive
+static bool sock_send(int fd, void const* data, size_t len)
+{
+  uint8_t const* buf = (uint8_t const*) data;
+
+  while ( len )
+  {
+    ssize_t const count = send(fd, buf, len, MSG_NOSIGNAL);
+    if ( count < 0 && errno == EINTR ) continue;
+    if ( count <= 0 ) return false;
+
+    buf += count;
+    len -= (size_t) count;
+  }
+
+  return true;
+}
+
+static inline uint8_t urb_queue_num(uint8_t ep_addr)
+{
+  return tu_edpt_number(ep_addr) ? (uint8_t) (tu_edpt_number(ep_addr) + 16*tu_edpt_dir(ep_addr)) : 0;
+}
+
+// Mutex is held, NULL if all URBs are in use. Never waits: server thread must go on reading e.g
+// the UNLINK that would free one.
+static urb_t* urb_alloc(void)
+{
+  for(uint32_t i=0; i<CFG_SIM_USBIP_URB_MAX; i++)
+  {
+    urb_t* urb = &_usbip.urb[i];
+    if ( urb->used ) continue;
+
+    tu_varclr(urb);
+    urb->used = true;
+    return urb;
+  }
+
+  return NULL;
+}
+
+static void urb_free(urb_t* urb)
+{
+  if ( !urb->internal ) free(urb->buffer);
+  free(urb->iso);
+
+  urb->used = false;
+  pthread_cond_broadcast(&_usbip.cond);
+}
+
+static void list_append(urb_t** list, urb_t* urb)
+{
+  urb->next = NULL;
+  while ( *list ) list = &(*list)->next;
+  (*list) = urb;
+}
+
+// Remove URB from its endpoint queue, return false if it is not there
+static bool list_remove(urb_t** list, urb_t* urb)
+{
+  for( ; *list; list = &(*list)->next )
+  {
+    if ( *list == urb )
+    {
+      (*list) = urb->next;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void urb_submit(urb_t* urb)
+{
+  list_append(&_usbip.queue[urb->queue], urb);
+}
+
+// Transfer is over: internal URB wakes its submitter, others are returned to client by controller thread
+static void urb_complete(urb_t* urb, int32_t status)
+{
+  list_remove(&_usbip.queue[urb->queue], urb);
+
+  urb->status = status;
+  urb->done   = true;
+
+  if ( urb->internal )
+  {
+    pthread_cond_broadcast(&_usbip.cond);
+  }
+  else
+  {
+    list_append(&_usbip.done, urb);
+  }
+}
+
+//--------------------------------------------------------------------+
+// Controller: moves packets of queued URBs as a host controller would
+//--------------------------------------------------------------------+
+
+// Endpoint that is not ready is NAKed right away, controller never waits for device
+static sim_xact_t xact_out(uint8_t ep_addr, void const * data, uint16_t len)
+{
+  if ( !sim_host_edpt_ready(ep_addr) ) return SIM_XACT_NAK;
+  return sim_host_out(ep_addr, data, len);
+}
+
+static sim_xact_t xact_in(uint8_t ep_addr, void * buffer, uint16_t bufsize, uint16_t* len)
+{
+  (*len) = 0;
+  if ( !sim_host_edpt_ready(ep_addr) ) return SIM_XACT_NAK;
+  return sim_host_in(ep_addr, buffer, bufsize, len);
+}
+
+static sim_xact_t control_xact(urb_t* urb)
+{
+  uint16_t const mps = CFG_TUD_ENDPOINT0_SIZE;
+  sim_xact_t ret = SIM_XACT_ACK;
+  uint16_t len;
+
+  switch ( urb->stage )
+  {
+    case STAGE_SETUP:
+      ret = sim_host_setup(&urb->setup);
+      urb->stage = urb->length ? STAGE_DATA : STAGE_STATUS;
+    break;
+
+    case STAGE_DATA:
+    {
+      uint16_t const remaining = (uint16_t) (urb->length - urb->actual);
+      len = tu_min16(mps, remaining);
+
+      if ( urb->dir_in )
+      {
+        ret = xact_in(0x80, urb->buffer + urb->actual, len, &len);
+      }
+      else
+      {
+        ret = xact_out(0x00, urb->buffer + urb->actual, len);
+      }
+
+      if ( ret == SIM_XACT_ACK )
+      {
+        if ( len > remaining )
+        {
+          urb_complete(urb, -EOVERFLOW);
+          break;
+        }
+
+        urb->actual += len;
+
+        // Short packet or wLength ends data stage
+        if ( (len < mps) || (urb->actual == urb->length) ) urb->stage = STAGE_STATUS;
+      }
+    }
+    break;
+
+    case STAGE_STATUS:
+      ret = urb->dir_in ? xact_out(0x00, NULL, 0) : xact_in(0x80, NULL, 0, &len);
+      if ( ret == SIM_XACT_ACK ) urb_complete(urb, 0);
+    break;
+
+    default: break;
+  }
+
+  if ( ret == SIM_XACT_STALL ) urb_complete(urb, -EPIPE);
+
+  return ret;
+}
+
+static sim_xact_t bulk_xact(urb_t* urb)
+{
+  uint16_t const mps = sim_host_edpt_size(urb->ep_addr);
+  if ( !mps ) return SIM_XACT_NAK;
+
+  uint32_t const remaining = urb->length - urb->actual;
+  uint16_t len = (uint16_t) tu_min32(mps, remaining);
+  sim_xact_t ret;
+
+  if ( urb->dir_in )
+  {
+    ret = xact_in(urb->ep_addr, urb->buffer + urb->actual, len, &len);
+
+    if ( ret == SIM_XACT_ACK )
+    {
+      if ( len > remaining )
+      {
+        urb->actual = urb->length;
+        urb_complete(urb, -EOVERFLOW);
+      }
+      else
+      {
+        urb->actual += len;
+
+        if ( len < mps )
+        {
+          bool const short_error = (urb->flags & URB_SHORT_NOT_OK) && (urb->actual < urb->length);
+          urb_complete(urb, short_error ? -EREMOTEIO : 0);
+        }
+        else if ( urb->actual == urb->length )
+        {
+          urb_complete(urb, 0);
+        }
+      }
+    }
+  }
+  else
+  {
+    ret = xact_out(urb->ep_addr, urb->buffer + urb->actual, len);
+
+    if ( ret == SIM_XACT_ACK )
+    {
+      urb->actual += len;
+
+      // Zero length packet follows the last full packet if requested
+      bool const zlp = (len == mps) && (urb->flags & URB_ZERO_PACKET);
+      if ( (urb->actual == urb->length) && !zlp ) urb_complete(urb, 0);
+    }
+  }
+
+  if ( ret == SIM_XACT_STALL ) urb_complete(urb, -EPIPE);
+
+  return ret;
+}
+
+// One packet per frame, a packet device is not ready for is lost
+static void iso_xact(urb_t* urb)
+{
+  iso_packet_t* packet = &urb->iso[urb->iso_index];
+  uint16_t len = (uint16_t) packet->length;
+  sim_xact_t ret;
+
+  if ( urb->iso_index == 0 ) urb->start_frame = sim_host_frame_count();
+
+  if ( urb->dir_in )
+  {
+    ret = xact_in(urb->ep_addr, urb->buffer + packet->offset, len, &len);
+  }
+  else
+  {
+    ret = xact_out(urb->ep_addr, urb->buffer + packet->offset, len);
+  }
+
+  packet->actual_length = 0;
+  packet->status        = 0;
+
+  if ( ret != SIM_XACT_ACK )
+  {
+    packet->status = -EXDEV;
+  }
+  else if ( len > packet->length )
+  {
+    packet->actual_length = packet->length;
+    packet->status        = -EOVERFLOW;
+  }
+  else
+  {
+    packet->actual_length = len;
+  }
+
+  if ( packet->status ) urb->error_count++;
+  urb->actual += packet->actual_length;
+
+  if ( ++urb->iso_index == urb->iso_count ) urb_complete(urb, 0);
+}
+
+// Mutex is held, return true if any packet is moved
+static bool service_queues(bool new_frame)
+{
+  bool progress = false;
+
+  for(uint8_t q=0; q<QUEUE_COUNT; q++)
+  {
+    urb_t* urb = _usbip.queue[q];
+    if ( !urb ) continue;
+
+    if ( urb->iso_count )
+    {
+      if ( new_frame ) iso_xact(urb);
+      continue;
+    }
+
+    for(uint32_t count=0; (count < PACKETS_PER_PASS) && (urb = _usbip.queue[q]) != NULL; count++)
+    {
+      sim_xact_t const ret = (q == 0) ? control_xact(urb) : bulk_xact(urb);
+      if ( ret == SIM_XACT_NAK ) break;
+
+      progress = true;
+    }
+  }
+
+  return progress;
+}
+
+static void send_ret_submit(int fd, urb_t const* urb)
+{
+  urb_header_t hdr;
+  tu_varclr(&hdr);
+
+  hdr.command                      = htonl(USBIP_RET_SUBMIT);
+  hdr.seqnum                       = htonl(urb->seqnum);
+  hdr.ret_submit.status            = (int32_t) htonl((uint32_t) urb->status);
+  hdr.ret_submit.actual_length     = (int32_t) htonl(urb->actual);
+  hdr.ret_submit.start_frame       = (int32_t) htonl(urb->start_frame);
+  hdr.ret_submit.number_of_packets = (int32_t) htonl((uint32_t) urb->number_of_packets);
+  hdr.ret_submit.error_count       = (int32_t) htonl(urb->error_count);
+
+  pthread_mutex_lock(&_usbip.tx_mutex);
+
+  sock_send(fd, &hdr, sizeof(hdr));
+
+  if ( urb->dir_in )
+  {
+    if ( !urb->iso_count )
+    {
+      sock_send(fd, urb->buffer, urb->actual);
+    }
+    else
+    {
+      // isochronous packets are sent back to back, client moves them to their offset
+      for(uint32_t i=0; i<urb->iso_count; i++)
+      {
+        sock_send(fd, urb->buffer + urb->iso[i].offset, urb->iso[i].actual_length);
+      }
+    }
+  }
+
+  for(uint32_t i=0; i<urb->iso_count; i++)
+  {
+    iso_packet_t const packet =
+    {
+      .offset        = htonl(urb->iso[i].offset),
+      .length        = htonl(urb->iso[i].length),
+      .actual_length = htonl(urb->iso[i].actual_length),
+      .status        = (int32_t) htonl((uint32_t) urb->iso[i].status)
+    };
+
+    sock_send(fd, &packet, sizeof(packet));
+  }
+
+  pthread_mutex_unlock(&_usbip.tx_mutex);
+}
+
+// Return completed URBs to client, mutex is not held while sending
+static void send_completed(void)
+{
+  for(;;)
+  {
+    pthread_mutex_lock(&_usbip.mutex);
+    urb_t* urb = _usbip.done;
+    if ( urb ) _usbip.done = urb->next;
+    int const fd = _usbip.fd;
+    pthread_mutex_unlock(&_usbip.mutex);
+
+    if ( !urb ) break;
+
+    send_ret_submit(fd, urb);
+
+    pthread_mutex_lock(&_usbip.mutex);
+    urb_free(urb);
+    pthread_mutex_unlock(&_usbip.mutex);
+  }
+}
+
+// Frames are paced at 1 ms of wall clock while a client is attached, packets in between go as fast as both sides can
+static void* controller_thread(void* param)
+{
+  (void) param;
+
+  uint64_t next_frame = time_us();
+
+  for(;;)
+  {
+    uint32_t const events = sim_host_event_count();
+    uint64_t const now = time_us();
+    bool new_frame = false;
+
+    pthread_mutex_lock(&_usbip.mutex);
+    bool const attached = _usbip.attached;
+    pthread_mutex_unlock(&_usbip.mutex);
+
+    if ( !attached )
+    {
+      next_frame = now;
+    }
+    else if ( now >= next_frame )
+    {
+      sim_host_frame();
+      new_frame = true;
+
+      // skip frames rather than bursting them when host machine is busy
+      next_frame = (now - next_frame >= 1000) ? (now + 1000) : (next_frame + 1000);
+    }
+
+    pthread_mutex_lock(&_usbip.mutex);
+    bool const progress = service_queues(new_frame);
+    pthread_mutex_unlock(&_usbip.mutex);
+
+    send_completed();
+
+    // All endpoints NAKed: sleep until device arms one, a URB is submitted or next frame
+    if ( !progress )
+    {
+      uint64_t const current = time_us();
+      uint32_t const timeout = !attached ? IDLE_WAIT_US : (next_frame > current) ? (uint32_t) (next_frame - current) : 0;
+
+      if ( timeout ) sim_host_wait_event(events, timeout);
+    }
+  }
+
+  return NULL;
+}
+
+//--------------------------------------------------------------------+
+// Server: device list, import and URB commands from client
+//--------------------------------------------------------------------+
+
+// Control transfer through controller thread, used before client takes over the device
+static bool control_sync(tusb_control_request_t const* request, void* data, uint32_t* len)
+{
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += CONTROL_TIMEOUT_MS / 1000;
+
+  pthread_mutex_lock(&_usbip.mutex);
+
+  urb_t* urb = urb_alloc();
+  if ( !urb )
+  {
+    pthread_mutex_unlock(&_usbip.mutex);
+    return false;
+  }
+
+  urb->internal = true;
+  urb->setup    = (*request);
+  urb->dir_in   = (request->bmRequestType_bit.direction == TUSB_DIR_IN);
+  urb->buffer   = (uint8_t*) data;
+  urb->length   = request->wLength;
+  urb_submit(urb);
+
+  sim_host_notify();
+
+  while ( !urb->done )
+  {
+    if ( ETIMEDOUT == pthread_cond_timedwait(&_usbip.cond, &_usbip.mutex, &deadline) ) break;
+  }
+
+  if ( !urb->done ) list_remove(&_usbip.queue[urb->queue], urb);
+
+  bool const ret = urb->done && (urb->status == 0);
+  (*len) = urb->actual;
+
+  urb_free(urb);
+  pthread_mutex_unlock(&_usbip.mutex);
+
+  return ret;
+}
+
+// Bus reset then read device & configuration descriptors, interface list is optional
+static bool get_device_info(op_device_t* dev, op_interface_t* itf, uint8_t itf_max)
+{
+  tusb_desc_device_t desc_device;
+  uint8_t desc_config[CONFIG_DESC_MAX];
+  uint32_t len;
+
+  TU_VERIFY( sim_host_wait_connect(CONNECT_WAIT_MS) );
+  sim_host_bus_reset();
+
+  tusb_control_request_t request =
+  {
+    .bmRequestType = 0x80,
+    .bRequest      = TUSB_REQ_GET_DESCRIPTOR,
+    .wValue        = TUSB_DESC_DEVICE << 8,
+    .wIndex        = 0,
+    .wLength       = sizeof(desc_device)
+  };
+
+  TU_VERIFY( control_sync(&request, &desc_device, &len) && len == sizeof(desc_device) );
+
+  request.wValue  = TUSB_DESC_CONFIGURATION << 8;
+  request.wLength = sizeof(desc_config);
+  TU_VERIFY( control_sync(&request, desc_config, &len) && len >= sizeof(tusb_desc_configuration_t) );
+
+  tusb_desc_configuration_t const* config = (tusb_desc_configuration_t const*) desc_config;
+
+  tu_varclr(dev);
+  snprintf(dev->path, sizeof(dev->path), "/sys/devices/platform/tinyusb/usb%u/%s", BUSNUM, USBIP_BUSID);
+  snprintf(dev->busid, sizeof(dev->busid), "%s", USBIP_BUSID);
+
+  dev->busnum              = htonl(BUSNUM);
+  dev->devnum              = htonl(DEVNUM);
+  dev->speed               = htonl(USBIP_SPEED_FULL);
+  dev->idVendor            = htons(desc_device.idVendor);
+  dev->idProduct           = htons(desc_device.idProduct);
+  dev->bcdDevice           = htons(desc_device.bcdDevice);
+  dev->bDeviceClass        = desc_device.bDeviceClass;
+  dev->bDeviceSubClass     = desc_device.bDeviceSubClass;
+  dev->bDeviceProtocol     = desc_device.bDeviceProtocol;
+  dev->bConfigurationValue = 0; // device is just reset
+  dev->bNumConfigurations  = desc_device.bNumConfigurations;
+  dev->bNumInterfaces      = tu_min8(config->bNumInterfaces, itf_max);
+
+  uint8_t count = 0;
+  for(uint8_t const* p = desc_config; (p < desc_config + len) && itf && (count < dev->bNumInterfaces); p = tu_desc_next(p))
+  {
+    tusb_desc_interface_t const* desc_itf = (tusb_desc_interface_t const*) p;
+    if ( !p[0] ) break;
+    if ( tu_desc_type(p) != TUSB_DESC_INTERFACE || desc_itf->bAlternateSetting ) continue;
+
+    itf[count].bInterfaceClass    = desc_itf->bInterfaceClass;
+    itf[count].bInterfaceSubClass = desc_itf->bInterfaceSubClass;
+    itf[count].bInterfaceProtocol = desc_itf->bInterfaceProtocol;
+    itf[count].padding            = 0;
+    count++;
+  }
+
+  return true;
+}
+
+static bool reply_devlist(int fd)
+{
+  op_device_t dev;
+  op_interface_t itf[32];
+  uint32_t ndev = 0;
+
+  tu_varclr(itf);
+  if ( get_device_info(&dev, itf, TU_ARRAY_SIZE(itf)) ) ndev = 1;
+
+  op_header_t const hdr = { .version = htons(USBIP_VERSION), .code = htons(OP_REP_DEVLIST), .status = 0 };
+  uint32_t const ndev_be = htonl(ndev);
+
+  pthread_mutex_lock(&_usbip.tx_mutex);
+  bool ret = sock_send(fd, &hdr, sizeof(hdr)) && sock_send(fd, &ndev_be, sizeof(ndev_be));
+  if ( ret && ndev )
+  {
+    ret = sock_send(fd, &dev, sizeof(dev)) && sock_send(fd, itf, dev.bNumInterfaces*sizeof(op_interface_t));
+  }
+  pthread_mutex_unlock(&_usbip.tx_mutex);
+
+  return ret;
+}
+
+static bool reply_import(int fd, char const* busid)
+{
+  op_device_t dev;
+  bool const found = (0 == strncmp(busid, USBIP_BUSID, 32)) && get_device_info(&dev, NULL, 0xff);
+
+  op_header_t const hdr = { .version = htons(USBIP_VERSION), .code = htons(OP_REP_IMPORT), .status = htonl(found ? 0 : 1) };
+
+  pthread_mutex_lock(&_usbip.tx_mutex);
+  bool const ret = sock_send(fd, &hdr, sizeof(hdr)) && (!found || sock_send(fd, &dev, sizeof(dev)));
+  pthread_mutex_unlock(&_usbip.tx_mutex);
+
+  return ret && found;
+}
+
+static bool recv_submit(int fd, urb_header_t const* hdr)
+{
+  uint32_t const ep     = ntohl(hdr->ep);
+  bool     const dir_in = (ntohl(hdr->direction) == USBIP_DIR_IN);
+  int32_t  const length = (int32_t) ntohl((uint32_t) hdr->cmd_submit.transfer_buffer_length);
+  int32_t  const number_of_packets = (int32_t) ntohl((uint32_t) hdr->cmd_submit.number_of_packets);
+
+  // malformed command ends connection
+  TU_VERIFY( ep < 16 && length >= 0 && length <= URB_BUFSIZE_MAX && number_of_packets <= ISO_PACKET_MAX );
+
+  uint8_t* buffer = length ? (uint8_t*) malloc((size_t) length) : NULL;
+  iso_packet_t* iso = (number_of_packets > 0) ? (iso_packet_t*) calloc((size_t) number_of_packets, sizeof(iso_packet_t)) : NULL;
+
+  bool ok = true;
+  if ( !dir_in && length ) ok = sock_recv(fd, buffer, (size_t) length);
+  if ( ok && iso ) ok = sock_recv(fd, iso, (size_t) number_of_packets*sizeof(iso_packet_t));
+
+  if ( !ok )
+  {
+    free(buffer);
+    free(iso);
+    return false;
+  }
+
+  pthread_mutex_lock(&_usbip.mutex);
+
+  urb_t* urb = urb_alloc();
+
+  if ( !urb )
+  {
+    pthread_mutex_unlock(&_usbip.mutex);
+
+    // no room: completed at once with an error, packets of isochronous URB are failed as well
+    urb_t rejected;
+    tu_varclr(&rejected);
+
+    rejected.seqnum            = ntohl(hdr->seqnum);
+    rejected.number_of_packets = number_of_packets;
+    rejected.status            = -ENOMEM;
+    rejected.iso               = iso;
+    rejected.iso_count         = iso ? (uint32_t) number_of_packets : 0;
+    rejected.error_count       = rejected.iso_count;
+
+    for(uint32_t i=0; i<rejected.iso_count; i++)
+    {
+      iso[i].offset        = ntohl(iso[i].offset);
+      iso[i].length        = ntohl(iso[i].length);
+      iso[i].actual_length = 0;
+      iso[i].status        = -ENOMEM;
+    }
+
+    send_ret_submit(fd, &rejected);
+
+    free(buffer);
+    free(iso);
+    return true;
+  }
+
+  urb->seqnum            = ntohl(hdr->seqnum);
+  urb->flags             = ntohl(hdr->cmd_submit.transfer_flags);
+  urb->number_of_packets = number_of_packets;
+  urb->dir_in            = dir_in;
+  urb->ep_addr           = (uint8_t) (ep | (dir_in ? TUSB_DIR_IN_MASK : 0));
+  urb->queue             = urb_queue_num(urb->ep_addr);
+  urb->buffer            = buffer;
+  urb->length            = (uint32_t) length;
+  urb->iso               = iso;
+
+  if ( ep == 0 )
+  {
+    memcpy(&urb->setup, hdr->cmd_submit.setup, sizeof(urb->setup));
+    urb->length = tu_min32(urb->length, urb->setup.wLength);
+  }
+
+  bool valid = true;
+
+  if ( iso )
+  {
+    urb->iso_count = (uint32_t) number_of_packets;
+
+    for(uint32_t i=0; i<urb->iso_count; i++)
+    {
+      iso[i].offset = ntohl(iso[i].offset);
+      iso[i].length = ntohl(iso[i].length);
+      if ( (iso[i].offset > urb->length) || (iso[i].length > urb->length - iso[i].offset) || (iso[i].length > 0xffff) ) valid = false;
+    }
+  }
+
+  if ( valid )
+  {
+    urb_submit(urb);
+  }
+  else
+  {
+    urb->done   = true;
+    urb->status = -EINVAL;
+    list_append(&_usbip.done, urb);
+  }
+
+  sim_host_notify();
+  pthread_mutex_unlock(&_usbip.mutex);
+
+  return true;
+}
+
+// URB still in flight is given back without RET_SUBMIT, otherwise its RET_SUBMIT is (being) sent
+static bool recv_unlink(int fd, urb_header_t const* hdr)
+{
+  uint32_t const seqnum = ntohl(hdr->cmd_unlink.seqnum);
+  int32_t status = 0;
+
+  pthread_mutex_lock(&_usbip.mutex);
+
+  for(uint32_t i=0; i<CFG_SIM_USBIP_URB_MAX; i++)
+  {
+    urb_t* urb = &_usbip.urb[i];
+
+    if ( urb->used && !urb->internal && !urb->done && urb->seqnum == seqnum )
+    {
+      list_remove(&_usbip.queue[urb->queue], urb);
+      urb_free(urb);
+      status = -ECONNRESET;
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&_usbip.mutex);
+
+  urb_header_t reply;
+  tu_varclr(&reply);
+
+  reply.command           = htonl(USBIP_RET_UNLINK);
+  reply.seqnum            = hdr->seqnum;
+  reply.ret_unlink.status = (int32_t) htonl((uint32_t) status);
+
+  pthread_mutex_lock(&_usbip.tx_mutex);
+  bool const ret = sock_send(fd, &reply, sizeof(reply));
+  pthread_mutex_unlock(&_usbip.tx_mutex);
+
+  return ret;
+}
+
+// Device is imported: connection carries URB commands until client detaches
+static void serve_urbs(int fd)
+{
+  pthread_mutex_lock(&_usbip.mutex);
+  _usbip.fd       = fd;
+  _usbip.attached = true;
+  pthread_mutex_unlock(&_usbip.mutex);
+
+  printf("usbip: device %s attached\r\n", USBIP_BUSID);
+
+  urb_header_t hdr;
+  while ( sock_recv(fd, &hdr, sizeof(hdr)) )
+  {
+    uint32_t const command = ntohl(hdr.command);
+    bool ok = false;
+
+    if ( command == USBIP_CMD_SUBMIT ) ok = recv_submit(fd, &hdr);
+    if ( command == USBIP_CMD_UNLINK ) ok = recv_unlink(fd, &hdr);
+
+    if ( !ok ) break;
+  }
+
+  // Drop URBs in flight, then wait for completed ones to be sent before socket is closed
+  pthread_mutex_lock(&_usbip.mutex);
+
+  _usbip.attached = false;
+
+  for(uint8_t q=0; q<QUEUE_COUNT; q++)
+  {
+    while ( _usbip.queue[q] )
+    {
+      urb_t* urb = _usbip.queue[q];
+      _usbip.queue[q] = urb->next;
+      urb_free(urb);
+    }
+  }
+
+  for(uint32_t i=0; i<CFG_SIM_USBIP_URB_MAX; i++)
+  {
+    while ( _usbip.urb[i].used ) pthread_cond_wait(&_usbip.cond, &_usbip.mutex);
+  }
+
+  _usbip.fd = -1;
+  pthread_mutex_unlock(&_usbip.mutex);
+
+  printf("usbip: device %s detached\r\n", USBIP_BUSID);
+}
+
+static void serve_client(int fd)
+{
+  op_header_t hdr;
+
+  while ( sock_recv(fd, &hdr, sizeof(hdr)) )
+  {
+    uint16_t const code = ntohs(hdr.code);
+
+    if ( code == OP_REQ_DEVLIST )
+    {
+      if ( !reply_devlist(fd) ) break;
+    }
+    else if ( code == OP_REQ_IMPORT )
+    {
+      char busid[32];
+      if ( !sock_recv(fd, busid, sizeof(busid)) ) break;
+
+      busid[sizeof(busid)-1] = 0;
+      if ( reply_import(fd, busid) ) serve_urbs(fd);
+      break;
+    }
+    else
+    {
+      break;
+    }
+  }
+}
+
+static void* server_thread(void* param)
+{
+  (void) param;
+
+  for(;;)
+  {
+    int const fd = accept(_usbip.listen_fd, NULL, NULL);
+    if ( fd < 0 ) continue;
+
+    // small commands and replies must not wait for Nagle
+    int const one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    serve_client(fd);
+    close(fd);
+  }
+
+  return NULL;
+}
+
+//--------------------------------------------------------------------+
+// USB/IP Server API
+//--------------------------------------------------------------------+
+
+uint16_t sim_usbip_start(uint16_t port)
+{
+  int const fd = socket(AF_INET, SOCK_STREAM, 0);
+  TU_VERIFY(fd >= 0, 0);
+
+  int const one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if ( bind(fd, (struct sockaddr*) &addr, sizeof(addr)) || listen(fd, 1) || getsockname(fd, (struct sockaddr*) &addr, &addr_len) )
+  {
+    printf("usbip: cannot listen on port %u: %s\r\n", port, strerror(errno));
+    close(fd);
+    return 0;
+  }
+
+  _usbip.listen_fd = fd;
+
+  pthread_t thread;
+  TU_VERIFY( 0 == pthread_create(&thread, NULL, controller_thread, NULL), 0 );
+  pthread_detach(thread);
+
+  TU_VERIFY( 0 == pthread_create(&thread, NULL, server_thread, NULL), 0 );
+  pthread_detach(thread);
+
+  port = ntohs(addr.sin_port);
+  printf("usbip: listening on 127.0.0.1:%u\r\n", port);
+
+  return port;
+}
+
+#endif
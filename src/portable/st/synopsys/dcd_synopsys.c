@@ -685,7 +685,7 @@ void OTG_FS_IRQHandler(void) {
 
   if(int_status & USB_OTG_GINTSTS_SOF) {
     USB_OTG_FS->GINTSTS = USB_OTG_GINTSTS_SOF;
-    dcd_event_bus_signal(0, DCD_EVENT_SOF, true);
+    dcd_event_sof(0, (dev->DSTS & USB_OTG_DSTS_FNSOF_Msk) >> USB_OTG_DSTS_FNSOF_Pos, true);
   }
 
   if(int_status & USB_OTG_GINTSTS_RXFLVL) {
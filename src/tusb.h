@@ -37,6 +37,7 @@
 #include "common/tusb_common.h"
 #include "osal/osal.h"
 #include "common/tusb_fifo.h"
+#include "common/tusb_msgq.h"
 
 //------------- HOST -------------//
 #if TUSB_OPT_HOST_ENABLED
@@ -76,10 +77,18 @@
     #include "class/msc/msc_device.h"
   #endif
 
+  #if CFG_TUD_UAS
+    #include "class/msc/uas_device.h"
+  #endif
+
   #if CFG_TUD_MIDI
     #include "class/midi/midi_device.h"
   #endif
 
+  #if CFG_TUD_AUDIO
+    #include "class/audio/audio_device.h"
+  #endif
+
   #if CFG_TUD_VENDOR
     #include "class/vendor/vendor_device.h"
   #endif
@@ -74,6 +74,8 @@
 
 #define OPT_MCU_MIMXRT10XX        700 ///< NXP iMX RT10xx
 
+#define OPT_MCU_SIM               900 ///< Linux process with virtual host (portable/sim)
+
 /** @} */
 
 /** \defgroup group_supported_os Supported RTOS
@@ -168,6 +170,22 @@
   #define CFG_TUD_ENDPOINT0_SIZE   64
 #endif
 
+// Number of endpoint numbers (including control endpoint 0) tracked by the stack, up to 16.
+// Raise it for controllers with more than 8 bidirectional endpoints.
+#ifndef CFG_TUD_ENDPOINT_MAX
+  #if CFG_TUSB_MCU == OPT_MCU_NRF5X
+    // isochronous endpoint is number 8
+    #define CFG_TUD_ENDPOINT_MAX   9
+  #else
+    #define CFG_TUD_ENDPOINT_MAX   8
+  #endif
+#endif
+
+// Transfer statistics per endpoint and class driver, see tud_stats_get()
+#ifndef CFG_TUD_STATS
+  #define CFG_TUD_STATS            0
+#endif
+
 #ifndef CFG_TUD_CDC
   #define CFG_TUD_CDC             0
 #endif
@@ -176,6 +194,10 @@
   #define CFG_TUD_MSC             0
 #endif
 
+#ifndef CFG_TUD_UAS
+  #define CFG_TUD_UAS             0
+#endif
+
 #ifndef CFG_TUD_HID
   #define CFG_TUD_HID             0
 #endif
@@ -184,6 +206,10 @@
   #define CFG_TUD_MIDI            0
 #endif
 
+#ifndef CFG_TUD_AUDIO
+  #define CFG_TUD_AUDIO           0
+#endif
+
 #ifndef CFG_TUD_VENDOR
   #define CFG_TUD_VENDOR          0
 #endif
@@ -229,6 +255,10 @@
   #error Control Endpoint Max Packet Size cannot be larger than 64
 #endif
 
+#if (CFG_TUD_ENDPOINT_MAX < 1) || (CFG_TUD_ENDPOINT_MAX > 16)
+  #error CFG_TUD_ENDPOINT_MAX must be between 1 and 16
+#endif
+
 #endif /* _TUSB_OPTION_H_ */
 
 /** @} */
@@ -0,0 +1,401 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+
+#include <string.h>
+
+#include "unity.h"
+
+// Files to test
+#include "tusb_fifo.h"
+#include "tusb.h"
+#include "usbd.h"
+TEST_FILE("usbd_control.c")
+TEST_FILE("audio_device.c")
+
+// Mock File
+#include "mock_dcd.h"
+#include "mock_msc_device.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  EDPT_CTRL_OUT   = 0x00,
+  EDPT_CTRL_IN    = 0x80,
+
+  EDPT_AUDIO_OUT  = 0x01,
+  EDPT_AUDIO_FB   = 0x81,
+  EDPT_AUDIO_IN   = 0x82,
+};
+
+enum
+{
+  ITF_NUM_AUDIO_CONTROL,
+  ITF_NUM_AUDIO_SPEAKER,
+  ITF_NUM_AUDIO_MIC,
+  ITF_NUM_TOTAL
+};
+
+// entity IDs of headset template
+enum
+{
+  CLOCK_ID   = 1,
+  FU_SPK_ID  = 3,
+  FU_MIC_ID  = 6,
+};
+
+uint8_t const rhport = 0;
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + TUD_AUDIO_HEADSET_STEREO_DESC_LEN)
+
+uint8_t const data_desc_configuration[] =
+{
+  // Interface count, string index, total length, attribute, power in mA
+  TUD_CONFIG_DESCRIPTOR(ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 100),
+
+  // Interface number, string index, 16-bit samples, EP OUT & feedback & IN address, EP size
+  TUD_AUDIO_HEADSET_STEREO_DESCRIPTOR(ITF_NUM_AUDIO_CONTROL, 0, 2, 16, EDPT_AUDIO_OUT, EDPT_AUDIO_FB, EDPT_AUDIO_IN, CFG_TUD_AUDIO_EPSIZE),
+};
+
+tusb_control_request_t const request_set_configuration =
+{
+  .bmRequestType = 0x00,
+  .bRequest      = TUSB_REQ_SET_CONFIGURATION,
+  .wValue        = 1,
+  .wIndex        = 0,
+  .wLength       = 0
+};
+
+// OUT transfer buffer armed by driver
+static uint8_t* out_buf;
+
+// data of control OUT stage
+static uint8_t const* ctrl_data;
+
+static bool     rx_streaming;
+static uint32_t sample_rate;
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+uint8_t const * tud_descriptor_device_cb(void)
+{
+  return NULL;
+}
+
+uint8_t const * tud_descriptor_configuration_cb(uint8_t index)
+{
+  return data_desc_configuration;
+}
+
+uint16_t const* tud_descriptor_string_cb(uint8_t index)
+{
+  return NULL;
+}
+
+void tud_audio_rx_stream_cb(bool streaming)
+{
+  rx_streaming = streaming;
+}
+
+bool tud_audio_sample_rate_cb(uint32_t rate)
+{
+  sample_rate = rate;
+  return true;
+}
+
+static bool capture_out_buf(uint8_t port, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes, int cmock_num_calls)
+{
+  (void) port; (void) total_bytes; (void) cmock_num_calls;
+  if ( ep_addr == EDPT_AUDIO_OUT ) out_buf = buffer;
+  return true;
+}
+
+static bool fill_ctrl_data(uint8_t port, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes, int cmock_num_calls)
+{
+  (void) port; (void) cmock_num_calls;
+  if ( ep_addr == EDPT_CTRL_OUT && total_bytes ) memcpy(buffer, ctrl_data, total_bytes);
+  return true;
+}
+
+static void set_configuration(void)
+{
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+
+  // all interfaces start in zero bandwidth setting: no endpoint is opened
+  dcd_set_config_Expect(rhport, 1);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+
+  tud_task();
+}
+
+static void set_interface(uint8_t itf, uint8_t alt)
+{
+  tusb_control_request_t const req_set_interface =
+  {
+    .bmRequestType = 0x01,
+    .bRequest = TUSB_REQ_SET_INTERFACE,
+    .wValue = alt,
+    .wIndex = itf,
+    .wLength = 0
+  };
+
+  dcd_event_setup_received(rhport, (uint8_t*) &req_set_interface, false);
+}
+
+// Class request to an entity of Audio Control interface
+static void entity_request(uint8_t dir_in, uint8_t req, uint8_t entity, uint8_t ctrl, uint8_t ch, uint16_t len)
+{
+  tusb_control_request_t const request =
+  {
+    .bmRequestType = (uint8_t) (dir_in ? 0xA1 : 0x21),
+    .bRequest      = req,
+    .wValue        = (uint16_t) ((ctrl << 8) | ch),
+    .wIndex        = (uint16_t) ((entity << 8) | ITF_NUM_AUDIO_CONTROL),
+    .wLength       = len
+  };
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request, false);
+}
+
+// SET CUR, expect_ok is false if the data is rejected in status stage
+static void set_cur(uint8_t entity, uint8_t ctrl, uint8_t ch, void const* data, uint16_t len, bool expect_ok)
+{
+  entity_request(0, AUDIO_CS_REQ_CUR, entity, ctrl, ch, len);
+
+  ctrl_data = data;
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_OUT, NULL, len, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_AddCallback(fill_ctrl_data);
+  tud_task();
+  dcd_edpt_xfer_Stub(NULL);
+
+  dcd_event_xfer_complete(rhport, EDPT_CTRL_OUT, len, XFER_RESULT_SUCCESS, false);
+
+  if ( expect_ok )
+  {
+    dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  }
+  else
+  {
+    dcd_edpt_stall_Expect(rhport, EDPT_CTRL_OUT);
+    dcd_edpt_stall_Expect(rhport, EDPT_CTRL_IN);
+  }
+
+  tud_task();
+}
+
+// GET request, data stage is expected to match
+static void get_request(uint8_t req, uint8_t entity, uint8_t ctrl, uint8_t ch, void const* expected, uint16_t len)
+{
+  entity_request(1, req, entity, ctrl, ch, len);
+
+  dcd_edpt_xfer_ExpectWithArrayAndReturn(rhport, EDPT_CTRL_IN, (uint8_t*) expected, len, len, true);
+  dcd_event_xfer_complete(rhport, EDPT_CTRL_IN, len, XFER_RESULT_SUCCESS, false);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_OUT, NULL, 0, true);
+
+  tud_task();
+}
+
+// Select speaker streaming setting: data OUT and feedback IN are started
+static void start_speaker(uint8_t const fb_expected[3])
+{
+  set_interface(ITF_NUM_AUDIO_SPEAKER, 1);
+
+  dcd_edpt_open_ExpectAndReturn(rhport, NULL, true);
+  dcd_edpt_open_IgnoreArg_p_endpoint_desc();
+  dcd_edpt_open_ExpectAndReturn(rhport, NULL, true);
+  dcd_edpt_open_IgnoreArg_p_endpoint_desc();
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_AUDIO_OUT, NULL, CFG_TUD_AUDIO_EPSIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_AddCallback(capture_out_buf);
+  dcd_edpt_xfer_ExpectWithArrayAndReturn(rhport, EDPT_AUDIO_FB, (uint8_t*) fb_expected, 3, 3, true);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+
+  tud_task();
+  dcd_edpt_xfer_Stub(NULL);
+}
+
+void setUp(void)
+{
+  dcd_int_disable_Ignore();
+  dcd_int_enable_Ignore();
+  dcd_edpt_close_Ignore();
+  mscd_init_Ignore();
+  mscd_reset_Ignore();
+
+  if ( !tusb_inited() )
+  {
+    dcd_init_Expect(rhport);
+    tusb_init();
+  }
+
+  dcd_event_bus_signal(rhport, DCD_EVENT_BUS_RESET, false);
+  tud_task();
+
+  out_buf      = NULL;
+  rx_streaming = false;
+  sample_rate  = 0;
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+void test_audio_speaker_stream(void)
+{
+  // 48 samples per frame in 10.14
+  uint8_t const fb_nominal[3] = { 0x00, 0x00, 0x0C };
+
+  uint8_t data[192];
+  uint8_t buf[192];
+  for(uint16_t i=0; i<sizeof(data); i++) data[i] = (uint8_t) i;
+
+  set_configuration();
+  TEST_ASSERT_FALSE(tud_audio_rx_streaming());
+
+  start_speaker(fb_nominal);
+  TEST_ASSERT_TRUE(rx_streaming);
+  TEST_ASSERT_TRUE(tud_audio_rx_streaming());
+  TEST_ASSERT_NOT_NULL(out_buf);
+
+  // one frame of 48 stereo 16-bit samples
+  memcpy(out_buf, data, sizeof(data));
+  dcd_event_xfer_complete(rhport, EDPT_AUDIO_OUT, sizeof(data), XFER_RESULT_SUCCESS, true);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_AUDIO_OUT, NULL, CFG_TUD_AUDIO_EPSIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  tud_task();
+
+  TEST_ASSERT_EQUAL(sizeof(data), tud_audio_available());
+
+  // fifo is 50 samples below half full: ask for 50/64 sample more per frame
+  dcd_event_bus_signal(rhport, DCD_EVENT_SOF, true);
+  tud_task();
+
+  uint8_t const fb_more[3] = { 0x00, 0x32, 0x0C };
+  dcd_event_xfer_complete(rhport, EDPT_AUDIO_FB, 3, XFER_RESULT_SUCCESS, true);
+  dcd_edpt_xfer_ExpectWithArrayAndReturn(rhport, EDPT_AUDIO_FB, (uint8_t*) fb_more, 3, 3, true);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(sizeof(buf), tud_audio_read(buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_MEMORY(data, buf, sizeof(data));
+
+  // back to zero bandwidth
+  set_interface(ITF_NUM_AUDIO_SPEAKER, 0);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  tud_task();
+
+  TEST_ASSERT_FALSE(rx_streaming);
+  TEST_ASSERT_FALSE(tud_audio_rx_streaming());
+}
+
+void test_audio_mic_stream(void)
+{
+  uint8_t data[2*192];
+  for(uint16_t i=0; i<sizeof(data); i++) data[i] = (uint8_t) i;
+
+  set_configuration();
+  TEST_ASSERT_EQUAL(sizeof(data), tud_audio_write(data, sizeof(data)));
+
+  // one frame worth of samples per packet
+  set_interface(ITF_NUM_AUDIO_MIC, 1);
+  dcd_edpt_open_ExpectAndReturn(rhport, NULL, true);
+  dcd_edpt_open_IgnoreArg_p_endpoint_desc();
+  dcd_edpt_xfer_ExpectWithArrayAndReturn(rhport, EDPT_AUDIO_IN, data, 192, 192, true);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  tud_task();
+
+  TEST_ASSERT_TRUE(tud_audio_tx_streaming());
+
+  dcd_event_xfer_complete(rhport, EDPT_AUDIO_IN, 192, XFER_RESULT_SUCCESS, true);
+  dcd_edpt_xfer_ExpectWithArrayAndReturn(rhport, EDPT_AUDIO_IN, data + 192, 192, 192, true);
+  tud_task();
+
+  // underrun: zero length packet
+  dcd_event_xfer_complete(rhport, EDPT_AUDIO_IN, 192, XFER_RESULT_SUCCESS, true);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_AUDIO_IN, NULL, 0, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  tud_task();
+}
+
+void test_audio_sample_rate(void)
+{
+  uint32_t const rate_cur = 48000;
+  uint32_t const rate_bad = 44100;
+  uint8_t  const valid    = 1;
+
+  set_configuration();
+
+  get_request(AUDIO_CS_REQ_CUR, CLOCK_ID, AUDIO_CS_CTRL_SAM_FREQ, 0, &rate_cur, 4);
+  get_request(AUDIO_CS_REQ_CUR, CLOCK_ID, AUDIO_CS_CTRL_CLK_VALID, 0, &valid, 1);
+
+  // rate that is not in the list is rejected
+  set_cur(CLOCK_ID, AUDIO_CS_CTRL_SAM_FREQ, 0, &rate_bad, 4, false);
+  TEST_ASSERT_EQUAL(0, sample_rate);
+
+  set_cur(CLOCK_ID, AUDIO_CS_CTRL_SAM_FREQ, 0, &rate_cur, 4, true);
+  TEST_ASSERT_EQUAL(48000, sample_rate);
+  TEST_ASSERT_EQUAL(48000, tud_audio_sample_rate());
+}
+
+void test_audio_volume(void)
+{
+  int16_t const range[4] = { 1, CFG_TUD_AUDIO_VOLUME_MIN, CFG_TUD_AUDIO_VOLUME_MAX, CFG_TUD_AUDIO_VOLUME_RES };
+  int16_t const vol      = -6*256;
+  int16_t const vol_bad  = 6*256;
+  uint8_t const mute     = 1;
+
+  set_configuration();
+
+  get_request(AUDIO_CS_REQ_RANGE, FU_SPK_ID, AUDIO_FU_CTRL_VOLUME, 1, range, sizeof(range));
+
+  set_cur(FU_SPK_ID, AUDIO_FU_CTRL_VOLUME, 1, &vol, 2, true);
+  TEST_ASSERT_EQUAL(vol, tud_audio_get_volume(FU_SPK_ID, 1));
+  get_request(AUDIO_CS_REQ_CUR, FU_SPK_ID, AUDIO_FU_CTRL_VOLUME, 1, &vol, 2);
+
+  // above maximum is rejected
+  set_cur(FU_SPK_ID, AUDIO_FU_CTRL_VOLUME, 1, &vol_bad, 2, false);
+  TEST_ASSERT_EQUAL(vol, tud_audio_get_volume(FU_SPK_ID, 1));
+
+  // microphone unit is independent
+  set_cur(FU_MIC_ID, AUDIO_FU_CTRL_MUTE, 0, &mute, 1, true);
+  TEST_ASSERT_TRUE(tud_audio_get_mute(FU_MIC_ID, 0));
+  TEST_ASSERT_FALSE(tud_audio_get_mute(FU_SPK_ID, 0));
+
+  // unknown entity is stalled
+  entity_request(1, AUDIO_CS_REQ_CUR, 9, AUDIO_FU_CTRL_MUTE, 0, 1);
+  dcd_edpt_stall_Expect(rhport, EDPT_CTRL_OUT);
+  dcd_edpt_stall_Expect(rhport, EDPT_CTRL_IN);
+  tud_task();
+}
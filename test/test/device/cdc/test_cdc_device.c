@@ -0,0 +1,399 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+
+#include <string.h>
+
+#include "unity.h"
+
+// Files to test
+#include "tusb_fifo.h"
+#include "tusb.h"
+#include "usbd.h"
+TEST_FILE("usbd_control.c")
+TEST_FILE("cdc_device.c")
+
+// Mock File
+#include "mock_dcd.h"
+#include "mock_msc_device.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  EDPT_CTRL_OUT  = 0x00,
+  EDPT_CTRL_IN   = 0x80,
+
+  EDPT_CDC_NOTIF = 0x81,
+  EDPT_CDC_OUT   = 0x02,
+  EDPT_CDC_IN    = 0x82,
+};
+
+uint8_t const rhport = 0;
+
+enum
+{
+  ITF_NUM_CDC,
+  ITF_NUM_CDC_DATA,
+  ITF_NUM_TOTAL
+};
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN)
+
+uint8_t const data_desc_configuration[] =
+{
+  // Interface count, string index, total length, attribute, power in mA
+  TUD_CONFIG_DESCRIPTOR(ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 100),
+
+  // Interface number, string index, EP notification address and size, EP data address (out, in) and size.
+  TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, 0, EDPT_CDC_NOTIF, 8, EDPT_CDC_OUT, EDPT_CDC_IN, CFG_TUD_CDC_EPSIZE),
+};
+
+tusb_control_request_t const request_set_configuration =
+{
+  .bmRequestType = 0x00,
+  .bRequest      = TUSB_REQ_SET_CONFIGURATION,
+  .wValue        = 1,
+  .wIndex        = 0,
+  .wLength       = 0
+};
+
+tusb_control_request_t const request_set_line_state =
+{
+  .bmRequestType = 0x21,
+  .bRequest      = CDC_REQUEST_SET_CONTROL_LINE_STATE,
+  .wValue        = 0x0003, // DTR + RTS
+  .wIndex        = ITF_NUM_CDC,
+  .wLength       = 0
+};
+
+uint8_t const* desc_configuration;
+
+// OUT transfer buffer armed by driver
+static uint8_t* out_buf;
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+uint8_t const * tud_descriptor_device_cb(void)
+{
+  return NULL;
+}
+
+uint8_t const * tud_descriptor_configuration_cb(uint8_t index)
+{
+  return desc_configuration;
+}
+
+uint16_t const* tud_descriptor_string_cb(uint8_t index)
+{
+  return NULL;
+}
+
+static uint32_t wanted_pos[16];
+static uint8_t  wanted_count;
+
+void tud_cdc_rx_wanted_pos_cb(uint8_t itf, char wanted_char, uint32_t pos)
+{
+  (void) itf;
+  TEST_ASSERT_EQUAL('\n', wanted_char);
+  if ( wanted_count < TU_ARRAY_SIZE(wanted_pos) ) wanted_pos[wanted_count] = pos;
+  wanted_count++;
+}
+
+static bool capture_out_buf(uint8_t port, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes, int cmock_num_calls)
+{
+  (void) port; (void) total_bytes; (void) cmock_num_calls;
+  if ( ep_addr == EDPT_CDC_OUT ) out_buf = buffer;
+  return true;
+}
+
+// Set configuration and DTR, OUT endpoint is armed with xfer_len
+static void mount_cdc(uint16_t xfer_len)
+{
+  desc_configuration = data_desc_configuration;
+  // skip configuration, IAD, interface and 4 functional descriptors
+  uint8_t const* desc_ep = desc_configuration;
+  for(uint8_t i=0; i<7; i++) desc_ep = tu_desc_next(desc_ep);
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+
+  dcd_set_config_Expect(rhport, 1);
+
+  // open endpoints
+  dcd_edpt_open_ExpectAndReturn(rhport, (tusb_desc_endpoint_t const *) desc_ep, true);
+  desc_ep = tu_desc_next(tu_desc_next(desc_ep));
+  dcd_edpt_open_ExpectAndReturn(rhport, (tusb_desc_endpoint_t const *) desc_ep, true);
+  dcd_edpt_open_ExpectAndReturn(rhport, (tusb_desc_endpoint_t const *) tu_desc_next(desc_ep), true);
+
+  // Prepare for incoming data
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CDC_OUT, NULL, xfer_len, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_AddCallback(capture_out_buf);
+
+  // control status
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+
+  tud_task();
+
+  dcd_edpt_xfer_Stub(NULL);
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_line_state, false);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+
+  tud_task();
+}
+
+void setUp(void)
+{
+  dcd_int_disable_Ignore();
+  dcd_int_enable_Ignore();
+  mscd_init_Ignore();
+  mscd_reset_Ignore();
+
+  if ( !tusb_inited() )
+  {
+    dcd_init_Expect(rhport);
+    tusb_init();
+  }
+
+  dcd_event_bus_signal(rhport, DCD_EVENT_BUS_RESET, false);
+  tud_task();
+
+  out_buf = NULL;
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+void test_cdc_rx_multi_packet(void)
+{
+  uint8_t data[CFG_TUD_CDC_RX_BUFSIZE];
+  uint8_t buf[CFG_TUD_CDC_RX_BUFSIZE];
+
+  for(uint16_t i=0; i<sizeof(data); i++) data[i] = (uint8_t) i;
+
+  // empty fifo: whole fifo is armed as one transfer
+  tud_cdc_set_rx_multi_packet(true);
+  mount_cdc(CFG_TUD_CDC_RX_BUFSIZE);
+  TEST_ASSERT_NOT_NULL(out_buf);
+
+  // 2 full packets and a short one received straight into fifo
+  uint16_t const len = 2*CFG_TUD_CDC_EPSIZE + 10;
+  memcpy(out_buf, data, len);
+  dcd_event_xfer_complete(rhport, EDPT_CDC_OUT, len, XFER_RESULT_SUCCESS, true);
+
+  // rearm with remaining linear space: free space is not word aligned, receive one packet at a time
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CDC_OUT, NULL, CFG_TUD_CDC_EPSIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  tud_task();
+
+  TEST_ASSERT_EQUAL(len, tud_cdc_available());
+  TEST_ASSERT_EQUAL(len, tud_cdc_read(buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_MEMORY(data, buf, len);
+
+  tud_cdc_set_rx_multi_packet(false);
+}
+
+void test_cdc_rx_single_packet(void)
+{
+  uint8_t data[2*CFG_TUD_CDC_EPSIZE];
+  uint8_t buf[2*CFG_TUD_CDC_EPSIZE];
+
+  for(uint16_t i=0; i<sizeof(data); i++) data[i] = (uint8_t) i;
+
+  // default: one packet even though fifo has room for more, host never has to send a ZLP
+  mount_cdc(CFG_TUD_CDC_EPSIZE);
+  TEST_ASSERT_NOT_NULL(out_buf);
+
+  // full packet received straight into fifo, next one follows it in fifo storage
+  uint8_t* const fifo_buf = out_buf;
+  memcpy(out_buf, data, CFG_TUD_CDC_EPSIZE);
+  dcd_event_xfer_complete(rhport, EDPT_CDC_OUT, CFG_TUD_CDC_EPSIZE, XFER_RESULT_SUCCESS, true);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CDC_OUT, fifo_buf + CFG_TUD_CDC_EPSIZE, CFG_TUD_CDC_EPSIZE, true);
+  tud_task();
+
+  memcpy(fifo_buf + CFG_TUD_CDC_EPSIZE, data + CFG_TUD_CDC_EPSIZE, CFG_TUD_CDC_EPSIZE);
+  dcd_event_xfer_complete(rhport, EDPT_CDC_OUT, CFG_TUD_CDC_EPSIZE, XFER_RESULT_SUCCESS, true);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CDC_OUT, NULL, CFG_TUD_CDC_EPSIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  tud_task();
+
+  TEST_ASSERT_EQUAL(sizeof(data), tud_cdc_read(buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_MEMORY(data, buf, sizeof(data));
+}
+
+void test_cdc_tx_ping_pong(void)
+{
+  uint8_t data[3*CFG_TUD_CDC_EPSIZE];
+  for(uint16_t i=0; i<sizeof(data); i++) data[i] = (uint8_t) i;
+
+  mount_cdc(CFG_TUD_CDC_EPSIZE);
+
+  TEST_ASSERT_EQUAL(sizeof(data), tud_cdc_write(data, sizeof(data)));
+
+  // first packet on the bus, second one is staged
+  dcd_edpt_xfer_ExpectWithArrayAndReturn(rhport, EDPT_CDC_IN, data, CFG_TUD_CDC_EPSIZE, CFG_TUD_CDC_EPSIZE, true);
+  TEST_ASSERT_TRUE(tud_cdc_write_flush());
+  TEST_ASSERT_EQUAL(CFG_TUD_CDC_TX_BUFSIZE - CFG_TUD_CDC_EPSIZE, tud_cdc_write_available());
+
+  // flush while busy does not start another transfer
+  TEST_ASSERT_TRUE(tud_cdc_write_flush());
+
+  // staged packet is sent on completion, the last one is staged
+  dcd_event_xfer_complete(rhport, EDPT_CDC_IN, CFG_TUD_CDC_EPSIZE, XFER_RESULT_SUCCESS, true);
+  dcd_edpt_xfer_ExpectWithArrayAndReturn(rhport, EDPT_CDC_IN, data + CFG_TUD_CDC_EPSIZE, CFG_TUD_CDC_EPSIZE, CFG_TUD_CDC_EPSIZE, true);
+  tud_task();
+
+  dcd_event_xfer_complete(rhport, EDPT_CDC_IN, CFG_TUD_CDC_EPSIZE, XFER_RESULT_SUCCESS, true);
+  dcd_edpt_xfer_ExpectWithArrayAndReturn(rhport, EDPT_CDC_IN, data + 2*CFG_TUD_CDC_EPSIZE, CFG_TUD_CDC_EPSIZE, CFG_TUD_CDC_EPSIZE, true);
+  tud_task();
+
+  // nothing left, ended on packet boundary: ZLP
+  dcd_event_xfer_complete(rhport, EDPT_CDC_IN, CFG_TUD_CDC_EPSIZE, XFER_RESULT_SUCCESS, true);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CDC_IN, NULL, 0, true);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(CFG_TUD_CDC_TX_BUFSIZE, tud_cdc_write_available());
+}
+
+void test_cdc_tx_flush_threshold(void)
+{
+  uint8_t data[CFG_TUD_CDC_EPSIZE];
+  for(uint16_t i=0; i<sizeof(data); i++) data[i] = (uint8_t) i;
+
+  mount_cdc(CFG_TUD_CDC_EPSIZE);
+  tud_cdc_set_tx_flush_policy(CFG_TUD_CDC_EPSIZE, 0);
+
+  // below threshold: nothing sent
+  tud_cdc_write(data, CFG_TUD_CDC_EPSIZE-1);
+
+  // reach threshold: whole packet is sent
+  dcd_edpt_xfer_ExpectWithArrayAndReturn(rhport, EDPT_CDC_IN, data, CFG_TUD_CDC_EPSIZE, CFG_TUD_CDC_EPSIZE, true);
+  tud_cdc_write(data + CFG_TUD_CDC_EPSIZE-1, 1);
+
+  // ended on packet boundary with no more data: ZLP
+  dcd_event_xfer_complete(rhport, EDPT_CDC_IN, CFG_TUD_CDC_EPSIZE, XFER_RESULT_SUCCESS, true);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CDC_IN, NULL, 0, true);
+  tud_task();
+
+  // ZLP complete
+  dcd_event_xfer_complete(rhport, EDPT_CDC_IN, 0, XFER_RESULT_SUCCESS, true);
+  tud_task();
+
+  tud_cdc_set_tx_flush_policy(0, 0);
+}
+
+void test_cdc_tx_flush_sof(void)
+{
+  uint8_t const data[] = "hello";
+
+  mount_cdc(CFG_TUD_CDC_EPSIZE);
+  tud_cdc_set_tx_flush_policy(0, 3);
+
+  // nothing to flush: SOF is not requested
+  dcd_event_bus_signal(rhport, DCD_EVENT_SOF, true);
+  TEST_ASSERT_EQUAL(0, tud_task_ext(0, 0));
+
+  tud_cdc_write(data, sizeof(data));
+
+  // 2 frames without write: still waiting
+  dcd_event_bus_signal(rhport, DCD_EVENT_SOF, true);
+  tud_task();
+  dcd_event_bus_signal(rhport, DCD_EVENT_SOF, true);
+  tud_task();
+
+  // SOFs are not queued while one is pending
+  dcd_event_bus_signal(rhport, DCD_EVENT_SOF, true);
+  dcd_event_bus_signal(rhport, DCD_EVENT_SOF, true);
+
+  // 3rd frame: partial packet is flushed
+  dcd_edpt_xfer_ExpectWithArrayAndReturn(rhport, EDPT_CDC_IN, (uint8_t*) data, sizeof(data), sizeof(data), true);
+  TEST_ASSERT_EQUAL(1, tud_task_ext(0, 0));
+
+  // short packet, no ZLP
+  dcd_event_xfer_complete(rhport, EDPT_CDC_IN, sizeof(data), XFER_RESULT_SUCCESS, true);
+  tud_task();
+
+  // everything flushed: SOF is released
+  dcd_event_bus_signal(rhport, DCD_EVENT_SOF, true);
+  TEST_ASSERT_EQUAL(0, tud_task_ext(0, 0));
+
+  tud_cdc_set_tx_flush_policy(0, 0);
+}
+
+void test_cdc_rx_wanted_char(void)
+{
+  // hits at every alignment, in words and in unaligned head/tail
+  char const line1[] = "ab\ncdefghij\n\nklmnopq\n";
+  char const line2[] = "rst\nuv\n";
+  uint32_t const expected[] = { 2, 11, 12, 20, 24, 27 };
+  uint8_t buf[64];
+
+  wanted_count = 0;
+  tud_cdc_set_wanted_char('\n');
+
+  mount_cdc(CFG_TUD_CDC_EPSIZE);
+
+  uint16_t const len1 = (uint16_t) strlen(line1);
+  memcpy(out_buf, line1, len1);
+  dcd_event_xfer_complete(rhport, EDPT_CDC_OUT, len1, XFER_RESULT_SUCCESS, true);
+
+  // free space is not word aligned: one packet
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CDC_OUT, NULL, CFG_TUD_CDC_EPSIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_AddCallback(capture_out_buf);
+  tud_task();
+  dcd_edpt_xfer_Stub(NULL);
+
+  // second transfer continues at fifo position len1
+  uint16_t const len2 = (uint16_t) strlen(line2);
+  memcpy(out_buf, line2, len2);
+  dcd_event_xfer_complete(rhport, EDPT_CDC_OUT, len2, XFER_RESULT_SUCCESS, true);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CDC_OUT, NULL, 0, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_IgnoreArg_total_bytes();
+  tud_task();
+
+  TEST_ASSERT_EQUAL(TU_ARRAY_SIZE(expected), wanted_count);
+  TEST_ASSERT_EQUAL_UINT32_ARRAY(expected, wanted_pos, TU_ARRAY_SIZE(expected));
+
+  // position + 1 is the length of the first line
+  TEST_ASSERT_EQUAL(expected[0]+1, tud_cdc_read(buf, expected[0]+1));
+  TEST_ASSERT_EQUAL_MEMORY("ab\n", buf, 3);
+
+  tud_cdc_set_wanted_char(-1);
+}
@@ -0,0 +1,160 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <string.h>
+#include "unity.h"
+
+// Files to test
+#include "tusb_option.h"
+#include "msc_cache.h"
+
+// Mock File
+#include "mock_msc_device.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+enum
+{
+  DISK_BLOCK_NUM  = 16,
+  DISK_BLOCK_SIZE = CFG_TUD_MSC_CACHE_BLOCK_SIZE
+};
+
+static uint8_t  disk[DISK_BLOCK_NUM][DISK_BLOCK_SIZE];
+static uint32_t app_read_count;
+static uint32_t app_write_count;
+
+static int32_t app_read(uint8_t lun, uint64_t lba, uint32_t offset, void* buffer, uint32_t bufsize, int cmock_num_calls)
+{
+  (void) lun; (void) cmock_num_calls;
+
+  app_read_count++;
+  memcpy(buffer, disk[lba] + offset, bufsize);
+  return (int32_t) bufsize;
+}
+
+static int32_t app_write(uint8_t lun, uint64_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize, int cmock_num_calls)
+{
+  (void) lun; (void) cmock_num_calls;
+
+  app_write_count++;
+  memcpy(disk[lba] + offset, buffer, bufsize);
+  return (int32_t) bufsize;
+}
+
+void setUp(void)
+{
+  mscd_get_block_size_IgnoreAndReturn(DISK_BLOCK_SIZE);
+  mscd_app_read_Stub(app_read);
+  mscd_app_write_Stub(app_write);
+
+  mscd_cache_invalidate(0);
+
+  for(uint32_t i=0; i<sizeof(disk); i++) ((uint8_t*) disk)[i] = (uint8_t) (i*7);
+  app_read_count  = 0;
+  app_write_count = 0;
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+void test_cache_read_hit(void)
+{
+  uint8_t buf[2*DISK_BLOCK_SIZE];
+  tud_msc_cache_stats_t before, after;
+  tud_msc_cache_get_stats(&before);
+
+  // both blocks come from application then stay in cache
+  TEST_ASSERT_EQUAL(sizeof(buf), mscd_cache_read(0, 2, 0, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL(1, app_read_count);
+  TEST_ASSERT_EQUAL_MEMORY(disk[2], buf, sizeof(buf));
+
+  memset(buf, 0, sizeof(buf));
+  TEST_ASSERT_EQUAL(sizeof(buf), mscd_cache_read(0, 2, 0, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL(1, app_read_count);
+  TEST_ASSERT_EQUAL_MEMORY(disk[2], buf, sizeof(buf));
+
+  tud_msc_cache_get_stats(&after);
+  TEST_ASSERT_EQUAL(2, after.miss - before.miss);
+  TEST_ASSERT_EQUAL(2, after.hit - before.hit);
+}
+
+void test_cache_write_back(void)
+{
+  uint8_t data[DISK_BLOCK_SIZE];
+  uint8_t buf[DISK_BLOCK_SIZE];
+  memset(data, 0x5A, sizeof(data));
+
+  TEST_ASSERT_EQUAL(sizeof(data), mscd_cache_write(0, 5, 0, data, sizeof(data)));
+  TEST_ASSERT_EQUAL(0, app_write_count);
+
+  tud_msc_cache_stats_t stats;
+  tud_msc_cache_get_stats(&stats);
+  TEST_ASSERT_EQUAL(1, stats.dirty);
+
+  // dirty block is read back from cache
+  TEST_ASSERT_EQUAL(sizeof(buf), mscd_cache_read(0, 5, 0, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL(0, app_read_count);
+  TEST_ASSERT_EQUAL_MEMORY(data, buf, sizeof(buf));
+
+  TEST_ASSERT_TRUE(mscd_cache_flush(0));
+  TEST_ASSERT_EQUAL(1, app_write_count);
+  TEST_ASSERT_EQUAL_MEMORY(data, disk[5], sizeof(data));
+
+  tud_msc_cache_get_stats(&stats);
+  TEST_ASSERT_EQUAL(0, stats.dirty);
+}
+
+void test_cache_lru_eviction(void)
+{
+  uint8_t data[DISK_BLOCK_SIZE];
+
+  // fill the cache with dirty blocks 0..N-1
+  for(uint8_t i=0; i<CFG_TUD_MSC_CACHE_BLOCKS; i++)
+  {
+    memset(data, i+1, sizeof(data));
+    TEST_ASSERT_EQUAL(sizeof(data), mscd_cache_write(0, i, 0, data, sizeof(data)));
+  }
+  TEST_ASSERT_EQUAL(0, app_write_count);
+
+  // block 0 becomes the most recently used
+  uint8_t buf[DISK_BLOCK_SIZE];
+  mscd_cache_read(0, 0, 0, buf, sizeof(buf));
+
+  // new block evicts block 1
+  memset(data, 0xEE, sizeof(data));
+  TEST_ASSERT_EQUAL(sizeof(data), mscd_cache_write(0, 10, 0, data, sizeof(data)));
+  TEST_ASSERT_EQUAL(1, app_write_count);
+  TEST_ASSERT_EACH_EQUAL_UINT8(2, disk[1], DISK_BLOCK_SIZE);
+
+  TEST_ASSERT_TRUE(mscd_cache_flush(0));
+  TEST_ASSERT_EQUAL(CFG_TUD_MSC_CACHE_BLOCKS + 1, app_write_count);
+  TEST_ASSERT_EACH_EQUAL_UINT8(0xEE, disk[10], DISK_BLOCK_SIZE);
+}
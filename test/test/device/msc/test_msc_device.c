@@ -89,6 +89,18 @@ enum
 
 uint8_t msc_disk[DISK_BLOCK_NUM][DISK_BLOCK_SIZE];
 
+// number of read10/write10 callback invocations
+uint32_t read10_count;
+uint32_t write10_count;
+uint32_t unit_ready_count;
+
+// read10/write10 callbacks return TUD_MSC_RET_ASYNC and the request is kept here
+bool     async_mode;
+uint32_t async_lba;
+uint32_t async_offset;
+uint8_t* async_buf;
+uint32_t async_size;
+
 // Invoked when received SCSI_CMD_INQUIRY
 // Application fill vendor id, product id and revision with string up to 8, 16, 4 characters respectively
 void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16], uint8_t product_rev[4])
@@ -109,6 +121,7 @@ void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16
 bool tud_msc_test_unit_ready_cb(uint8_t lun)
 {
   (void) lun;
+  unit_ready_count++;
 
   return true; // RAM disk is always ready
 }
@@ -139,6 +152,13 @@ bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, boo
 int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize)
 {
   (void) lun;
+  read10_count++;
+
+  if ( async_mode )
+  {
+    async_lba = lba; async_offset = offset; async_buf = buffer; async_size = bufsize;
+    return TUD_MSC_RET_ASYNC;
+  }
 
   uint8_t const* addr = msc_disk[lba] + offset;
   memcpy(buffer, addr, bufsize);
@@ -151,6 +171,13 @@ int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buff
 int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
 {
   (void) lun;
+  write10_count++;
+
+  if ( async_mode )
+  {
+    async_lba = lba; async_offset = offset; async_buf = buffer; async_size = bufsize;
+    return TUD_MSC_RET_ASYNC;
+  }
 
   uint8_t* addr = msc_disk[lba] + offset;
   memcpy(addr, buffer, bufsize);
@@ -202,6 +229,11 @@ void setUp(void)
 
   dcd_event_bus_signal(rhport, DCD_EVENT_BUS_RESET, false);
   tud_task();
+
+  read10_count  = 0;
+  write10_count = 0;
+  unit_ready_count = 0;
+  async_mode    = false;
 }
 
 void tearDown(void)
@@ -211,6 +243,44 @@ void tearDown(void)
 //--------------------------------------------------------------------+
 //
 //--------------------------------------------------------------------+
+// Configure device, cbw is received as the first command
+static void mount_msc(msc_cbw_t const* cbw)
+{
+  desc_configuration = data_desc_configuration;
+  uint8_t const* desc_ep = tu_desc_next(tu_desc_next(desc_configuration));
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+
+  dcd_set_config_Expect(rhport, 1);
+
+  // open endpoints
+  dcd_edpt_open_ExpectAndReturn(rhport, (tusb_desc_endpoint_t const *) desc_ep, true);
+  dcd_edpt_open_ExpectAndReturn(rhport, (tusb_desc_endpoint_t const *) tu_desc_next(desc_ep), true);
+
+  // Prepare SCSI command
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_OUT, NULL, sizeof(msc_cbw_t), true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer( (uint8_t*) cbw, sizeof(msc_cbw_t));
+
+  // command received
+  dcd_event_xfer_complete(rhport, EDPT_MSC_OUT, sizeof(msc_cbw_t), 0, true);
+
+  // control status
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+}
+
+static void expect_status(void)
+{
+  // SCSI Status
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, 13, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 13, 0, true);
+
+  // Prepare for next command
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_OUT, NULL, sizeof(msc_cbw_t), true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+}
+
 void test_msc(void)
 {
   // Read 1 LBA = 0, Block count = 1
@@ -233,41 +303,463 @@ void test_msc(void)
 
   memcpy(cbw_read10.command, &cmd_read10, cbw_read10.cmd_len);
 
-  desc_configuration = data_desc_configuration;
-  uint8_t const* desc_ep = tu_desc_next(tu_desc_next(desc_configuration));
+  mount_msc(&cbw_read10);
 
-  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+  // SCSI Data transfer
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, 512, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 512, 0, true); // complete
 
-  dcd_set_config_Expect(rhport, 1);
+  expect_status();
 
-  // open endpoints
-  dcd_edpt_open_ExpectAndReturn(rhport, (tusb_desc_endpoint_t const *) desc_ep, true);
-  dcd_edpt_open_ExpectAndReturn(rhport, (tusb_desc_endpoint_t const *) tu_desc_next(desc_ep), true);
+  tud_task();
+}
 
-  // Prepare SCSI command
-  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_OUT, NULL, sizeof(msc_cbw_t), true);
+// data seen on the bus by host
+static uint8_t  host_buf[4*DISK_BLOCK_SIZE];
+static uint32_t host_len;
+static uint8_t* data_buf[4];
+static uint32_t data_count;
+
+static bool capture_data(uint8_t port, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes, int cmock_num_calls)
+{
+  (void) port; (void) cmock_num_calls;
+
+  if ( ep_addr == EDPT_MSC_IN && total_bytes != sizeof(msc_csw_t) )
+  {
+    memcpy(host_buf + host_len, buffer, total_bytes);
+    host_len += total_bytes;
+  }
+
+  if ( (ep_addr == EDPT_MSC_IN || ep_addr == EDPT_MSC_OUT) && total_bytes == DISK_BLOCK_SIZE )
+  {
+    data_buf[data_count++] = buffer;
+  }
+
+  return true;
+}
+
+void test_msc_read10_pipelined(void)
+{
+  // Read 4 blocks from LBA = 2
+  msc_cbw_t cbw =
+  {
+    .signature   = MSC_CBW_SIGNATURE,
+    .tag         = 0xCAFECAFE,
+    .total_bytes = 4*DISK_BLOCK_SIZE,
+    .lun         = 0,
+    .dir         = TUSB_DIR_IN_MASK,
+    .cmd_len     = sizeof(scsi_read10_t)
+  };
+
+  scsi_read10_t cmd =
+  {
+      .cmd_code    = SCSI_CMD_READ_10,
+      .lba         = tu_htonl(2),
+      .block_count = tu_htons(4)
+  };
+
+  memcpy(cbw.command, &cmd, cbw.cmd_len);
+
+  for(uint32_t i=0; i<sizeof(msc_disk); i++) ((uint8_t*) msc_disk)[i] = (uint8_t) (i*7);
+  host_len   = 0;
+  data_count = 0;
+
+  mount_msc(&cbw);
+
+  // first chunk is sent as soon as it is read, second one is read while first is on the bus
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, DISK_BLOCK_SIZE, true);
   dcd_edpt_xfer_IgnoreArg_buffer();
-  dcd_edpt_xfer_ReturnMemThruPtr_buffer( (uint8_t*) &cbw_read10, sizeof(msc_cbw_t));
+  dcd_edpt_xfer_AddCallback(capture_data);
+  tud_task();
+  TEST_ASSERT_EQUAL(2, read10_count);
 
-  // command received
-  dcd_event_xfer_complete(rhport, EDPT_MSC_OUT, sizeof(msc_cbw_t), 0, true);
+  for(uint32_t i=1; i<4; i++)
+  {
+    dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, DISK_BLOCK_SIZE, true);
+    dcd_edpt_xfer_IgnoreArg_buffer();
+    dcd_event_xfer_complete(rhport, EDPT_MSC_IN, DISK_BLOCK_SIZE, 0, true);
+    tud_task();
 
-  // control status
-  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+    TEST_ASSERT_EQUAL(tu_min32(i+2, 4), read10_count);
+    TEST_ASSERT(data_buf[i] != data_buf[i-1]);
+  }
 
-  // SCSI Data transfer
-  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, 512, true);
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, DISK_BLOCK_SIZE, 0, true);
+  expect_status();
+  tud_task();
+  dcd_edpt_xfer_Stub(NULL);
+
+  TEST_ASSERT_EQUAL(4*DISK_BLOCK_SIZE, host_len);
+  TEST_ASSERT_EQUAL_MEMORY(msc_disk[2], host_buf, host_len);
+}
+
+void test_msc_write10_pipelined(void)
+{
+  // Write 3 blocks to LBA = 5
+  msc_cbw_t cbw =
+  {
+    .signature   = MSC_CBW_SIGNATURE,
+    .tag         = 0xCAFECAFE,
+    .total_bytes = 3*DISK_BLOCK_SIZE,
+    .lun         = 0,
+    .dir         = 0,
+    .cmd_len     = sizeof(scsi_write10_t)
+  };
+
+  scsi_write10_t cmd =
+  {
+      .cmd_code    = SCSI_CMD_WRITE_10,
+      .lba         = tu_htonl(5),
+      .block_count = tu_htons(3)
+  };
+
+  memcpy(cbw.command, &cmd, cbw.cmd_len);
+
+  for(uint32_t i=0; i<sizeof(host_buf); i++) host_buf[i] = (uint8_t) (i*3 + 1);
+  memset(msc_disk, 0, sizeof(msc_disk));
+  data_count = 0;
+
+  mount_msc(&cbw);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_OUT, NULL, DISK_BLOCK_SIZE, true);
   dcd_edpt_xfer_IgnoreArg_buffer();
-  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 512, 0, true); // complete
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer(host_buf, DISK_BLOCK_SIZE);
+  dcd_edpt_xfer_AddCallback(capture_data);
+  tud_task();
+  TEST_ASSERT_EQUAL(0, write10_count);
 
-  // SCSI Status
-  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, 13, true);
+  // next chunk is received while the previous one is written
+  for(uint32_t i=1; i<3; i++)
+  {
+    dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_OUT, NULL, DISK_BLOCK_SIZE, true);
+    dcd_edpt_xfer_IgnoreArg_buffer();
+    dcd_edpt_xfer_ReturnMemThruPtr_buffer(host_buf + i*DISK_BLOCK_SIZE, DISK_BLOCK_SIZE);
+    dcd_event_xfer_complete(rhport, EDPT_MSC_OUT, DISK_BLOCK_SIZE, 0, true);
+    tud_task();
+
+    TEST_ASSERT_EQUAL(i, write10_count);
+    TEST_ASSERT(data_buf[i] != data_buf[i-1]);
+  }
+
+  dcd_event_xfer_complete(rhport, EDPT_MSC_OUT, DISK_BLOCK_SIZE, 0, true);
+  expect_status();
+  tud_task();
+  dcd_edpt_xfer_Stub(NULL);
+
+  TEST_ASSERT_EQUAL(3, write10_count);
+  TEST_ASSERT_EQUAL_MEMORY(host_buf, msc_disk[5], 3*DISK_BLOCK_SIZE);
+}
+
+void test_msc_read10_async(void)
+{
+  // Read 2 blocks from LBA = 1
+  msc_cbw_t cbw =
+  {
+    .signature   = MSC_CBW_SIGNATURE,
+    .tag         = 0xCAFECAFE,
+    .total_bytes = 2*DISK_BLOCK_SIZE,
+    .lun         = 0,
+    .dir         = TUSB_DIR_IN_MASK,
+    .cmd_len     = sizeof(scsi_read10_t)
+  };
+
+  scsi_read10_t cmd =
+  {
+      .cmd_code    = SCSI_CMD_READ_10,
+      .lba         = tu_htonl(1),
+      .block_count = tu_htons(2)
+  };
+
+  memcpy(cbw.command, &cmd, cbw.cmd_len);
+
+  for(uint32_t i=0; i<sizeof(msc_disk); i++) ((uint8_t*) msc_disk)[i] = (uint8_t) (i*5);
+  host_len   = 0;
+  data_count = 0;
+  async_mode = true;
+
+  mount_msc(&cbw);
+  dcd_edpt_xfer_AddCallback(capture_data);
+
+  // request is submitted once, no polling while it is pending
+  tud_task();
+  tud_task();
+  TEST_ASSERT_EQUAL(1, read10_count);
+  TEST_ASSERT_EQUAL(1, async_lba);
+
+  // complete first block: it is sent and next one is submitted
+  memcpy(async_buf, msc_disk[async_lba] + async_offset, async_size);
+  TEST_ASSERT(tud_msc_async_done(0, async_size, true));
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, DISK_BLOCK_SIZE, true);
   dcd_edpt_xfer_IgnoreArg_buffer();
-  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 13, 0, true);
+  tud_task();
+  TEST_ASSERT_EQUAL(2, read10_count);
+  TEST_ASSERT_EQUAL(2, async_lba);
 
-  // Prepare for next command
-  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_OUT, NULL, sizeof(msc_cbw_t), true);
+  // second block is complete while first is still on the bus
+  memcpy(async_buf, msc_disk[async_lba] + async_offset, async_size);
+  TEST_ASSERT(tud_msc_async_done(0, async_size, false));
+  tud_task();
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, DISK_BLOCK_SIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, DISK_BLOCK_SIZE, 0, true);
+  tud_task();
+
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, DISK_BLOCK_SIZE, 0, true);
+  expect_status();
+  tud_task();
+  dcd_edpt_xfer_Stub(NULL);
+
+  TEST_ASSERT_EQUAL(2, read10_count);
+  TEST_ASSERT_EQUAL(2*DISK_BLOCK_SIZE, host_len);
+  TEST_ASSERT_EQUAL_MEMORY(msc_disk[1], host_buf, host_len);
+}
+
+void test_msc_async_done_after_reset(void)
+{
+  // Read 1 block from LBA = 4
+  msc_cbw_t cbw =
+  {
+    .signature   = MSC_CBW_SIGNATURE,
+    .tag         = 0xCAFECAFE,
+    .total_bytes = DISK_BLOCK_SIZE,
+    .lun         = 0,
+    .dir         = TUSB_DIR_IN_MASK,
+    .cmd_len     = sizeof(scsi_read10_t)
+  };
+
+  scsi_read10_t cmd =
+  {
+      .cmd_code    = SCSI_CMD_READ_10,
+      .lba         = tu_htonl(4),
+      .block_count = tu_htons(1)
+  };
+
+  memcpy(cbw.command, &cmd, cbw.cmd_len);
+
+  for(uint32_t i=0; i<sizeof(msc_disk); i++) ((uint8_t*) msc_disk)[i] = (uint8_t) (i*3);
+  host_len   = 0;
+  data_count = 0;
+  async_mode = true;
+
+  mount_msc(&cbw);
+  tud_task();
+  TEST_ASSERT_EQUAL(1, read10_count);
+
+  // bus reset while request is pending, host then issues the same command again
+  dcd_event_bus_signal(rhport, DCD_EVENT_BUS_RESET, false);
+  tud_task();
+
+  mount_msc(&cbw);
+
+  // completion of the cancelled request is reported late, it must not complete the new one
+  TEST_ASSERT(tud_msc_async_done(0, -1, false));
+  tud_task();
+  TEST_ASSERT_EQUAL(2, read10_count);
+
+  dcd_edpt_xfer_AddCallback(capture_data);
+  memcpy(async_buf, msc_disk[async_lba] + async_offset, async_size);
+  TEST_ASSERT(tud_msc_async_done(0, async_size, false));
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, DISK_BLOCK_SIZE, true);
   dcd_edpt_xfer_IgnoreArg_buffer();
+  tud_task();
+
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, DISK_BLOCK_SIZE, 0, true);
+  expect_status();
+  tud_task();
+  dcd_edpt_xfer_Stub(NULL);
 
+  TEST_ASSERT_EQUAL(2, read10_count);
+  TEST_ASSERT_EQUAL(DISK_BLOCK_SIZE, host_len);
+  TEST_ASSERT_EQUAL_MEMORY(msc_disk[4], host_buf, host_len);
+}
+
+void test_msc_write10_async(void)
+{
+  // Write 2 blocks to LBA = 3
+  msc_cbw_t cbw =
+  {
+    .signature   = MSC_CBW_SIGNATURE,
+    .tag         = 0xCAFECAFE,
+    .total_bytes = 2*DISK_BLOCK_SIZE,
+    .lun         = 0,
+    .dir         = 0,
+    .cmd_len     = sizeof(scsi_write10_t)
+  };
+
+  scsi_write10_t cmd =
+  {
+      .cmd_code    = SCSI_CMD_WRITE_10,
+      .lba         = tu_htonl(3),
+      .block_count = tu_htons(2)
+  };
+
+  memcpy(cbw.command, &cmd, cbw.cmd_len);
+
+  for(uint32_t i=0; i<sizeof(host_buf); i++) host_buf[i] = (uint8_t) (i*11 + 3);
+  memset(msc_disk, 0, sizeof(msc_disk));
+  async_mode = true;
+
+  mount_msc(&cbw);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_OUT, NULL, DISK_BLOCK_SIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer(host_buf, DISK_BLOCK_SIZE);
   tud_task();
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_OUT, NULL, DISK_BLOCK_SIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer(host_buf + DISK_BLOCK_SIZE, DISK_BLOCK_SIZE);
+  dcd_event_xfer_complete(rhport, EDPT_MSC_OUT, DISK_BLOCK_SIZE, 0, true);
+  tud_task();
+
+  // second block is received while the first one is pending, nothing is polled
+  dcd_event_xfer_complete(rhport, EDPT_MSC_OUT, DISK_BLOCK_SIZE, 0, true);
+  tud_task();
+  tud_task();
+  TEST_ASSERT_EQUAL(1, write10_count);
+
+  memcpy(msc_disk[async_lba] + async_offset, async_buf, async_size);
+  TEST_ASSERT(tud_msc_async_done(0, async_size, true));
+  tud_task();
+  TEST_ASSERT_EQUAL(2, write10_count);
+
+  memcpy(msc_disk[async_lba] + async_offset, async_buf, async_size);
+  TEST_ASSERT(tud_msc_async_done(0, async_size, false));
+  expect_status();
+  tud_task();
+
+  TEST_ASSERT_EQUAL(2, write10_count);
+  TEST_ASSERT_EQUAL_MEMORY(host_buf, msc_disk[3], 2*DISK_BLOCK_SIZE);
+}
+
+void test_msc_read16(void)
+{
+  // Read 3 blocks from LBA = 7
+  msc_cbw_t cbw =
+  {
+    .signature   = MSC_CBW_SIGNATURE,
+    .tag         = 0xCAFECAFE,
+    .total_bytes = 3*DISK_BLOCK_SIZE,
+    .lun         = 0,
+    .dir         = TUSB_DIR_IN_MASK,
+    .cmd_len     = sizeof(scsi_read16_t)
+  };
+
+  // 64-bit lba and 32-bit block count, Big Endian
+  uint8_t const cmd[16] = { SCSI_CMD_READ_16, 0, 0, 0, 0, 0, 0, 0, 0, 7, 0, 0, 0, 3, 0, 0 };
+  memcpy(cbw.command, cmd, sizeof(cmd));
+
+  for(uint32_t i=0; i<sizeof(msc_disk); i++) ((uint8_t*) msc_disk)[i] = (uint8_t) (i*13);
+  host_len   = 0;
+  data_count = 0;
+
+  mount_msc(&cbw);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, DISK_BLOCK_SIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_AddCallback(capture_data);
+  tud_task();
+
+  for(uint32_t i=1; i<3; i++)
+  {
+    dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, DISK_BLOCK_SIZE, true);
+    dcd_edpt_xfer_IgnoreArg_buffer();
+    dcd_event_xfer_complete(rhport, EDPT_MSC_IN, DISK_BLOCK_SIZE, 0, true);
+    tud_task();
+  }
+
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, DISK_BLOCK_SIZE, 0, true);
+  expect_status();
+  tud_task();
+  dcd_edpt_xfer_Stub(NULL);
+
+  TEST_ASSERT_EQUAL(3, read10_count);
+  TEST_ASSERT_EQUAL(3*DISK_BLOCK_SIZE, host_len);
+  TEST_ASSERT_EQUAL_MEMORY(msc_disk[7], host_buf, host_len);
+}
+
+void test_msc_read_capacity16(void)
+{
+  msc_cbw_t cbw =
+  {
+    .signature   = MSC_CBW_SIGNATURE,
+    .tag         = 0xCAFECAFE,
+    .total_bytes = 32,
+    .lun         = 0,
+    .dir         = TUSB_DIR_IN_MASK,
+    .cmd_len     = sizeof(scsi_read_capacity16_t)
+  };
+
+  uint8_t const cmd[16] = { SCSI_CMD_SERVICE_ACTION_IN_16, SCSI_SERVICE_ACTION_READ_CAPACITY_16, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 32, 0, 0 };
+  memcpy(cbw.command, cmd, sizeof(cmd));
+
+  host_len = 0;
+
+  mount_msc(&cbw);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, 32, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_AddCallback(capture_data);
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 32, 0, true);
+  expect_status();
+  tud_task();
+  dcd_edpt_xfer_Stub(NULL);
+
+  // last lba (64-bit) and block size (32-bit), Big Endian
+  uint8_t const resp[12] = { 0, 0, 0, 0, 0, 0, 0, DISK_BLOCK_NUM-1, 0, 0, DISK_BLOCK_SIZE >> 8, DISK_BLOCK_SIZE & 0xff };
+
+  TEST_ASSERT_EQUAL(32, host_len);
+  TEST_ASSERT_EQUAL_MEMORY(resp, host_buf, sizeof(resp));
+}
+
+void test_msc_lun_state(void)
+{
+  msc_cbw_t cbw =
+  {
+    .signature   = MSC_CBW_SIGNATURE,
+    .tag         = 0xCAFECAFE,
+    .total_bytes = 0,
+    .lun         = 0,
+    .dir         = 0,
+    .cmd_len     = sizeof(scsi_test_unit_ready_t)
+  };
+
+  cbw.command[0] = SCSI_CMD_TEST_UNIT_READY;
+
+  mount_msc(&cbw);
+
+  // second TEST UNIT READY is answered from cache
+  expect_status();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer((uint8_t*) &cbw, sizeof(msc_cbw_t));
+  dcd_event_xfer_complete(rhport, EDPT_MSC_OUT, sizeof(msc_cbw_t), 0, true);
+  expect_status();
+  tud_task();
+
+  TEST_ASSERT_EQUAL(1, unit_ready_count);
+
+  // medium changed
+  tud_msc_lun_invalidate(0);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, sizeof(msc_csw_t), true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_event_xfer_complete(rhport, EDPT_MSC_OUT, sizeof(msc_cbw_t), 0, true);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(2, unit_ready_count);
+
+  // sense data is kept per LUN
+  uint8_t key, asc, ascq;
+  TEST_ASSERT_TRUE(tud_msc_set_sense(1, SCSI_SENSE_NOT_READY, 0x3A, 0x00));
+
+  mscd_get_sense(0, &key, &asc, &ascq);
+  TEST_ASSERT_EQUAL(SCSI_SENSE_NONE, key);
+
+  mscd_get_sense(1, &key, &asc, &ascq);
+  TEST_ASSERT_EQUAL(SCSI_SENSE_NOT_READY, key);
+  TEST_ASSERT_EQUAL(0x3A, asc);
+
+  TEST_ASSERT_FALSE(tud_msc_set_sense(CFG_TUD_MSC_MAX_LUN, SCSI_SENSE_NOT_READY, 0x3A, 0x00));
 }
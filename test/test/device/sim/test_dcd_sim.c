@@ -0,0 +1,264 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+
+#include <pthread.h>
+#include <string.h>
+
+#include "unity.h"
+
+// Files to test
+#include "tusb_fifo.h"
+#include "tusb.h"
+#include "usbd.h"
+#include "dcd_sim.h"
+TEST_FILE("usbd_control.c")
+TEST_FILE("cdc_device.c")
+TEST_FILE("dcd_sim.c")
+TEST_FILE("sim_host.c")
+
+// Mock File
+#include "mock_msc_device.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  EDPT_CDC_NOTIF = 0x81,
+  EDPT_CDC_OUT   = 0x02,
+  EDPT_CDC_IN    = 0x82,
+};
+
+enum
+{
+  ITF_NUM_CDC,
+  ITF_NUM_CDC_DATA,
+  ITF_NUM_TOTAL
+};
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN)
+
+tusb_desc_device_t const desc_device =
+{
+  .bLength            = sizeof(tusb_desc_device_t),
+  .bDescriptorType    = TUSB_DESC_DEVICE,
+  .bcdUSB             = 0x0200,
+  .bDeviceClass       = TUSB_CLASS_MISC,
+  .bDeviceSubClass    = MISC_SUBCLASS_COMMON,
+  .bDeviceProtocol    = MISC_PROTOCOL_IAD,
+  .bMaxPacketSize0    = CFG_TUD_ENDPOINT0_SIZE,
+  .idVendor           = 0xCafe,
+  .idProduct          = 0x4000,
+  .bcdDevice          = 0x0100,
+  .bNumConfigurations = 0x01
+};
+
+uint8_t const desc_configuration[] =
+{
+  // Interface count, string index, total length, attribute, power in mA
+  TUD_CONFIG_DESCRIPTOR(ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 100),
+
+  // Interface number, string index, EP notification address and size, EP data address (out, in) and size.
+  TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, 0, EDPT_CDC_NOTIF, 8, EDPT_CDC_OUT, EDPT_CDC_IN, CFG_TUD_CDC_EPSIZE),
+};
+
+tusb_control_request_t const request_set_line_state =
+{
+  .bmRequestType = 0x21,
+  .bRequest      = CDC_REQUEST_SET_CONTROL_LINE_STATE,
+  .wValue        = 0x0003, // DTR + RTS
+  .wIndex        = ITF_NUM_CDC,
+  .wLength       = 0
+};
+
+tusb_control_request_t const request_get_device_desc =
+{
+  .bmRequestType = 0x80,
+  .bRequest      = TUSB_REQ_GET_DESCRIPTOR,
+  .wValue        = TUSB_DESC_DEVICE << 8,
+  .wIndex        = 0,
+  .wLength       = sizeof(tusb_desc_device_t)
+};
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+uint8_t const * tud_descriptor_device_cb(void)
+{
+  return (uint8_t const*) &desc_device;
+}
+
+uint8_t const * tud_descriptor_configuration_cb(uint8_t index)
+{
+  return desc_configuration;
+}
+
+uint16_t const* tud_descriptor_string_cb(uint8_t index)
+{
+  return NULL;
+}
+
+// Host thread plays the bus while test thread runs device task as application would
+static volatile bool host_done;
+static bool host_result;
+
+static void* host_thread(void* param)
+{
+  bool (*host_fn)(void) = (bool (*)(void)) param;
+
+  host_result = host_fn();
+  host_done = true;
+
+  return NULL;
+}
+
+// Run host function to completion, echo CDC data back meanwhile
+static bool run_host(bool (*host_fn)(void))
+{
+  pthread_t thread;
+
+  host_done = false;
+  TEST_ASSERT_EQUAL(0, pthread_create(&thread, NULL, host_thread, (void*) host_fn));
+
+  while ( !host_done )
+  {
+    tud_task();
+
+    if ( tud_mounted() && tud_cdc_available() )
+    {
+      uint8_t buf[64];
+      uint32_t count = tud_cdc_read(buf, sizeof(buf));
+
+      tud_cdc_write(buf, count);
+      tud_cdc_write_flush();
+    }
+  }
+
+  pthread_join(thread, NULL);
+
+  return host_result;
+}
+
+void setUp(void)
+{
+  mscd_init_Ignore();
+  mscd_reset_Ignore();
+
+  tusb_init();
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+// Virtual host
+//--------------------------------------------------------------------+
+
+static bool host_echo(void)
+{
+  char const message[] = "hello tinyusb";
+  char buf[64];
+  uint16_t len;
+
+  TU_VERIFY( sim_host_enumerate() );
+  TU_VERIFY( sim_host_control(&request_set_line_state, NULL, NULL) );
+
+  TU_VERIFY( SIM_XACT_ACK == sim_host_out(EDPT_CDC_OUT, message, sizeof(message)) );
+
+  // device may not have echoed yet
+  sim_xact_t ret;
+  do
+  {
+    ret = sim_host_in(EDPT_CDC_IN, buf, sizeof(buf), &len);
+  } while ( ret == SIM_XACT_NAK );
+
+  TU_VERIFY( ret == SIM_XACT_ACK && len == sizeof(message) );
+  return 0 == memcmp(buf, message, len);
+}
+
+static bool host_unsupported_request(void)
+{
+  tusb_control_request_t const request =
+  {
+    .bmRequestType = 0x80,
+    .bRequest      = 0x99,
+    .wValue        = 0,
+    .wIndex        = 0,
+    .wLength       = 1
+  };
+
+  uint8_t buf[sizeof(tusb_desc_device_t)];
+  uint16_t len;
+
+  TU_VERIFY( sim_host_enumerate() );
+
+  // Request is stalled, next setup clears stall
+  TU_VERIFY( !sim_host_control(&request, buf, &len) );
+  TU_VERIFY( sim_host_control(&request_get_device_desc, buf, &len) );
+
+  return (len == sizeof(buf)) && (0 == memcmp(buf, &desc_device, len));
+}
+
+static bool host_frames(void)
+{
+  TU_VERIFY( sim_host_enumerate() );
+
+  uint32_t const start = sim_host_frame_count();
+  for(uint32_t i=0; i<0x800; i++) sim_host_frame();
+
+  // 11-bit frame number wraps around
+  return sim_host_frame_count() == start;
+}
+
+//--------------------------------------------------------------------+
+// Test
+//--------------------------------------------------------------------+
+
+void test_dcd_sim_enumerate(void)
+{
+  TEST_ASSERT_TRUE( run_host(sim_host_enumerate) );
+  TEST_ASSERT_TRUE( tud_mounted() );
+}
+
+void test_dcd_sim_cdc_echo(void)
+{
+  TEST_ASSERT_TRUE( run_host(host_echo) );
+  TEST_ASSERT_TRUE( tud_cdc_connected() );
+}
+
+void test_dcd_sim_stall(void)
+{
+  TEST_ASSERT_TRUE( run_host(host_unsupported_request) );
+  TEST_ASSERT_TRUE( tud_mounted() );
+}
+
+void test_dcd_sim_frame_count(void)
+{
+  TEST_ASSERT_TRUE( run_host(host_frames) );
+}
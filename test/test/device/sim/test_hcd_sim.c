@@ -0,0 +1,269 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "unity.h"
+
+// Files to test
+#include "tusb_fifo.h"
+#include "tusb.h"
+#include "dcd_sim.h"
+TEST_FILE("usbd.c")
+TEST_FILE("usbd_control.c")
+TEST_FILE("msc_device.c")
+TEST_FILE("usbh.c")
+TEST_FILE("msc_host.c")
+TEST_FILE("dcd_sim.c")
+TEST_FILE("hcd_sim.c")
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  DEV_ADDR       = 1,
+  EDPT_MSC_OUT   = 0x01,
+  EDPT_MSC_IN    = 0x81,
+
+  BLOCK_SIZE     = 512,
+  BLOCK_COUNT    = 32,
+  XFER_BLOCKS    = 16,
+
+  TIMEOUT_MS     = 5000
+};
+
+enum
+{
+  ITF_NUM_MSC,
+  ITF_NUM_TOTAL
+};
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + TUD_MSC_DESC_LEN)
+
+tusb_desc_device_t const desc_device =
+{
+  .bLength            = sizeof(tusb_desc_device_t),
+  .bDescriptorType    = TUSB_DESC_DEVICE,
+  .bcdUSB             = 0x0200,
+  .bDeviceClass       = 0x00,
+  .bDeviceSubClass    = 0x00,
+  .bDeviceProtocol    = 0x00,
+  .bMaxPacketSize0    = CFG_TUD_ENDPOINT0_SIZE,
+  .idVendor           = 0xCafe,
+  .idProduct          = 0x4001,
+  .bcdDevice          = 0x0100,
+  .bNumConfigurations = 0x01
+};
+
+uint8_t const desc_configuration[] =
+{
+  // Interface count, string index, total length, attribute, power in mA
+  TUD_CONFIG_DESCRIPTOR(ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 100),
+
+  // Interface number, string index, EP Out & EP In address, EP size
+  TUD_MSC_DESCRIPTOR(ITF_NUM_MSC, 0, EDPT_MSC_OUT, EDPT_MSC_IN, 64),
+};
+
+static uint8_t ram_disk[BLOCK_COUNT][BLOCK_SIZE];
+
+static volatile bool     host_xfer_done;
+static volatile uint8_t  host_xfer_result;
+
+//--------------------------------------------------------------------+
+// Device callbacks
+//--------------------------------------------------------------------+
+uint8_t const * tud_descriptor_device_cb(void)
+{
+  return (uint8_t const*) &desc_device;
+}
+
+uint8_t const * tud_descriptor_configuration_cb(uint8_t index)
+{
+  return desc_configuration;
+}
+
+uint16_t const* tud_descriptor_string_cb(uint8_t index)
+{
+  return NULL;
+}
+
+void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16], uint8_t product_rev[4])
+{
+  memcpy(vendor_id  , "TinyUSB ", 8);
+  memcpy(product_id , "Loopback Disk   ", 16);
+  memcpy(product_rev, "1.0 ", 4);
+}
+
+bool tud_msc_test_unit_ready_cb(uint8_t lun)
+{
+  return true;
+}
+
+void tud_msc_capacity_cb(uint8_t lun, uint32_t* block_count, uint16_t* block_size)
+{
+  (*block_count) = BLOCK_COUNT;
+  (*block_size)  = BLOCK_SIZE;
+}
+
+int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize)
+{
+  memcpy(buffer, ram_disk[lba] + offset, bufsize);
+  return (int32_t) bufsize;
+}
+
+int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+{
+  memcpy(ram_disk[lba] + offset, buffer, bufsize);
+  return (int32_t) bufsize;
+}
+
+int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void* buffer, uint16_t bufsize)
+{
+  return -1;
+}
+
+//--------------------------------------------------------------------+
+// Host callbacks
+//--------------------------------------------------------------------+
+void tuh_msc_mounted_cb(uint8_t dev_addr)
+{
+  (void) dev_addr;
+}
+
+void tuh_msc_unmounted_cb(uint8_t dev_addr)
+{
+  (void) dev_addr;
+}
+
+void tuh_msc_isr(uint8_t dev_addr, xfer_result_t event, uint32_t xferred_bytes)
+{
+  (void) dev_addr; (void) xferred_bytes;
+
+  host_xfer_result = event;
+  host_xfer_done   = true;
+}
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+static uint32_t millis(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t) (ts.tv_sec*1000 + ts.tv_nsec/1000000);
+}
+
+// Device stack runs in its own thread, host stack in test thread
+static void* device_thread(void* param)
+{
+  (void) param;
+  while (1) tud_task();
+  return NULL;
+}
+
+static void wait_mounted(void)
+{
+  static bool started = false;
+
+  if ( !started )
+  {
+    pthread_t thread;
+
+    started = true;
+    tusb_init();
+    TEST_ASSERT_EQUAL(0, pthread_create(&thread, NULL, device_thread, NULL));
+  }
+
+  uint32_t const start = millis();
+  while ( !tuh_msc_is_mounted(DEV_ADDR) && (millis() - start < TIMEOUT_MS) ) tuh_task();
+
+  TEST_ASSERT_TRUE( tuh_msc_is_mounted(DEV_ADDR) );
+}
+
+static void wait_xfer(void)
+{
+  uint32_t const start = millis();
+  while ( !host_xfer_done && (millis() - start < TIMEOUT_MS) ) tuh_task();
+
+  TEST_ASSERT_TRUE( host_xfer_done );
+  TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, host_xfer_result);
+}
+
+void setUp(void)
+{
+  host_xfer_done = false;
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+// Test
+//--------------------------------------------------------------------+
+
+void test_hcd_sim_msc_mount(void)
+{
+  wait_mounted();
+
+  TEST_ASSERT_TRUE( tud_mounted() );
+  TEST_ASSERT_EQUAL_MEMORY("TinyUSB ", tuh_msc_get_vendor_name(DEV_ADDR), 8);
+
+  uint32_t last_lba, block_size;
+  TEST_ASSERT_EQUAL(TUSB_ERROR_NONE, tuh_msc_get_capacity(DEV_ADDR, &last_lba, &block_size));
+  TEST_ASSERT_EQUAL(BLOCK_COUNT-1, last_lba);
+  TEST_ASSERT_EQUAL(BLOCK_SIZE, block_size);
+}
+
+void test_hcd_sim_msc_write_read(void)
+{
+  static uint8_t data[XFER_BLOCKS*BLOCK_SIZE];
+  static uint8_t readback[XFER_BLOCKS*BLOCK_SIZE];
+
+  wait_mounted();
+
+  for(uint32_t i=0; i<sizeof(data); i++) data[i] = (uint8_t) (i + i/BLOCK_SIZE);
+
+  uint64_t const start_us = sim_hcd_time_us();
+
+  TEST_ASSERT_EQUAL(TUSB_ERROR_NONE, tuh_msc_write10(DEV_ADDR, 0, data, 8, XFER_BLOCKS));
+  wait_xfer();
+  TEST_ASSERT_EQUAL_MEMORY(data, ram_disk[8], sizeof(data));
+
+  host_xfer_done = false;
+  TEST_ASSERT_EQUAL(TUSB_ERROR_NONE, tuh_msc_read10(DEV_ADDR, 0, readback, 8, XFER_BLOCKS));
+  wait_xfer();
+  TEST_ASSERT_EQUAL_MEMORY(data, readback, sizeof(data));
+
+  // Full speed bulk moves at most 19 packets of 64 bytes per 1 ms frame
+  TEST_ASSERT_TRUE( sim_hcd_time_us() - start_us >= 1000*(2*sizeof(data)/(19*64)) );
+}
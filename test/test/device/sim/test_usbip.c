@@ -0,0 +1,441 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "unity.h"
+
+// Files to test
+#include "tusb_fifo.h"
+#include "tusb.h"
+#include "usbd.h"
+#include "dcd_sim.h"
+TEST_FILE("usbd_control.c")
+TEST_FILE("cdc_device.c")
+TEST_FILE("dcd_sim.c")
+TEST_FILE("usbip_server.c")
+
+// Mock File
+#include "mock_msc_device.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  EDPT_CDC_NOTIF = 0x81,
+  EDPT_CDC_OUT   = 0x02,
+  EDPT_CDC_IN    = 0x82,
+};
+
+enum
+{
+  ITF_NUM_CDC,
+  ITF_NUM_CDC_DATA,
+  ITF_NUM_TOTAL
+};
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN)
+
+tusb_desc_device_t const desc_device =
+{
+  .bLength            = sizeof(tusb_desc_device_t),
+  .bDescriptorType    = TUSB_DESC_DEVICE,
+  .bcdUSB             = 0x0200,
+  .bDeviceClass       = TUSB_CLASS_MISC,
+  .bDeviceSubClass    = MISC_SUBCLASS_COMMON,
+  .bDeviceProtocol    = MISC_PROTOCOL_IAD,
+  .bMaxPacketSize0    = CFG_TUD_ENDPOINT0_SIZE,
+  .idVendor           = 0xCafe,
+  .idProduct          = 0x4000,
+  .bcdDevice          = 0x0100,
+  .bNumConfigurations = 0x01
+};
+
+uint8_t const desc_configuration[] =
+{
+  // Interface count, string index, total length, attribute, power in mA
+  TUD_CONFIG_DESCRIPTOR(ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 100),
+
+  // Interface number, string index, EP notification address and size, EP data address (out, in) and size.
+  TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, 0, EDPT_CDC_NOTIF, 8, EDPT_CDC_OUT, EDPT_CDC_IN, CFG_TUD_CDC_EPSIZE),
+};
+
+tusb_control_request_t const request_set_line_state =
+{
+  .bmRequestType = 0x21,
+  .bRequest      = CDC_REQUEST_SET_CONTROL_LINE_STATE,
+  .wValue        = 0x0003, // DTR + RTS
+  .wIndex        = ITF_NUM_CDC,
+  .wLength       = 0
+};
+
+tusb_control_request_t const request_get_device_desc =
+{
+  .bmRequestType = 0x80,
+  .bRequest      = TUSB_REQ_GET_DESCRIPTOR,
+  .wValue        = TUSB_DESC_DEVICE << 8,
+  .wIndex        = 0,
+  .wLength       = sizeof(tusb_desc_device_t)
+};
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+uint8_t const * tud_descriptor_device_cb(void)
+{
+  return (uint8_t const*) &desc_device;
+}
+
+uint8_t const * tud_descriptor_configuration_cb(uint8_t index)
+{
+  return desc_configuration;
+}
+
+uint16_t const* tud_descriptor_string_cb(uint8_t index)
+{
+  return NULL;
+}
+
+// Client thread talks to USB/IP server while test thread runs device task as application would
+static volatile bool host_done;
+static bool host_result;
+
+static void* host_thread(void* param)
+{
+  bool (*host_fn)(void) = (bool (*)(void)) param;
+
+  host_result = host_fn();
+  host_done = true;
+
+  return NULL;
+}
+
+// Run host function to completion, echo CDC data back meanwhile
+static bool run_host(bool (*host_fn)(void))
+{
+  pthread_t thread;
+
+  host_done = false;
+  TEST_ASSERT_EQUAL(0, pthread_create(&thread, NULL, host_thread, (void*) host_fn));
+
+  while ( !host_done )
+  {
+    tud_task();
+
+    if ( tud_mounted() && tud_cdc_available() )
+    {
+      uint8_t buf[64];
+      uint32_t count = tud_cdc_read(buf, sizeof(buf));
+
+      tud_cdc_write(buf, count);
+      tud_cdc_write_flush();
+    }
+  }
+
+  pthread_join(thread, NULL);
+
+  return host_result;
+}
+
+static uint16_t server_port;
+
+void setUp(void)
+{
+  mscd_init_Ignore();
+  mscd_reset_Ignore();
+
+  tusb_init();
+
+  // server threads live for the whole test run
+  if ( !server_port ) server_port = sim_usbip_start(0);
+  TEST_ASSERT_NOT_EQUAL(0, server_port);
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+// USB/IP client
+//--------------------------------------------------------------------+
+
+typedef struct
+{
+  uint32_t command;
+  uint32_t seqnum;
+  int32_t  status;
+  int32_t  actual;
+  uint8_t  data[64];
+}ret_t;
+
+static int client_connect(void)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr =
+  {
+    .sin_family = AF_INET,
+    .sin_port   = htons(server_port),
+    .sin_addr   = { .s_addr = htonl(INADDR_LOOPBACK) }
+  };
+
+  if ( connect(fd, (struct sockaddr*) &addr, sizeof(addr)) ) return -1;
+  return fd;
+}
+
+static bool client_recv(int fd, void* buf, size_t len)
+{
+  return len == (size_t) recv(fd, buf, len, MSG_WAITALL);
+}
+
+static bool client_op(int fd, uint16_t code)
+{
+  uint32_t const hdr[2] = { htonl(0x0111u << 16 | code), 0 };
+  return sizeof(hdr) == send(fd, hdr, sizeof(hdr), 0);
+}
+
+static bool client_import(int fd)
+{
+  char busid[32] = "1-1";
+  uint32_t reply[2];
+  uint8_t dev[312];
+
+  TU_VERIFY( client_op(fd, 0x8003) && sizeof(busid) == send(fd, busid, sizeof(busid), 0) );
+  TU_VERIFY( client_recv(fd, reply, sizeof(reply)) && reply[0] == htonl(0x01110003) && reply[1] == 0 );
+
+  return client_recv(fd, dev, sizeof(dev));
+}
+
+static bool client_submit(int fd, uint32_t seqnum, uint8_t ep_addr, void const* setup, void const* data, int32_t len)
+{
+  uint32_t hdr[12] = { 0 };
+  bool const dir_in = tu_edpt_dir(ep_addr) == TUSB_DIR_IN;
+
+  hdr[0] = htonl(1);
+  hdr[1] = htonl(seqnum);
+  hdr[2] = htonl(0x00010001);
+  hdr[3] = htonl(dir_in);
+  hdr[4] = htonl(tu_edpt_number(ep_addr));
+  hdr[6] = htonl((uint32_t) len);
+  if ( setup ) memcpy(&hdr[10], setup, 8);
+
+  TU_VERIFY( sizeof(hdr) == send(fd, hdr, sizeof(hdr), 0) );
+  return dir_in || !len || (len == send(fd, data, (size_t) len, 0));
+}
+
+static bool client_unlink(int fd, uint32_t seqnum, uint32_t victim)
+{
+  uint32_t hdr[12] = { 0 };
+
+  hdr[0] = htonl(2);
+  hdr[1] = htonl(seqnum);
+  hdr[5] = htonl(victim);
+
+  return sizeof(hdr) == send(fd, hdr, sizeof(hdr), 0);
+}
+
+// Next RET_SUBMIT/RET_UNLINK, data follows RET_SUBMIT of IN URB
+static bool client_ret(int fd, bool dir_in, ret_t* ret)
+{
+  uint32_t hdr[12];
+  TU_VERIFY( client_recv(fd, hdr, sizeof(hdr)) );
+
+  ret->command = ntohl(hdr[0]);
+  ret->seqnum  = ntohl(hdr[1]);
+  ret->status  = (int32_t) ntohl(hdr[5]);
+  ret->actual  = (ret->command == 3) ? (int32_t) ntohl(hdr[6]) : 0;
+
+  TU_VERIFY( ret->actual >= 0 && ret->actual <= (int32_t) sizeof(ret->data) );
+  return !dir_in || !ret->actual || client_recv(fd, ret->data, (size_t) ret->actual);
+}
+
+static bool client_control(int fd, uint32_t seqnum, tusb_control_request_t const* request, void* data, ret_t* ret)
+{
+  bool const dir_in = request->bmRequestType_bit.direction == TUSB_DIR_IN;
+
+  TU_VERIFY( client_submit(fd, seqnum, dir_in ? 0x80 : 0x00, request, data, request->wLength) );
+  TU_VERIFY( client_ret(fd, dir_in, ret) );
+
+  return ret->command == 3 && ret->seqnum == seqnum;
+}
+
+//--------------------------------------------------------------------+
+// Client
+//--------------------------------------------------------------------+
+
+static bool client_devlist(void)
+{
+  int fd = client_connect();
+  TU_VERIFY( fd >= 0 && client_op(fd, 0x8005) );
+
+  uint32_t reply[3];
+  uint8_t dev[312];
+  uint8_t itf[ITF_NUM_TOTAL][4];
+
+  bool ret = client_recv(fd, reply, sizeof(reply)) && client_recv(fd, dev, sizeof(dev)) && client_recv(fd, itf, sizeof(itf));
+  close(fd);
+  TU_VERIFY( ret );
+
+  TU_VERIFY( reply[0] == htonl(0x01110005) && reply[2] == htonl(1) );
+  TU_VERIFY( 0 == strcmp((char*) dev + 256, "1-1") );
+
+  // idVendor, idProduct and bNumInterfaces
+  TU_VERIFY( dev[300] == 0xCa && dev[301] == 0xfe && dev[302] == 0x40 && dev[303] == 0x00 && dev[311] == ITF_NUM_TOTAL );
+
+  return itf[ITF_NUM_CDC][0] == TUSB_CLASS_CDC && itf[ITF_NUM_CDC_DATA][0] == TUSB_CLASS_CDC_DATA;
+}
+
+static bool client_echo(void)
+{
+  tusb_control_request_t const request_set_config =
+  {
+    .bmRequestType = 0x00,
+    .bRequest      = TUSB_REQ_SET_CONFIGURATION,
+    .wValue        = 1,
+    .wIndex        = 0,
+    .wLength       = 0
+  };
+
+  char const message[] = "hello tinyusb";
+  uint8_t desc[sizeof(tusb_desc_device_t)];
+  ret_t ret, ret_in;
+
+  int fd = client_connect();
+  TU_VERIFY( fd >= 0 && client_import(fd) );
+
+  TU_VERIFY( client_control(fd, 1, &request_get_device_desc, desc, &ret) && ret.status == 0 );
+  TU_VERIFY( ret.actual == sizeof(desc_device) && 0 == memcmp(ret.data, &desc_device, sizeof(desc_device)) );
+  TU_VERIFY( client_control(fd, 2, &request_set_config, NULL, &ret) && ret.status == 0 );
+  TU_VERIFY( client_control(fd, 3, &request_set_line_state, NULL, &ret) && ret.status == 0 );
+
+  // Two IN URBs in flight before data is sent, echo completes the first one
+  TU_VERIFY( client_submit(fd, 10, EDPT_CDC_IN, NULL, NULL, 64) );
+  TU_VERIFY( client_submit(fd, 11, EDPT_CDC_IN, NULL, NULL, 64) );
+  TU_VERIFY( client_submit(fd, 12, EDPT_CDC_OUT, NULL, message, sizeof(message)) );
+
+  TU_VERIFY( client_ret(fd, false, &ret) && ret.seqnum == 12 && ret.status == 0 && ret.actual == sizeof(message) );
+  TU_VERIFY( client_ret(fd, true, &ret_in) && ret_in.seqnum == 10 && ret_in.status == 0 );
+  TU_VERIFY( ret_in.actual == sizeof(message) && 0 == memcmp(ret_in.data, message, sizeof(message)) );
+
+  // Second one is still in flight
+  TU_VERIFY( client_unlink(fd, 13, 11) );
+  TU_VERIFY( client_ret(fd, false, &ret) && ret.command == 4 && ret.seqnum == 13 && ret.status == -ECONNRESET );
+
+  close(fd);
+  return true;
+}
+
+static bool client_stall(void)
+{
+  tusb_control_request_t const request =
+  {
+    .bmRequestType = 0x80,
+    .bRequest      = 0x99,
+    .wValue        = 0,
+    .wIndex        = 0,
+    .wLength       = 1
+  };
+
+  uint8_t buf[sizeof(tusb_desc_device_t)];
+  ret_t ret;
+
+  int fd = client_connect();
+  TU_VERIFY( fd >= 0 && client_import(fd) );
+
+  // Stalled request, next one goes through
+  TU_VERIFY( client_control(fd, 1, &request, buf, &ret) && ret.status == -EPIPE );
+  TU_VERIFY( client_control(fd, 2, &request_get_device_desc, buf, &ret) && ret.status == 0 );
+
+  close(fd);
+  return ret.actual == sizeof(desc_device);
+}
+
+static bool client_urb_full(void)
+{
+  tusb_control_request_t const request_set_config =
+  {
+    .bmRequestType = 0x00,
+    .bRequest      = TUSB_REQ_SET_CONFIGURATION,
+    .wValue        = 1,
+    .wIndex        = 0,
+    .wLength       = 0
+  };
+
+  ret_t ret;
+
+  int fd = client_connect();
+  TU_VERIFY( fd >= 0 && client_import(fd) );
+  TU_VERIFY( client_control(fd, 1, &request_set_config, NULL, &ret) && ret.status == 0 );
+
+  // let server release URB of the control transfer after its RET_SUBMIT
+  usleep(10000);
+
+  // IN URBs stay in flight as device has nothing to send
+  for(uint32_t i=0; i<CFG_SIM_USBIP_URB_MAX; i++) TU_VERIFY( client_submit(fd, 10+i, EDPT_CDC_IN, NULL, NULL, 64) );
+
+  // one more fails at once instead of blocking the server, which still reads the UNLINK freeing one
+  TU_VERIFY( client_submit(fd, 30, EDPT_CDC_IN, NULL, NULL, 64) );
+  TU_VERIFY( client_ret(fd, true, &ret) && ret.command == 3 && ret.seqnum == 30 && ret.status == -ENOMEM && ret.actual == 0 );
+
+  TU_VERIFY( client_unlink(fd, 31, 10) );
+  TU_VERIFY( client_ret(fd, false, &ret) && ret.command == 4 && ret.seqnum == 31 && ret.status == -ECONNRESET );
+
+  close(fd);
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Test
+//--------------------------------------------------------------------+
+
+void test_usbip_devlist(void)
+{
+  TEST_ASSERT_TRUE( run_host(client_devlist) );
+}
+
+void test_usbip_cdc_echo(void)
+{
+  TEST_ASSERT_TRUE( run_host(client_echo) );
+  TEST_ASSERT_TRUE( tud_cdc_connected() );
+}
+
+void test_usbip_stall(void)
+{
+  TEST_ASSERT_TRUE( run_host(client_stall) );
+}
+
+void test_usbip_urb_full(void)
+{
+  TEST_ASSERT_EQUAL(6, CFG_SIM_USBIP_URB_MAX);
+  TEST_ASSERT_TRUE( run_host(client_urb_full) );
+}
@@ -0,0 +1,621 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+
+#include "unity.h"
+
+// Files to test
+#include "tusb_fifo.h"
+#include "tusb.h"
+#include "usbd.h"
+TEST_FILE("usbd_control.c")
+TEST_FILE("msc_device.c")
+TEST_FILE("uas_device.c")
+
+// Mock File
+#include "mock_dcd.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  EDPT_CTRL_OUT    = 0x00,
+  EDPT_CTRL_IN     = 0x80,
+
+  EDPT_UAS_CMD     = 0x01,
+  EDPT_UAS_STATUS  = 0x81,
+  EDPT_UAS_DATAIN  = 0x82,
+  EDPT_UAS_DATAOUT = 0x02,
+};
+
+uint8_t const rhport = 0;
+
+enum
+{
+  ITF_NUM_UAS,
+  ITF_NUM_TOTAL
+};
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + TUD_UAS_DESC_LEN)
+
+uint8_t const data_desc_configuration[] =
+{
+  // Interface count, string index, total length, attribute, power in mA
+  TUD_CONFIG_DESCRIPTOR(ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 100),
+
+  // Interface number, string index, EP Command, Status, Data In, Data Out address, EP size
+  TUD_UAS_DESCRIPTOR(ITF_NUM_UAS, 0, EDPT_UAS_CMD, EDPT_UAS_STATUS, EDPT_UAS_DATAIN, EDPT_UAS_DATAOUT, 64),
+};
+
+tusb_control_request_t const request_set_configuration =
+{
+  .bmRequestType = 0x00,
+  .bRequest      = TUSB_REQ_SET_CONFIGURATION,
+  .wValue        = 1,
+  .wIndex        = 0,
+  .wLength       = 0
+};
+
+enum
+{
+  DISK_BLOCK_NUM  = 16,
+  DISK_BLOCK_SIZE = 512
+};
+
+uint8_t msc_disk[DISK_BLOCK_NUM][DISK_BLOCK_SIZE];
+
+bool unit_ready;
+
+// read10 result of a block other than its size: e.g 0 (not ready) or TUD_MSC_RET_ASYNC
+enum { READ_OK = 1 };
+int32_t read_result[DISK_BLOCK_NUM];
+
+void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16], uint8_t product_rev[4])
+{
+  (void) lun;
+
+  memcpy(vendor_id  , "TinyUSB", 7);
+  memcpy(product_id , "UAS", 3);
+  memcpy(product_rev, "1.0", 3);
+}
+
+bool tud_msc_test_unit_ready_cb(uint8_t lun)
+{
+  (void) lun;
+  return unit_ready;
+}
+
+void tud_msc_capacity_cb(uint8_t lun, uint32_t* block_count, uint16_t* block_size)
+{
+  (void) lun;
+
+  *block_count = DISK_BLOCK_NUM;
+  *block_size  = DISK_BLOCK_SIZE;
+}
+
+int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize)
+{
+  (void) lun;
+
+  if ( read_result[lba] != READ_OK ) return read_result[lba];
+
+  memcpy(buffer, msc_disk[lba] + offset, bufsize);
+  return bufsize;
+}
+
+int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+{
+  (void) lun;
+
+  memcpy(msc_disk[lba] + offset, buffer, bufsize);
+  return bufsize;
+}
+
+int32_t tud_msc_scsi_cb (uint8_t lun, uint8_t const scsi_cmd[16], void* buffer, uint16_t bufsize)
+{
+  (void) lun; (void) scsi_cmd; (void) buffer; (void) bufsize;
+
+  tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
+  return -1;
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+uint8_t const * tud_descriptor_device_cb(void)
+{
+  return NULL;
+}
+
+uint8_t const * tud_descriptor_configuration_cb(uint8_t index)
+{
+  return data_desc_configuration;
+}
+
+uint16_t const* tud_descriptor_string_cb(uint8_t index)
+{
+  return NULL;
+}
+
+// Information Units and data seen on the bus by host
+static uint8_t  status_iu[8][sizeof(uas_sense_iu_t) + 18];
+static uint32_t status_count;
+static uint8_t  host_buf[4*DISK_BLOCK_SIZE];
+static uint32_t host_len;
+
+static bool capture_xfer(uint8_t port, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes, int cmock_num_calls)
+{
+  (void) port; (void) cmock_num_calls;
+
+  if ( ep_addr == EDPT_UAS_STATUS )
+  {
+    memcpy(status_iu[status_count++], buffer, total_bytes);
+  }
+  else if ( ep_addr == EDPT_UAS_DATAIN )
+  {
+    memcpy(host_buf + host_len, buffer, total_bytes);
+    host_len += total_bytes;
+  }
+
+  return true;
+}
+
+void setUp(void)
+{
+  dcd_int_disable_Ignore();
+  dcd_int_enable_Ignore();
+
+  if ( !tusb_inited() )
+  {
+    dcd_init_Expect(rhport);
+    tusb_init();
+  }
+
+  dcd_event_bus_signal(rhport, DCD_EVENT_BUS_RESET, false);
+  tud_task();
+
+  unit_ready   = true;
+  status_count = 0;
+  host_len     = 0;
+
+  for(uint32_t i=0; i<DISK_BLOCK_NUM; i++) read_result[i] = READ_OK;
+}
+
+void tearDown(void)
+{
+  dcd_edpt_xfer_Stub(NULL);
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+static void make_cmd_iu(uas_command_iu_t* iu, uint16_t tag, void const* cdb, uint8_t cdb_len)
+{
+  memset(iu, 0, sizeof(uas_command_iu_t));
+  iu->iu_id = UAS_IU_COMMAND;
+  iu->tag   = tu_htons(tag);
+  memcpy(iu->cdb, cdb, cdb_len);
+}
+
+static void expect_cmd_pipe(uas_command_iu_t const* iu)
+{
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_UAS_CMD, NULL, sizeof(uas_command_iu_t), true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer((uint8_t*) iu, sizeof(uas_command_iu_t));
+}
+
+static void expect_xfer(uint8_t ep_addr, uint16_t len)
+{
+  dcd_edpt_xfer_ExpectAndReturn(rhport, ep_addr, NULL, len, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+}
+
+// Configure device, first IU is received on the command pipe
+static void mount_uas(uas_command_iu_t const* iu)
+{
+  uint8_t const* desc_ep = tu_desc_next(tu_desc_next(data_desc_configuration));
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+
+  dcd_set_config_Expect(rhport, 1);
+
+  // open endpoints, each one is followed by Pipe Usage descriptor
+  for(uint8_t i=0; i<4; i++)
+  {
+    dcd_edpt_open_ExpectAndReturn(rhport, (tusb_desc_endpoint_t const *) desc_ep, true);
+    desc_ep = tu_desc_next(tu_desc_next(desc_ep));
+  }
+
+  expect_cmd_pipe(iu);
+
+  // control status
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  tud_task();
+
+  dcd_edpt_xfer_AddCallback(capture_xfer);
+}
+
+static void assert_sense_iu(uint8_t const* iu, uint16_t tag, uint8_t status)
+{
+  uas_sense_iu_t const* p_sense = (uas_sense_iu_t const*) iu;
+
+  TEST_ASSERT_EQUAL(UAS_IU_SENSE, p_sense->iu_id);
+  TEST_ASSERT_EQUAL(tu_htons(tag), p_sense->tag);
+  TEST_ASSERT_EQUAL(status, p_sense->status);
+}
+
+void test_uas_queued_commands(void)
+{
+  scsi_read10_t const read10 =
+  {
+    .cmd_code    = SCSI_CMD_READ_10,
+    .lba         = tu_htonl(3),
+    .block_count = tu_htons(2)
+  };
+
+  scsi_test_unit_ready_t const tur = { .cmd_code = SCSI_CMD_TEST_UNIT_READY };
+
+  uas_command_iu_t iu_read, iu_tur, iu_none;
+  make_cmd_iu(&iu_read, 1, &read10, sizeof(read10));
+  make_cmd_iu(&iu_tur , 2, &tur, sizeof(tur));
+  memset(&iu_none, 0, sizeof(iu_none));
+
+  for(uint32_t i=0; i<sizeof(msc_disk); i++) ((uint8_t*) msc_disk)[i] = (uint8_t) (i*5);
+
+  mount_uas(&iu_read);
+
+  // READ10 takes the data pipes and is announced by Read Ready IU, TEST UNIT READY is queued behind it
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_ready_iu_t));
+  expect_cmd_pipe(&iu_tur);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_CMD, sizeof(uas_command_iu_t), 0, true);
+  tud_task();
+
+  expect_cmd_pipe(&iu_none);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_CMD, sizeof(uas_command_iu_t), 0, true);
+  tud_task();
+
+  // host is ready: data starts, TEST UNIT READY completes before READ10
+  expect_xfer(EDPT_UAS_DATAIN, DISK_BLOCK_SIZE);
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_sense_iu_t));
+  dcd_event_xfer_complete(rhport, EDPT_UAS_STATUS, sizeof(uas_ready_iu_t), 0, true);
+  tud_task();
+
+  expect_xfer(EDPT_UAS_DATAIN, DISK_BLOCK_SIZE);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_DATAIN, DISK_BLOCK_SIZE, 0, true);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_STATUS, sizeof(uas_sense_iu_t), 0, true);
+  tud_task();
+
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_sense_iu_t));
+  dcd_event_xfer_complete(rhport, EDPT_UAS_DATAIN, DISK_BLOCK_SIZE, 0, true);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(3, status_count);
+  TEST_ASSERT_EQUAL(UAS_IU_READ_READY, status_iu[0][0]);
+  assert_sense_iu(status_iu[1], 2, 0);
+  assert_sense_iu(status_iu[2], 1, 0);
+
+  TEST_ASSERT_EQUAL(2*DISK_BLOCK_SIZE, host_len);
+  TEST_ASSERT_EQUAL_MEMORY(msc_disk[3], host_buf, host_len);
+}
+
+void test_uas_write10(void)
+{
+  scsi_write10_t const write10 =
+  {
+    .cmd_code    = SCSI_CMD_WRITE_10,
+    .lba         = tu_htonl(6),
+    .block_count = tu_htons(2)
+  };
+
+  uas_command_iu_t iu_write, iu_none;
+  make_cmd_iu(&iu_write, 7, &write10, sizeof(write10));
+  memset(&iu_none, 0, sizeof(iu_none));
+
+  for(uint32_t i=0; i<sizeof(host_buf); i++) host_buf[i] = (uint8_t) (i*3 + 1);
+  memset(msc_disk, 0, sizeof(msc_disk));
+
+  mount_uas(&iu_write);
+
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_ready_iu_t));
+  expect_cmd_pipe(&iu_none);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_CMD, sizeof(uas_command_iu_t), 0, true);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(UAS_IU_WRITE_READY, status_iu[0][0]);
+
+  for(uint32_t i=0; i<2; i++)
+  {
+    expect_xfer(EDPT_UAS_DATAOUT, DISK_BLOCK_SIZE);
+    dcd_edpt_xfer_ReturnMemThruPtr_buffer(host_buf + i*DISK_BLOCK_SIZE, DISK_BLOCK_SIZE);
+
+    if ( i == 0 )
+    {
+      dcd_event_xfer_complete(rhport, EDPT_UAS_STATUS, sizeof(uas_ready_iu_t), 0, true);
+    }
+    else
+    {
+      dcd_event_xfer_complete(rhport, EDPT_UAS_DATAOUT, DISK_BLOCK_SIZE, 0, true);
+    }
+    tud_task();
+  }
+
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_sense_iu_t));
+  dcd_event_xfer_complete(rhport, EDPT_UAS_DATAOUT, DISK_BLOCK_SIZE, 0, true);
+  tud_task();
+
+  assert_sense_iu(status_iu[1], 7, 0);
+  TEST_ASSERT_EQUAL_MEMORY(host_buf, msc_disk[6], 2*DISK_BLOCK_SIZE);
+}
+
+void test_uas_check_condition(void)
+{
+  scsi_test_unit_ready_t const tur = { .cmd_code = SCSI_CMD_TEST_UNIT_READY };
+
+  uas_command_iu_t iu_tur, iu_none;
+  make_cmd_iu(&iu_tur, 3, &tur, sizeof(tur));
+  memset(&iu_none, 0, sizeof(iu_none));
+
+  unit_ready = false;
+  mount_uas(&iu_tur);
+
+  // sense data is sent along with status
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_sense_iu_t) + sizeof(scsi_sense_fixed_resp_t));
+  expect_cmd_pipe(&iu_none);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_CMD, sizeof(uas_command_iu_t), 0, true);
+  tud_task();
+
+  assert_sense_iu(status_iu[0], 3, 2);
+
+  scsi_sense_fixed_resp_t const* p_sense = (scsi_sense_fixed_resp_t const*) (status_iu[0] + sizeof(uas_sense_iu_t));
+  TEST_ASSERT_EQUAL(SCSI_SENSE_NOT_READY, p_sense->sense_key);
+  TEST_ASSERT_EQUAL(0x04, p_sense->add_sense_code);
+}
+
+void test_uas_read10_async(void)
+{
+  scsi_read10_t const read10 =
+  {
+    .cmd_code    = SCSI_CMD_READ_10,
+    .lba         = tu_htonl(5),
+    .block_count = tu_htons(1)
+  };
+
+  uas_command_iu_t iu_read, iu_none;
+  make_cmd_iu(&iu_read, 4, &read10, sizeof(read10));
+  memset(&iu_none, 0, sizeof(iu_none));
+
+  read_result[5] = TUD_MSC_RET_ASYNC;
+  mount_uas(&iu_read);
+
+  // asynchronous request is not supported by UAS: command fails instead of waiting forever
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_sense_iu_t) + sizeof(scsi_sense_fixed_resp_t));
+  expect_cmd_pipe(&iu_none);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_CMD, sizeof(uas_command_iu_t), 0, true);
+  tud_task();
+
+  assert_sense_iu(status_iu[0], 4, 2);
+  TEST_ASSERT_EQUAL(0, host_len);
+
+  // late completion from application is ignored
+  TEST_ASSERT_TRUE(tud_msc_async_done(0, DISK_BLOCK_SIZE, false));
+  tud_task();
+  TEST_ASSERT_EQUAL(1, status_count);
+}
+
+static void make_read10_iu(uas_command_iu_t* iu, uint16_t tag, uint32_t lba)
+{
+  scsi_read10_t const read10 =
+  {
+    .cmd_code    = SCSI_CMD_READ_10,
+    .lba         = tu_htonl(lba),
+    .block_count = tu_htons(1)
+  };
+
+  make_cmd_iu(iu, tag, &read10, sizeof(read10));
+}
+
+static void make_task_mgmt_iu(uas_command_iu_t* iu, uint16_t tag, uint8_t function, uint16_t task_tag)
+{
+  uas_task_mgmt_iu_t* p_tmf = (uas_task_mgmt_iu_t*) iu;
+
+  memset(iu, 0, sizeof(uas_command_iu_t));
+  p_tmf->iu_id    = UAS_IU_TASK_MGMT;
+  p_tmf->tag      = tu_htons(tag);
+  p_tmf->function = function;
+  p_tmf->task_tag = tu_htons(task_tag);
+}
+
+static void assert_response_iu(uint8_t const* iu, uint16_t tag, uint8_t response_code)
+{
+  uas_response_iu_t const* p_resp = (uas_response_iu_t const*) iu;
+
+  TEST_ASSERT_EQUAL(UAS_IU_RESPONSE, p_resp->iu_id);
+  TEST_ASSERT_EQUAL(tu_htons(tag), p_resp->tag);
+  TEST_ASSERT_EQUAL(response_code, p_resp->response_code);
+}
+
+void test_uas_out_of_order(void)
+{
+  uas_command_iu_t iu_read1, iu_read2, iu_none;
+  make_read10_iu(&iu_read1, 1, 3);
+  make_read10_iu(&iu_read2, 2, 8);
+  memset(&iu_none, 0, sizeof(iu_none));
+
+  for(uint32_t i=0; i<sizeof(msc_disk); i++) ((uint8_t*) msc_disk)[i] = (uint8_t) (i*7);
+
+  // data of first READ10 is not ready yet
+  read_result[3] = 0;
+  mount_uas(&iu_read1);
+
+  expect_cmd_pipe(&iu_read2);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_CMD, sizeof(uas_command_iu_t), 0, true);
+  TEST_ASSERT_EQUAL(1, tud_task_ext(1, 0));
+  TEST_ASSERT_EQUAL(0, status_count);
+
+  // second READ10 passes the first one: retry of first one, then command
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_ready_iu_t));
+  expect_cmd_pipe(&iu_none);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_CMD, sizeof(uas_command_iu_t), 0, true);
+  TEST_ASSERT_EQUAL(2, tud_task_ext(2, 0));
+
+  read_result[3] = READ_OK;
+
+  expect_xfer(EDPT_UAS_DATAIN, DISK_BLOCK_SIZE);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_STATUS, sizeof(uas_ready_iu_t), 0, true);
+  tud_task();
+
+  // second one done, first one takes the data pipes, its Ready IU goes ahead of the Sense IU
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_ready_iu_t));
+  dcd_event_xfer_complete(rhport, EDPT_UAS_DATAIN, DISK_BLOCK_SIZE, 0, true);
+  tud_task();
+
+  expect_xfer(EDPT_UAS_DATAIN, DISK_BLOCK_SIZE);
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_sense_iu_t));
+  dcd_event_xfer_complete(rhport, EDPT_UAS_STATUS, sizeof(uas_ready_iu_t), 0, true);
+  tud_task();
+
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_sense_iu_t));
+  dcd_event_xfer_complete(rhport, EDPT_UAS_DATAIN, DISK_BLOCK_SIZE, 0, true);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_STATUS, sizeof(uas_sense_iu_t), 0, true);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(4, status_count);
+  TEST_ASSERT_EQUAL(UAS_IU_READ_READY, status_iu[0][0]);
+  TEST_ASSERT_EQUAL(tu_htons(2), ((uas_ready_iu_t*) status_iu[0])->tag);
+  TEST_ASSERT_EQUAL(UAS_IU_READ_READY, status_iu[1][0]);
+  TEST_ASSERT_EQUAL(tu_htons(1), ((uas_ready_iu_t*) status_iu[1])->tag);
+  assert_sense_iu(status_iu[2], 2, 0);
+  assert_sense_iu(status_iu[3], 1, 0);
+
+  TEST_ASSERT_EQUAL(2*DISK_BLOCK_SIZE, host_len);
+  TEST_ASSERT_EQUAL_MEMORY(msc_disk[8], host_buf, DISK_BLOCK_SIZE);
+  TEST_ASSERT_EQUAL_MEMORY(msc_disk[3], host_buf + DISK_BLOCK_SIZE, DISK_BLOCK_SIZE);
+}
+
+void test_uas_overlapped_tag(void)
+{
+  uas_command_iu_t iu_read, iu_dup, iu_none;
+  make_read10_iu(&iu_read, 5, 1);
+  make_read10_iu(&iu_dup , 5, 2);
+  memset(&iu_none, 0, sizeof(iu_none));
+
+  mount_uas(&iu_read);
+
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_ready_iu_t));
+  expect_cmd_pipe(&iu_dup);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_CMD, sizeof(uas_command_iu_t), 0, true);
+  tud_task();
+
+  // tag still in use: Response IU once status pipe is free, command in progress goes on
+  expect_cmd_pipe(&iu_none);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_CMD, sizeof(uas_command_iu_t), 0, true);
+  tud_task();
+
+  expect_xfer(EDPT_UAS_DATAIN, DISK_BLOCK_SIZE);
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_response_iu_t));
+  dcd_event_xfer_complete(rhport, EDPT_UAS_STATUS, sizeof(uas_ready_iu_t), 0, true);
+  tud_task();
+
+  assert_response_iu(status_iu[1], 5, UAS_RESPONSE_OVERLAPPED_TAG);
+
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_sense_iu_t));
+  dcd_event_xfer_complete(rhport, EDPT_UAS_DATAIN, DISK_BLOCK_SIZE, 0, true);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_STATUS, sizeof(uas_response_iu_t), 0, true);
+  tud_task();
+
+  assert_sense_iu(status_iu[2], 5, 0);
+}
+
+void test_uas_task_management(void)
+{
+  uas_command_iu_t iu_read1, iu_read2, iu_abort2, iu_abort1, iu_query, iu_none;
+  make_read10_iu(&iu_read1, 1, 1);
+  make_read10_iu(&iu_read2, 2, 2);
+  make_task_mgmt_iu(&iu_abort2, 3, UAS_TMF_ABORT_TASK, 2);
+  make_task_mgmt_iu(&iu_abort1, 4, UAS_TMF_ABORT_TASK, 1);
+  make_task_mgmt_iu(&iu_query , 5, UAS_TMF_QUERY_TASK, 2);
+  memset(&iu_none, 0, sizeof(iu_none));
+
+  TEST_ASSERT_EQUAL(4, CFG_TUD_UAS_QUEUE_DEPTH);
+
+  mount_uas(&iu_read1);
+
+  // first READ10 owns the data pipes, second one is queued
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_ready_iu_t));
+  expect_cmd_pipe(&iu_read2);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_CMD, sizeof(uas_command_iu_t), 0, true);
+  tud_task();
+
+  expect_cmd_pipe(&iu_abort2);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_CMD, sizeof(uas_command_iu_t), 0, true);
+  tud_task();
+
+  // queued command is aborted, started one cannot be
+  expect_cmd_pipe(&iu_abort1);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_CMD, sizeof(uas_task_mgmt_iu_t), 0, true);
+  tud_task();
+
+  expect_cmd_pipe(&iu_query);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_CMD, sizeof(uas_task_mgmt_iu_t), 0, true);
+  tud_task();
+
+  // all slots are in use, command pipe is not armed again
+  dcd_event_xfer_complete(rhport, EDPT_UAS_CMD, sizeof(uas_task_mgmt_iu_t), 0, true);
+  tud_task();
+
+  // Response IUs follow data transfer start in arrival order
+  expect_xfer(EDPT_UAS_DATAIN, DISK_BLOCK_SIZE);
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_response_iu_t));
+  dcd_event_xfer_complete(rhport, EDPT_UAS_STATUS, sizeof(uas_ready_iu_t), 0, true);
+  tud_task();
+
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_response_iu_t));
+  expect_cmd_pipe(&iu_none);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_STATUS, sizeof(uas_response_iu_t), 0, true);
+  tud_task();
+
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_response_iu_t));
+  dcd_event_xfer_complete(rhport, EDPT_UAS_STATUS, sizeof(uas_response_iu_t), 0, true);
+  tud_task();
+
+  // aborted command never gets the data pipes
+  expect_xfer(EDPT_UAS_STATUS, sizeof(uas_sense_iu_t));
+  dcd_event_xfer_complete(rhport, EDPT_UAS_DATAIN, DISK_BLOCK_SIZE, 0, true);
+  dcd_event_xfer_complete(rhport, EDPT_UAS_STATUS, sizeof(uas_response_iu_t), 0, true);
+  tud_task();
+
+  dcd_event_xfer_complete(rhport, EDPT_UAS_STATUS, sizeof(uas_sense_iu_t), 0, true);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(5, status_count);
+  assert_response_iu(status_iu[1], 3, UAS_RESPONSE_TMF_COMPLETE);
+  assert_response_iu(status_iu[2], 4, UAS_RESPONSE_TMF_FAILED);
+  assert_response_iu(status_iu[3], 5, UAS_RESPONSE_TMF_COMPLETE);
+  assert_sense_iu(status_iu[4], 1, 0);
+  TEST_ASSERT_EQUAL(DISK_BLOCK_SIZE, host_len);
+}
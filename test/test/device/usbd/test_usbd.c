@@ -28,6 +28,7 @@
 #include "tusb_fifo.h"
 #include "tusb.h"
 #include "usbd.h"
+#include "usbd_pvt.h"
 TEST_FILE("usbd_control.c")
 
 // Mock File
@@ -234,3 +235,693 @@ void test_usbd_control_in_zlp(void)
 
   tud_task();
 }
+
+//--------------------------------------------------------------------+
+// Task budget
+//--------------------------------------------------------------------+
+static uint32_t func_call_count;
+
+static void count_func_call(void* param)
+{
+  (void) param;
+  func_call_count++;
+}
+
+void test_usbd_task_ext_budget(void)
+{
+  func_call_count = 0;
+
+  // more events than a batch
+  for(uint32_t i=0; i<10; i++) usbd_defer_func(count_func_call, NULL, false);
+
+  TEST_ASSERT_EQUAL(3, tud_task_ext(3, 0));
+  TEST_ASSERT_EQUAL(3, func_call_count);
+
+  TEST_ASSERT_EQUAL(6, tud_task_ext(6, 0));
+  TEST_ASSERT_EQUAL(9, func_call_count);
+
+  // no limit: drain the rest
+  TEST_ASSERT_EQUAL(1, tud_task_ext(0, 0));
+  TEST_ASSERT_EQUAL(10, func_call_count);
+
+  TEST_ASSERT_EQUAL(0, tud_task_ext(0, 0));
+}
+
+//--------------------------------------------------------------------+
+// Transfer complete
+//--------------------------------------------------------------------+
+enum
+{
+  EDPT_MSC_OUT = 0x01,
+  EDPT_MSC_IN  = 0x81
+};
+
+uint8_t const data_desc_configuration_msc[] =
+{
+  // Interface count, string index, total length, attribute, power in mA
+  TUD_CONFIG_DESCRIPTOR(1, 0, TUD_CONFIG_DESC_LEN + TUD_MSC_DESC_LEN, 0, 100),
+
+  // Interface number, string index, EP Out & EP In address, EP size
+  TUD_MSC_DESCRIPTOR(0, 0, EDPT_MSC_OUT, EDPT_MSC_IN, 64),
+};
+
+// same interface on the highest endpoint numbers
+uint8_t const data_desc_configuration_msc_ep15[] =
+{
+  TUD_CONFIG_DESCRIPTOR(1, 0, TUD_CONFIG_DESC_LEN + TUD_MSC_DESC_LEN, 0, 100),
+  TUD_MSC_DESCRIPTOR(0, 0, 0x0F, 0x8F, 64),
+};
+
+tusb_control_request_t const req_set_configuration =
+{
+  .bmRequestType = 0x00,
+  .bRequest = TUSB_REQ_SET_CONFIGURATION,
+  .wValue = 1,
+  .wIndex = 0x0000,
+  .wLength = 0
+};
+
+static void set_configuration(uint8_t const* desc_cfg)
+{
+  uint16_t const itf_len = TUD_MSC_DESC_LEN;
+
+  desc_configuration = desc_cfg;
+
+  // bus reset to start from a clean state
+  mscd_reset_Expect(rhport);
+  dcd_event_bus_signal(rhport, DCD_EVENT_BUS_RESET, false);
+
+  dcd_event_setup_received(rhport, (uint8_t*) &req_set_configuration, false);
+
+  dcd_set_config_Expect(rhport, 1);
+  mscd_open_ExpectAndReturn(rhport, NULL, NULL, true);
+  mscd_open_IgnoreArg_itf_desc();
+  mscd_open_IgnoreArg_p_length();
+  mscd_open_ReturnThruPtr_p_length(&itf_len);
+
+  // status
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+
+  tud_task();
+}
+
+static void set_configuration_msc(void)
+{
+  set_configuration(data_desc_configuration_msc);
+}
+
+void test_usbd_xfer_complete_after_reset(void)
+{
+  set_configuration_msc();
+
+  // completion kept behind a bus reset belongs to a closed endpoint and is dropped
+  dcd_event_bus_signal(rhport, DCD_EVENT_BUS_RESET, true);
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 64, XFER_RESULT_SUCCESS, true);
+
+  mscd_reset_Expect(rhport);
+
+  // bus reset and wakeup of kept completions
+  TEST_ASSERT_EQUAL(2, tud_task_ext(0, 0));
+}
+
+//--------------------------------------------------------------------+
+// Coalesced transfer completion
+//--------------------------------------------------------------------+
+void test_usbd_xfer_coalesce(void)
+{
+  set_configuration_msc();
+
+  // completions of busy endpoints share one queued event, reported in order of endpoint number
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 13, XFER_RESULT_SUCCESS, true);
+  dcd_event_xfer_complete(rhport, EDPT_MSC_OUT, 31, XFER_RESULT_SUCCESS, true);
+
+  mscd_xfer_cb_ExpectAndReturn(rhport, EDPT_MSC_OUT, XFER_RESULT_SUCCESS, 31, true);
+  mscd_xfer_cb_ExpectAndReturn(rhport, EDPT_MSC_IN, XFER_RESULT_SUCCESS, 13, true);
+
+  TEST_ASSERT_EQUAL(1, tud_task_ext(0, 0));
+
+  // nothing left behind
+  TEST_ASSERT_EQUAL(0, tud_task_ext(0, 0));
+}
+
+void test_usbd_xfer_coalesce_same_edpt(void)
+{
+  set_configuration_msc();
+
+  // next transfer of an endpoint completes before task takes the first one: both are reported in order
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 64, XFER_RESULT_SUCCESS, true);
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 13, XFER_RESULT_SUCCESS, true);
+
+  mscd_xfer_cb_ExpectAndReturn(rhport, EDPT_MSC_IN, XFER_RESULT_SUCCESS, 64, true);
+  mscd_xfer_cb_ExpectAndReturn(rhport, EDPT_MSC_IN, XFER_RESULT_SUCCESS, 13, true);
+
+  TEST_ASSERT_EQUAL(2, tud_task_ext(0, 0));
+
+  // endpoint is kept again after task released it
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 7, XFER_RESULT_SUCCESS, true);
+  mscd_xfer_cb_ExpectAndReturn(rhport, EDPT_MSC_IN, XFER_RESULT_SUCCESS, 7, true);
+
+  TEST_ASSERT_EQUAL(1, tud_task_ext(0, 0));
+}
+
+void test_usbd_xfer_coalesce_queue_full(void)
+{
+  tud_stats_t stats;
+
+  set_configuration_msc();
+  tud_stats_clear();
+
+  // no room for wakeup: completion is lost like any other event
+  for(uint32_t i=0; i<CFG_TUD_TASK_QUEUE_SZ; i++) usbd_defer_func(count_func_call, NULL, false);
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 64, XFER_RESULT_SUCCESS, true);
+
+  TEST_ASSERT_EQUAL(CFG_TUD_TASK_QUEUE_SZ, tud_task_ext(0, 0));
+
+  tud_stats_get(&stats);
+  TEST_ASSERT_EQUAL(1, stats.queue_full);
+
+  // endpoint is not left pending without wakeup
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 13, XFER_RESULT_SUCCESS, true);
+  mscd_xfer_cb_ExpectAndReturn(rhport, EDPT_MSC_IN, XFER_RESULT_SUCCESS, 13, true);
+
+  TEST_ASSERT_EQUAL(1, tud_task_ext(0, 0));
+}
+
+//--------------------------------------------------------------------+
+// Endpoint table
+//--------------------------------------------------------------------+
+void test_usbd_xfer_complete_ep15(void)
+{
+  TEST_ASSERT_EQUAL(16, CFG_TUD_ENDPOINT_MAX);
+
+  set_configuration(data_desc_configuration_msc_ep15);
+
+  dcd_event_xfer_complete(rhport, 0x8F, 64, XFER_RESULT_SUCCESS, true);
+  dcd_event_xfer_complete(rhport, 0x0F, 31, XFER_RESULT_SUCCESS, true);
+
+  mscd_xfer_cb_ExpectAndReturn(rhport, 0x0F, XFER_RESULT_SUCCESS, 31, true);
+  mscd_xfer_cb_ExpectAndReturn(rhport, 0x8F, XFER_RESULT_SUCCESS, 64, true);
+
+  // coalesced into one event
+  TEST_ASSERT_EQUAL(1, tud_task_ext(0, 0));
+}
+
+//--------------------------------------------------------------------+
+// Application class driver
+//--------------------------------------------------------------------+
+enum
+{
+  APP_SUBCLASS  = 0x42,
+  APP_ALT0_LEN  = 9,        // idle setting without endpoint
+  APP_ALT1_LEN  = 9 + 7 + 7,
+  EDPT_APP_OUT  = 0x02,
+  EDPT_APP_IN   = 0x82
+};
+
+static uint32_t app_xfer_bytes;
+static uint8_t  app_xfer_result;
+static uint8_t  app_alt;
+static uint32_t app_frame_count;
+
+static void app_init(void)
+{
+}
+
+static void app_reset(uint8_t rhport_)
+{
+  (void) rhport_;
+}
+
+static bool app_open(uint8_t rhport_, tusb_desc_interface_t const * desc_itf, uint16_t* p_length)
+{
+  (void) rhport_;
+
+  TEST_ASSERT_EQUAL(APP_SUBCLASS, desc_itf->bInterfaceSubClass);
+  *p_length = APP_ALT0_LEN;
+  app_alt   = 0;
+
+  return true;
+}
+
+static bool app_set_interface(uint8_t rhport_, tusb_desc_interface_t const * desc_itf, uint16_t length)
+{
+  (void) rhport_;
+
+  TEST_ASSERT_EQUAL(desc_itf->bAlternateSetting ? APP_ALT1_LEN : APP_ALT0_LEN, length);
+  app_alt = desc_itf->bAlternateSetting;
+
+  return true;
+}
+
+static bool app_xfer_cb(uint8_t rhport_, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+{
+  (void) rhport_; (void) ep_addr;
+
+  app_xfer_bytes += xferred_bytes;
+  app_xfer_result = result;
+  return true;
+}
+
+static void app_sof(uint8_t rhport_, uint32_t frame_count)
+{
+  (void) rhport_;
+  app_frame_count = frame_count;
+}
+
+static usbd_class_driver_t const app_driver[] =
+{
+  {
+      USBD_DRIVER_NAME("App")
+      .class_code       = TUSB_CLASS_VENDOR_SPECIFIC,
+      .subclass_code    = APP_SUBCLASS,
+      .match            = USBD_MATCH_SUBCLASS,
+      .init             = app_init,
+      .reset            = app_reset,
+      .open             = app_open,
+      .set_interface    = app_set_interface,
+      .control_request  = NULL,
+      .control_complete = NULL,
+      .xfer_cb          = app_xfer_cb,
+      .sof              = app_sof
+  }
+};
+
+usbd_class_driver_t const* usbd_app_driver_get_cb(uint8_t* driver_count)
+{
+  *driver_count = TU_ARRAY_SIZE(app_driver);
+  return app_driver;
+}
+
+uint8_t const data_desc_configuration_app[] =
+{
+  TUD_CONFIG_DESCRIPTOR(2, 0, TUD_CONFIG_DESC_LEN + TUD_MSC_DESC_LEN + APP_ALT0_LEN + APP_ALT1_LEN, 0, 100),
+  TUD_MSC_DESCRIPTOR(0, 0, EDPT_MSC_OUT, EDPT_MSC_IN, 64),
+
+  // Interface number, alternate, endpoint count, class, subclass, protocol, string index
+  9, TUSB_DESC_INTERFACE, 1, 0, 0, TUSB_CLASS_VENDOR_SPECIFIC, APP_SUBCLASS, 0, 0,
+
+  9, TUSB_DESC_INTERFACE, 1, 1, 2, TUSB_CLASS_VENDOR_SPECIFIC, APP_SUBCLASS, 0, 0,
+  7, TUSB_DESC_ENDPOINT, EDPT_APP_OUT, TUSB_XFER_ISOCHRONOUS, U16_TO_U8S_LE(64), 1,
+  7, TUSB_DESC_ENDPOINT, EDPT_APP_IN , TUSB_XFER_BULK, U16_TO_U8S_LE(64), 0,
+};
+
+static void set_configuration_app(void)
+{
+  uint16_t const itf_len = TUD_MSC_DESC_LEN;
+
+  desc_configuration = data_desc_configuration_app;
+  app_xfer_bytes     = 0;
+  app_xfer_result    = XFER_RESULT_SUCCESS;
+  app_frame_count    = 0;
+
+  mscd_reset_Expect(rhport);
+  dcd_event_bus_signal(rhport, DCD_EVENT_BUS_RESET, false);
+
+  dcd_event_setup_received(rhport, (uint8_t*) &req_set_configuration, false);
+
+  // MSC interface still goes to built-in driver, vendor interface to application driver
+  dcd_set_config_Expect(rhport, 1);
+  mscd_open_ExpectAndReturn(rhport, NULL, NULL, true);
+  mscd_open_IgnoreArg_itf_desc();
+  mscd_open_IgnoreArg_p_length();
+  mscd_open_ReturnThruPtr_p_length(&itf_len);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+
+  tud_task();
+}
+
+void test_usbd_app_driver(void)
+{
+  set_configuration_app();
+
+  // endpoints of alternate setting are mapped to application driver as well
+  dcd_event_xfer_complete(rhport, EDPT_APP_IN, 64, XFER_RESULT_SUCCESS, true);
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 13, XFER_RESULT_SUCCESS, true);
+
+  mscd_xfer_cb_ExpectAndReturn(rhport, EDPT_MSC_IN, XFER_RESULT_SUCCESS, 13, true);
+
+  TEST_ASSERT_EQUAL(1, tud_task_ext(0, 0));
+  TEST_ASSERT_EQUAL(64, app_xfer_bytes);
+}
+
+//--------------------------------------------------------------------+
+// Alternate setting
+//--------------------------------------------------------------------+
+static void set_interface(uint8_t itf, uint8_t alt)
+{
+  tusb_control_request_t const req_set_interface =
+  {
+    .bmRequestType = 0x01,
+    .bRequest = TUSB_REQ_SET_INTERFACE,
+    .wValue = alt,
+    .wIndex = itf,
+    .wLength = 0
+  };
+
+  dcd_event_setup_received(rhport, (uint8_t*) &req_set_interface, false);
+}
+
+static void get_interface(uint8_t itf, uint8_t alt)
+{
+  tusb_control_request_t const req_get_interface =
+  {
+    .bmRequestType = 0x81,
+    .bRequest = TUSB_REQ_GET_INTERFACE,
+    .wValue = 0,
+    .wIndex = itf,
+    .wLength = 1
+  };
+
+  dcd_event_setup_received(rhport, (uint8_t*) &req_get_interface, false);
+
+  // data
+  dcd_edpt_xfer_ExpectWithArrayAndReturn(rhport, EDPT_CTRL_IN, &alt, 1, 1, true);
+  dcd_event_xfer_complete(rhport, EDPT_CTRL_IN, 1, 0, false);
+
+  // status
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_OUT, NULL, 0, true);
+
+  tud_task();
+}
+
+void test_usbd_set_interface(void)
+{
+  set_configuration_app();
+
+  // select streaming setting: its endpoints are opened
+  set_interface(1, 1);
+  dcd_edpt_open_ExpectAndReturn(rhport, NULL, true);
+  dcd_edpt_open_IgnoreArg_p_endpoint_desc();
+  dcd_edpt_open_ExpectAndReturn(rhport, NULL, true);
+  dcd_edpt_open_IgnoreArg_p_endpoint_desc();
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(1, app_alt);
+  get_interface(1, 1);
+
+  // back to idle setting: its endpoints are closed
+  set_interface(1, 0);
+  dcd_edpt_close_Expect(rhport, EDPT_APP_OUT);
+  dcd_edpt_close_Expect(rhport, EDPT_APP_IN);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(0, app_alt);
+  get_interface(1, 0);
+
+  // setting that does not exist is stalled
+  set_interface(1, 2);
+  dcd_edpt_stall_Expect(rhport, EDPT_CTRL_OUT);
+  dcd_edpt_stall_Expect(rhport, EDPT_CTRL_IN);
+  tud_task();
+
+  // built-in driver without alternate setting only accepts setting 0
+  set_interface(0, 1);
+  dcd_edpt_stall_Expect(rhport, EDPT_CTRL_OUT);
+  dcd_edpt_stall_Expect(rhport, EDPT_CTRL_IN);
+  tud_task();
+
+  set_interface(0, 0);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  tud_task();
+}
+
+//--------------------------------------------------------------------+
+// Isochronous & SOF
+//--------------------------------------------------------------------+
+
+static dcd_iso_packet_t* iso_packets;
+static uint8_t iso_count;
+
+// Controller side of isochronous transfer: keep packets so that test can play the frames
+static bool fake_iso_xfer(uint8_t port, uint8_t ep_addr, uint8_t * buffer, dcd_iso_packet_t* packets, uint8_t count, int cmock_num_calls)
+{
+  (void) port; (void) buffer; (void) cmock_num_calls;
+
+  TEST_ASSERT_EQUAL(EDPT_APP_OUT, ep_addr);
+
+  // stack hands over packets with only length set
+  for(uint8_t i=0; i<count; i++)
+  {
+    TEST_ASSERT_EQUAL(0, packets[i].actual);
+    TEST_ASSERT_EQUAL(XFER_RESULT_MISSED, packets[i].result);
+  }
+
+  iso_packets = packets;
+  iso_count   = count;
+
+  return true;
+}
+
+void test_usbd_iso_xfer(void)
+{
+  uint8_t buf[3*64];
+  dcd_iso_packet_t packets[3] =
+  {
+    { .length = 64, .actual = 64, .result = XFER_RESULT_SUCCESS },
+    { .length = 64 },
+    { .length = 64 }
+  };
+
+  set_configuration_app();
+
+  dcd_edpt_iso_xfer_Stub(fake_iso_xfer);
+  TEST_ASSERT_TRUE(usbd_edpt_iso_xfer(rhport, EDPT_APP_OUT, buf, packets, 3));
+  dcd_edpt_iso_xfer_Stub(NULL);
+
+  TEST_ASSERT_EQUAL_PTR(packets, iso_packets);
+  TEST_ASSERT_EQUAL(3, iso_count);
+  TEST_ASSERT_TRUE(usbd_edpt_busy(rhport, EDPT_APP_OUT));
+
+  // 3 frames: full packet, missed frame, short packet
+  iso_packets[0].actual = 64;
+  iso_packets[0].result = XFER_RESULT_SUCCESS;
+  iso_packets[2].actual = 40;
+  iso_packets[2].result = XFER_RESULT_SUCCESS;
+  dcd_event_xfer_complete(rhport, EDPT_APP_OUT, 104, XFER_RESULT_FAILED, true);
+
+  // driver is invoked once for the whole transfer
+  TEST_ASSERT_EQUAL(1, tud_task_ext(0, 0));
+  TEST_ASSERT_EQUAL(104, app_xfer_bytes);
+  TEST_ASSERT_EQUAL(XFER_RESULT_FAILED, app_xfer_result);
+  TEST_ASSERT_EQUAL(XFER_RESULT_MISSED, packets[1].result);
+  TEST_ASSERT_FALSE(usbd_edpt_busy(rhport, EDPT_APP_OUT));
+}
+
+void test_usbd_iso_xfer_failed(void)
+{
+  uint8_t buf[2*64];
+  dcd_iso_packet_t packets[2] = { { .length = 64 }, { .length = 64 } };
+
+  set_configuration_app();
+
+  dcd_edpt_iso_xfer_Stub(fake_iso_xfer);
+  TEST_ASSERT_TRUE(usbd_edpt_iso_xfer(rhport, EDPT_APP_OUT, buf, packets, 2));
+  dcd_edpt_iso_xfer_Stub(NULL);
+
+  // every frame missed: failed completion still reaches the driver with its packets
+  app_xfer_bytes  = 0;
+  app_xfer_result = XFER_RESULT_SUCCESS;
+  dcd_event_xfer_complete(rhport, EDPT_APP_OUT, 0, XFER_RESULT_FAILED, true);
+
+  TEST_ASSERT_EQUAL(1, tud_task_ext(0, 0));
+  TEST_ASSERT_EQUAL(0, app_xfer_bytes);
+  TEST_ASSERT_EQUAL(XFER_RESULT_FAILED, app_xfer_result);
+  TEST_ASSERT_EQUAL(XFER_RESULT_MISSED, packets[0].result);
+  TEST_ASSERT_EQUAL(XFER_RESULT_MISSED, packets[1].result);
+  TEST_ASSERT_FALSE(usbd_edpt_busy(rhport, EDPT_APP_OUT));
+}
+
+void test_usbd_sof_frame_count(void)
+{
+  set_configuration_app();
+
+  // not requested by any driver
+  dcd_event_sof(rhport, 10, true);
+  TEST_ASSERT_EQUAL(0, tud_task_ext(0, 0));
+
+  // only one SOF is queued, driver sees the latest frame number
+  usbd_sof_enable(rhport, SOF_CONSUMER_CDC, true);
+  dcd_event_sof(rhport, 11, true);
+  dcd_event_sof(rhport, 12, true);
+
+  TEST_ASSERT_EQUAL(1, tud_task_ext(0, 0));
+  TEST_ASSERT_EQUAL(12, app_frame_count);
+}
+
+//--------------------------------------------------------------------+
+// Statistics
+//--------------------------------------------------------------------+
+enum
+{
+  DRVID_APP = 0, // application drivers come first
+  DRVID_MSC = 1
+};
+
+static uint32_t stats_now;
+
+uint32_t tud_stats_time_cb(void)
+{
+  return stats_now;
+}
+
+void test_usbd_stats_xfer(void)
+{
+  uint8_t buf[512];
+  tud_stats_t stats;
+
+  set_configuration_app();
+  tud_stats_clear();
+
+  // full transfer
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, buf, 64, true);
+  TEST_ASSERT_TRUE(usbd_edpt_xfer(rhport, EDPT_MSC_IN, buf, 64));
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 64, XFER_RESULT_SUCCESS, true);
+  mscd_xfer_cb_ExpectAndReturn(rhport, EDPT_MSC_IN, XFER_RESULT_SUCCESS, 64, true);
+  tud_task();
+
+  // short transfer
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_OUT, buf, 512, true);
+  TEST_ASSERT_TRUE(usbd_edpt_xfer(rhport, EDPT_MSC_OUT, buf, 512));
+  dcd_event_xfer_complete(rhport, EDPT_MSC_OUT, 31, XFER_RESULT_SUCCESS, true);
+  mscd_xfer_cb_ExpectAndReturn(rhport, EDPT_MSC_OUT, XFER_RESULT_SUCCESS, 31, true);
+  tud_task();
+
+  // application driver endpoint
+  dcd_event_xfer_complete(rhport, EDPT_APP_IN, 13, XFER_RESULT_SUCCESS, true);
+  tud_task();
+
+  tud_stats_get(&stats);
+
+  TEST_ASSERT_EQUAL(64, stats.edpt[1][TUSB_DIR_IN].bytes);
+  TEST_ASSERT_EQUAL(1, stats.edpt[1][TUSB_DIR_IN].xfers);
+  TEST_ASSERT_EQUAL(0, stats.edpt[1][TUSB_DIR_IN].short_xfers);
+
+  TEST_ASSERT_EQUAL(31, stats.edpt[1][TUSB_DIR_OUT].bytes);
+  TEST_ASSERT_EQUAL(1, stats.edpt[1][TUSB_DIR_OUT].xfers);
+  TEST_ASSERT_EQUAL(1, stats.edpt[1][TUSB_DIR_OUT].short_xfers);
+
+  TEST_ASSERT_EQUAL(64+31, stats.driver[DRVID_MSC].bytes);
+  TEST_ASSERT_EQUAL(2, stats.driver[DRVID_MSC].xfers);
+  TEST_ASSERT_EQUAL(1, stats.driver[DRVID_MSC].short_xfers);
+
+  TEST_ASSERT_EQUAL(13, stats.edpt[2][TUSB_DIR_IN].bytes);
+  TEST_ASSERT_EQUAL(13, stats.driver[DRVID_APP].bytes);
+  TEST_ASSERT_EQUAL(0, stats.driver[DRVID_APP].errors);
+
+  // cleared on request only, not by bus reset
+  mscd_reset_Expect(rhport);
+  dcd_event_bus_signal(rhport, DCD_EVENT_BUS_RESET, false);
+  tud_task();
+
+  tud_stats_get(&stats);
+  TEST_ASSERT_EQUAL(2, stats.driver[DRVID_MSC].xfers);
+
+  tud_stats_clear();
+  tud_stats_get(&stats);
+  TEST_ASSERT_EQUAL(0, stats.driver[DRVID_MSC].xfers);
+  TEST_ASSERT_EQUAL(0, stats.edpt[1][TUSB_DIR_IN].bytes);
+}
+
+void test_usbd_stats_error_stall(void)
+{
+  uint8_t buf[64];
+  tud_stats_t stats;
+
+  set_configuration_msc();
+  tud_stats_clear();
+
+  // rejected by DCD
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, buf, 64, false);
+  TEST_ASSERT_FALSE(usbd_edpt_xfer(rhport, EDPT_MSC_IN, buf, 64));
+
+  // completed with error
+  dcd_event_xfer_complete(rhport, EDPT_MSC_OUT, 0, XFER_RESULT_FAILED, true);
+  mscd_xfer_cb_ExpectAndReturn(rhport, EDPT_MSC_OUT, XFER_RESULT_FAILED, 0, true);
+  tud_task();
+
+  dcd_edpt_stall_Expect(rhport, EDPT_MSC_IN);
+  usbd_edpt_stall(rhport, EDPT_MSC_IN);
+
+  // unsupported request stalls control endpoint
+  tusb_control_request_t const req_unsupported =
+  {
+    .bmRequestType = 0x00,
+    .bRequest = TUSB_REQ_SYNCH_FRAME,
+    .wValue = 0,
+    .wIndex = 0,
+    .wLength = 0
+  };
+
+  dcd_event_setup_received(rhport, (uint8_t*) &req_unsupported, false);
+  dcd_edpt_stall_Expect(rhport, EDPT_CTRL_OUT);
+  dcd_edpt_stall_Expect(rhport, EDPT_CTRL_IN);
+  tud_task();
+
+  tud_stats_get(&stats);
+
+  TEST_ASSERT_EQUAL(1, stats.edpt[1][TUSB_DIR_IN].errors);
+  TEST_ASSERT_EQUAL(1, stats.edpt[1][TUSB_DIR_IN].stalls);
+  TEST_ASSERT_EQUAL(1, stats.edpt[1][TUSB_DIR_OUT].errors);
+  TEST_ASSERT_EQUAL(1, stats.edpt[1][TUSB_DIR_OUT].xfers);
+  TEST_ASSERT_EQUAL(2, stats.driver[DRVID_MSC].errors);
+  TEST_ASSERT_EQUAL(1, stats.driver[DRVID_MSC].stalls);
+
+  // control endpoint belongs to no driver
+  TEST_ASSERT_EQUAL(1, stats.edpt[0][TUSB_DIR_OUT].stalls);
+  TEST_ASSERT_EQUAL(1, stats.edpt[0][TUSB_DIR_IN].stalls);
+}
+
+void test_usbd_stats_latency(void)
+{
+  tud_stats_t stats;
+
+  set_configuration_msc();
+  tud_stats_clear();
+
+  // completion waits 30 then 10 ticks in queue
+  stats_now = 100;
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 64, XFER_RESULT_SUCCESS, true);
+  stats_now = 130;
+  mscd_xfer_cb_ExpectAndReturn(rhport, EDPT_MSC_IN, XFER_RESULT_SUCCESS, 64, true);
+  tud_task();
+
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 64, XFER_RESULT_SUCCESS, true);
+  stats_now = 140;
+  mscd_xfer_cb_ExpectAndReturn(rhport, EDPT_MSC_IN, XFER_RESULT_SUCCESS, 64, true);
+  tud_task();
+
+  stats_now = 0;
+
+  tud_stats_get(&stats);
+  TEST_ASSERT_EQUAL(40, stats.edpt[1][TUSB_DIR_IN].latency_sum);
+  TEST_ASSERT_EQUAL(30, stats.edpt[1][TUSB_DIR_IN].latency_max);
+  TEST_ASSERT_EQUAL(40, stats.driver[DRVID_MSC].latency_sum);
+}
+
+void test_usbd_stats_queue(void)
+{
+  tud_stats_t stats;
+
+  tud_stats_clear();
+
+  for(uint32_t i=0; i<5; i++) usbd_defer_func(count_func_call, NULL, false);
+  TEST_ASSERT_EQUAL(5, tud_task_ext(0, 0));
+
+  for(uint32_t i=0; i<2; i++) usbd_defer_func(count_func_call, NULL, false);
+  TEST_ASSERT_EQUAL(2, tud_task_ext(0, 0));
+
+  tud_stats_get(&stats);
+  TEST_ASSERT_EQUAL(5, stats.queue_max);
+  TEST_ASSERT_EQUAL(0, stats.queue_full);
+
+  // one more than queue can hold
+  for(uint32_t i=0; i<CFG_TUD_TASK_QUEUE_SZ+1; i++) usbd_defer_func(count_func_call, NULL, false);
+  TEST_ASSERT_EQUAL(CFG_TUD_TASK_QUEUE_SZ, tud_task_ext(0, 0));
+
+  tud_stats_get(&stats);
+  TEST_ASSERT_EQUAL(CFG_TUD_TASK_QUEUE_SZ, stats.queue_max);
+  TEST_ASSERT_EQUAL(1, stats.queue_full);
+}
@@ -69,6 +69,27 @@
 #define CFG_TUSB_MEM_ALIGN       __attribute__ ((aligned(4)))
 #endif
 
+//--------------------------------------------------------------------
+// HOST CONFIGURATION
+// Host stack is enabled by defining CFG_TUSB_RHPORT1_MODE as OPT_MODE_HOST
+//--------------------------------------------------------------------
+
+#define CFG_TUSB_HOST_DEVICE_MAX  1
+
+#ifndef CFG_TUH_MSC
+#define CFG_TUH_MSC               0
+#endif
+
+#ifndef CFG_TUH_CDC
+#define CFG_TUH_CDC               0
+#endif
+
+#define CFG_TUH_HUB               0
+#define CFG_TUH_HID_KEYBOARD      0
+#define CFG_TUH_HID_MOUSE         0
+#define CFG_TUSB_HOST_HID_GENERIC 0
+#define CFG_TUH_VENDOR            0
+
 //--------------------------------------------------------------------
 // DEVICE CONFIGURATION
 //--------------------------------------------------------------------
@@ -86,8 +107,8 @@
 //------------- CDC -------------//
 
 // FIFO size of CDC TX and RX
-#define CFG_TUD_CDC_RX_BUFSIZE   64
-#define CFG_TUD_CDC_TX_BUFSIZE   64
+#define CFG_TUD_CDC_RX_BUFSIZE   256
+#define CFG_TUD_CDC_TX_BUFSIZE   256
 
 //------------- MSC -------------//
 
@@ -24,6 +24,8 @@
  * This file is part of the TinyUSB stack.
  */
 
+#include <string.h>
+
 #include "unity.h"
 #include "tusb_fifo.h"
 
@@ -87,3 +89,97 @@ void test_full(void)
 
   TEST_ASSERT_TRUE(tu_fifo_full(&ff));
 }
+
+void test_read_write_n_wrap(void)
+{
+  uint8_t data[FIFO_SIZE];
+  uint8_t rd[FIFO_SIZE];
+
+  for(uint8_t i=0; i < FIFO_SIZE; i++) data[i] = i;
+
+  // move read/write index near the end
+  TEST_ASSERT_EQUAL(7, tu_fifo_write_n(&ff, data, 7));
+  TEST_ASSERT_EQUAL(7, tu_fifo_read_n(&ff, rd, 7));
+
+  // write across the wrap point, limited up to full
+  TEST_ASSERT_EQUAL(FIFO_SIZE, tu_fifo_write_n(&ff, data, FIFO_SIZE+5));
+  TEST_ASSERT_TRUE(tu_fifo_full(&ff));
+
+  memset(rd, 0, sizeof(rd));
+  TEST_ASSERT_EQUAL(FIFO_SIZE, tu_fifo_read_n(&ff, rd, FIFO_SIZE+5));
+  TEST_ASSERT_EQUAL_MEMORY(data, rd, FIFO_SIZE);
+  TEST_ASSERT_TRUE(tu_fifo_empty(&ff));
+}
+
+void test_write_n_overwritable(void)
+{
+  TU_FIFO_DEF(ff_ow, FIFO_SIZE, uint8_t, true);
+
+  uint8_t data[FIFO_SIZE+4];
+  uint8_t rd[FIFO_SIZE];
+
+  for(uint8_t i=0; i < sizeof(data); i++) data[i] = i;
+
+  // older items are overwritten, the latest FIFO_SIZE items are kept
+  TEST_ASSERT_EQUAL(3, tu_fifo_write_n(&ff_ow, data, 3));
+  TEST_ASSERT_EQUAL(sizeof(data), tu_fifo_write_n(&ff_ow, data, sizeof(data)));
+  TEST_ASSERT_TRUE(tu_fifo_full(&ff_ow));
+
+  TEST_ASSERT_EQUAL(FIFO_SIZE, tu_fifo_read_n(&ff_ow, rd, FIFO_SIZE));
+  TEST_ASSERT_EQUAL_MEMORY(data+4, rd, FIFO_SIZE);
+}
+
+void test_get_read_write_info_wrap(void)
+{
+  tu_fifo_buffer_info_t info;
+  uint8_t data[FIFO_SIZE];
+
+  for(uint8_t i=0; i < FIFO_SIZE; i++) data[i] = i;
+
+  // empty fifo: whole buffer is writable in one linear region
+  tu_fifo_get_write_info(&ff, &info);
+  TEST_ASSERT_EQUAL(FIFO_SIZE, info.len_lin);
+  TEST_ASSERT_EQUAL(0, info.len_wrap);
+  TEST_ASSERT_NULL(info.ptr_wrap);
+
+  tu_fifo_get_read_info(&ff, &info);
+  TEST_ASSERT_EQUAL(0, info.len_lin);
+  TEST_ASSERT_EQUAL(0, info.len_wrap);
+
+  // move index to 6, then 4 items are left linear before the wrap point
+  tu_fifo_write_n(&ff, data, 6);
+  tu_fifo_advance_read(&ff, 6);
+  TEST_ASSERT_TRUE(tu_fifo_empty(&ff));
+
+  // produce 7 items in place across the wrap point
+  tu_fifo_get_write_info(&ff, &info);
+  TEST_ASSERT_EQUAL(4, info.len_lin);
+  TEST_ASSERT_EQUAL(6, info.len_wrap);
+  TEST_ASSERT_EQUAL_PTR(ff_buf, info.ptr_wrap);
+
+  memcpy(info.ptr_lin, data, info.len_lin);
+  memcpy(info.ptr_wrap, data + info.len_lin, 7 - info.len_lin);
+  tu_fifo_advance_write(&ff, 7);
+  TEST_ASSERT_EQUAL(7, tu_fifo_count(&ff));
+
+  // consume them in place
+  tu_fifo_get_read_info(&ff, &info);
+  TEST_ASSERT_EQUAL(4, info.len_lin);
+  TEST_ASSERT_EQUAL(3, info.len_wrap);
+  TEST_ASSERT_EQUAL_MEMORY(data, info.ptr_lin, 4);
+  TEST_ASSERT_EQUAL_MEMORY(data+4, info.ptr_wrap, 3);
+
+  // partially consume, remaining data is now linear
+  tu_fifo_advance_read(&ff, 5);
+  tu_fifo_get_read_info(&ff, &info);
+  TEST_ASSERT_EQUAL(2, info.len_lin);
+  TEST_ASSERT_EQUAL(0, info.len_wrap);
+  TEST_ASSERT_EQUAL_MEMORY(data+5, info.ptr_lin, 2);
+
+  // advance is capped at available items
+  tu_fifo_advance_read(&ff, 100);
+  TEST_ASSERT_TRUE(tu_fifo_empty(&ff));
+
+  tu_fifo_advance_write(&ff, 100);
+  TEST_ASSERT_TRUE(tu_fifo_full(&ff));
+}
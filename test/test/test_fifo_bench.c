@@ -0,0 +1,116 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "unity.h"
+#include "tusb_fifo.h"
+
+// Micro-benchmark of fifo bulk copy against item-by-item access. Timings are only reported,
+// wall clock on a loaded machine is no pass/fail criterion; data integrity of both paths is checked.
+// Non power of 2 depth and odd transfer size so that most transfers wrap around.
+#define FIFO_SIZE   1000
+#define XFER_SIZE   509
+#define ITERATION   2000
+
+TU_FIFO_DEF(ff, FIFO_SIZE, uint8_t, false);
+
+static uint8_t _src[XFER_SIZE];
+static uint8_t _dst[XFER_SIZE];
+
+static inline uint64_t bench_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return (uint64_t) clock();
+#endif
+}
+
+static void report(char const* name, uint64_t cycles)
+{
+  uint64_t const bytes = 2ULL*XFER_SIZE*ITERATION; // both write and read
+  printf("%-10s: %llu bytes in %llu cycles, %.3f bytes/cycle\n", name,
+         (unsigned long long) bytes, (unsigned long long) cycles, ((double) bytes) / (cycles ? cycles : 1));
+}
+
+void setUp(void)
+{
+  tu_fifo_clear(&ff);
+  for(uint16_t i=0; i<XFER_SIZE; i++) _src[i] = (uint8_t) i;
+}
+
+void tearDown(void)
+{
+}
+
+static uint64_t bench_per_item(void)
+{
+  uint64_t start = bench_cycles();
+
+  for(uint32_t n=0; n<ITERATION; n++)
+  {
+    for(uint16_t i=0; i<XFER_SIZE; i++) tu_fifo_write(&ff, &_src[i]);
+    for(uint16_t i=0; i<XFER_SIZE; i++) tu_fifo_read(&ff, &_dst[i]);
+  }
+
+  return bench_cycles() - start;
+}
+
+static uint64_t bench_bulk(void)
+{
+  uint64_t start = bench_cycles();
+
+  for(uint32_t n=0; n<ITERATION; n++)
+  {
+    tu_fifo_write_n(&ff, _src, XFER_SIZE);
+    tu_fifo_read_n(&ff, _dst, XFER_SIZE);
+  }
+
+  return bench_cycles() - start;
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+void test_bench_bulk_vs_per_item(void)
+{
+  uint64_t const per_item = bench_per_item();
+  TEST_ASSERT_EQUAL_MEMORY(_src, _dst, XFER_SIZE);
+
+  memset(_dst, 0, sizeof(_dst));
+
+  uint64_t const bulk = bench_bulk();
+  TEST_ASSERT_EQUAL_MEMORY(_src, _dst, XFER_SIZE);
+
+  report("per item", per_item);
+  report("bulk"    , bulk);
+
+  // every byte written was read back
+  TEST_ASSERT_TRUE(tu_fifo_empty(&ff));
+}
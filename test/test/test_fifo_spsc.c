@@ -0,0 +1,144 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <pthread.h>
+
+#include "unity.h"
+#include "tusb_fifo.h"
+
+// Stress test for single producer single consumer access without any lock:
+// producer and consumer run on separate threads and only hand off via fifo indices.
+// Non power of 2 depth and multi-byte items to catch torn or reordered data.
+#define FIFO_SIZE   37
+#define ITEM_TOTAL  500000UL
+
+typedef struct
+{
+  uint32_t seq;
+  uint32_t inv;
+} item_t;
+
+TU_FIFO_DEF(ff, FIFO_SIZE, item_t, false);
+
+static volatile uint32_t _error_count;
+
+// Sleep briefly so that the other side can run, sched_yield() is not enough when test host has a single cpu
+static void let_other_run(void)
+{
+  struct timespec const ts = { .tv_sec = 0, .tv_nsec = 1000 };
+  nanosleep(&ts, NULL);
+}
+
+static void* producer_thread(void* arg)
+{
+  bool const bulk = (bool) (uintptr_t) arg;
+  item_t items[FIFO_SIZE];
+  uint32_t seq = 0;
+  uint32_t rnd = 1;
+
+  while ( seq < ITEM_TOTAL )
+  {
+    // random chunk size to exercise all wrap positions
+    rnd = rnd*1103515245 + 12345;
+    uint16_t n = bulk ? (uint16_t) (1 + ((rnd >> 16) % FIFO_SIZE)) : 1;
+    if ( n > ITEM_TOTAL - seq ) n = (uint16_t) (ITEM_TOTAL - seq);
+
+    for(uint16_t i=0; i<n; i++)
+    {
+      items[i].seq = seq + i;
+      items[i].inv = ~(seq + i);
+    }
+
+    uint16_t const written = bulk ? tu_fifo_write_n(&ff, items, n) : (tu_fifo_write(&ff, items) ? 1 : 0);
+
+    // fifo is full
+    if ( written == 0 ) let_other_run();
+
+    seq += written;
+  }
+
+  return NULL;
+}
+
+static void* consumer_thread(void* arg)
+{
+  bool const bulk = (bool) (uintptr_t) arg;
+  item_t items[FIFO_SIZE];
+  uint32_t seq = 0;
+
+  while ( seq < ITEM_TOTAL )
+  {
+    uint16_t const n = bulk ? tu_fifo_read_n(&ff, items, FIFO_SIZE) : (tu_fifo_read(&ff, items) ? 1 : 0);
+
+    // fifo is empty
+    if ( n == 0 ) let_other_run();
+
+    for(uint16_t i=0; i<n; i++)
+    {
+      if ( (items[i].seq != seq) || (items[i].inv != ~seq) ) _error_count++;
+      seq++;
+    }
+  }
+
+  return NULL;
+}
+
+static void run_spsc(bool bulk)
+{
+  pthread_t producer, consumer;
+
+  TEST_ASSERT_EQUAL(0, pthread_create(&consumer, NULL, consumer_thread, (void*) (uintptr_t) bulk));
+  TEST_ASSERT_EQUAL(0, pthread_create(&producer, NULL, producer_thread, (void*) (uintptr_t) bulk));
+
+  pthread_join(producer, NULL);
+  pthread_join(consumer, NULL);
+
+  TEST_ASSERT_EQUAL(0, _error_count);
+  TEST_ASSERT_TRUE(tu_fifo_empty(&ff));
+}
+
+void setUp(void)
+{
+  tu_fifo_clear(&ff);
+  _error_count = 0;
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+void test_spsc_single_item(void)
+{
+  run_spsc(false);
+}
+
+void test_spsc_bulk(void)
+{
+  run_spsc(true);
+}
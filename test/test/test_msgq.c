@@ -0,0 +1,191 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <string.h>
+
+#include "unity.h"
+#include "tusb_msgq.h"
+
+#define MSGQ_SIZE 32
+TU_MSGQ_DEF(mq, MSGQ_SIZE);
+
+void setUp(void)
+{
+  tu_msgq_clear(&mq);
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+void test_empty(void)
+{
+  uint8_t buf[8];
+  uint16_t len;
+
+  TEST_ASSERT_TRUE(tu_msgq_empty(&mq));
+  TEST_ASSERT_EQUAL(0, tu_msgq_count(&mq));
+  TEST_ASSERT_NULL(tu_msgq_peek(&mq, &len));
+  TEST_ASSERT_EQUAL(0, tu_msgq_read(&mq, buf, sizeof(buf)));
+}
+
+void test_boundary_kept(void)
+{
+  uint8_t const msg1[] = { 1 };
+  uint8_t const msg2[] = { 2, 3, 4, 5, 6 };
+  uint8_t const msg3[] = { 7, 8, 9 };
+  uint8_t buf[8];
+
+  TEST_ASSERT_TRUE(tu_msgq_write(&mq, msg1, sizeof(msg1)));
+  TEST_ASSERT_TRUE(tu_msgq_write(&mq, msg2, sizeof(msg2)));
+  TEST_ASSERT_TRUE(tu_msgq_write(&mq, msg3, sizeof(msg3)));
+  TEST_ASSERT_EQUAL(3, tu_msgq_count(&mq));
+
+  TEST_ASSERT_EQUAL(sizeof(msg1), tu_msgq_read(&mq, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_MEMORY(msg1, buf, sizeof(msg1));
+
+  TEST_ASSERT_EQUAL(sizeof(msg2), tu_msgq_read(&mq, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_MEMORY(msg2, buf, sizeof(msg2));
+
+  // excess of message larger than buffer is discarded
+  TEST_ASSERT_EQUAL(2, tu_msgq_read(&mq, buf, 2));
+  TEST_ASSERT_EQUAL_MEMORY(msg3, buf, 2);
+
+  TEST_ASSERT_TRUE(tu_msgq_empty(&mq));
+  TEST_ASSERT_EQUAL(0, tu_msgq_count(&mq));
+}
+
+void test_dense_packing(void)
+{
+  uint8_t const msg[8] = { 0 };
+  uint8_t n = 0;
+
+  // 8-byte reports take 10 bytes each, one byte is always kept free
+  while ( tu_msgq_write(&mq, msg, sizeof(msg)) ) n++;
+
+  TEST_ASSERT_EQUAL((MSGQ_SIZE-1) / TU_MSGQ_MSG_SIZE(sizeof(msg)), n);
+  TEST_ASSERT_EQUAL(n, tu_msgq_count(&mq));
+}
+
+void test_too_large(void)
+{
+  uint8_t msg[MSGQ_SIZE] = { 0 };
+
+  TEST_ASSERT_FALSE(tu_msgq_write(&mq, msg, 0));
+  TEST_ASSERT_FALSE(tu_msgq_write(&mq, msg, tu_msgq_max_len(&mq) + 1));
+  TEST_ASSERT_TRUE(tu_msgq_write(&mq, msg, tu_msgq_max_len(&mq)));
+  TEST_ASSERT_FALSE(tu_msgq_write(&mq, msg, 1));
+}
+
+void test_max_len_drained(void)
+{
+  uint8_t msg[MSGQ_SIZE] = { 0 };
+  uint8_t buf[MSGQ_SIZE];
+
+  // drained with both offsets in the middle of buffer
+  TEST_ASSERT_TRUE(tu_msgq_write(&mq, msg, MSGQ_SIZE/2 - TU_MSGQ_HDR_SIZE));
+  TEST_ASSERT_EQUAL(MSGQ_SIZE/2 - TU_MSGQ_HDR_SIZE, tu_msgq_read(&mq, buf, sizeof(buf)));
+  TEST_ASSERT_TRUE(tu_msgq_empty(&mq));
+
+  // room is what fits on either side of the offset, less than the upper bound
+  TEST_ASSERT_FALSE(tu_msgq_write(&mq, msg, MSGQ_SIZE/2 - TU_MSGQ_HDR_SIZE + 1));
+  TEST_ASSERT_TRUE(tu_msgq_write(&mq, msg, MSGQ_SIZE/2 - TU_MSGQ_HDR_SIZE));
+  TEST_ASSERT_TRUE(MSGQ_SIZE/2 < tu_msgq_max_len(&mq));
+}
+
+void test_zero_copy_wrap(void)
+{
+  uint8_t msg[20];
+  uint16_t len;
+
+  for(uint8_t i=0; i < sizeof(msg); i++) msg[i] = i;
+
+  // fill up to offset 24, then free it: 8 bytes left before the end
+  TEST_ASSERT_TRUE(tu_msgq_write(&mq, msg, 10));
+  TEST_ASSERT_TRUE(tu_msgq_write(&mq, msg, 10));
+  tu_msgq_read_commit(&mq);
+
+  // does not fit in the tail: placed at start of buffer, contiguous
+  uint8_t* ptr = (uint8_t*) tu_msgq_write_reserve(&mq, 9);
+  TEST_ASSERT_NOT_NULL(ptr);
+  TEST_ASSERT_EQUAL_PTR(mq_buf + TU_MSGQ_HDR_SIZE, ptr);
+  memcpy(ptr, msg + 1, 7);
+  tu_msgq_write_commit(&mq, 7);
+
+  // would overrun the message still in queue
+  TEST_ASSERT_NULL(tu_msgq_write_reserve(&mq, 4));
+
+  TEST_ASSERT_EQUAL_MEMORY(msg, tu_msgq_peek(&mq, &len), 10);
+  TEST_ASSERT_EQUAL(10, len);
+  tu_msgq_read_commit(&mq);
+
+  // skip marker at the tail is followed
+  uint8_t const* rd_ptr = (uint8_t const*) tu_msgq_peek(&mq, &len);
+  TEST_ASSERT_EQUAL(7, len);
+  TEST_ASSERT_EQUAL_PTR(mq_buf + TU_MSGQ_HDR_SIZE, rd_ptr);
+  TEST_ASSERT_EQUAL_MEMORY(msg + 1, rd_ptr, 7);
+  tu_msgq_read_commit(&mq);
+
+  TEST_ASSERT_TRUE(tu_msgq_empty(&mq));
+}
+
+void test_wrap_all_offsets(void)
+{
+  uint8_t msg[MSGQ_SIZE];
+  uint8_t buf[MSGQ_SIZE];
+  uint8_t wr_seq = 0;
+  uint8_t rd_seq = 0;
+
+  // lengths coprime with buffer size: hit every offset and tail size (incl. tail smaller than header)
+  for(uint16_t round = 0; round < 500; round++)
+  {
+    uint16_t const len = (uint16_t) (1 + (round*7) % 13);
+
+    for(uint16_t i=0; i < len; i++) msg[i] = wr_seq++;
+
+    if ( !tu_msgq_write(&mq, msg, len) )
+    {
+      // queue is full: drain and verify payload continuity
+      uint16_t n;
+      while ( (n = tu_msgq_read(&mq, buf, sizeof(buf))) > 0 )
+      {
+        for(uint16_t i=0; i < n; i++) TEST_ASSERT_EQUAL_HEX8(rd_seq++, buf[i]);
+      }
+
+      TEST_ASSERT_EQUAL(0, tu_msgq_count(&mq));
+      TEST_ASSERT_TRUE(tu_msgq_write(&mq, msg, len));
+    }
+
+    // payload is always contiguous
+    uint16_t peek_len;
+    uint8_t const* ptr = (uint8_t const*) tu_msgq_peek(&mq, &peek_len);
+    TEST_ASSERT_NOT_NULL(ptr);
+    TEST_ASSERT_TRUE(ptr + peek_len <= mq_buf + MSGQ_SIZE);
+  }
+}
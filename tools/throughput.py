@@ -0,0 +1,317 @@
+#!/usr/bin/env python3
+#
+# Host side of examples/device/throughput: measure bulk throughput, transfer latency and jitter.
+#
+#   python3 tools/throughput.py [--usbip HOST:PORT] [--size 64,512,4096] [--count N] [--depth N] [source|sink|loopback|all]
+#
+# Device is reached either with libusb (pyusb module) by VID/PID, or with the built-in USB/IP client, e.g. against
+# the simulation port without root access:
+#
+#   SIM_USBIP_PORT=3240 examples/device/throughput/_build/build-sim/sim-firmware.elf &
+#   python3 tools/throughput.py --usbip 127.0.0.1:3240 all
+#
+# Latency of a transfer is the time from its submission to its completion, it includes queueing behind
+# other transfers when --depth is more than 1. Jitter is the standard deviation of latency.
+# Size is rounded up to whole packets where the device could not keep transfer boundaries: source reads,
+# and loopback with more than one transfer in flight.
+
+import argparse
+import socket
+import statistics
+import struct
+import sys
+import time
+
+VID = 0xCafe
+PID = 0x4010
+
+ITF_SOURCE   = 0
+ITF_SINK     = 1
+ITF_LOOPBACK = 2
+
+VENDOR_REQUEST_RESET = 1
+VENDOR_REQUEST_STATS = 2
+
+URB_ZERO_PACKET = 0x0040
+
+# counting pattern starting at offset
+def pattern(offset, length):
+    start = offset % 256
+    return (bytes(range(256)) * ((start + length) // 256 + 1))[start:start + length]
+
+
+#--------------------------------------------------------------------+
+# USB/IP client, several URBs may be in flight
+#--------------------------------------------------------------------+
+class UsbipDevice:
+    def __init__(self, address, busid='1-1'):
+        host, port = address.rsplit(':', 1)
+        self.sock = socket.create_connection((host, int(port)))
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.seqnum = 0
+        self.urbs = {}     # seqnum: direction in
+        self.done = {}     # seqnum: (status, data or length)
+
+        self.sock.sendall(struct.pack('>HHI', 0x0111, 0x8003, 0) + busid.encode().ljust(32, b'\0'))
+        _, code, status = struct.unpack('>HHI', self.recv(8))
+        if code != 0x0003 or status != 0:
+            raise IOError('usbip: cannot import %s' % busid)
+        self.recv(312)
+
+        # usbip host sets configuration as kernel would
+        self.control(0x00, 9, 1, 0, 0)
+
+    def recv(self, length):
+        data = bytearray()
+        while len(data) < length:
+            chunk = self.sock.recv(length - len(data))
+            if not chunk:
+                raise IOError('usbip: connection closed')
+            data += chunk
+        return bytes(data)
+
+    def submit(self, ep, data_or_len, zlp=False, setup=b'\0' * 8):
+        self.seqnum += 1
+        dir_in = isinstance(data_or_len, int)
+        length = data_or_len if dir_in else len(data_or_len)
+        flags = URB_ZERO_PACKET if zlp else 0
+
+        hdr = struct.pack('>IIIIIIiiii', 1, self.seqnum, 0x00010001, 1 if dir_in else 0, ep & 0x7f, flags, length, 0, 0, 0)
+        self.sock.sendall(hdr + setup + (b'' if dir_in else data_or_len))
+        self.urbs[self.seqnum] = dir_in
+        return self.seqnum
+
+    def wait(self, seqnum):
+        while seqnum not in self.done:
+            hdr = self.recv(48)
+            command, seq, _, _, _, status, actual = struct.unpack('>IIIIIii', hdr[:28])
+            if command != 3:
+                continue
+            dir_in = self.urbs.pop(seq)
+            self.done[seq] = (status, self.recv(actual) if dir_in else actual)
+
+        status, result = self.done.pop(seqnum)
+        if status != 0:
+            raise IOError('usbip: transfer failed with status %d' % status)
+        return result
+
+    def control(self, bmRequestType, bRequest, wValue, wIndex, data_or_len):
+        length = data_or_len if isinstance(data_or_len, int) else len(data_or_len)
+        setup = struct.pack('<BBHHH', bmRequestType, bRequest, wValue, wIndex, length)
+
+        if bmRequestType & 0x80:
+            return self.wait(self.submit(0x80, length, setup=setup))
+        return self.wait(self.submit(0x00, b'' if isinstance(data_or_len, int) else data_or_len, setup=setup))
+
+    def close(self):
+        self.sock.close()
+
+
+#--------------------------------------------------------------------+
+# libusb through pyusb, one transfer at a time
+#--------------------------------------------------------------------+
+class LibusbDevice:
+    def __init__(self, timeout_ms=5000):
+        import usb.core
+        self.dev = usb.core.find(idVendor=VID, idProduct=PID)
+        if self.dev is None:
+            raise IOError('device %04x:%04x not found' % (VID, PID))
+        self.dev.set_configuration()
+        self.timeout = timeout_ms
+        self.pending = {}
+        self.seqnum = 0
+
+    def submit(self, ep, data_or_len, zlp=False):
+        self.seqnum += 1
+        self.pending[self.seqnum] = (ep, data_or_len, zlp)
+        return self.seqnum
+
+    def wait(self, seqnum):
+        ep, data_or_len, zlp = self.pending.pop(seqnum)
+        if ep & 0x80:
+            return bytes(self.dev.read(ep, data_or_len, self.timeout))
+
+        count = self.dev.write(ep, data_or_len, self.timeout)
+        if zlp:
+            self.dev.write(ep, b'', self.timeout)
+        return count
+
+    def control(self, bmRequestType, bRequest, wValue, wIndex, data_or_len):
+        ret = self.dev.ctrl_transfer(bmRequestType, bRequest, wValue, wIndex, data_or_len, self.timeout)
+        return bytes(ret) if bmRequestType & 0x80 else ret
+
+    def close(self):
+        import usb.util
+        usb.util.dispose_resources(self.dev)
+
+
+#--------------------------------------------------------------------+
+# Tests
+#--------------------------------------------------------------------+
+
+# Endpoint addresses and size (out, in, size) of each interface from configuration descriptor
+def find_endpoints(dev):
+    config = dev.control(0x80, 6, 0x0200, 0, 9)
+    config = dev.control(0x80, 6, 0x0200, 0, struct.unpack('<H', config[2:4])[0])
+
+    endpoints = {}
+    itf = None
+    pos = 0
+    while pos < len(config):
+        length, desc_type = config[pos], config[pos + 1]
+        if desc_type == 4:
+            itf = config[pos + 2]
+        elif desc_type == 5:
+            ep = config[pos + 2]
+            size = struct.unpack('<H', config[pos + 4:pos + 6])[0] & 0x7ff
+            out_ep, in_ep, _ = endpoints.get(itf, (None, None, 0))
+            endpoints[itf] = (out_ep, ep, size) if ep & 0x80 else (ep, in_ep, size)
+        pos += length
+
+    return endpoints
+
+
+def get_stats(dev):
+    data = dev.control(0xC0, VENDOR_REQUEST_STATS, 0, 0, 16)
+    return dict(zip(('source_bytes', 'sink_bytes', 'sink_errors', 'loopback_bytes'), struct.unpack('<IIII', data)))
+
+
+# Round up to whole packets
+def packets(size, ep):
+    return (size + ep[2] - 1) // ep[2] * ep[2]
+
+
+# Keep depth transfers in flight, make_xfer(i) submits transfer i and returns (handle, check), check(result)
+# returns number of bytes moved and errors found. Tests return the size actually used with run() results.
+def run(dev, count, depth, make_xfer):
+    latency = []
+    errors = 0
+    total = 0
+    inflight = []
+
+    start = time.perf_counter()
+    for i in range(count + depth):
+        if i >= depth:
+            handle, check, submitted = inflight.pop(0)
+            result = [dev.wait(h) for h in handle]
+            latency.append(time.perf_counter() - submitted)
+            moved, errs = check(result)
+            total += moved
+            errors += errs
+        if i < count:
+            submitted = time.perf_counter()
+            handle, check = make_xfer(i)
+            inflight.append((handle, check, submitted))
+    elapsed = time.perf_counter() - start
+
+    return total, elapsed, latency, errors
+
+
+def test_source(dev, ep, size, count, depth):
+    state = {'next': None}
+
+    # device always sends full packets, a shorter read would overflow
+    size = packets(size, ep)
+
+    def make_xfer(i):
+        def check(result):
+            data = result[0]
+            if not data:
+                return 0, 0
+            expected = pattern(data[0] if state['next'] is None else state['next'], len(data))
+            state['next'] = (data[-1] + 1) % 256
+            return len(data), sum(a != b for a, b in zip(data, expected)) if data != expected else 0
+        return [dev.submit(ep[1], size)], check
+
+    return (size,) + run(dev, count, depth, make_xfer)
+
+
+def test_sink(dev, ep, size, count, depth):
+    dev.control(0x40, VENDOR_REQUEST_RESET, 0, 0, 0)
+
+    def make_xfer(i):
+        return [dev.submit(ep[0], pattern(i * size, size))], lambda result: (result[0], 0)
+
+    total, elapsed, latency, _ = run(dev, count, depth, make_xfer)
+
+    # device may still be draining its fifo
+    for _ in range(100):
+        stats = get_stats(dev)
+        if stats['sink_bytes'] >= total:
+            break
+        time.sleep(0.01)
+
+    return size, total, elapsed, latency, stats['sink_errors']
+
+
+def test_loopback(dev, ep, size, count, depth):
+    usbip = isinstance(dev, UsbipDevice)
+
+    # device echoes a byte stream, with several transfers in flight their echoes may be merged and
+    # only whole packets keep each one in its own IN transfer
+    if depth > 1:
+        size = packets(size, ep)
+
+    # device transfer may be longer, zero length packet ends the one ending with full packet
+    zlp = (size % ep[2] == 0)
+
+    def make_xfer(i):
+        data = pattern(i, size)
+        # IN is queued first so that any size goes through, synchronous libusb needs size within device fifo
+        handle = [dev.submit(ep[1], size), dev.submit(ep[0], data, zlp)] if usbip else \
+                 [dev.submit(ep[0], data, zlp), dev.submit(ep[1], size)]
+
+        def check(result):
+            echo = result[0] if usbip else result[1]
+            return len(echo), 0 if echo == data else 1
+        return handle, check
+
+    return (size,) + run(dev, count, depth, make_xfer)
+
+
+TESTS = {
+    'source':   (ITF_SOURCE, test_source),
+    'sink':     (ITF_SINK, test_sink),
+    'loopback': (ITF_LOOPBACK, test_loopback),
+}
+
+
+def percentile(sorted_values, p):
+    return sorted_values[min(len(sorted_values) - 1, int(len(sorted_values) * p / 100))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description='TinyUSB bulk throughput benchmark, see examples/device/throughput')
+    parser.add_argument('test', nargs='?', default='all', choices=['all'] + list(TESTS))
+    parser.add_argument('--usbip', metavar='HOST:PORT', help='attach over USB/IP instead of libusb')
+    parser.add_argument('--size', default='512', help='bytes per transfer, comma separated list to sweep')
+    parser.add_argument('--count', type=int, default=1000, help='transfers per test')
+    parser.add_argument('--depth', type=int, default=1, help='transfers in flight, USB/IP only')
+    args = parser.parse_args()
+
+    dev = UsbipDevice(args.usbip) if args.usbip else LibusbDevice()
+    depth = args.depth if args.usbip else 1
+    endpoints = find_endpoints(dev)
+
+    print('%-9s %7s %6s %9s %8s %8s %8s %8s %9s %6s' %
+          ('test', 'size', 'depth', 'MB/s', 'p50 us', 'p90 us', 'p99 us', 'max us', 'jitter us', 'errors'))
+
+    failed = False
+    for name in (TESTS if args.test == 'all' else [args.test]):
+        itf, fn = TESTS[name]
+        for size in [int(s, 0) for s in args.size.split(',')]:
+            size, total, elapsed, latency, errors = fn(dev, endpoints[itf], size, args.count, depth)
+
+            us = sorted(t * 1e6 for t in latency)
+            jitter = statistics.pstdev(us) if len(us) > 1 else 0
+            print('%-9s %7d %6d %9.3f %8.0f %8.0f %8.0f %8.0f %9.1f %6d' %
+                  (name, size, depth, total / elapsed / 1e6, percentile(us, 50), percentile(us, 90),
+                   percentile(us, 99), us[-1], jitter, errors))
+            failed = failed or errors != 0
+
+    dev.close()
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())